@@ -0,0 +1,1435 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "bufHashTbl.h"
+#include "bufPoolSet.h"
+#include "buffer.h"
+#include "crc32c.h"
+#include "file.h"
+#include "file_iterator.h"
+#include "filescan.h"
+#include "file_io.h"
+#include "file_map.h"
+#include "io_engine.h"
+#include "exceptions/end_of_file_exception.h"
+#include "exceptions/file_not_found_exception.h"
+#include "exceptions/hash_not_found_exception.h"
+
+using namespace badgerdb;
+
+namespace {
+
+/**
+ * Name of the file a case works on; removed, like the one below, before and
+ * after each case
+ */
+const std::string benchFileName = "relA.bench";
+
+/**
+ * Name of a second file, for cases that need two
+ */
+const std::string benchDataFileName = "relA.bench.data";
+
+/**
+ * Factor the work of every case is multiplied by, from the command line
+ */
+int scale = 1;
+
+typedef std::chrono::steady_clock Clock;
+
+double secondsSince(const Clock::time_point start)
+{
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+/**
+ * Prints one measurement of a case.
+ */
+void report(const std::string& what, const double value, const char* unit)
+{
+  std::cout << "  " << std::left << std::setw(44) << what << std::right
+            << std::setw(14) << std::fixed << std::setprecision(1) << value
+            << " " << unit << "\n";
+}
+
+void removeBenchFile()
+{
+  const std::string names[] = {benchFileName, benchDataFileName};
+  for (std::size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++)
+  {
+    try
+    {
+      File::remove(names[i]);
+    }
+    catch (const FileNotFoundException&)
+    {
+    }
+  }
+}
+
+/**
+ * Adds 'count' pages holding one small record each to a file.
+ */
+void createPages(PageFile& file, const PageId count)
+{
+  for (PageId i = 0; i < count; i++)
+  {
+    PageId pageNo;
+    Page page = file.allocatePage(pageNo);
+    page.insertRecord("bench");
+    file.writePage(pageNo, page);
+  }
+}
+
+/**
+ * Counts data TLB misses of the calling thread with perf_event_open, when the
+ * kernel lets us; otherwise every count is reported as unavailable.
+ */
+class TlbMissCounter
+{
+ public:
+  TlbMissCounter()
+  {
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.config = PERF_COUNT_HW_CACHE_DTLB |
+                  (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                  (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    fd = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+  }
+
+  ~TlbMissCounter()
+  {
+    if (fd >= 0)
+      close(fd);
+  }
+
+  bool available() const
+  {
+    return fd >= 0;
+  }
+
+  void start()
+  {
+    if (fd < 0)
+      return;
+    ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+    ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+  }
+
+  std::uint64_t stop()
+  {
+    std::uint64_t count = 0;
+    if (fd < 0)
+      return 0;
+    ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+    if (read(fd, &count, sizeof(count)) != sizeof(count))
+      return 0;
+    return count;
+  }
+
+ private:
+  int fd;
+};
+
+/**
+ * The page table BufMgr used before BufHashTbl: an array of chains with one
+ * heap allocated bucket per entry, kept as the baseline of the page table
+ * case.  The hash is computed unsigned, where the original could go negative.
+ */
+class ChainedHashTbl
+{
+ public:
+  explicit ChainedHashTbl(const int htSize)
+    : HTSIZE(htSize), ht(htSize, static_cast<Bucket*>(NULL))
+  {
+  }
+
+  ~ChainedHashTbl()
+  {
+    for (int i = 0; i < HTSIZE; i++)
+      while (ht[i])
+      {
+        Bucket* next = ht[i]->next;
+        delete ht[i];
+        ht[i] = next;
+      }
+  }
+
+  void insert(const File* file, const PageId pageNo, const FrameId frameNo)
+  {
+    Bucket* bucket = new Bucket;
+    bucket->file = file;
+    bucket->pageNo = pageNo;
+    bucket->frameNo = frameNo;
+    bucket->next = ht[hash(file, pageNo)];
+    ht[hash(file, pageNo)] = bucket;
+  }
+
+  bool tryLookup(const File* file, const PageId pageNo, FrameId& frameNo) const
+  {
+    for (Bucket* bucket = ht[hash(file, pageNo)]; bucket; bucket = bucket->next)
+      if (bucket->file == file && bucket->pageNo == pageNo)
+      {
+        frameNo = bucket->frameNo;
+        return true;
+      }
+    return false;
+  }
+
+  void remove(const File* file, const PageId pageNo)
+  {
+    for (Bucket** link = &ht[hash(file, pageNo)]; *link; link = &(*link)->next)
+      if ((*link)->file == file && (*link)->pageNo == pageNo)
+      {
+        Bucket* bucket = *link;
+        *link = bucket->next;
+        delete bucket;
+        return;
+      }
+  }
+
+ private:
+  struct Bucket
+  {
+    const File* file;
+    PageId pageNo;
+    FrameId frameNo;
+    Bucket* next;
+  };
+
+  int hash(const File* file, const PageId pageNo) const
+  {
+    return ((std::uint32_t)(long)file + pageNo) % HTSIZE;
+  }
+
+  int HTSIZE;
+  std::vector<Bucket*> ht;
+};
+
+// -----------------------------------------------------------------------------
+// Cases
+// -----------------------------------------------------------------------------
+
+/**
+ * A page table entry of the page table case
+ */
+struct PageKey
+{
+  const File* file;
+  PageId pageNo;
+};
+
+/**
+ * Runs the page table case on one kind of table, sized by 'slots' for the
+ * entries in 'keys', and reports under 'how'.  Hits look the pages up in the
+ * order of 'hits'; misses ask for the same pages of a third file.
+ */
+template <class Table>
+void hashTableRun(const std::string& how, const std::vector<PageKey>& keys,
+                  const std::vector<PageKey>& hits, const File* absent,
+                  const PageId repeats, const int slots)
+{
+  const PageId n = keys.size();
+  double insertSeconds = 0, hitSeconds = 0, missSeconds = 0, removeSeconds = 0;
+  std::uint64_t found = 0;
+  FrameId frameNo = 0;
+  for (PageId r = 0; r < repeats; r++)
+  {
+    Table table(slots);
+    Clock::time_point start = Clock::now();
+    for (PageId i = 0; i < n; i++)
+      table.insert(keys[i].file, keys[i].pageNo, i);
+    insertSeconds += secondsSince(start);
+
+    start = Clock::now();
+    for (PageId i = 0; i < n; i++)
+      found += table.tryLookup(hits[i].file, hits[i].pageNo, frameNo);
+    hitSeconds += secondsSince(start);
+
+    start = Clock::now();
+    for (PageId i = 0; i < n; i++)
+      found += table.tryLookup(absent, keys[i].pageNo, frameNo);
+    missSeconds += secondsSince(start);
+
+    start = Clock::now();
+    for (PageId i = 0; i < n; i++)
+      table.remove(keys[i].file, keys[i].pageNo);
+    removeSeconds += secondsSince(start);
+  }
+  const double ops = static_cast<double>(n) * repeats;
+  report(how + "insert", ops / insertSeconds / 1e6, "M ops/s");
+  report(how + "lookup, hit", ops / hitSeconds / 1e6, "M ops/s");
+  report(how + "lookup, miss", ops / missSeconds / 1e6, "M ops/s");
+  report(how + "remove", ops / removeSeconds / 1e6, "M ops/s");
+  if (found != ops)
+    std::cerr << "hashtable: " << found << " of " << ops << " pages found\n";
+}
+
+/**
+ * Page table: inserts, hits, misses and removals on tables of 100, 10k and 1M
+ * entries, the pages of two files, in random order.  Measured for BufHashTbl
+ * with four slots per entry, as BufMgr sizes its shards, and for the chained
+ * table it replaced, sized as BufMgr sized it.  Smaller tables repeat the work
+ * so that every size does as many operations.
+ */
+void hashTableBench()
+{
+  const PageId sizes[] = {100, 10000, 1000000};
+  const PageId opsPerSize = 1000000 * scale;
+  PageFile files[] = {PageFile::create(benchFileName), PageFile::create(benchDataFileName)};
+  const File* absent = &files[0] + 2;  // never dereferenced
+  for (std::size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+  {
+    const PageId n = sizes[s];
+    const PageId repeats = std::max<PageId>(1, opsPerSize / n);
+    const std::string how = std::to_string(n) + " entries, ";
+    std::vector<PageKey> keys(n);
+    for (PageId i = 0; i < n; i++)
+    {
+      keys[i].file = &files[i % 2];
+      keys[i].pageNo = i / 2 + 1;
+    }
+    std::mt19937 rng(1);
+    std::shuffle(keys.begin(), keys.end(), rng);
+    std::vector<PageKey> hits(keys);
+    std::shuffle(hits.begin(), hits.end(), rng);
+
+    hashTableRun<BufHashTbl>(how + "open: ", keys, hits, absent, repeats, 4 * n);
+    hashTableRun<ChainedHashTbl>(how + "chained: ", keys, hits, absent, repeats, (int)(n * 1.2) + 1);
+  }
+}
+
+/**
+ * Misses: reads cycling through a file four times the size of the pool, so
+ * that every read evicts a page and reads another from the file.  Measured
+ * as readPage() runs now, and with each miss first reported by a thrown
+ * HashNotFoundException, as the page table lookup did before tryLookup().
+ */
+void missBench()
+{
+  const PageId numPages = 1024;
+  const int reads = 100000 * scale;
+  PageFile file = PageFile::create(benchFileName);
+  createPages(file, numPages);
+
+  for (int thrown = 1; thrown >= 0; thrown--)
+  {
+    const std::string how = thrown ? "thrown miss: " : "tryLookup: ";
+    BufMgr pool(numPages / 4);
+    BufHashTbl empty(2);
+    Page* page;
+    FrameId frameNo;
+    Clock::time_point start = Clock::now();
+    for (int i = 0; i < reads; i++)
+    {
+      const PageId pageNo = 1 + i % numPages;
+      if (thrown)
+      {
+        try
+        {
+          empty.lookup(&file, pageNo, frameNo);
+        }
+        catch (const HashNotFoundException&)
+        {
+        }
+      }
+      pool.readPage(&file, pageNo, page);
+      pool.unPinPage(&file, pageNo, false);
+    }
+    report(how + "readPage + unPinPage, miss", reads / secondsSince(start) / 1e3, "K ops/s");
+    report(how + "hit ratio", 100.0 * pool.getBufStats().hits.load() / reads, "%");
+  }
+}
+
+/**
+ * Trace of a skewed workload broken up by scans: four reads in five go to a
+ * hot eighth of the file, the rest to any page, and every 5000 reads a scan of
+ * 500 pages passes through.
+ */
+std::vector<PageId> skewedTrace(const PageId numPages, const int reads)
+{
+  std::vector<PageId> trace;
+  std::mt19937 rng(4);
+  PageId scanPageNo = 1;
+  for (int i = 0; i < reads; i++)
+  {
+    if (i % 5000 < 500)
+      trace.push_back(1 + scanPageNo++ % numPages);
+    else if (rng() % 5 != 0)
+      trace.push_back(1 + rng() % (numPages / 8));
+    else
+      trace.push_back(1 + rng() % numPages);
+  }
+  return trace;
+}
+
+/**
+ * Trace shaped like the B+tree tests: each probe reads the root, one of 16
+ * inner nodes and a leaf, and one probe in ten goes on into a range scan of
+ * 20 leaves.
+ */
+std::vector<PageId> indexTrace(const PageId numPages, const int reads)
+{
+  const PageId innerPages = 16;
+  const PageId firstLeaf = 2 + innerPages;
+  const PageId numLeaves = numPages - firstLeaf + 1;
+  std::vector<PageId> trace;
+  std::mt19937 rng(4);
+  while (trace.size() < static_cast<std::size_t>(reads))
+  {
+    const PageId leaf = rng() % numLeaves;
+    trace.push_back(1);
+    trace.push_back(2 + leaf * innerPages / numLeaves);
+    const PageId scanLength = rng() % 10 == 0 ? 20 : 1;
+    for (PageId k = 0; k < scanLength && leaf + k < numLeaves; k++)
+      trace.push_back(firstLeaf + leaf + k);
+  }
+  trace.resize(reads);
+  return trace;
+}
+
+/**
+ * Replacement policies: hit ratio of each on traces of page reads, replayed
+ * through a pool of a sixteenth of the file.
+ */
+void policyBench()
+{
+  const PageId numPages = 2048;
+  const int reads = 100000 * scale;
+  PageFile file = PageFile::create(benchFileName);
+  createPages(file, numPages);
+
+  const ReplacementPolicyType policies[] = {
+    CLOCK_REPLACEMENT, LRUK_REPLACEMENT, TWOQ_REPLACEMENT, ARC_REPLACEMENT
+  };
+  const char* traceNames[] = {"skewed", "index"};
+  const std::vector<PageId> traces[] = {skewedTrace(numPages, reads), indexTrace(numPages, reads)};
+  for (std::size_t t = 0; t < sizeof(traces) / sizeof(traces[0]); t++)
+  {
+    for (std::size_t p = 0; p < sizeof(policies) / sizeof(policies[0]); p++)
+    {
+      BufMgr pool(numPages / 16, policies[p]);
+      const std::string how = std::string(traceNames[t]) + ", " + pool.policyName() + ": ";
+      Page* page;
+      Clock::time_point start = Clock::now();
+      for (std::size_t i = 0; i < traces[t].size(); i++)
+      {
+        pool.readPage(&file, traces[t][i], page);
+        pool.unPinPage(&file, traces[t][i], false);
+      }
+      const double seconds = secondsSince(start);
+      report(how + "hit ratio", 100.0 * pool.getBufStats().hits.load() / reads, "%");
+      report(how + "readPage + unPinPage", reads / seconds / 1e3, "K ops/s");
+    }
+  }
+}
+
+/**
+ * Scan resistance: a hot set of half the pool is read between scans of eight
+ * times the pool, with the scans going through a BufferAccessStrategy ring or
+ * through the whole pool.
+ */
+void ringBench()
+{
+  const PageId poolSize = 256;
+  const PageId hotPages = poolSize / 2;
+  const PageId numPages = hotPages + 8 * poolSize;
+  const int rounds = 10 * scale;
+  PageFile file = PageFile::create(benchFileName);
+  createPages(file, numPages);
+
+  for (int useRing = 0; useRing < 2; useRing++)
+  {
+    BufMgr pool(poolSize);
+    BufferAccessStrategy ring;
+    std::uint64_t hotHits = 0;
+    double scanSeconds = 0;
+    Page* page;
+    for (int r = 0; r < rounds; r++)
+    {
+      pool.clearBufStats();
+      for (PageId pageNo = 1; pageNo <= hotPages; pageNo++)
+      {
+        pool.readPage(&file, pageNo, page);
+        pool.unPinPage(&file, pageNo, false);
+      }
+      hotHits += pool.getBufStats().hits.load();
+
+      Clock::time_point start = Clock::now();
+      for (PageId pageNo = hotPages + 1; pageNo <= numPages; pageNo++)
+      {
+        pool.readPage(&file, pageNo, page, useRing ? &ring : NULL);
+        pool.unPinPage(&file, pageNo, false);
+      }
+      scanSeconds += secondsSince(start);
+    }
+    const std::string how = useRing ? "with ring: " : "without ring: ";
+    // the first round only warms the pool
+    report(how + "hot set hit ratio",
+           100.0 * hotHits / (hotPages * (rounds - 1)), "%");
+    report(how + "scan", (numPages - hotPages) * rounds / scanSeconds / 1e3, "K pages/s");
+  }
+}
+
+/**
+ * Probe latency beside a scan: one thread probes random pages of a hot set of
+ * half the pool while another scans the rest of the file over and over, with
+ * no scan, with scans through the whole pool and with scans through a ring.
+ */
+void probeLatencyBench()
+{
+  const PageId poolSize = 256;
+  const PageId hotPages = poolSize / 2;
+  const PageId numPages = hotPages + 8 * poolSize;
+  const int probes = 20000 * scale;
+  PageFile file = PageFile::create(benchFileName);
+  createPages(file, numPages);
+
+  const char* scanNames[] = {"no scan", "scan without ring", "scan with ring"};
+  for (int scanKind = 0; scanKind < 3; scanKind++)
+  {
+    BufMgr pool(poolSize);
+    Page* page;
+    for (PageId pageNo = 1; pageNo <= hotPages; pageNo++)
+    {
+      pool.readPage(&file, pageNo, page);
+      pool.unPinPage(&file, pageNo, false);
+    }
+
+    std::atomic<bool> stop(false);
+    std::thread scanner;
+    if (scanKind != 0)
+    {
+      scanner = std::thread([&pool, &file, &stop, scanKind, hotPages, numPages]() {
+        BufferAccessStrategy ring;
+        Page* scanPage;
+        while (!stop.load())
+        {
+          for (PageId pageNo = hotPages + 1; pageNo <= numPages && !stop.load(); pageNo++)
+          {
+            pool.readPage(&file, pageNo, scanPage, scanKind == 2 ? &ring : NULL);
+            pool.unPinPage(&file, pageNo, false);
+          }
+        }
+      });
+    }
+
+    std::mt19937 rng(5);
+    std::vector<double> latencies(probes);
+    for (int i = 0; i < probes; i++)
+    {
+      const PageId pageNo = 1 + rng() % hotPages;
+      Clock::time_point start = Clock::now();
+      pool.readPage(&file, pageNo, page);
+      pool.unPinPage(&file, pageNo, false);
+      latencies[i] = secondsSince(start) * 1e6;
+    }
+    stop = true;
+    if (scanner.joinable())
+      scanner.join();
+
+    std::sort(latencies.begin(), latencies.end());
+    const std::string how = std::string(scanNames[scanKind]) + ": probe ";
+    report(how + "median", latencies[probes / 2], "us");
+    report(how + "99th percentile", latencies[probes * 99 / 100], "us");
+  }
+}
+
+/**
+ * Read-ahead: FileScan over a file twice the size of the pool, read with
+ * O_DIRECT so that every page comes from the device, at several prefetch
+ * distances.
+ */
+void prefetchBench()
+{
+  const PageId numPages = 4096;
+  const int rounds = 2 * scale;
+  File::setIoBackend(IO_DIRECT);
+  {
+    PageFile file = PageFile::create(benchFileName);
+    createPages(file, numPages);
+  }
+
+  const std::uint32_t distances[] = {0, 8, 32, 64};
+  for (std::size_t d = 0; d < sizeof(distances) / sizeof(distances[0]); d++)
+  {
+    BufMgr pool(numPages / 2);
+    std::uint64_t records = 0;
+    Clock::time_point start = Clock::now();
+    for (int r = 0; r < rounds; r++)
+    {
+      FileScan scan(benchFileName, &pool, FileScan::DEFAULT_RING_THRESHOLD, distances[d]);
+      try
+      {
+        RecordId rid;
+        while (true)
+        {
+          scan.scanNext(rid);
+          records++;
+        }
+      }
+      catch (const EndOfFileException&)
+      {
+      }
+    }
+    report("prefetch distance " + std::to_string(distances[d]),
+           records / secondsSince(start) / 1e3, "K pages/s");
+  }
+  File::setIoBackend(IO_POSIX);
+}
+
+/**
+ * Frame pool placement: construction time of a pool of 8192 frames with each
+ * placement, then random hits over all of its frames, with the data TLB
+ * misses they cause where perf counters can be read.
+ */
+void placementBench()
+{
+  const PageId numPages = 8192;
+  const int reads = 1000000 * scale;
+  PageFile file = PageFile::create(benchFileName);
+  createPages(file, numPages);
+
+  const PoolPlacement placements[] = {POOL_LOCAL, POOL_INTERLEAVE, POOL_PARTITION};
+  const char* placementNames[] = {"local", "interleave", "partition"};
+  TlbMissCounter tlbMisses;
+  for (std::size_t p = 0; p < sizeof(placements) / sizeof(placements[0]); p++)
+  {
+    const std::string how = std::string(placementNames[p]) + ": ";
+    Clock::time_point start = Clock::now();
+    BufMgr pool(numPages, CLOCK_REPLACEMENT, placements[p]);
+    report(how + "construct", secondsSince(start) * 1e3, "ms");
+    std::cout << "  " << how << (pool.usesHugePages() ? "explicit huge pages" : "base or transparent huge pages") << "\n";
+
+    Page* page;
+    for (PageId pageNo = 1; pageNo <= numPages; pageNo++)
+    {
+      pool.readPage(&file, pageNo, page);
+      pool.unPinPage(&file, pageNo, false);
+    }
+
+    std::mt19937 rng(8);
+    std::uint64_t checksum = 0;
+    tlbMisses.start();
+    start = Clock::now();
+    for (int i = 0; i < reads; i++)
+    {
+      const PageId pageNo = 1 + rng() % numPages;
+      pool.readPage(&file, pageNo, page);
+      // touch the frame, as a caller would
+      checksum += page->page_number();
+      pool.unPinPage(&file, pageNo, false);
+    }
+    const double seconds = secondsSince(start);
+    const std::uint64_t misses = tlbMisses.stop();
+    report(how + "readPage + unPinPage, hit", reads / seconds / 1e6, "M ops/s");
+    if (tlbMisses.available())
+      report(how + "dTLB misses per read", static_cast<double>(misses) / reads, "");
+    else
+      std::cout << "  " << how << "dTLB misses unavailable (perf_event_open failed)\n";
+    if (checksum == 0)
+      std::cerr << "placement: no page was read\n";
+  }
+}
+
+/**
+ * Frame sweep: misses through a pool of 16384 frames, 15 in 16 of them
+ * pinned, so that every miss sweeps past pinned frames to find a victim.
+ */
+void sweepBench()
+{
+  const PageId poolSize = 16384;
+  const PageId pinnedPages = poolSize - poolSize / 16;
+  const PageId otherPages = 4 * (poolSize - pinnedPages);
+  const int reads = 100000 * scale;
+  PageFile file = PageFile::create(benchFileName);
+  createPages(file, pinnedPages + otherPages);
+
+  BufMgr pool(poolSize);
+  Page* page;
+  for (PageId pageNo = 1; pageNo <= pinnedPages; pageNo++)
+    pool.readPage(&file, pageNo, page);
+
+  pool.clearBufStats();
+  Clock::time_point start = Clock::now();
+  for (int i = 0; i < reads; i++)
+  {
+    const PageId pageNo = pinnedPages + 1 + i % otherPages;
+    pool.readPage(&file, pageNo, page);
+    pool.unPinPage(&file, pageNo, false);
+  }
+  report("readPage + unPinPage, miss, 15/16 pinned", reads / secondsSince(start) / 1e3, "K ops/s");
+  report("hit ratio", 100.0 * pool.getBufStats().hits.load() / reads, "%");
+
+  for (PageId pageNo = 1; pageNo <= pinnedPages; pageNo++)
+    pool.unPinPage(&file, pageNo, false);
+}
+
+/**
+ * Page guards: hits on resident pages pinned and unpinned by hand, which looks
+ * each page up twice, against fetchPage(), whose guard unpins the frame it
+ * remembers.
+ */
+void guardBench()
+{
+  const PageId numPages = 4096;
+  const int reads = 2000000 * scale;
+  PageFile file = PageFile::create(benchFileName);
+  createPages(file, numPages);
+
+  BufMgr pool(numPages);
+  Page* page;
+  for (PageId pageNo = 1; pageNo <= numPages; pageNo++)
+  {
+    pool.readPage(&file, pageNo, page);
+    pool.unPinPage(&file, pageNo, false);
+  }
+
+  std::mt19937 rng(11);
+  Clock::time_point start = Clock::now();
+  for (int i = 0; i < reads; i++)
+  {
+    const PageId pageNo = 1 + rng() % numPages;
+    pool.readPage(&file, pageNo, page);
+    pool.unPinPage(&file, pageNo, false);
+  }
+  report("readPage + unPinPage", reads / secondsSince(start) / 1e6, "M ops/s");
+
+  rng.seed(11);
+  start = Clock::now();
+  for (int i = 0; i < reads; i++)
+  {
+    PageGuard guard = pool.fetchPage(&file, 1 + rng() % numPages);
+  }
+  report("fetchPage + guard destructor", reads / secondsSince(start) / 1e6, "M ops/s");
+}
+
+/**
+ * Pool sets: index probes mixed with scans of a data file sixteen times the
+ * size of the index, with both files in one pool of 512 frames or each bound
+ * to a pool of 256 frames of its own.
+ */
+void poolSetBench()
+{
+  const PageId indexPages = 256;
+  const PageId dataPages = 16 * indexPages;
+  const int rounds = 2000 * scale;
+  {
+    PageFile index = PageFile::create(benchFileName);
+    createPages(index, indexPages);
+    PageFile data = PageFile::create(benchDataFileName);
+    createPages(data, dataPages);
+  }
+  PageFile index = PageFile::open(benchFileName);
+  PageFile data = PageFile::open(benchDataFileName);
+
+  for (int separate = 0; separate < 2; separate++)
+  {
+    BufferPoolSet pools;
+    if (separate)
+    {
+      pools.createPool("data", dataPages / 16);
+      pools.createPool("index", indexPages);
+      pools.bind(benchFileName, "index");
+    }
+    else
+    {
+      pools.createPool("shared", dataPages / 16 + indexPages);
+    }
+    BufMgr* indexPool = pools.poolFor(&index);
+    BufMgr* dataPool = pools.poolFor(&data);
+
+    std::mt19937 rng(14);
+    PageId scanPageNo = 0;
+    std::uint64_t probeHits = 0;
+    Page* page;
+    Clock::time_point start = Clock::now();
+    for (int r = 0; r < rounds; r++)
+    {
+      const std::uint64_t hitsBefore = indexPool->getBufStats().hits.load();
+      for (int i = 0; i < 10; i++)
+      {
+        const PageId pageNo = 1 + rng() % indexPages;
+        indexPool->readPage(&index, pageNo, page);
+        indexPool->unPinPage(&index, pageNo, false);
+      }
+      probeHits += indexPool->getBufStats().hits.load() - hitsBefore;
+
+      for (int i = 0; i < 100; i++)
+      {
+        const PageId pageNo = 1 + scanPageNo++ % dataPages;
+        dataPool->readPage(&data, pageNo, page);
+        dataPool->unPinPage(&data, pageNo, false);
+      }
+    }
+    const double seconds = secondsSince(start);
+    const std::string how = separate ? "own pools: " : "one pool: ";
+    report(how + "index hit ratio", 100.0 * probeHits / (10.0 * rounds), "%");
+    report(how + "rounds of 10 probes, 100 scans", rounds / seconds / 1e3, "K rounds/s");
+  }
+}
+
+/**
+ * I/O backends: fio-style page writes, then sequential and random page reads
+ * of a 4096-page file through each backend; the writes end with one sync.
+ */
+void backendBench()
+{
+  const PageId numPages = 4096;
+  const int rounds = 2 * scale;
+  const IoBackend backends[] = {IO_STREAM, IO_POSIX, IO_DIRECT};
+  const char* backendNames[] = {"stream", "posix", "direct"};
+  for (std::size_t b = 0; b < sizeof(backends) / sizeof(backends[0]); b++)
+  {
+    removeBenchFile();
+    File::setIoBackend(backends[b]);
+    const std::string how = std::string(backendNames[b]) + ": ";
+    PageFile file = PageFile::create(benchFileName);
+    createPages(file, numPages);
+    std::vector<Page> pages(numPages);
+    for (PageId pageNo = 1; pageNo <= numPages; pageNo++)
+      pages[pageNo - 1] = file.readPage(pageNo);
+
+    Clock::time_point start = Clock::now();
+    for (int r = 0; r < rounds; r++)
+    {
+      for (PageId pageNo = 1; pageNo <= numPages; pageNo++)
+        file.writePage(pageNo, pages[pageNo - 1]);
+    }
+    file.sync();
+    report(how + "writePage, sequential, then sync", numPages * rounds / secondsSince(start) / 1e3, "K pages/s");
+
+    start = Clock::now();
+    for (int r = 0; r < rounds; r++)
+    {
+      for (PageId pageNo = 1; pageNo <= numPages; pageNo++)
+        pages[pageNo - 1] = file.readPage(pageNo);
+    }
+    report(how + "readPage, sequential", numPages * rounds / secondsSince(start) / 1e3, "K pages/s");
+
+    std::mt19937 rng(16);
+    start = Clock::now();
+    for (int r = 0; r < rounds; r++)
+    {
+      for (PageId i = 0; i < numPages; i++)
+        pages[i] = file.readPage(1 + rng() % numPages);
+    }
+    report(how + "readPage, random", numPages * rounds / secondsSince(start) / 1e3, "K pages/s");
+  }
+  File::setIoBackend(IO_POSIX);
+}
+
+/**
+ * I/O engines: random page reads of a 4096-page file opened with O_DIRECT,
+ * kept at a fixed queue depth, through io_uring where the kernel has it and
+ * through the thread pool.
+ */
+void engineBench()
+{
+  const PageId numPages = 4096;
+  const int reads = 20000 * scale;
+  {
+    PageFile file = PageFile::create(benchFileName);
+    createPages(file, numPages);
+  }
+
+  const std::uint32_t depths[] = {1, 4, 16, 64, 128};
+  const std::uint32_t maxDepth = depths[sizeof(depths) / sizeof(depths[0]) - 1];
+  void* memory;
+  if (posix_memalign(&memory, PosixIo::DIRECT_ALIGNMENT, maxDepth * Page::SIZE) != 0)
+    throw std::bad_alloc();
+  char* buffers = static_cast<char*>(memory);
+  std::shared_ptr<FileIo> io = FileIo::open(benchFileName, false, IO_DIRECT);
+
+  for (int useUring = 1; useUring >= 0; useUring--)
+  {
+    for (std::size_t d = 0; d < sizeof(depths) / sizeof(depths[0]); d++)
+    {
+      std::unique_ptr<IoEngine> engine = IoEngine::create(depths[d], useUring != 0);
+      // without io_uring both rounds would measure the thread pool
+      if (useUring && std::strcmp(engine->name(), "io_uring") != 0)
+        break;
+
+      std::atomic<int> completed(0);
+      std::atomic<int> errors(0);
+      std::mt19937 rng(18);
+      Clock::time_point start = Clock::now();
+      for (int i = 0; i < reads; i++)
+      {
+        while (i - completed.load() >= static_cast<int>(depths[d]))
+          std::this_thread::yield();
+        // the pages read are thrown away, so requests may share a buffer
+        engine->submitRead(*io, buffers + (i % depths[d]) * Page::SIZE, Page::SIZE,
+                           static_cast<std::uint64_t>(rng() % numPages) * Page::SIZE,
+                           [&](int error) {
+                             if (error != 0)
+                               errors++;
+                             completed++;
+                           });
+      }
+      while (completed.load() < reads)
+        std::this_thread::yield();
+      const double seconds = secondsSince(start);
+      report(std::string(engine->name()) + ": queue depth " + std::to_string(depths[d]),
+             reads / seconds / 1e3, "K reads/s");
+      if (errors.load() != 0)
+        std::cerr << "engine: " << errors.load() << " reads failed\n";
+    }
+  }
+  io.reset();
+  free(memory);
+}
+
+/**
+ * Mapped index files: random point reads of pages of a 4096-page BlobFile
+ * resident in the buffer pool, against the same reads through a FileMap.
+ * Each read looks at one byte of its page, as a lookup in a node would.
+ */
+void mapBench()
+{
+  const PageId numPages = 4096;
+  const int reads = 2000000 * scale;
+  BlobFile file = BlobFile::create(benchFileName);
+  for (PageId i = 0; i < numPages; i++)
+  {
+    PageId pageNo;
+    Page page = file.allocatePage(pageNo);
+    page.insertRecord("bench");
+    file.writePage(pageNo, page);
+  }
+  file.sync();
+
+  std::uint64_t checksum = 0;
+  {
+    BufMgr pool(numPages);
+    Page* page;
+    for (PageId pageNo = 1; pageNo <= numPages; pageNo++)
+    {
+      pool.readPage(&file, pageNo, page);
+      pool.unPinPage(&file, pageNo, false);
+    }
+    std::mt19937 rng(19);
+    Clock::time_point start = Clock::now();
+    for (int i = 0; i < reads; i++)
+    {
+      const PageId pageNo = 1 + rng() % numPages;
+      pool.readPage(&file, pageNo, page);
+      checksum += reinterpret_cast<const unsigned char*>(page)[i % Page::SIZE];
+      pool.unPinPage(&file, pageNo, false);
+    }
+    report("buffered: readPage + unPinPage", secondsSince(start) / reads * 1e9, "ns/read");
+  }
+
+  FileMap mapping(file);
+  std::mt19937 rng(19);
+  Clock::time_point start = Clock::now();
+  for (int i = 0; i < reads; i++)
+  {
+    const Page* page = mapping.page(1 + rng() % numPages);
+    checksum += reinterpret_cast<const unsigned char*>(page)[i % Page::SIZE];
+  }
+  report("mapped: FileMap::page", secondsSince(start) / reads * 1e9, "ns/read");
+  if (checksum == 0)
+    std::cerr << "map: no page was read\n";
+}
+
+/**
+ * Page allocation: allocates 50000 pages to an empty PageFile, deletes every
+ * other one in ascending order and allocates them again from the free list.
+ */
+void allocateBench()
+{
+  const PageId numPages = 50000 * scale;
+  PageFile file = PageFile::create(benchFileName);
+
+  Clock::time_point start = Clock::now();
+  for (PageId i = 0; i < numPages; i++)
+  {
+    PageId pageNo;
+    file.allocatePage(pageNo);
+  }
+  report("allocatePage, new pages", numPages / secondsSince(start) / 1e3, "K pages/s");
+
+  start = Clock::now();
+  for (PageId pageNo = 1; pageNo <= numPages; pageNo += 2)
+    file.deletePage(pageNo);
+  report("deletePage, every other, ascending", numPages / 2 / secondsSince(start) / 1e3, "K pages/s");
+
+  start = Clock::now();
+  for (PageId i = 0; i < numPages / 2; i++)
+  {
+    PageId pageNo;
+    file.allocatePage(pageNo);
+  }
+  report("allocatePage, reused pages", numPages / 2 / secondsSince(start) / 1e3, "K pages/s");
+}
+
+/**
+ * Page reads: PageFile::readPage of random pages of a 4096-page file held in
+ * the kernel page cache, and walks of the used pages with a FileIterator.
+ */
+void readBench()
+{
+  const PageId numPages = 4096;
+  const int reads = 500000 * scale;
+  PageFile file = PageFile::create(benchFileName);
+  createPages(file, numPages);
+
+  std::mt19937 rng(21);
+  Page page;
+  Clock::time_point start = Clock::now();
+  for (int i = 0; i < reads; i++)
+    page = file.readPage(1 + rng() % numPages);
+  report("readPage, random", reads / secondsSince(start) / 1e3, "K pages/s");
+
+  const int walks = reads / numPages;
+  std::uint64_t visited = 0;
+  start = Clock::now();
+  for (int i = 0; i < walks; i++)
+  {
+    for (FileIterator iter = file.begin(); iter != file.end(); ++iter)
+      visited++;
+  }
+  report("FileIterator walk", visited / secondsSince(start) / 1e3, "K pages/s");
+}
+
+/**
+ * Free-space map: loads 20000 records of 100 bytes with insertRecord(), then
+ * in each of ten rounds deletes a random half of them and inserts as many
+ * again.  The file should stay near the size the load left it at.
+ */
+void freeSpaceBench()
+{
+  const int numRecords = 20000 * scale;
+  const int rounds = 10;
+  const std::string data(100, 'x');
+  PageFile file = PageFile::create(benchFileName);
+  BufMgr pool(256);
+
+  std::vector<RecordId> rids;
+  Clock::time_point start = Clock::now();
+  for (int i = 0; i < numRecords; i++)
+    rids.push_back(file.insertRecord(&pool, data));
+  report("insertRecord, load", numRecords / secondsSince(start) / 1e3, "K records/s");
+  const PageId loadedPages = file.getNumPages();
+  report("pages after load", loadedPages, "pages");
+
+  std::mt19937 rng(22);
+  double deleteSeconds = 0;
+  double insertSeconds = 0;
+  for (int r = 0; r < rounds; r++)
+  {
+    std::shuffle(rids.begin(), rids.end(), rng);
+    start = Clock::now();
+    for (int i = 0; i < numRecords / 2; i++)
+      file.deleteRecord(&pool, rids[i]);
+    deleteSeconds += secondsSince(start);
+
+    start = Clock::now();
+    for (int i = 0; i < numRecords / 2; i++)
+      rids[i] = file.insertRecord(&pool, data);
+    insertSeconds += secondsSince(start);
+  }
+  report("deleteRecord", numRecords / 2 * rounds / deleteSeconds / 1e3, "K records/s");
+  report("insertRecord, into freed space", numRecords / 2 * rounds / insertSeconds / 1e3, "K records/s");
+  report("pages after " + std::to_string(rounds) + " rounds", file.getNumPages(), "pages");
+  pool.flushFile(&file);
+}
+
+/**
+ * Extents: bulk insert of 20000 pages into a PageFile and a BlobFile without
+ * reserving space ahead, with the default doubling from 8 up to 1024 pages
+ * and with 1024 pages reserved at a time.  Each run ends with a sync.
+ */
+void extentBench()
+{
+  const PageId numPages = 20000 * scale;
+  const PageId bounds[][2] = {{0, 0}, {8, 1024}, {1024, 1024}};
+  const char* boundNames[] = {"no extents", "extents of 8 to 1024", "extents of 1024"};
+  for (std::size_t b = 0; b < sizeof(bounds) / sizeof(bounds[0]); b++)
+  {
+    File::setExtentPages(bounds[b][0], bounds[b][1]);
+    const std::string how = std::string(boundNames[b]) + ": ";
+
+    removeBenchFile();
+    {
+      PageFile file = PageFile::create(benchFileName);
+      Clock::time_point start = Clock::now();
+      createPages(file, numPages);
+      file.sync();
+      report(how + "PageFile", numPages / secondsSince(start) / 1e3, "K pages/s");
+    }
+
+    removeBenchFile();
+    {
+      BlobFile file = BlobFile::create(benchFileName);
+      Page page;
+      Clock::time_point start = Clock::now();
+      for (PageId i = 0; i < numPages; i++)
+      {
+        PageId pageNo;
+        file.allocatePage(pageNo);
+        file.writePage(pageNo, page);
+      }
+      file.sync();
+      report(how + "BlobFile", numPages / secondsSince(start) / 1e3, "K pages/s");
+    }
+  }
+  // back to the defaults
+  File::setExtentPages(8, 1024);
+}
+
+/**
+ * Vectored I/O: a 4096-page file read and written one page per call and in
+ * runs of 32 pages, and flushFile() of a pool full of the file's pages, all
+ * dirty, which writes them back in runs.
+ */
+void vectoredBench()
+{
+  const PageId numPages = 4096;
+  const std::uint32_t runPages = 32;
+  const int rounds = 4 * scale;
+  PageFile file = PageFile::create(benchFileName);
+  createPages(file, numPages);
+
+  std::vector<Page> pages(numPages);
+  std::vector<Page*> pagePtrs(numPages);
+  for (PageId i = 0; i < numPages; i++)
+    pagePtrs[i] = &pages[i];
+
+  Clock::time_point start = Clock::now();
+  for (int r = 0; r < rounds; r++)
+  {
+    for (PageId pageNo = 1; pageNo <= numPages; pageNo++)
+      pages[pageNo - 1] = file.readPage(pageNo);
+  }
+  report("readPage", numPages * rounds / secondsSince(start) / 1e3, "K pages/s");
+
+  start = Clock::now();
+  for (int r = 0; r < rounds; r++)
+  {
+    for (PageId pageNo = 1; pageNo <= numPages; pageNo += runPages)
+      file.readPages(pageNo, runPages, &pagePtrs[pageNo - 1]);
+  }
+  report("readPages, runs of 32", numPages * rounds / secondsSince(start) / 1e3, "K pages/s");
+
+  start = Clock::now();
+  for (int r = 0; r < rounds; r++)
+  {
+    for (PageId pageNo = 1; pageNo <= numPages; pageNo++)
+      file.writePage(pageNo, pages[pageNo - 1]);
+  }
+  file.sync();
+  report("writePage, then sync", numPages * rounds / secondsSince(start) / 1e3, "K pages/s");
+
+  start = Clock::now();
+  for (int r = 0; r < rounds; r++)
+  {
+    for (PageId pageNo = 1; pageNo <= numPages; pageNo += runPages)
+      file.writePages(pageNo, runPages, &pagePtrs[pageNo - 1]);
+  }
+  file.sync();
+  report("writePages, runs of 32, then sync", numPages * rounds / secondsSince(start) / 1e3, "K pages/s");
+
+  BufMgr pool(numPages);
+  double flushSeconds = 0;
+  for (int r = 0; r < rounds; r++)
+  {
+    Page* page;
+    for (PageId pageNo = 1; pageNo <= numPages; pageNo++)
+    {
+      pool.readPage(&file, pageNo, page);
+      pool.unPinPage(&file, pageNo, true);
+    }
+    start = Clock::now();
+    pool.flushFile(&file);
+    flushSeconds += secondsSince(start);
+  }
+  report("flushFile, all pages dirty", numPages * rounds / flushSeconds / 1e3, "K pages/s");
+}
+
+/**
+ * Scaling: readPage + unPinPage of random pages from 1 to 64 threads at once,
+ * on a pool holding three quarters of a 4096-page file, so that most reads hit
+ * and the rest evict.  The total work is the same at every thread count.
+ */
+void threadsBench()
+{
+  const PageId numPages = 4096;
+  const int reads = 400000 * scale;
+  PageFile file = PageFile::create(benchFileName);
+  createPages(file, numPages);
+
+  const int threadCounts[] = {1, 2, 4, 8, 16, 32, 64};
+  for (std::size_t t = 0; t < sizeof(threadCounts) / sizeof(threadCounts[0]); t++)
+  {
+    const int numThreads = threadCounts[t];
+    const int readsPerThread = reads / numThreads;
+    BufMgr pool(numPages / 4 * 3);
+    std::vector<std::thread> threads;
+    Clock::time_point start = Clock::now();
+    for (int i = 0; i < numThreads; i++)
+    {
+      threads.push_back(std::thread([&pool, &file, readsPerThread, numPages, i]() {
+        std::mt19937 rng(3 + i);
+        Page* page;
+        for (int r = 0; r < readsPerThread; r++)
+        {
+          const PageId pageNo = 1 + rng() % numPages;
+          pool.readPage(&file, pageNo, page);
+          pool.unPinPage(&file, pageNo, false);
+        }
+      }));
+    }
+    for (std::size_t i = 0; i < threads.size(); i++)
+      threads[i].join();
+    const double seconds = secondsSince(start);
+    report(std::to_string(numThreads) + " threads: readPage + unPinPage",
+           readsPerThread * numThreads / seconds / 1e3, "K ops/s");
+  }
+}
+
+/**
+ * Background writer: random updates of a file four times the size of the pool,
+ * each leaving its page dirty, without and with the background writer, then a
+ * checkpoint.  Reports how many victims readPage() had to write itself, which
+ * the writer should bring close to none, and how many pages were written in
+ * all, since pages the writer cleans may be dirtied again before eviction.
+ */
+void writerBench()
+{
+  const PageId numPages = 2048;
+  const int updates = 100000 * scale;
+  PageFile file = PageFile::create(benchFileName);
+  createPages(file, numPages);
+
+  for (int useWriter = 0; useWriter < 2; useWriter++)
+  {
+    const std::string how = useWriter ? "with writer: " : "without writer: ";
+    BufMgr pool(numPages / 4);
+    if (useWriter)
+      pool.startWriter(1);  // a round every millisecond, to keep up with the updates
+    std::mt19937 rng(7);
+    Page* page;
+    Clock::time_point start = Clock::now();
+    for (int i = 0; i < updates; i++)
+    {
+      const PageId pageNo = 1 + rng() % numPages;
+      pool.readPage(&file, pageNo, page);
+      pool.unPinPage(&file, pageNo, true);
+    }
+    report(how + "readPage + unPinPage, dirty", updates / secondsSince(start) / 1e3, "K ops/s");
+    pool.stopWriter();
+    const BufStats& stats = pool.getBufStats();
+    const std::uint64_t evictions = stats.cleanEvictions.load() + stats.dirtyEvictions.load();
+    const double foreground = 100.0 * stats.evictionWrites.load() / std::max<std::uint64_t>(evictions, 1);
+    report(how + "victims written by readPage", foreground, "% of evictions");
+    report(how + "pages written in all", 100.0 * stats.diskwrites.load() / updates, "% of ops");
+    // with the writer on, readPage() should find its victims already clean
+    if (useWriter && foreground > 10)
+      std::cerr << "writer: readPage wrote " << foreground << "% of its victims itself\n";
+
+    start = Clock::now();
+    pool.checkpoint();
+    report(how + "checkpoint", secondsSince(start) * 1e3, "ms");
+  }
+}
+
+/**
+ * Compressed tier: random reads of a file three times the size of a pool of
+ * 256 frames, read with O_DIRECT, without the compressed second tier and with
+ * one of a quarter of the pool's memory.  The pages hold little data and
+ * compress well, as index leaves do.
+ */
+void compressedBench()
+{
+  const PageId poolSize = 256;
+  const PageId numPages = 3 * poolSize;
+  const int reads = 50000 * scale;
+  File::setIoBackend(IO_DIRECT);
+  PageFile file = PageFile::create(benchFileName);
+  createPages(file, numPages);
+
+  for (int useTier = 0; useTier < 2; useTier++)
+  {
+    const std::string how = useTier ? "with tier: " : "without tier: ";
+    BufMgr pool(poolSize);
+    if (useTier)
+      pool.setCompressedCacheSize(poolSize / 4 * Page::SIZE);
+    std::mt19937 rng(15);
+    Page* page;
+    Clock::time_point start = Clock::now();
+    for (int i = 0; i < reads; i++)
+    {
+      const PageId pageNo = 1 + rng() % numPages;
+      pool.readPage(&file, pageNo, page);
+      pool.unPinPage(&file, pageNo, false);
+    }
+    report(how + "readPage + unPinPage", reads / secondsSince(start) / 1e3, "K ops/s");
+    report(how + "reads from disk", 100.0 * pool.getBufStats().diskreads.load() / reads, "% of ops");
+    report(how + "tier memory in use", pool.getCompressedCacheUsage() / 1024.0, "KiB");
+  }
+  File::setIoBackend(IO_POSIX);
+}
+
+/**
+ * Checksums: CRC32C of pages alone, then page writes and reads of a 4096-page
+ * file without and with checksums, and verify() of the whole file from one and
+ * from four threads.  Reads come from the kernel page cache, so this is the
+ * largest share of the I/O time the checksums can take.
+ */
+void checksumBench()
+{
+  const PageId numPages = 4096;
+  const int rounds = 2 * scale;
+
+  Page blank;
+  blank.insertRecord("bench");
+  std::uint32_t crc = 0;
+  Clock::time_point start = Clock::now();
+  for (PageId i = 0; i < numPages * rounds; i++)
+    crc = crc32c(&blank, sizeof(blank), crc);
+  report("crc32c of a page", numPages * rounds * double(Page::SIZE) / secondsSince(start) / 1e6, "MB/s");
+
+  for (int useChecksums = 0; useChecksums < 2; useChecksums++)
+  {
+    const std::string how = useChecksums ? "with checksums: " : "without checksums: ";
+    removeBenchFile();
+    File::setChecksums(useChecksums != 0);
+    PageFile file = PageFile::create(benchFileName);
+    createPages(file, numPages);
+    std::vector<Page> pages(numPages);
+
+    start = Clock::now();
+    for (int r = 0; r < rounds; r++)
+    {
+      for (PageId pageNo = 1; pageNo <= numPages; pageNo++)
+        pages[pageNo - 1] = file.readPage(pageNo);
+    }
+    report(how + "readPage", numPages * rounds / secondsSince(start) / 1e3, "K pages/s");
+
+    start = Clock::now();
+    for (int r = 0; r < rounds; r++)
+    {
+      for (PageId pageNo = 1; pageNo <= numPages; pageNo++)
+        file.writePage(pageNo, pages[pageNo - 1]);
+    }
+    file.sync();
+    report(how + "writePage, then sync", numPages * rounds / secondsSince(start) / 1e3, "K pages/s");
+
+    if (!useChecksums)
+      continue;
+    const std::uint32_t threadCounts[] = {1, 4};
+    for (std::size_t t = 0; t < sizeof(threadCounts) / sizeof(threadCounts[0]); t++)
+    {
+      start = Clock::now();
+      const std::vector<PageId> failed = file.verify(1, numPages, threadCounts[t]);
+      report("verify, " + std::to_string(threadCounts[t]) + " threads",
+             numPages / secondsSince(start) / 1e3, "K pages/s");
+      if (!failed.empty())
+        std::cerr << "checksum: " << failed.size() << " pages failed verify\n";
+    }
+  }
+  File::setChecksums(false);
+  if (crc == 0)
+    std::cerr << "checksum: crc of zero\n";
+}
+
+struct BenchCase
+{
+  const char* name;
+  const char* title;
+  void (*run)();
+};
+
+const BenchCase benchCases[] = {
+  {"hashtable", "BufHashTbl page table", hashTableBench},
+  {"miss", "BufMgr::readPage miss path", missBench},
+  {"policy", "Replacement policies", policyBench},
+  {"ring", "Scan-resistant access strategy", ringBench},
+  {"probe", "Probe latency beside a scan", probeLatencyBench},
+  {"prefetch", "FileScan read-ahead", prefetchBench},
+  {"placement", "Frame pool placement", placementBench},
+  {"sweep", "Victim sweep past pinned frames", sweepBench},
+  {"guard", "PageGuard against manual unpinning", guardBench},
+  {"poolset", "Index and data files in separate pools", poolSetBench},
+  {"backend", "File I/O backends", backendBench},
+  {"engine", "Asynchronous I/O engines", engineBench},
+  {"map", "Memory-mapped index files", mapBench},
+  {"allocate", "PageFile page allocation", allocateBench},
+  {"read", "PageFile page reads", readBench},
+  {"freespace", "Record inserts through the free-space map", freeSpaceBench},
+  {"extent", "File growth by extents", extentBench},
+  {"vectored", "Runs of pages in one call", vectoredBench},
+  {"threads", "Concurrent readers", threadsBench},
+  {"writer", "Background dirty page writer", writerBench},
+  {"compressed", "Compressed second tier", compressedBench},
+  {"checksum", "Page checksums", checksumBench},
+};
+
+}
+
+/**
+ * Runs reproducible benchmarks of the storage layer: every case uses fixed
+ * sizes and seeds.  Compare builds by running the same case on each.
+ *
+ * usage: badgerdb_bench [CASE [SCALE]]
+ *
+ * Without CASE all cases run; SCALE multiplies the work of a case.
+ */
+int main(int argc, char* argv[])
+{
+  const std::size_t numCases = sizeof(benchCases) / sizeof(benchCases[0]);
+  if (argc > 2)
+    scale = std::max(1, atoi(argv[2]));
+
+  bool ran = false;
+  for (std::size_t i = 0; i < numCases; i++)
+  {
+    if (argc > 1 && std::strcmp(argv[1], "all") != 0 &&
+        std::strcmp(argv[1], benchCases[i].name) != 0)
+      continue;
+    std::cout << benchCases[i].name << ": " << benchCases[i].title << "\n";
+    removeBenchFile();
+    benchCases[i].run();
+    removeBenchFile();
+    ran = true;
+  }
+
+  if (!ran)
+  {
+    std::cerr << "usage: " << argv[0] << " [CASE [SCALE]]\ncases:";
+    for (std::size_t i = 0; i < numCases; i++)
+      std::cerr << " " << benchCases[i].name;
+    std::cerr << "\n";
+    return 2;
+  }
+  return 0;
+}
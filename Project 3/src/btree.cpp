@@ -21,6 +21,7 @@
 #include "exceptions/page_not_pinned_exception.h"
 #include "exceptions/invalid_record_exception.h"
 #include "exceptions/page_pinned_exception.h"
+#include "exceptions/index_read_only_exception.h"
 
 namespace badgerdb
 {
@@ -29,8 +30,8 @@ const int compare(const T a, const T b){
   return a - b;
 }
 
-template<> // explicit specialization for T = void
-const int compare<char[STRINGSIZE]>( char a[STRINGSIZE], char b[STRINGSIZE]){
+template<> // explicit specialization for T = char[STRINGSIZE]
+const int compare<char[STRINGSIZE]>( const char a[STRINGSIZE], const char b[STRINGSIZE]){
   return strncmp(a,b,STRINGSIZE);
 }
 
@@ -91,6 +92,54 @@ const int getIndex( T_NodeType * thisPage, T &key )
 }
 
 
+// -----------------------------------------------------------------------------
+// BTreeIndex::mappedNode
+// -----------------------------------------------------------------------------
+
+template<class T_NodeType>
+T_NodeType* BTreeIndex::mappedNode(PageId pageNo)
+{
+  // the mapping is read-only; nodes read from it are never written
+  return reinterpret_cast<T_NodeType*>(const_cast<Page*>(mapping->page(pageNo)));
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::currentNode
+// -----------------------------------------------------------------------------
+
+template<class T_NodeType>
+T_NodeType* BTreeIndex::currentNode()
+{
+  if ( mapping ) {
+    return reinterpret_cast<T_NodeType*>(const_cast<Page*>(currentMappedPage));
+  }
+  return currentPage.as<T_NodeType>();
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::moveScanTo
+// -----------------------------------------------------------------------------
+
+template<class T_NodeType>
+const void BTreeIndex::moveScanTo(PageId pageNo)
+{
+  currentPage.release();
+  currentPageNum = pageNo;
+  if ( mapping ) {
+    currentMappedPage = mapping->page(currentPageNum);
+  } else {
+    currentPage = bufMgr->fetchPage(file, currentPageNum);
+  }
+
+  // have the leaf after this one read in while this one is consumed
+  PageId afterNextPageNo = currentNode<T_NodeType>()->rightSibPageNo;
+  if ( afterNextPageNo != 0 && mapping ) {
+    mapping->prefetch(afterNextPageNo);
+  } else if ( afterNextPageNo != 0 ) {
+    bufMgr->prefetch(file, afterNextPageNo);
+  }
+}
+
 template<class T_NodeType>
 const void BTreeIndex::shiftToNextEntry(T_NodeType *thisPage)
 {
@@ -102,11 +151,10 @@ const void BTreeIndex::shiftToNextEntry(T_NodeType *thisPage)
           return;
       }
       PageId nextPageNo = thisPage->rightSibPageNo; 
-      bufMgr->unPinPage(file, currentPageNum, false);
-      currentPageNum = nextPageNo;
-      bufMgr->readPage(file, currentPageNum, currentPageData);
+      moveScanTo<T_NodeType>(nextPageNo);
       nextEntry = 0;
     }
+}
 
 // -----------------------------------------------------------------------------
 // BTreeIndex::BTreeIndex -- Constructor
@@ -120,11 +168,7 @@ BTreeIndex::BTreeIndex(const std::string & relationName,
 		 : bufMgr(bufMgrIn),               // initialized data field
         attributeType(attrType),
         attrByteOffset(attrByteOffset){
-			{
-			std::ostringstream idxStr;
-			idxStr << relationName << '.' << attrByteOffset;
-			outIndexName = idxStr.str(); 
-			}
+	outIndexName = indexFileName(relationName, attrByteOffset);
 	// BTreeIndex data field setup
 	 switch  (attributeType ) {
     case INTEGER:
@@ -146,36 +190,40 @@ BTreeIndex::BTreeIndex(const std::string & relationName,
   scanExecuting = false;
     nextEntry = -1;
     currentPageNum = 0;
+    currentMappedPage = NULL;
 
 // Check for the existence of the Index
 	// Old file attempt
 	try {
     file = new BlobFile(outIndexName,false);
-    Page *tempPage;
     headerPageNum = file->getFirstPageNo();
-    bufMgr->readPage(file, headerPageNum, tempPage);
-    IndexMetaInfo *metaInfo = reinterpret_cast<IndexMetaInfo *>(tempPage);
+    PageGuard header = bufMgr->fetchPage(file, headerPageNum);
+    IndexMetaInfo *metaInfo = header.as<IndexMetaInfo>();
     rootPageNum = metaInfo->rootPageNo;
 
-    bufMgr->unPinPage(file, headerPageNum, false);
     if ( relationName.compare(metaInfo->relationName) != 0
         || metaInfo->attrByteOffset != attrByteOffset
         || metaInfo->attrType != attrType
        ) 
 	   {
 		   std::cout<<"Meta info does not match the index!\n";
+      header.release();
+      // the pool must not keep pages of a File that is about to go away
+      bufMgr->flushFile(file);
       delete file;
       file = NULL;
       return;
     	}
 		 } catch (FileNotFoundException e ) {
 	// Deletes file. Creates and contructs the new index file
-    Page *tempPage;
     file = new BlobFile(outIndexName, true);
 
-    bufMgr->allocPage(file, headerPageNum, tempPage);
-    IndexMetaInfo *metaInfo = reinterpret_cast<IndexMetaInfo *>(tempPage);
-    bufMgr->allocPage(file, rootPageNum, tempPage);
+    PageGuard header = bufMgr->newPage(file);
+    headerPageNum = header.getPageNo();
+    IndexMetaInfo *metaInfo = header.as<IndexMetaInfo>();
+    PageGuard root = bufMgr->newPage(file);
+    rootPageNum = root.getPageNo();
+    Page *tempPage = root.getPage();
 
     std::copy(relationName.begin(), relationName.end(), metaInfo->relationName);
     metaInfo->attrByteOffset = attrByteOffset;
@@ -198,8 +246,10 @@ BTreeIndex::BTreeIndex(const std::string & relationName,
     } else {
       std::cout<<"Data type unsupported\n";
     }
-    bufMgr->unPinPage(file, rootPageNum, true);
-    bufMgr->unPinPage(file, headerPageNum, true);
+    root.markDirty();
+    root.release();
+    header.markDirty();
+    header.release();
 
     // Build the B-Tree
     buildBTree(relationName);
@@ -207,18 +257,53 @@ BTreeIndex::BTreeIndex(const std::string & relationName,
 }
 
 
+BTreeIndex::BTreeIndex(const std::string & relationName,
+		std::string & outIndexName,
+		BufferPoolSet *pools,
+		const int attrByteOffset,
+		const Datatype attrType)
+		 : BTreeIndex(relationName, outIndexName,
+		     pools->poolFor(indexFileName(relationName, attrByteOffset)),
+		     attrByteOffset, attrType)
+{
+}
+
+std::string BTreeIndex::indexFileName(const std::string & relationName, const int attrByteOffset)
+{
+  std::ostringstream idxStr;
+  idxStr << relationName << '.' << attrByteOffset;
+  return idxStr.str();
+}
+
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::buildBTree
+// -----------------------------------------------------------------------------
+
+const void BTreeIndex::buildBTree(const std::string & relationName)
+{
+  FileScan fscan(relationName, bufMgr);
+  try {
+    RecordId rid;
+    while ( true ) {
+      fscan.scanNext(rid);
+      std::string record = fscan.getRecord();
+      insertEntry(record.c_str() + attrByteOffset, rid);
+    }
+  } catch ( EndOfFileException e ) {
+    // every record of the relation is in the index
+  }
+}
+
+
 // -----------------------------------------------------------------------------
 // BTreeIndex::~BTreeIndex -- destructor
 // -----------------------------------------------------------------------------
 
 BTreeIndex::~BTreeIndex()
 {
-    if ( currentPageNum ) {
-      try {
-        bufMgr->unPinPage(file, currentPageNum, false);
-      } catch ( PageNotPinnedException e) {
-      	}
-    }
+    currentPage.release();
+    mapping.reset();
 
     scanExecuting = false;
     try {
@@ -234,12 +319,44 @@ BTreeIndex::~BTreeIndex()
     } 
 }
 
+// -----------------------------------------------------------------------------
+// BTreeIndex::mapReadOnly
+// -----------------------------------------------------------------------------
+
+const void BTreeIndex::mapReadOnly()
+{
+    if ( mapping ) {
+      return;
+    }
+    scanExecuting = false;
+    currentPage.release();
+
+    // the mapping reads the file on disk, so the pool must hold no newer pages
+    bufMgr->flushFile(file);
+    file->sync();
+    mapping.reset(new FileMap(*file));
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::unmap
+// -----------------------------------------------------------------------------
+
+const void BTreeIndex::unmap()
+{
+    scanExecuting = false;
+    currentMappedPage = NULL;
+    mapping.reset();
+}
+
 // -----------------------------------------------------------------------------
 // BTreeIndex::insertEntry
 // -----------------------------------------------------------------------------
 
 const void BTreeIndex::insertEntry(const void *key, const RecordId rid) 
 {
+    if ( mapping ) {
+      throw IndexReadOnlyException(file->filename());
+    }
     // Finds data type and then the leaf
     if ( attributeType == INTEGER ) {
         RIDKeyPair<int> rkpair;
@@ -277,15 +394,20 @@ const PageId BTreeIndex::findLeafNode(PageId pageNo, T &key)
   if ( rootPageNum == 2 ) {
     return rootPageNum; 
   }
-  Page *tempPage;
-  bufMgr->readPage(file, pageNo, tempPage);
-  T_NonLeafNode* thisPage = reinterpret_cast<T_NonLeafNode*>(tempPage);
+  PageGuard node;
+  T_NonLeafNode* thisPage;
+  if ( mapping ) {
+    thisPage = mappedNode<T_NonLeafNode>(pageNo);
+  } else {
+    node = bufMgr->fetchPage(file, pageNo);
+    thisPage = node.as<T_NonLeafNode>();
+  }
   
   int index = getIndex<T, T_NonLeafNode>(thisPage, key);
 
   PageId leafNodeNo = thisPage->pageNoArray[index];
   int thisPageLevel  = thisPage->level;
-  bufMgr->unPinPage(file, pageNo, false);
+  node.release();
   if ( thisPageLevel == 0 ) { 
     leafNodeNo = findLeafNode<T, T_NonLeafNode>(leafNodeNo, key);
   }
@@ -301,11 +423,10 @@ const PageId BTreeIndex::findLeafNode(PageId pageNo, T &key)
 template<class T, class T_NonLeafNode, class T_LeafNode> 
 const void BTreeIndex::insertLeafNode(PageId pageNo, RIDKeyPair<T> rkpair)
 {
-  Page *tempPage;
-  bufMgr->readPage(file, pageNo, tempPage);
-  T_LeafNode * thisPage = reinterpret_cast<T_LeafNode*>(tempPage);
+  PageGuard leaf = bufMgr->fetchPage(file, pageNo);
+  T_LeafNode * thisPage = leaf.as<T_LeafNode>();
   T thisKey;
-  copyKey((thisKey), ((rkpair.key)));
+  keyCopy((thisKey), ((rkpair.key)));
 
   int size = thisPage->size;
   if ( size < leafOccupancy ) {
@@ -318,16 +439,16 @@ const void BTreeIndex::insertLeafNode(PageId pageNo, RIDKeyPair<T> rkpair)
     memmove((void*)(&(thisPage->ridArray[index+1])),
             (void*)(&(thisPage->ridArray[index])), sizeof(RecordId)*(size-index));
 
-    copyKey(((thisPage->keyArray[index])), (thisKey));
+    keyCopy(((thisPage->keyArray[index])), (thisKey));
     thisPage->ridArray[index] = rkpair.rid;
 
     (thisPage->size)++;
-    bufMgr->unPinPage(file, pageNo, true);
+    leaf.markDirty();
   } else {
     int midIndex = leafOccupancy/2 + leafOccupancy%2;
     bool insertLeftNode = compare<T>(thisKey, thisPage->keyArray[midIndex])<0;
 
-    bufMgr->unPinPage(file, pageNo, false);
+    leaf.release();
 
     PageId rightPageNo = splitLeafNode<T, T_NonLeafNode, T_LeafNode>(pageNo);
 
@@ -349,8 +470,14 @@ const PageId BTreeIndex::splitLeafNode(PageId pageNo)
 {
     Page *tempPage;
     PageId firstPageNo = pageNo;
-    bufMgr->readPage(file, firstPageNo, tempPage);
-    T_LeafNode* firstPage = reinterpret_cast<T_LeafNode*>(tempPage);
+    bool rootIsLeaf = rootPageNum == 2;
+
+    // a leaf root gets a new parent, which goes into the header page, so the
+    // header is fetched along with the leaf
+    PageId fetchPageNos[2] = { firstPageNo, headerPageNum };
+    Page* fetchedPages[2];
+    bufMgr->readPages(file, fetchPageNos, rootIsLeaf ? 2 : 1, fetchedPages);
+    T_LeafNode* firstPage = reinterpret_cast<T_LeafNode*>(fetchedPages[0]);
     PageId secondPageNo;
     bufMgr->allocPage(file, secondPageNo, tempPage);
     T_LeafNode* secondPage = reinterpret_cast<T_LeafNode*>(tempPage);
@@ -370,16 +497,14 @@ const PageId BTreeIndex::splitLeafNode(PageId pageNo)
     secondPage->size = leafOccupancy - midIndex;
 
     T copyUpKey;
-    copyKey((copyUpKey), ((firstPage->keyArray[midIndex])));
-
-    bool rootIsLeaf = rootPageNum == 2;
+    keyCopy((copyUpKey), ((firstPage->keyArray[midIndex])));
 
     if ( !rootIsLeaf ) {
       PageId firstPageParentNo = findParentOf<T, T_NonLeafNode, T_LeafNode>
         (firstPageNo, firstPage->keyArray[firstPage->size-1]);
       
-      bufMgr->unPinPage(file, firstPageNo, true);
-      bufMgr->unPinPage(file, secondPageNo, true);
+      PageId splitPageNos[2] = { firstPageNo, secondPageNo };
+      bufMgr->unPinPages(file, splitPageNos, 2, true);
       insertNonLeafNode<T, T_NonLeafNode, T_LeafNode>
         (firstPageParentNo, copyUpKey, secondPageNo);
     } else { 
@@ -388,17 +513,14 @@ const PageId BTreeIndex::splitLeafNode(PageId pageNo)
       T_NonLeafNode* parentPage = reinterpret_cast<T_NonLeafNode*>(tempPage);
 
       rootPageNum = parentPageNo;
-      bufMgr->readPage(file, headerPageNum, tempPage);
-      IndexMetaInfo* metaPage = reinterpret_cast<IndexMetaInfo*>(tempPage);
+      IndexMetaInfo* metaPage = reinterpret_cast<IndexMetaInfo*>(fetchedPages[1]);
       metaPage->rootPageNo = parentPageNo;
-      bufMgr->unPinPage(file, headerPageNum, true);
-
-      bufMgr->unPinPage(file, firstPageNo, true);
-      bufMgr->unPinPage(file, secondPageNo, true);
+      PageId splitPageNos[3] = { headerPageNum, firstPageNo, secondPageNo };
+      bufMgr->unPinPages(file, splitPageNos, 3, true);
 
       parentPage->level = 1; 
       parentPage->size = 1;  
-      copyKey(((parentPage->keyArray[0])), ((copyUpKey)));
+      keyCopy(((parentPage->keyArray[0])), ((copyUpKey)));
       parentPage->pageNoArray[0] = firstPageNo;
       parentPage->pageNoArray[1] = secondPageNo;
 
@@ -415,11 +537,10 @@ const PageId BTreeIndex::splitLeafNode(PageId pageNo)
 template<class T, class T_NonLeafNode, class T_LeafNode>
 const void BTreeIndex::insertNonLeafNode(PageId pageNo, T &key, PageId childPageNo)
 {
-    Page *tempPage;
-    bufMgr->readPage(file, pageNo, tempPage);
-    T_NonLeafNode* thisPage = reinterpret_cast<T_NonLeafNode*>(tempPage);
+    PageGuard node = bufMgr->fetchPage(file, pageNo);
+    T_NonLeafNode* thisPage = node.as<T_NonLeafNode>();
     T thisKey;
-    copyKey(thisKey, key);
+    keyCopy(thisKey, key);
     int size = thisPage->size;
     if ( size < nodeOccupancy ) {
     int index = getIndex<T, T_NonLeafNode>(thisPage, thisKey);
@@ -430,10 +551,10 @@ const void BTreeIndex::insertNonLeafNode(PageId pageNo, T &key, PageId childPage
               (void*)(&(thisPage->pageNoArray[index+1])), sizeof(PageId)*(size-index));
 
       // inserts current key
-      copyKey(thisPage->keyArray[index], thisKey);
+      keyCopy(thisPage->keyArray[index], thisKey);
       thisPage->pageNoArray[index+1] = childPageNo;
       (thisPage->size)++;
-      bufMgr->unPinPage(file, pageNo, true);
+      node.markDirty();
     } else {
 
       int midIndex = nodeOccupancy/2;
@@ -445,7 +566,7 @@ const void BTreeIndex::insertNonLeafNode(PageId pageNo, T &key, PageId childPage
         insertLeftNode = compare<T>(thisKey, thisPage->keyArray[midIndex])<0;
       }
 
-      bufMgr->unPinPage(file, pageNo, false);
+      node.release();
 
       PageId rightPageNo = splitNonLeafNode<T, T_NonLeafNode, T_LeafNode>
         (pageNo, midIndex);
@@ -487,10 +608,10 @@ const PageId BTreeIndex::splitNonLeafNode(PageId pageNo, int midIndex)
     secondPage->size = nodeOccupancy - midIndex -1; 
 
     T pushUpKey;
-    copyKey(pushUpKey, firstPage->keyArray[midIndex]);
+    keyCopy(pushUpKey, firstPage->keyArray[midIndex]);
 
-      bufMgr->unPinPage(file, firstPageNo, true);
-      bufMgr->unPinPage(file, secondPageNo, true);
+    PageId splitPageNos[2] = { firstPageNo, secondPageNo };
+    bufMgr->unPinPages(file, splitPageNos, 2, true);
 
     bool currentNodeIsRoot = rootPageNum == firstPageNo;
 
@@ -509,15 +630,15 @@ const PageId BTreeIndex::splitNonLeafNode(PageId pageNo, int midIndex)
       bufMgr->readPage(file, headerPageNum, tempPage);
       IndexMetaInfo* metaPage = reinterpret_cast<IndexMetaInfo*>(tempPage);
       metaPage->rootPageNo = parentPageNo;
-      bufMgr->unPinPage(file, headerPageNum, true);
 
       parentPage->level = 0;
       parentPage->size = 1;
-      copyKey(((parentPage->keyArray[0])),((pushUpKey)));
+      keyCopy(((parentPage->keyArray[0])),((pushUpKey)));
       parentPage->pageNoArray[0] = firstPageNo;
       parentPage->pageNoArray[1] = secondPageNo;
       
-      bufMgr->unPinPage(file, parentPageNo, true);
+      PageId rootPageNos[2] = { headerPageNum, parentPageNo };
+      bufMgr->unPinPages(file, rootPageNos, 2, true);
     }
     return secondPageNo;
 }
@@ -526,18 +647,17 @@ const PageId BTreeIndex::splitNonLeafNode(PageId pageNo, int midIndex)
 template< class T, class T_NonLeafNode, class T_LeafNode>
 const PageId BTreeIndex::findParentOf(PageId childPageNo, T &key)
 {
-  Page *tempPage;
   PageId nextPageNo = rootPageNum;
   PageId parentNodeNo = 0;
   while ( 1 ) {
-    bufMgr->readPage(file, nextPageNo, tempPage);
-    T_NonLeafNode* thisPage = reinterpret_cast<T_NonLeafNode*>(tempPage);
+    PageGuard node = bufMgr->fetchPage(file, nextPageNo);
+    T_NonLeafNode* thisPage = node.as<T_NonLeafNode>();
     
     int index = getIndex<T, T_NonLeafNode>(thisPage, key);
 
     parentNodeNo = nextPageNo;
     nextPageNo = thisPage-> pageNoArray[index];
-    bufMgr->unPinPage(file, parentNodeNo, false);
+    node.release();
 
     if ( nextPageNo == childPageNo )  {
       break;
@@ -570,63 +690,50 @@ template <class T, class T_NonLeafNode, class T_LeafNode>
 const void BTreeIndex::printTree() 
 {
   std::cout<<"Printing Tree" << std::endl;
-  Page *tempPage;
   PageId currNo = rootPageNum;
 
   bool rootIsLeaf = rootPageNum == 2;
-  bufMgr->readPage(file, currNo, tempPage);
+  PageGuard node = bufMgr->fetchPage(file, currNo);
 
   int lineSize = 20;
 
-  try {
-    if ( rootIsLeaf ) {
-      // print the root
-      T_LeafNode *currPage = reinterpret_cast<T_LeafNode*>(tempPage);
-      int size = currPage->size;
+  if ( rootIsLeaf ) {
+    // print the root
+    T_LeafNode *currPage = node.as<T_LeafNode>();
+    int size = currPage->size;
   std::cout<<" Root is leaf with size "<<size<<std::endl;
   std::cout<<std::endl<<" PageId: "<<currNo<<std::endl;
+    for ( int i = 0 ; i < size ; ++i) {
+      if ( i%lineSize == 0 ) std::cout<<std::endl<<i<<": ";
+      std::cout<<currPage->keyArray[i]<<" ";
+    }
+    std::cout<<std::endl<<"Root Leaf B-Tree printed"<<std::endl;
+  } else {
+    T_NonLeafNode *currPage = node.as<T_NonLeafNode>();
+    while ( currPage->level != 1 ) {
+      currNo = currPage->pageNoArray[0];
+      node = bufMgr->fetchPage(file, currNo);
+      currPage = node.as<T_NonLeafNode>();
+    }
+
+    currNo = currPage->pageNoArray[0];
+    node = bufMgr->fetchPage(file, currNo);
+    T_LeafNode *currLeafPage = node.as<T_LeafNode>();
+    while ( 1 ) {
+      int size = currLeafPage->size;
+      std::cout<<std::endl<<" PageId: "<<currNo<<std::endl;
       for ( int i = 0 ; i < size ; ++i) {
         if ( i%lineSize == 0 ) std::cout<<std::endl<<i<<": ";
-        std::cout<<currPage->keyArray[i]<<" ";
-      }
-      std::cout<<std::endl<<"Root Leaf B-Tree printed"<<std::endl;
-      bufMgr->unPinPage(file, currNo, false);
-    } else {
-      T_NonLeafNode *currPage = reinterpret_cast<T_NonLeafNode*>(tempPage);
-      while ( currPage->level != 1 ) {
-        PageId nextPageNo = currPage->pageNoArray[0];
-        bufMgr->unPinPage(file, currNo, false);
-        currNo = nextPageNo;
-        bufMgr->readPage(file, currNo, tempPage);
-        currPage = reinterpret_cast<T_NonLeafNode*>(tempPage);
-      }
-
-      PageId leafNo = currPage->pageNoArray[0];
-      bufMgr->unPinPage(file, currNo, false);
-
-      currNo = leafNo;
-      bufMgr->readPage(file, currNo, tempPage);
-      T_LeafNode *currLeafPage = reinterpret_cast<T_LeafNode*>(tempPage);
-      while ( 1 ) {
-        int size = currLeafPage->size;
-        std::cout<<std::endl<<" PageId: "<<currNo<<std::endl;
-        for ( int i = 0 ; i < size ; ++i) {
-          if ( i%lineSize == 0 ) std::cout<<std::endl<<i<<": ";
-          std::cout<<currLeafPage->keyArray[i]<<" ";
-        }
-        std::cout<<std::endl;
-        bufMgr->unPinPage(file, currNo, false);
-        if ( currLeafPage->rightSibPageNo == 0 ) break;
-        currNo = currLeafPage->rightSibPageNo;
-        bufMgr->readPage(file, currNo, tempPage);
-        currLeafPage = reinterpret_cast<T_LeafNode*>(tempPage);
+        std::cout<<currLeafPage->keyArray[i]<<" ";
       }
-      std::cout<<std::endl<<"B-Tree printed"<<std::endl;
-      bufMgr->unPinPage(file, currNo, false);
+      std::cout<<std::endl;
+      if ( currLeafPage->rightSibPageNo == 0 ) break;
+      currNo = currLeafPage->rightSibPageNo;
+      node = bufMgr->fetchPage(file, currNo);
+      currLeafPage = node.as<T_LeafNode>();
     }
-  } catch ( PageNotPinnedException e ) {
+    std::cout<<std::endl<<"B-Tree printed"<<std::endl;
   }
-  
 }
 
 // -----------------------------------------------------------------------------
@@ -635,6 +742,9 @@ const void BTreeIndex::printTree()
 
 const void BTreeIndex::deleteEntry(const void* key)
 {
+    if ( mapping ) {
+      throw IndexReadOnlyException(file->filename());
+    }
     if ( attributeType == INTEGER ) {
         int intKey = *(int*)key;
         PageId leafToDelete = findLeafNode<int, struct NonLeafNodeInt>
@@ -672,7 +782,7 @@ const void BTreeIndex::deleteLeafNode(PageId pageNo, T& key)
   int index = getIndex<T, T_LeafNode>(thisPage, key);
   if ( index == -1 ) {
     bufMgr->unPinPage(file, pageNo, false);
-    throw EmptyBTreeException();
+    throw TreeEmptyException();
   }
 
   if ( compare(thisPage->keyArray[index], key) != 0 ) {
@@ -701,19 +811,21 @@ const void BTreeIndex::deleteLeafNode(PageId pageNo, T& key)
     PageId parentPageNo = findParentOf<T, T_NonLeafNode, T_LeafNode>
       (pageNo, thisPage->keyArray[thisSize-1]);
 
-    bufMgr->readPage(file, parentPageNo, tempPage);
-    T_NonLeafNode* parentPage = reinterpret_cast<T_NonLeafNode*>(tempPage);
-
+    // parent and right sibling are fetched together
     PageId rightPageNo = thisPage->rightSibPageNo;
+    PageId familyPageNos[2] = { parentPageNo, rightPageNo };
+    Page* familyPages[2];
+    bufMgr->readPages(file, familyPageNos, rightPageNo != 0 ? 2 : 1, familyPages);
+    T_NonLeafNode* parentPage = reinterpret_cast<T_NonLeafNode*>(familyPages[0]);
 
+    T_LeafNode* rightPage = NULL;
     if ( rightPageNo != 0 ) {
-      bufMgr->readPage(file, rightPageNo, tempPage);
-      T_LeafNode* rightPage = reinterpret_cast<T_LeafNode*>(tempPage);
+      rightPage = reinterpret_cast<T_LeafNode*>(familyPages[1]);
       int rightPageSize = rightPage->size;
       if ( rightPageSize > leafHalfFillNo ) { 
         int pindex = getIndex<T, T_NonLeafNode>(parentPage, rightPage->keyArray[0]);
-        copyKey(parentPage->keyArray[pindex], rightPage->keyArray[1]);
-        copyKey(thisPage->keyArray[thisSize], rightPage->keyArray[0]);
+        keyCopy(parentPage->keyArray[pindex], rightPage->keyArray[1]);
+        keyCopy(thisPage->keyArray[thisSize], rightPage->keyArray[0]);
         thisPage->ridArray[thisSize] = rightPage->ridArray[0];
         memmove((void*)(&(rightPage->keyArray[0])),
                 (void*)(&(rightPage->keyArray[1])), sizeof(T)*(rightPageSize-1));
@@ -721,15 +833,14 @@ const void BTreeIndex::deleteLeafNode(PageId pageNo, T& key)
                 (void*)(&(rightPage->ridArray[1])), sizeof(RecordId)*(rightPageSize-1));
         (rightPage->size)--;
         (thisPage->size)++;
-        bufMgr->unPinPage(file, pageNo, true);
-        bufMgr->unPinPage(file, rightPageNo, true);
-        bufMgr->unPinPage(file, parentPageNo, true);
+        PageId borrowPageNos[3] = { pageNo, rightPageNo, parentPageNo };
+        bufMgr->unPinPages(file, borrowPageNos, 3, true);
         return;
       } else {
+        // the right sibling stays pinned for the merge
         needToMerge = true;
         firstPageNo = pageNo;
         secondPageNo = rightPageNo;
-        bufMgr->unPinPage(file, rightPageNo, false);
       }
     }
 
@@ -741,34 +852,36 @@ const void BTreeIndex::deleteLeafNode(PageId pageNo, T& key)
       int leftPageSize = leftPage->size;
 
       if ( leftPageSize > leafHalfFillNo ) { 
-        copyKey(parentPage->keyArray[pindex], leftPage->keyArray[leftPageSize-1]);
+        keyCopy(parentPage->keyArray[pindex], leftPage->keyArray[leftPageSize-1]);
         memmove((void*)(&(thisPage->keyArray[1])),
                 (void*)(&(thisPage->keyArray[0])), sizeof(T)*(thisSize));
         memmove((void*)(&(thisPage->ridArray[1])),
                 (void*)(&(thisPage->ridArray[0])), sizeof(RecordId)*(thisSize));
-        copyKey(thisPage->keyArray[0], leftPage->keyArray[leftPageSize-1]);
+        keyCopy(thisPage->keyArray[0], leftPage->keyArray[leftPageSize-1]);
         thisPage->ridArray[0] = leftPage->ridArray[leftPageSize-1];
         (leftPage->size)--;
         (thisPage->size)++;
-        bufMgr->unPinPage(file, pageNo, true);
-        bufMgr->unPinPage(file, leftPageNo, true);
-        bufMgr->unPinPage(file, parentPageNo, true);
+        PageId borrowPageNos[3] = { pageNo, leftPageNo, parentPageNo };
+        bufMgr->unPinPages(file, borrowPageNos, 3, true);
+        if ( needToMerge )
+          bufMgr->unPinPage(file, rightPageNo, false);
         return;
       } else {
         bufMgr->unPinPage(file, leftPageNo, false);
       }
     }
-    bufMgr->unPinPage(file, pageNo, true);
 
     if ( needToMerge ) {
-      bufMgr->readPage(file, firstPageNo, tempPage);
-      T_LeafNode* firstPage = reinterpret_cast<T_LeafNode*>(tempPage);
-      bufMgr->readPage(file, secondPageNo, tempPage);
-      T_LeafNode* secondPage = reinterpret_cast<T_LeafNode*>(tempPage);
+      // this page and its right sibling are still pinned from above
+      T_LeafNode* firstPage = thisPage;
+      T_LeafNode* secondPage = rightPage;
 
       int size1 = firstPage->size, size2 = secondPage->size;
       if ( size1+size2 > leafOccupancy) {
         std::cout<<"Size larger than occupancy\n";
+        bufMgr->unPinPage(file, secondPageNo, false);
+        PageId keptPageNos[2] = { firstPageNo, parentPageNo };
+        bufMgr->unPinPages(file, keptPageNos, 2, true);
         return;
       }
 
@@ -782,12 +895,13 @@ const void BTreeIndex::deleteLeafNode(PageId pageNo, T& key)
       bufMgr->unPinPage(file, secondPageNo, false);
 
       T key;
-      copyKey(key, firstPage->keyArray[0]);
-      bufMgr->unPinPage(file, firstPageNo, true);
-      bufMgr->unPinPage(file, parentPageNo, true);
+      keyCopy(key, firstPage->keyArray[0]);
+      PageId mergedPageNos[2] = { firstPageNo, parentPageNo };
+      bufMgr->unPinPages(file, mergedPageNos, 2, true);
       deleteNonLeafNode<T, T_NonLeafNode, T_LeafNode>(parentPageNo, key);
     } else {
-      bufMgr->unPinPage(file, parentPageNo, true);
+      PageId keptPageNos[2] = { pageNo, parentPageNo };
+      bufMgr->unPinPages(file, keptPageNos, 2, true);
     }
   }
 }
@@ -800,11 +914,11 @@ const void BTreeIndex::deleteLeafNode(PageId pageNo, T& key)
 template<class T, class T_NonLeafNode, class T_LeafNode>
 const void BTreeIndex::mergeLeafNode(PageId firstPageNo, PageId secondPageNo)
 {
-  Page* tempPage;
-  bufMgr->readPage(file, firstPageNo, tempPage);
-  T_LeafNode* firstPage = reinterpret_cast<T_LeafNode*>(tempPage);
-  bufMgr->readPage(file, secondPageNo, tempPage);
-  T_LeafNode* secondPage = reinterpret_cast<T_LeafNode*>(tempPage);
+  PageId mergePageNos[2] = { firstPageNo, secondPageNo };
+  Page* mergePages[2];
+  bufMgr->readPages(file, mergePageNos, 2, mergePages);
+  T_LeafNode* firstPage = reinterpret_cast<T_LeafNode*>(mergePages[0]);
+  T_LeafNode* secondPage = reinterpret_cast<T_LeafNode*>(mergePages[1]);
 
   int size1 = firstPage->size, size2 = secondPage->size;
 
@@ -826,7 +940,7 @@ const void BTreeIndex::mergeLeafNode(PageId firstPageNo, PageId secondPageNo)
   PageId parentPageNo = findParentOf<T, T_NonLeafNode, T_LeafNode>
     (firstPageNo, firstPage->keyArray[size1-1]);
   T key;
-  copyKey(key, firstPage->keyArray[0]);
+  keyCopy(key, firstPage->keyArray[0]);
   bufMgr->unPinPage(file, firstPageNo, true);
   deleteNonLeafNode<T, T_NonLeafNode, T_LeafNode>(parentPageNo, key);
 }
@@ -873,75 +987,78 @@ const void BTreeIndex::deleteNonLeafNode(PageId pageNo, T& key)
     return;
   }
   {
-    bool needToMerge = false;
-    PageId firstPageNo = 0, secondPageNo = 0;
-
     PageId parentPageNo = findParentOf<T, T_NonLeafNode, T_LeafNode>
       (pageNo, thisPage->keyArray[thisSize-1]);
     bufMgr->readPage(file, parentPageNo, tempPage);
     T_NonLeafNode* parentPage = reinterpret_cast<T_NonLeafNode*>(tempPage);
     int pindex = getIndex<T, T_NonLeafNode>(parentPage, thisPage->keyArray[thisSize-1]);
 
-    if ( pindex < parentPage->size ) { // try right page 
-      PageId rightPageNo = parentPage->pageNoArray[pindex+1];
-      bufMgr->readPage(file, rightPageNo, tempPage);
-      T_NonLeafNode* rightPage = reinterpret_cast<T_NonLeafNode*>(tempPage);
+    // the siblings are only known from the parent; both are fetched together
+    bool hasRight = pindex < parentPage->size;
+    bool hasLeft = pindex > 0;
+    PageId rightPageNo = hasRight ? parentPage->pageNoArray[pindex+1] : 0;
+    PageId leftPageNo = hasLeft ? parentPage->pageNoArray[pindex-1] : 0;
+    PageId siblingPageNos[2];
+    Page* siblingPages[2];
+    std::uint32_t numSiblings = 0;
+    if ( hasRight )
+      siblingPageNos[numSiblings++] = rightPageNo;
+    if ( hasLeft )
+      siblingPageNos[numSiblings++] = leftPageNo;
+    bufMgr->readPages(file, siblingPageNos, numSiblings, siblingPages);
+    T_NonLeafNode* rightPage = hasRight ? reinterpret_cast<T_NonLeafNode*>(siblingPages[0]) : NULL;
+    T_NonLeafNode* leftPage = hasLeft ? reinterpret_cast<T_NonLeafNode*>(siblingPages[numSiblings-1]) : NULL;
+
+    if ( hasRight && rightPage->size > nodeHalfFillNo ) { // just borrow one
       int rightPageSize = rightPage->size;
+      keyCopy(thisPage->keyArray[thisSize], parentPage->keyArray[pindex]);
+      thisPage->pageNoArray[thisSize+1] = rightPage->pageNoArray[0];
+      keyCopy(parentPage->keyArray[pindex], rightPage->keyArray[0]);
+      memmove((void*)(&(rightPage->keyArray[0])),
+              (void*)(&(rightPage->keyArray[1])), sizeof(T)*(rightPageSize-1));
+      memmove((void*)(&(rightPage->pageNoArray[0])),
+              (void*)(&(rightPage->pageNoArray[1])), sizeof(PageId)*(rightPageSize));
 
-      if ( rightPageSize > nodeHalfFillNo ) { // just borrow one
-        copyKey(thisPage->keyArray[thisSize], parentPage->keyArray[pindex]);
-        thisPage->pageNoArray[thisSize+1] = rightPage->pageNoArray[0];
-        copyKey(parentPage->keyArray[pindex], rightPage->keyArray[0]);
-        memmove((void*)(&(rightPage->keyArray[0])),
-                (void*)(&(rightPage->keyArray[1])), sizeof(T)*(rightPageSize-1));
-        memmove((void*)(&(rightPage->pageNoArray[0])),
-                (void*)(&(rightPage->pageNoArray[1])), sizeof(PageId)*(rightPageSize));
-
-        (thisPage->size)++;
-        (rightPage->size)--;
-        bufMgr->unPinPage(file, pageNo, true);
-        bufMgr->unPinPage(file, parentPageNo, true);
-        bufMgr->unPinPage(file, rightPageNo, true);
-        return;
-      } else { 
-        needToMerge = true;
-        firstPageNo = pageNo;
-        secondPageNo = rightPageNo;
-        bufMgr->unPinPage(file, rightPageNo, false);
-      }
+      (thisPage->size)++;
+      (rightPage->size)--;
+      PageId borrowPageNos[3] = { pageNo, parentPageNo, rightPageNo };
+      bufMgr->unPinPages(file, borrowPageNos, 3, true);
+      if ( hasLeft )
+        bufMgr->unPinPage(file, leftPageNo, false);
+      return;
     }
 
-    { 
-      PageId leftPageNo = parentPage->pageNoArray[pindex-1];
-      bufMgr->readPage(file, leftPageNo, tempPage);
-      T_NonLeafNode* leftPage = reinterpret_cast<T_NonLeafNode*>(tempPage);
+    if ( hasLeft && leftPage->size > nodeHalfFillNo ) {
       int leftPageSize = leftPage->size;
+      // space allocation
+      memmove((void*)(&(thisPage->keyArray[1])),
+              (void*)(&(thisPage->keyArray[0])), sizeof(T)*(thisSize));
+      memmove((void*)(&(thisPage->pageNoArray[1])),
+              (void*)(&(thisPage->pageNoArray[0])), sizeof(PageId)*(thisSize+1));
+      // key to page
+      keyCopy(thisPage->keyArray[0], parentPage->keyArray[pindex]);
+      thisPage->pageNoArray[0] = leftPage->pageNoArray[leftPageSize];
+      // key to parent
+      keyCopy(parentPage->keyArray[pindex], leftPage->keyArray[leftPageSize-1]);
+      (thisPage->size)++;
+      (leftPage->size)--;
+      PageId borrowPageNos[3] = { pageNo, parentPageNo, leftPageNo };
+      bufMgr->unPinPages(file, borrowPageNos, 3, true);
+      if ( hasRight )
+        bufMgr->unPinPage(file, rightPageNo, false);
+      return;
+    }
 
-      if ( leftPageSize > nodeHalfFillNo ) { 
-        // space allocation
-        memmove((void*)(&(thisPage->keyArray[1])),
-                (void*)(&(thisPage->keyArray[0])), sizeof(T)*(thisSize));
-        memmove((void*)(&(thisPage->pageNoArray[1])),
-                (void*)(&(thisPage->pageNoArray[0])), sizeof(PageId)*(thisSize+1));
-        // key to page
-        copyKey(thisPage->keyArray[0], parentPage->keyArray[pindex]);
-        thisPage->pageNoArray[0] = leftPage->pageNoArray[leftPageSize];
-        // key to parent
-        copyKey(parentPage->keyArray[pindex], leftPage->keyArray[leftPageSize-1]);
-        (thisPage->size)++;
-        (leftPage->size)--;
-        bufMgr->unPinPage(file, pageNo, true);
-        bufMgr->unPinPage(file, parentPageNo, true);
-        bufMgr->unPinPage(file, leftPageNo, true);
-        return;
-      } else { 
-        bufMgr->unPinPage(file, leftPageNo, false);
-      }
+    if ( hasLeft )
+      bufMgr->unPinPage(file, leftPageNo, false);
+    if ( hasRight ) {
+      // this page, its right sibling and the parent stay pinned for the merge
+      mergeNonLeafNode<T, T_NonLeafNode, T_LeafNode>
+        (pageNo, thisPage, rightPageNo, rightPage, parentPageNo, parentPage);
+    } else {
+      PageId familyPageNos[2] = { pageNo, parentPageNo };
+      bufMgr->unPinPages(file, familyPageNos, 2, true);
     }
-    bufMgr->unPinPage(file, pageNo, true);
-    bufMgr->unPinPage(file, parentPageNo, true);
-    if (needToMerge) 
-      mergeNonLeafNode<T, T_NonLeafNode, T_LeafNode>(firstPageNo, secondPageNo);
   }
 }
 
@@ -950,38 +1067,33 @@ const void BTreeIndex::deleteNonLeafNode(PageId pageNo, T& key)
 // -----------------------------------------------------------------------------
 
 template<class T, class T_NonLeafNode, class T_LeafNode>
-const void BTreeIndex::mergeNonLeafNode(PageId firstPageNo, PageId secondPageNo)
+const void BTreeIndex::mergeNonLeafNode(PageId firstPageNo, T_NonLeafNode* firstPage,
+                                        PageId secondPageNo, T_NonLeafNode* secondPage,
+                                        PageId parentPageNo, T_NonLeafNode* parentPage)
 {
-  Page* tempPage;
-  bufMgr->readPage(file, firstPageNo, tempPage);
-  T_NonLeafNode* firstPage = reinterpret_cast<T_NonLeafNode*>(tempPage);
-  bufMgr->readPage(file, secondPageNo, tempPage);
-  T_NonLeafNode* secondPage = reinterpret_cast<T_NonLeafNode*>(tempPage);
-
   int size1 = firstPage->size, size2 = secondPage->size;
   if ( size1+size2 > nodeOccupancy) {
     std::cout<<"Size larger occupancy\n";
+    bufMgr->unPinPage(file, secondPageNo, false);
+    PageId keptPageNos[2] = { firstPageNo, parentPageNo };
+    bufMgr->unPinPages(file, keptPageNos, 2, true);
     return;
   }
 
-
-  PageId parentPageNo = findParentOf<T, T_NonLeafNode, T_LeafNode>
-    (firstPageNo, firstPage->keyArray[size1-1]);
-  bufMgr->readPage(file, parentPageNo, tempPage);
-  T_NonLeafNode* parentPage = reinterpret_cast<T_NonLeafNode*>(tempPage);
   int pindex = getIndex<T, T_NonLeafNode>(parentPage, firstPage->keyArray[size1-1]);
 
   // Entry combination
-  copyKey(firstPage->keyArray[size1], parentPage->keyArray[pindex]);
+  keyCopy(firstPage->keyArray[size1], parentPage->keyArray[pindex]);
   memmove((void*)(&( firstPage->keyArray[size1+1])),
           (void*)(&(secondPage->keyArray[0])), sizeof(T)*(size2));
   memmove((void*)(&( firstPage->pageNoArray[size1+1])),
-          (void*)(&(secondPage->pageNoArray[0])), sizeof(RecordId)*(size2+1));
+          (void*)(&(secondPage->pageNoArray[0])), sizeof(PageId)*(size2+1));
   firstPage->size = size1+size2+1; 
   bufMgr->unPinPage(file, secondPageNo, false);
   T key;
-  copyKey(key, firstPage->keyArray[0]);
-  bufMgr->unPinPage(file, firstPageNo, true);
+  keyCopy(key, firstPage->keyArray[0]);
+  PageId mergedPageNos[2] = { firstPageNo, parentPageNo };
+  bufMgr->unPinPages(file, mergedPageNos, 2, true);
   deleteNonLeafNode<T, T_NonLeafNode, T_LeafNode>(parentPageNo, key);
 }
 
@@ -1037,21 +1149,25 @@ const void BTreeIndex::startScan(const void* lowValParm,
 template<class T, class T_NonLeafNode, class T_LeafNode>
 const void BTreeIndex::startScanHelper(T &lowVal, T &highVal)
 {
-      if ( lowVal > highVal ) {
+      if ( compare<T>(lowVal, highVal) > 0 ) {
         scanExecuting = false;
         throw BadScanrangeException();
       }
       currentPageNum = findLeafNode<T, T_NonLeafNode>(rootPageNum, lowVal);
 
-      bufMgr->readPage(file, currentPageNum, currentPageData);
+      if ( mapping ) {
+        currentMappedPage = mapping->page(currentPageNum);
+      } else {
+        currentPage = bufMgr->fetchPage(file, currentPageNum);
+      }
       T_LeafNode* thisPage;
-      thisPage = reinterpret_cast<T_LeafNode*>(currentPageData);
+      thisPage = currentNode<T_LeafNode>();
       
       int size = thisPage->size;
       if ( compare<T>(lowVal, thisPage->keyArray[size-1]) > 0 ) {
         nextEntry = size-1;
         shiftToNextEntry<T_LeafNode>(thisPage);
-        thisPage = reinterpret_cast<T_LeafNode*>(currentPageData);
+        thisPage = currentNode<T_LeafNode>();
       } else {
         nextEntry = getIndex<T, T_LeafNode>(thisPage, lowVal);
       }
@@ -1096,7 +1212,7 @@ const void BTreeIndex::scanNextHelper(RecordId & outRid, T lowVal, T highVal)
     if ( nextEntry == -1 ) 
       throw IndexScanCompletedException();
 
-    T_LeafNode* thisPage = reinterpret_cast<T_LeafNode*>(currentPageData);
+    T_LeafNode* thisPage = currentNode<T_LeafNode>();
 
     if ( compare<T>(thisPage->keyArray[nextEntry], highVal) > 0 ) {
       throw IndexScanCompletedException();
@@ -1121,7 +1237,8 @@ const void BTreeIndex::endScan()
   }
 
   // unpins scanned pages
-  bufMgr->unPinPage(file, currentPageNum, false);
+  currentPage.release();
+  currentMappedPage = NULL;
 
 }
 
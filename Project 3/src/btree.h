@@ -11,11 +11,14 @@
 #include <string>
 #include "string.h"
 #include <sstream>
+#include <memory>
 
 #include "types.h"
 #include "page.h"
 #include "file.h"
+#include "file_map.h"
 #include "buffer.h"
+#include "bufPoolSet.h"
 
 namespace badgerdb
 {
@@ -401,9 +404,20 @@ class BTreeIndex {
 	PageId	currentPageNum;
 
   /**
-   * Current Page being scanned.
+   * Current Page being scanned, kept pinned while the scan is on it.
    */
-	Page		*currentPageData;
+	PageGuard	currentPage;
+
+  /**
+   * Current Page being scanned when the index is mapped, in the mapping.
+   */
+	const Page	*currentMappedPage;
+
+  /**
+   * Read-only mapping of the index file, or NULL while pages are read
+   * through the buffer manager.
+   */
+	std::unique_ptr<FileMap>	mapping;
 
   /**
    * Low INTEGER value for scan.
@@ -449,12 +463,37 @@ class BTreeIndex {
     Operator	highOp;
 
 
+    /**
+     * Returns the node in the page with the given number, read in place from
+     * the mapping.  Must only be called while the index is mapped.
+     */
+    template<class T_NodeType>
+    T_NodeType* mappedNode(PageId pageNo);
+
+    /**
+     * Returns the node in the page the scan is on.
+     */
+    template<class T_NodeType>
+    T_NodeType* currentNode();
+
+    /**
+     * Moves the scan to the page with the given number, pinning it unless the
+     * index is mapped, and has the page after it read in ahead.
+     */
+    template<class T_NodeType>
+    const void moveScanTo(PageId pageNo);
+
     /**
      * Create the intial BTree from given relation
      * @param relationName Name of the file that stores the relation
      */
     const void buildBTree(const std::string & relationName);
 
+    /**
+     * Returns the name of the index file on attrByteOffset of relationName.
+     */
+    static std::string indexFileName(const std::string & relationName, const int attrByteOffset);
+
 
     /**
      * print the tree
@@ -582,13 +621,20 @@ class BTreeIndex {
 
 
     /**
-     * Merge two succssive non leaf nodes
+     * Merge two succssive non leaf nodes.  The caller has both nodes and
+     * their parent pinned; the pins are dropped here.
      *
      * @param firstPageNo
+     * @param firstPage
      * @param secondPageNo
+     * @param secondPage
+     * @param parentPageNo
+     * @param parentPage
      */
     template<class T, class T_NonLeafNode, class T_LeafNode>
-      const void mergeNonLeafNode(PageId firstPageNo, PageId secondPageNo);
+      const void mergeNonLeafNode(PageId firstPageNo, T_NonLeafNode* firstPage,
+                                  PageId secondPageNo, T_NonLeafNode* secondPage,
+                                  PageId parentPageNo, T_NonLeafNode* parentPage);
 
 
 
@@ -647,6 +693,19 @@ class BTreeIndex {
     BTreeIndex(const std::string & relationName, std::string & outIndexName,
         BufMgr *bufMgrIn,	const int attrByteOffset,	const Datatype attrType);
 
+    /**
+     * BTreeIndex Constructor using the buffer pool 'pools' assigns to the
+     * index file, e.g. a pool kept for index pages only.
+     *
+     * @param relationName    Name of file.
+     * @param outIndexName    Return the name of index file.
+     * @param pools		Buffer pools to pick the buffer manager from
+     * @param attrByteOffset  Offset of attribute, over which index is to be built, in the record
+     * @param attrType		Datatype of attribute over which index is built
+     */
+    BTreeIndex(const std::string & relationName, std::string & outIndexName,
+        BufferPoolSet *pools,	const int attrByteOffset,	const Datatype attrType);
+
 
     /**
      * BTreeIndex Destructor. 
@@ -670,6 +729,7 @@ class BTreeIndex {
      * Make sure to unpin pages as soon as you can.
      * @param key	 Key to insert, pointer to integer/double/char string
      * @param rid	 Record ID of a record whose entry is getting inserted into the index.
+     * @throws  IndexReadOnlyException  If the index is mapped read-only.
      **/
     const void insertEntry(const void* key, const RecordId rid);
 
@@ -683,11 +743,33 @@ class BTreeIndex {
      * its children and the metapage needs to be updated.
      *
      * @param key   Key to delete.
+     * @throws  IndexReadOnlyException  If the index is mapped read-only.
      */
     const void deleteEntry(const void* key);
 
 
 
+    /**
+     * Maps the index file read-only, after which lookups and scans read the
+     * nodes in place from the mapping instead of pinning them in the buffer
+     * pool, and insertEntry() and deleteEntry() are refused.  The file's pages
+     * are flushed and synced first.  Ends any scan in progress.
+     *
+     * @throws  IoErrorException  If the file cannot be synced or mapped.
+     */
+    const void mapReadOnly();
+
+    /**
+     * Unmaps an index mapped with mapReadOnly(), returning to reading nodes
+     * through the buffer manager.  Ends any scan in progress.
+     */
+    const void unmap();
+
+    /**
+     * Returns true while the index is mapped read-only.
+     */
+    bool isMapped() const { return mapping != NULL; }
+
     /**
      * public method print the whole tree
      */
@@ -15,100 +15,138 @@
 
 namespace badgerdb {
 
-int BufHashTbl::hash(const File* file, const PageId pageNo)
+BufHashTbl::BufHashTbl(int htSize)
+	: HTSIZE(1), numEntries(0)
 {
-  int tmp, value;
-  tmp = (long)file;  // cast of pointer to the file object to an integer
-  value = (tmp + pageNo) % HTSIZE;
-  return value;
+  // round up to a power of two so probe positions wrap with a mask
+  while (HTSIZE < (std::uint32_t)htSize)
+    HTSIZE <<= 1;
+  mask = HTSIZE - 1;
+
+  // allocate the flat bucket array; a NULL file marks an empty slot
+  ht = new hashBucket [HTSIZE];
+  for(std::uint32_t i=0; i < HTSIZE; i++)
+    ht[i].file = NULL;
 }
 
-BufHashTbl::BufHashTbl(int htSize)
-	: HTSIZE(htSize)
+BufHashTbl::~BufHashTbl()
 {
-  // allocate an array of pointers to hashBuckets
-  ht = new hashBucket* [htSize];
-  for(int i=0; i < HTSIZE; i++)
-    ht[i] = NULL;
+  delete [] ht;
 }
 
-BufHashTbl::~BufHashTbl()
+std::uint32_t BufHashTbl::findSlot(const File* file, const PageId pageNo) const
 {
-  for(int i = 0; i < HTSIZE; i++) {
-    hashBucket* tmpBuf = ht[i];
-    while (ht[i]) {
-      tmpBuf = ht[i];
-      ht[i] = ht[i]->next;
-      delete tmpBuf;
-    }
+  std::uint32_t index = hash(file, pageNo);
+  while (ht[index].file) {
+    if (ht[index].file == file && ht[index].pageNo == pageNo)
+      return index;
+    index = (index + 1) & mask;
   }
-  delete [] ht;
+  return HTSIZE;
 }
 
-void BufHashTbl::insert(const File* file, const PageId pageNo, const FrameId frameNo)
+void BufHashTbl::reserve(const std::uint32_t htSize)
 {
-  int index = hash(file, pageNo);
+  std::uint32_t newSize = HTSIZE;
+  while (newSize < htSize)
+    newSize <<= 1;
+  if (newSize == HTSIZE)
+    return;
+
+  hashBucket* oldHt = ht;
+  std::uint32_t oldSize = HTSIZE;
+
+  try
+  {
+    ht = new hashBucket [newSize];
+  }
+  catch (std::bad_alloc&)
+  {
+    ht = oldHt;
+  	throw HashTableException();
+  }
+  HTSIZE = newSize;
+  mask = HTSIZE - 1;
+  for(std::uint32_t i=0; i < HTSIZE; i++)
+    ht[i].file = NULL;
+
+  for(std::uint32_t i=0; i < oldSize; i++)
+	{
+    if (!oldHt[i].file)
+      continue;
+    std::uint32_t index = hash(oldHt[i].file, oldHt[i].pageNo);
+    while (ht[index].file)
+      index = (index + 1) & mask;
+    ht[index] = oldHt[i];
+  }
+  delete [] oldHt;
+}
 
-  hashBucket* tmpBuc = ht[index];
-  while (tmpBuc) {
-    if (tmpBuc->file == file && tmpBuc->pageNo == pageNo)
-  		throw HashAlreadyPresentException(tmpBuc->file->filename(), tmpBuc->pageNo, tmpBuc->frameNo);
-    tmpBuc = tmpBuc->next;
+void BufHashTbl::insert(const File* file, const PageId pageNo, const FrameId frameNo)
+{
+  std::uint32_t index = hash(file, pageNo);
+  while (ht[index].file) {
+    if (ht[index].file == file && ht[index].pageNo == pageNo)
+  		throw HashAlreadyPresentException(ht[index].file->filename(), ht[index].pageNo, ht[index].frameNo);
+    index = (index + 1) & mask;
   }
 
-  tmpBuc = new hashBucket;
-  if (!tmpBuc)
+  // an empty slot must remain, or probes for absent pages never end
+  if (numEntries + 1 >= HTSIZE)
   	throw HashTableException();
 
-  tmpBuc->file = (File*) file;
-  tmpBuc->pageNo = pageNo;
-  tmpBuc->frameNo = frameNo;
-  tmpBuc->next = ht[index];
-  ht[index] = tmpBuc;
+  ht[index].file = (File*) file;
+  ht[index].pageNo = pageNo;
+  ht[index].frameNo = frameNo;
+  numEntries++;
 }
 
-void BufHashTbl::lookup(const File* file, const PageId pageNo, FrameId &frameNo) 
+void BufHashTbl::lookup(const File* file, const PageId pageNo, FrameId &frameNo)
 {
-  int index = hash(file, pageNo);
-  hashBucket* tmpBuc = ht[index];
-  while (tmpBuc) {
-    if (tmpBuc->file == file && tmpBuc->pageNo == pageNo)
-    {
-      frameNo = tmpBuc->frameNo; // return frameNo by reference
-      return;
-    }
-    tmpBuc = tmpBuc->next;
-  }
+  if (!tryLookup(file, pageNo, frameNo))
+    throw HashNotFoundException(file->filename(), pageNo);
+}
+
+bool BufHashTbl::tryLookup(const File* file, const PageId pageNo, FrameId &frameNo) const
+{
+  std::uint32_t index = findSlot(file, pageNo);
+  if (index == HTSIZE)
+    return false;
 
-  throw HashNotFoundException(file->filename(), pageNo);
+  frameNo = ht[index].frameNo; // return frameNo by reference
+  return true;
 }
 
 void BufHashTbl::remove(const File* file, const PageId pageNo) {
 
-  int index = hash(file, pageNo);
-  hashBucket* tmpBuc = ht[index];
-  hashBucket* prevBuc = NULL;
+  if (!tryRemove(file, pageNo))
+    throw HashNotFoundException(file->filename(), pageNo);
+}
 
-  while (tmpBuc)
-	{
-    if (tmpBuc->file == file && tmpBuc->pageNo == pageNo)
-		{
-      if(prevBuc) 
-				prevBuc->next = tmpBuc->next;
-      else
-				ht[index] = tmpBuc->next;
+bool BufHashTbl::tryRemove(const File* file, const PageId pageNo) {
 
-      delete tmpBuc;
-      return;
-    }
-		else
+  std::uint32_t index = findSlot(file, pageNo);
+  if (index == HTSIZE)
+    return false;
+
+  // Backward shift deletion: walk the rest of the cluster and move back any
+  // entry whose home slot does not lie between the hole and its position.
+  std::uint32_t hole = index;
+  std::uint32_t next = (hole + 1) & mask;
+  while (ht[next].file)
+	{
+    std::uint32_t home = hash(ht[next].file, ht[next].pageNo);
+    if (((next - home) & mask) >= ((next - hole) & mask))
 		{
-      prevBuc = tmpBuc;
-      tmpBuc = tmpBuc->next;
+      ht[hole] = ht[next];
+      hole = next;
     }
+    next = (next + 1) & mask;
   }
 
-  throw HashNotFoundException(file->filename(), pageNo);
+  ht[hole].file = NULL;
+  numEntries--;
+  return true;
 }
 
 }
@@ -7,16 +7,38 @@
 
 #pragma once
 
+#include <cstdint>
 #include "file.h"
 
 namespace badgerdb {
 
+/**
+ * Mixes a (file, pageNo) pair into a well distributed 64 bit hash value.
+ * Consecutive page numbers of one file land far apart in the table.
+ *
+ * @param file   	File object
+ * @param pageNo  Page number in the file
+ * @return  			Hash value.
+ */
+inline std::uint64_t hashPage(const File* file, const PageId pageNo)
+{
+  std::uint64_t h = (std::uint64_t)(std::uintptr_t)file;
+  h ^= (std::uint64_t)pageNo * 0x9E3779B97F4A7C15ULL;
+  // murmur3 64 bit finalizer
+  h ^= h >> 33;
+  h *= 0xFF51AFD7ED558CCDULL;
+  h ^= h >> 33;
+  h *= 0xC4CEB9FE1A85EC53ULL;
+  h ^= h >> 33;
+  return h;
+}
+
 /**
 * @brief Declarations for buffer pool hash table
 */
 struct hashBucket {
 	/**
-	 * pointer a file object (more on this below)
+	 * pointer a file object (more on this below). NULL marks an empty slot.
 	 */
 	File *file;
 
@@ -29,30 +51,42 @@ struct hashBucket {
 	 * frame number of page in the buffer pool
 	 */
 	FrameId frameNo;
-
-	/**
-	 * Next node in the hash table
-	 */
-	hashBucket*   next;
 };
 
 
 /**
 * @brief Hash table class to keep track of pages in the buffer pool
 *
+* The table is a flat array of buckets using open addressing with linear
+* probing.  Removal shifts later entries of the probe sequence back so no
+* tombstones are needed.  All memory is allocated by the constructor or by
+* reserve(); insert, lookup and remove never touch the heap, so the owner must
+* size the table for every entry it may hold.
+*
 * @warning This class is not threadsafe.
 */
 class BufHashTbl
 {
  private:
 	/**
-	 *	Size of Hash Table
+	 *	Size of Hash Table (always a power of two)
 	 */
-  int HTSIZE;
+  std::uint32_t HTSIZE;
+
+	/**
+	 *	HTSIZE - 1, used to wrap probe positions
+	 */
+  std::uint32_t mask;
+
+	/**
+	 *	Number of entries currently in the table
+	 */
+  std::uint32_t numEntries;
+
 	/**
 	 * Actual Hash table object
 	 */
-  hashBucket**  ht;
+  hashBucket*  ht;
 
 	/**
 	 * returns hash value between 0 and HTSIZE-1 computed using file and pageNo
@@ -61,11 +95,24 @@ class BufHashTbl
 	 * @param pageNo  Page number in the file
 	 * @return  			Hash value.
 	 */
-  int	 hash(const File* file, const PageId pageNo);
+  std::uint32_t hash(const File* file, const PageId pageNo) const
+  {
+    return (std::uint32_t)hashPage(file, pageNo) & mask;
+  }
+
+	/**
+	 * Returns the slot holding (file, pageNo), or HTSIZE if it is not present.
+	 *
+	 * @param file   	File object
+	 * @param pageNo  Page number in the file
+	 */
+  std::uint32_t findSlot(const File* file, const PageId pageNo) const;
 
  public:
 	/**
    * Constructor of BufHashTbl class
+	 *
+	 * @param htSize  Minimum number of slots; rounded up to a power of two.
 	 */
 	BufHashTbl(const int htSize);  // constructor
 
@@ -73,7 +120,16 @@ class BufHashTbl
    * Destructor of BufHashTbl class
 	 */
   ~BufHashTbl(); // destructor
-	
+
+	/**
+   * Grows the table to at least 'htSize' slots, rounded up to a power of
+   * two, and re-inserts every entry.  A table is never shrunk.
+	 *
+	 * @param htSize  Minimum number of slots
+   * @throws  HashTableException if the larger table could not be allocated
+	 */
+  void reserve(const std::uint32_t htSize);
+
 	/**
    * Insert entry into hash table mapping (file, pageNo) to frameNo.
 	 *
@@ -81,7 +137,7 @@ class BufHashTbl
 	 * @param pageNo 	Page number in the file
 	 * @param frameNo Frame number assigned to that page of the file
    * @throws  HashAlreadyPresentException	if the corresponding page already exists in the hash table
-   * @throws  HashTableException (optional) if could not create a new bucket as running of memory
+   * @throws  HashTableException if the table has no free slot left
 	 */
   void insert(const File* file, const PageId pageNo, const FrameId frameNo);
 
@@ -92,18 +148,38 @@ class BufHashTbl
 	 * @param file  	File object
 	 * @param pageNo	Page number in the file
 	 * @param frameNo Frame number reference
-   * @throws HashNotFoundException if the page entry is not found in the hash table 
+   * @throws HashNotFoundException if the page entry is not found in the hash table
 	 */
   void lookup(const File* file, const PageId pageNo, FrameId &frameNo);
 
+	/**
+   * Non-throwing variant of lookup().  A miss is reported through the return
+   * value, so no exception object (and no message string) is built for it.
+	 *
+	 * @param file  	File object
+	 * @param pageNo	Page number in the file
+	 * @param frameNo Frame number reference, only set when the page is found
+	 * @return  True if (file, pageNo) is in the hash table.
+	 */
+  bool tryLookup(const File* file, const PageId pageNo, FrameId &frameNo) const;
+
 	/**
    * Delete entry (file,pageNo) from hash table.
 	 *
 	 * @param file   	File object
 	 * @param pageNo  Page number in the file
-   * @throws HashNotFoundException if the page entry is not found in the hash table 
+   * @throws HashNotFoundException if the page entry is not found in the hash table
+	 */
+  void remove(const File* file, const PageId pageNo);
+
+	/**
+   * Non-throwing variant of remove().
+	 *
+	 * @param file   	File object
+	 * @param pageNo  Page number in the file
+	 * @return  True if an entry was removed, false if none was present.
 	 */
-  void remove(const File* file, const PageId pageNo);  
+  bool tryRemove(const File* file, const PageId pageNo);
 };
 
 }
@@ -0,0 +1,99 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "bufPoolSet.h"
+#include "exceptions/pool_exists_exception.h"
+#include "exceptions/pool_not_found_exception.h"
+
+namespace badgerdb {
+
+BufferPoolSet::BufferPoolSet()
+  : defaultPool(NULL)
+{
+}
+
+BufferPoolSet::~BufferPoolSet()
+{
+  while (!pools.empty())
+  {
+    delete pools.back().second;
+    pools.pop_back();
+  }
+}
+
+BufMgr* BufferPoolSet::createPool(const std::string& name, const std::uint32_t bufs,
+                                  const ReplacementPolicyType policyType,
+                                  const PoolPlacement placement)
+{
+  std::lock_guard<std::mutex> guard(latch);
+  for (std::size_t i = 0; i < pools.size(); i++)
+  {
+    if (pools[i].first == name)
+      throw PoolExistsException(name);
+  }
+
+  BufMgr* pool = new BufMgr(bufs, policyType, placement);
+  pools.push_back(std::make_pair(name, pool));
+  if (defaultPool == NULL)
+    defaultPool = pool;
+  return pool;
+}
+
+BufMgr* BufferPoolSet::findPool(const std::string& name)
+{
+  for (std::size_t i = 0; i < pools.size(); i++)
+  {
+    if (pools[i].first == name)
+      return pools[i].second;
+  }
+  throw PoolNotFoundException(name);
+}
+
+BufMgr* BufferPoolSet::getPool(const std::string& name)
+{
+  std::lock_guard<std::mutex> guard(latch);
+  return findPool(name);
+}
+
+void BufferPoolSet::setDefaultPool(const std::string& name)
+{
+  std::lock_guard<std::mutex> guard(latch);
+  defaultPool = findPool(name);
+}
+
+void BufferPoolSet::bind(const std::string& filename, const std::string& poolName)
+{
+  std::lock_guard<std::mutex> guard(latch);
+  bindings[filename] = findPool(poolName);
+}
+
+void BufferPoolSet::unbind(const std::string& filename)
+{
+  std::lock_guard<std::mutex> guard(latch);
+  bindings.erase(filename);
+}
+
+BufMgr* BufferPoolSet::poolFor(const std::string& filename)
+{
+  std::lock_guard<std::mutex> guard(latch);
+  std::map<std::string, BufMgr*>::const_iterator it = bindings.find(filename);
+  if (it != bindings.end())
+    return it->second;
+  if (defaultPool == NULL)
+    throw PoolNotFoundException("(default)");
+  return defaultPool;
+}
+
+void BufferPoolSet::listPools(std::vector<std::string>& names)
+{
+  std::lock_guard<std::mutex> guard(latch);
+  names.clear();
+  for (std::size_t i = 0; i < pools.size(); i++)
+    names.push_back(pools[i].first);
+}
+
+}
@@ -0,0 +1,142 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "buffer.h"
+
+namespace badgerdb {
+
+/**
+* @brief A set of named buffer pools and the assignment of files to them
+*
+* Each pool is a BufMgr of its own, with its own size and replacement policy,
+* so the pages of files bound to different pools never compete for frames.
+* A typical use keeps the index files of B+trees in a small pool of their own
+* so that scans of large relations cannot push hot index pages out.
+*
+* Files are bound to pools by name, which lets a file be bound before it is
+* opened; files that are not bound use the default pool, the first one
+* created unless changed with setDefaultPool().  The set owns its pools and
+* deletes them, last created first, when it is destroyed.
+*/
+class BufferPoolSet
+{
+ public:
+	/**
+   * Constructor of BufferPoolSet class.  The set starts out without pools.
+	 */
+  BufferPoolSet();
+
+	/**
+   * Destructor of BufferPoolSet class.  Deletes all pools, which writes back
+   * their dirty pages; files with pages in a pool must still be open.
+	 */
+  ~BufferPoolSet();
+
+	/**
+	 * Creates a pool.
+	 *
+	 * @param name		Name of the pool
+	 * @param bufs		Number of frames in the pool
+	 * @param policyType	Page replacement algorithm of the pool
+	 * @param placement	NUMA placement of the frames
+	 * @return  The new pool, owned by the set.
+	 * @throws  PoolExistsException If the set already has a pool of that name
+	 */
+  BufMgr* createPool(const std::string& name, const std::uint32_t bufs,
+                     const ReplacementPolicyType policyType = CLOCK_REPLACEMENT,
+                     const PoolPlacement placement = POOL_LOCAL);
+
+	/**
+	 * Returns the pool of the given name.
+	 *
+	 * @throws  PoolNotFoundException If the set has no pool of that name
+	 */
+  BufMgr* getPool(const std::string& name);
+
+	/**
+	 * Makes files that are not bound to a pool use the named pool.
+	 *
+	 * @throws  PoolNotFoundException If the set has no pool of that name
+	 */
+  void setDefaultPool(const std::string& name);
+
+	/**
+	 * Binds a file to a pool.  The binding only affects buffer managers looked
+	 * up after it is made, so a file should be bound before it is first used,
+	 * or flushed out of its old pool first.
+	 *
+	 * @param filename	Name of the file, as passed to File::open()
+	 * @param poolName	Name of the pool
+	 * @throws  PoolNotFoundException If the set has no pool of that name
+	 */
+  void bind(const std::string& filename, const std::string& poolName);
+
+	/**
+	 * Removes the binding of a file, which then uses the default pool.
+	 */
+  void unbind(const std::string& filename);
+
+	/**
+	 * Returns the pool a file is bound to, or the default pool.
+	 *
+	 * @param filename	Name of the file
+	 * @throws  PoolNotFoundException If the file is not bound and the set has no pools
+	 */
+  BufMgr* poolFor(const std::string& filename);
+
+	/**
+	 * Returns the pool a file is bound to, or the default pool.
+	 *
+	 * @param file		File object
+	 * @throws  PoolNotFoundException If the file is not bound and the set has no pools
+	 */
+  BufMgr* poolFor(const File* file) { return poolFor(file->filename()); }
+
+	/**
+	 * Lists the names of the pools in the order they were created.
+	 */
+  void listPools(std::vector<std::string>& names);
+
+ private:
+  BufferPoolSet(const BufferPoolSet&);
+  BufferPoolSet& operator=(const BufferPoolSet&);
+
+	/**
+	 * Returns the pool of the given name.  Called with 'latch' held.
+	 *
+	 * @throws  PoolNotFoundException If the set has no pool of that name
+	 */
+  BufMgr* findPool(const std::string& name);
+
+	/**
+   * Protects all members below
+	 */
+  std::mutex latch;
+
+	/**
+   * Pools with their names, in the order they were created
+	 */
+  std::vector<std::pair<std::string, BufMgr*> > pools;
+
+	/**
+   * Pool used by files that are not bound, NULL while there are no pools
+	 */
+  BufMgr* defaultPool;
+
+	/**
+   * Pool each bound file uses, by file name
+	 */
+  std::map<std::string, BufMgr*> bindings;
+};
+
+}
@@ -0,0 +1,459 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <iomanip>
+#include <sstream>
+#include "bufStats.h"
+#include "file.h"
+
+namespace badgerdb {
+
+const std::uint32_t StatCounter::NUM_STRIPES;
+const std::uint32_t Histogram::NUM_BUCKETS;
+const char* const FileStatsTable::OVERFLOW_NAME = "(other)";
+
+std::uint32_t nextStatStripe()
+{
+  static std::atomic<std::uint32_t> next(0);
+  return next.fetch_add(1, std::memory_order_relaxed);
+}
+
+//----------------------------------------
+// StatCounter
+//----------------------------------------
+
+std::uint64_t StatCounter::load() const
+{
+  std::uint64_t total = 0;
+  for (std::uint32_t i = 0; i < NUM_STRIPES; i++)
+    total += stripes[i].value.load(std::memory_order_relaxed);
+  return total;
+}
+
+void StatCounter::clear()
+{
+  for (std::uint32_t i = 0; i < NUM_STRIPES; i++)
+    stripes[i].value.store(0, std::memory_order_relaxed);
+}
+
+//----------------------------------------
+// Histogram
+//----------------------------------------
+
+std::uint32_t Histogram::bucketOf(const std::uint64_t value)
+{
+  const std::uint64_t subBuckets = 1 << SUB_BUCKET_BITS;
+  if (value < subBuckets)
+    return value;
+  std::uint32_t exponent = 63 - __builtin_clzll(value);
+  return ((exponent - SUB_BUCKET_BITS + 1) << SUB_BUCKET_BITS) +
+      ((value >> (exponent - SUB_BUCKET_BITS)) & (subBuckets - 1));
+}
+
+std::uint64_t Histogram::lowerBound(const std::uint32_t bucket)
+{
+  const std::uint32_t subBuckets = 1 << SUB_BUCKET_BITS;
+  if (bucket < subBuckets)
+    return bucket;
+  std::uint32_t exponent = (bucket >> SUB_BUCKET_BITS) + SUB_BUCKET_BITS - 1;
+  return (std::uint64_t)(subBuckets | (bucket & (subBuckets - 1))) << (exponent - SUB_BUCKET_BITS);
+}
+
+std::uint64_t Histogram::upperBound(const std::uint32_t bucket)
+{
+  const std::uint32_t subBuckets = 1 << SUB_BUCKET_BITS;
+  if (bucket < subBuckets)
+    return bucket;
+  std::uint32_t exponent = (bucket >> SUB_BUCKET_BITS) + SUB_BUCKET_BITS - 1;
+  return lowerBound(bucket) + ((std::uint64_t)1 << (exponent - SUB_BUCKET_BITS)) - 1;
+}
+
+std::uint64_t Histogram::snapshot(std::vector<std::uint64_t>& counts) const
+{
+  counts.assign(NUM_BUCKETS, 0);
+  std::uint64_t sum = 0;
+  for (std::uint32_t s = 0; s < NUM_STRIPES; s++)
+  {
+    for (std::uint32_t b = 0; b < NUM_BUCKETS; b++)
+      counts[b] += stripes[s].buckets[b].load(std::memory_order_relaxed);
+    sum += stripes[s].sum.load(std::memory_order_relaxed);
+  }
+  return sum;
+}
+
+std::uint64_t Histogram::quantile(const std::vector<std::uint64_t>& counts, const double q)
+{
+  std::uint64_t total = 0;
+  for (std::uint32_t b = 0; b < counts.size(); b++)
+    total += counts[b];
+  if (total == 0)
+    return 0;
+
+  std::uint64_t rank = std::max<std::uint64_t>(1, (std::uint64_t)std::ceil(q * total));
+  std::uint64_t seen = 0;
+  for (std::uint32_t b = 0; b < counts.size(); b++)
+  {
+    seen += counts[b];
+    if (seen >= rank)
+      return upperBound(b);
+  }
+  return upperBound(counts.size() - 1);
+}
+
+void Histogram::clear()
+{
+  for (std::uint32_t s = 0; s < NUM_STRIPES; s++)
+  {
+    for (std::uint32_t b = 0; b < NUM_BUCKETS; b++)
+      stripes[s].buckets[b].store(0, std::memory_order_relaxed);
+    stripes[s].sum.store(0, std::memory_order_relaxed);
+  }
+}
+
+//----------------------------------------
+// FileStatsTable
+//----------------------------------------
+
+FileStatsTable::FileStatsTable()
+{
+  for (std::uint32_t i = 0; i <= NUM_SLOTS; i++)
+    slots[i].file = NULL;
+  slots[NUM_SLOTS].filename = OVERFLOW_NAME;
+  clear();
+}
+
+void FileStatsTable::count(const File* file, const int which)
+{
+  slotFor(file).stripes[statStripe() % StatCounter::NUM_STRIPES].counts[which].fetch_add(
+      1, std::memory_order_relaxed);
+}
+
+FileStatsTable::Slot& FileStatsTable::slotFor(const File* file)
+{
+  std::uint32_t start = (std::uint32_t)(((std::uintptr_t)file >> 4) % NUM_SLOTS);
+
+  // almost always the file is found at once
+  for (std::uint32_t i = 0; i < NUM_SLOTS; i++)
+  {
+    Slot& slot = slots[(start + i) % NUM_SLOTS];
+    const File* owner = slot.file.load(std::memory_order_acquire);
+    if (owner == file)
+      return slot;
+    if (owner == NULL)
+    {
+      if (slot.file.compare_exchange_strong(owner, file))
+      {
+        std::lock_guard<std::mutex> guard(latch);
+        slot.filename = file->filename();
+        return slot;
+      }
+      if (owner == file)
+        return slot;
+    }
+  }
+  return slots[NUM_SLOTS];
+}
+
+void FileStatsTable::retireSlot(Slot& slot)
+{
+  std::pair<std::uint64_t, std::uint64_t>& total = retired[slot.filename];
+  for (std::uint32_t s = 0; s < StatCounter::NUM_STRIPES; s++)
+  {
+    total.first += slot.stripes[s].counts[0].exchange(0, std::memory_order_relaxed);
+    total.second += slot.stripes[s].counts[1].exchange(0, std::memory_order_relaxed);
+  }
+}
+
+void FileStatsTable::retire(const File* file)
+{
+  std::lock_guard<std::mutex> guard(latch);
+  for (std::uint32_t i = 0; i < NUM_SLOTS; i++)
+  {
+    Slot& slot = slots[i];
+    if (slot.file.load(std::memory_order_acquire) != file)
+      continue;
+    retireSlot(slot);
+    slot.filename.clear();
+    slot.file.store(NULL, std::memory_order_release);
+  }
+}
+
+void FileStatsTable::collect(std::vector<FileCounts>& counts) const
+{
+  std::lock_guard<std::mutex> guard(latch);
+  std::map<std::string, std::pair<std::uint64_t, std::uint64_t> > byName(retired);
+  for (std::uint32_t i = 0; i <= NUM_SLOTS; i++)
+  {
+    const Slot& slot = slots[i];
+    // a slot still being claimed has no name yet
+    if (slot.filename.empty())
+      continue;
+    std::pair<std::uint64_t, std::uint64_t> sum(0, 0);
+    for (std::uint32_t s = 0; s < StatCounter::NUM_STRIPES; s++)
+    {
+      sum.first += slot.stripes[s].counts[0].load(std::memory_order_relaxed);
+      sum.second += slot.stripes[s].counts[1].load(std::memory_order_relaxed);
+    }
+    if (sum.first == 0 && sum.second == 0 && i == NUM_SLOTS)
+      continue;
+    byName[slot.filename].first += sum.first;
+    byName[slot.filename].second += sum.second;
+  }
+
+  counts.clear();
+  for (std::map<std::string, std::pair<std::uint64_t, std::uint64_t> >::const_iterator it = byName.begin();
+       it != byName.end(); ++it)
+  {
+    FileCounts entry = { it->first, it->second.first, it->second.second };
+    counts.push_back(entry);
+  }
+}
+
+void FileStatsTable::clear()
+{
+  std::lock_guard<std::mutex> guard(latch);
+  retired.clear();
+  for (std::uint32_t i = 0; i <= NUM_SLOTS; i++)
+  {
+    for (std::uint32_t s = 0; s < StatCounter::NUM_STRIPES; s++)
+    {
+      slots[i].stripes[s].counts[0].store(0, std::memory_order_relaxed);
+      slots[i].stripes[s].counts[1].store(0, std::memory_order_relaxed);
+    }
+  }
+}
+
+//----------------------------------------
+// BufStats
+//----------------------------------------
+
+void BufStats::clear()
+{
+  accesses.clear();
+  diskreads.clear();
+  diskwrites.clear();
+  evictionWrites.clear();
+  hits.clear();
+  misses.clear();
+  prefetches.clear();
+  compressedHits.clear();
+  compressedStores.clear();
+  cleanEvictions.clear();
+  dirtyEvictions.clear();
+  maxPinnedFrames = pinnedFrames.load();
+  readPageLatency.clear();
+  allocPageLatency.clear();
+  writePageLatency.clear();
+  clockSweepLength.clear();
+  files.clear();
+}
+
+namespace {
+
+/**
+ * Writes 's' escaped for a JSON string or a Prometheus label value.  JSON
+ * gets every control character escaped, as \u00XX where it has no shorter
+ * form.  The Prometheus text format only knows \\, \" and \n, so other
+ * control characters, which would confuse line oriented tools, become '?'.
+ */
+void writeEscaped(std::ostream& out, const std::string& s, const StatsFormat format)
+{
+  for (std::string::const_iterator it = s.begin(); it != s.end(); ++it)
+  {
+    const unsigned char c = *it;
+    if (c == '"' || c == '\\')
+      out << '\\' << *it;
+    else if (c == '\n')
+      out << "\\n";
+    else if (c >= 0x20 && c != 0x7f)
+      out << *it;
+    else if (format == STATS_PROMETHEUS)
+      out << '?';
+    else if (c == '\t')
+      out << "\\t";
+    else if (c == '\r')
+      out << "\\r";
+    else
+    {
+      char escaped[8];
+      std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+      out << escaped;
+    }
+  }
+}
+
+void writeJsonHistogram(std::ostream& out, const Histogram& histogram)
+{
+  std::vector<std::uint64_t> counts;
+  std::uint64_t sum = histogram.snapshot(counts);
+  std::uint64_t count = 0, max = 0;
+  for (std::uint32_t b = 0; b < counts.size(); b++)
+  {
+    count += counts[b];
+    if (counts[b])
+      max = Histogram::upperBound(b);
+  }
+
+  out << "{\"count\":" << count << ",\"sum\":" << sum
+      << ",\"mean\":" << (count ? (double)sum / count : 0.0)
+      << ",\"p50\":" << Histogram::quantile(counts, 0.5)
+      << ",\"p90\":" << Histogram::quantile(counts, 0.9)
+      << ",\"p99\":" << Histogram::quantile(counts, 0.99)
+      << ",\"p999\":" << Histogram::quantile(counts, 0.999)
+      << ",\"max\":" << max << ",\"buckets\":[";
+  bool first = true;
+  for (std::uint32_t b = 0; b < counts.size(); b++)
+  {
+    if (counts[b] == 0)
+      continue;
+    out << (first ? "" : ",") << "[" << Histogram::lowerBound(b) << ","
+        << Histogram::upperBound(b) << "," << counts[b] << "]";
+    first = false;
+  }
+  out << "]}";
+}
+
+void writePromCounter(std::ostream& out, const char* name, const char* help,
+                      const std::uint64_t value)
+{
+  out << "# HELP " << name << " " << help << "\n"
+      << "# TYPE " << name << " counter\n"
+      << name << " " << value << "\n";
+}
+
+void writePromGauge(std::ostream& out, const char* name, const char* help,
+                    const std::int64_t value)
+{
+  out << "# HELP " << name << " " << help << "\n"
+      << "# TYPE " << name << " gauge\n"
+      << name << " " << value << "\n";
+}
+
+/**
+ * Writes a histogram with its values multiplied by 'scale', e.g. 1e-9 to
+ * turn nanoseconds into the seconds Prometheus expects.
+ */
+void writePromHistogram(std::ostream& out, const char* name, const char* help,
+                        const Histogram& histogram, const double scale)
+{
+  std::vector<std::uint64_t> counts;
+  std::uint64_t sum = histogram.snapshot(counts);
+
+  out << "# HELP " << name << " " << help << "\n"
+      << "# TYPE " << name << " histogram\n";
+  std::ostringstream bound;
+  bound << std::setprecision(10);
+  std::uint64_t cumulative = 0;
+  for (std::uint32_t b = 0; b < counts.size(); b++)
+  {
+    if (counts[b] == 0)
+      continue;
+    cumulative += counts[b];
+    bound.str("");
+    bound << Histogram::upperBound(b) * scale;
+    out << name << "_bucket{le=\"" << bound.str() << "\"} " << cumulative << "\n";
+  }
+  bound.str("");
+  bound << sum * scale;
+  out << name << "_bucket{le=\"+Inf\"} " << cumulative << "\n"
+      << name << "_sum " << bound.str() << "\n"
+      << name << "_count " << cumulative << "\n";
+}
+
+}
+
+void BufStats::dump(std::ostream& out, const StatsFormat format) const
+{
+  std::vector<FileCounts> fileCounts;
+  files.collect(fileCounts);
+
+  if (format == STATS_PROMETHEUS)
+  {
+    writePromCounter(out, "badgerdb_buffer_accesses_total", "Page requests.", accesses);
+    writePromCounter(out, "badgerdb_buffer_hits_total", "Page requests served from the pool.", hits);
+    writePromCounter(out, "badgerdb_buffer_misses_total", "Page requests that missed the pool.", misses);
+    writePromCounter(out, "badgerdb_buffer_disk_reads_total", "Pages read from disk.", diskreads);
+    writePromCounter(out, "badgerdb_buffer_disk_writes_total", "Pages written to disk.", diskwrites);
+    writePromCounter(out, "badgerdb_buffer_eviction_writes_total",
+                     "Pages written back by a thread evicting them.", evictionWrites);
+    writePromCounter(out, "badgerdb_buffer_prefetches_total", "Pages read ahead.", prefetches);
+    writePromCounter(out, "badgerdb_buffer_compressed_hits_total",
+                     "Pages read back from the compressed tier.", compressedHits);
+    writePromCounter(out, "badgerdb_buffer_compressed_stores_total",
+                     "Evicted pages stored in the compressed tier.", compressedStores);
+    out << "# HELP badgerdb_buffer_evictions_total Pages evicted.\n"
+        << "# TYPE badgerdb_buffer_evictions_total counter\n"
+        << "badgerdb_buffer_evictions_total{kind=\"clean\"} " << (std::uint64_t)cleanEvictions << "\n"
+        << "badgerdb_buffer_evictions_total{kind=\"dirty\"} " << (std::uint64_t)dirtyEvictions << "\n";
+    writePromGauge(out, "badgerdb_buffer_pinned_frames", "Frames pinned now.", pinnedFrames.load());
+    writePromGauge(out, "badgerdb_buffer_pinned_frames_max", "Most frames pinned at once.",
+                   maxPinnedFrames.load());
+
+    out << "# HELP badgerdb_buffer_file_hits_total Page requests served from the pool, by file.\n"
+        << "# TYPE badgerdb_buffer_file_hits_total counter\n";
+    for (std::uint32_t i = 0; i < fileCounts.size(); i++)
+    {
+      out << "badgerdb_buffer_file_hits_total{file=\"";
+      writeEscaped(out, fileCounts[i].filename, STATS_PROMETHEUS);
+      out << "\"} " << fileCounts[i].hits << "\n";
+    }
+    out << "# HELP badgerdb_buffer_file_misses_total Page requests read from disk, by file.\n"
+        << "# TYPE badgerdb_buffer_file_misses_total counter\n";
+    for (std::uint32_t i = 0; i < fileCounts.size(); i++)
+    {
+      out << "badgerdb_buffer_file_misses_total{file=\"";
+      writeEscaped(out, fileCounts[i].filename, STATS_PROMETHEUS);
+      out << "\"} " << fileCounts[i].misses << "\n";
+    }
+
+    writePromHistogram(out, "badgerdb_buffer_read_page_seconds", "Latency of readPage().",
+                       readPageLatency, 1e-9);
+    writePromHistogram(out, "badgerdb_buffer_alloc_page_seconds", "Latency of allocPage().",
+                       allocPageLatency, 1e-9);
+    writePromHistogram(out, "badgerdb_file_write_page_seconds", "Latency of File::writePage().",
+                       writePageLatency, 1e-9);
+    writePromHistogram(out, "badgerdb_buffer_clock_sweep_frames",
+                       "Frames the CLOCK hand passed to find a victim.", clockSweepLength, 1);
+    return;
+  }
+
+  out << "{\"accesses\":" << (std::uint64_t)accesses
+      << ",\"hits\":" << (std::uint64_t)hits
+      << ",\"misses\":" << (std::uint64_t)misses
+      << ",\"hitRatio\":" << hitRatio()
+      << ",\"diskReads\":" << (std::uint64_t)diskreads
+      << ",\"diskWrites\":" << (std::uint64_t)diskwrites
+      << ",\"evictionWrites\":" << (std::uint64_t)evictionWrites
+      << ",\"prefetches\":" << (std::uint64_t)prefetches
+      << ",\"compressedHits\":" << (std::uint64_t)compressedHits
+      << ",\"compressedStores\":" << (std::uint64_t)compressedStores
+      << ",\"evictions\":{\"clean\":" << (std::uint64_t)cleanEvictions
+      << ",\"dirty\":" << (std::uint64_t)dirtyEvictions << "}"
+      << ",\"pinnedFrames\":" << pinnedFrames.load()
+      << ",\"maxPinnedFrames\":" << maxPinnedFrames.load()
+      << ",\"files\":[";
+  for (std::uint32_t i = 0; i < fileCounts.size(); i++)
+  {
+    out << (i ? "," : "") << "{\"name\":\"";
+    writeEscaped(out, fileCounts[i].filename, STATS_JSON);
+    out << "\",\"hits\":" << fileCounts[i].hits << ",\"misses\":" << fileCounts[i].misses << "}";
+  }
+  out << "],\"readPageNs\":";
+  writeJsonHistogram(out, readPageLatency);
+  out << ",\"allocPageNs\":";
+  writeJsonHistogram(out, allocPageLatency);
+  out << ",\"writePageNs\":";
+  writeJsonHistogram(out, writePageLatency);
+  out << ",\"clockSweepFrames\":";
+  writeJsonHistogram(out, clockSweepLength);
+  out << "}";
+}
+
+}
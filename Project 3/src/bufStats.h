@@ -0,0 +1,454 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace badgerdb {
+
+class File;
+
+/**
+ * @brief Output formats of BufMgr::dumpStats().
+ */
+enum StatsFormat
+{
+  STATS_JSON = 0,        /* One JSON object */
+  STATS_PROMETHEUS = 1   /* Prometheus text exposition format */
+};
+
+/**
+ * Returns the stripe the calling thread updates statistics in.  Threads are
+ * assigned stripes round robin the first time they ask.
+ */
+std::uint32_t nextStatStripe();
+
+inline std::uint32_t statStripe()
+{
+  static thread_local std::uint32_t stripe = nextStatStripe();
+  return stripe;
+}
+
+/**
+ * @brief An event counter that is cheap to update from many threads.
+ *
+ * The count is split into one cache line per stripe; every thread adds to its
+ * own stripe with a relaxed atomic, and reading the counter sums the stripes.
+ */
+class StatCounter
+{
+ public:
+  /**
+   * Number of stripes of a counter
+   */
+  static const std::uint32_t NUM_STRIPES = 16;
+
+  StatCounter() { clear(); }
+
+  /**
+   * Adds 'n' to the counter.
+   */
+  void add(const std::uint64_t n = 1)
+  {
+    stripes[statStripe() % NUM_STRIPES].value.fetch_add(n, std::memory_order_relaxed);
+  }
+
+  void operator++(int) { add(); }
+
+  /**
+   * Returns the current count.
+   */
+  std::uint64_t load() const;
+
+  operator std::uint64_t() const { return load(); }
+
+  /**
+   * Resets the counter to zero.
+   */
+  void clear();
+
+ private:
+  StatCounter(const StatCounter&);
+  StatCounter& operator=(const StatCounter&);
+
+  struct Stripe
+  {
+    std::atomic<std::uint64_t> value;
+    char pad[64 - sizeof(std::atomic<std::uint64_t>)];
+  };
+
+  Stripe stripes[NUM_STRIPES];
+};
+
+/**
+ * @brief A histogram of non-negative values with bounded relative error.
+ *
+ * Values below 8 have a bucket each; above that every power of two is split
+ * into 8 buckets, so a value is known to within 12.5% over the whole 64 bit
+ * range, as in an HDR histogram with one significant digit.  Updates go to
+ * one of a few stripes with relaxed atomics.
+ */
+class Histogram
+{
+ public:
+  /**
+   * log2 of the number of buckets per power of two
+   */
+  static const std::uint32_t SUB_BUCKET_BITS = 3;
+
+  /**
+   * Number of buckets covering the 64 bit range
+   */
+  static const std::uint32_t NUM_BUCKETS = (64 - SUB_BUCKET_BITS + 1) << SUB_BUCKET_BITS;
+
+  /**
+   * Number of stripes of a histogram
+   */
+  static const std::uint32_t NUM_STRIPES = 4;
+
+  Histogram() { clear(); }
+
+  /**
+   * Adds one sample.
+   */
+  void record(const std::uint64_t value)
+  {
+    Stripe& stripe = stripes[statStripe() % NUM_STRIPES];
+    stripe.buckets[bucketOf(value)].fetch_add(1, std::memory_order_relaxed);
+    stripe.sum.fetch_add(value, std::memory_order_relaxed);
+  }
+
+  /**
+   * Returns the bucket 'value' is counted in.
+   */
+  static std::uint32_t bucketOf(const std::uint64_t value);
+
+  /**
+   * Returns the smallest value counted in 'bucket'.
+   */
+  static std::uint64_t lowerBound(const std::uint32_t bucket);
+
+  /**
+   * Returns the largest value counted in 'bucket'.
+   */
+  static std::uint64_t upperBound(const std::uint32_t bucket);
+
+  /**
+   * Copies the counts of all buckets, summed over the stripes.
+   *
+   * @param counts  Resized to NUM_BUCKETS and filled
+   * @return  Sum of all samples.
+   */
+  std::uint64_t snapshot(std::vector<std::uint64_t>& counts) const;
+
+  /**
+   * Returns the upper bound of the bucket holding the q-quantile of
+   * 'counts', 0 if there are no samples.
+   */
+  static std::uint64_t quantile(const std::vector<std::uint64_t>& counts, const double q);
+
+  /**
+   * Removes all samples.
+   */
+  void clear();
+
+ private:
+  Histogram(const Histogram&);
+  Histogram& operator=(const Histogram&);
+
+  struct Stripe
+  {
+    std::atomic<std::uint64_t> buckets[NUM_BUCKETS];
+    std::atomic<std::uint64_t> sum;
+    char pad[64 - sizeof(std::atomic<std::uint64_t>)];
+  };
+
+  Stripe stripes[NUM_STRIPES];
+};
+
+/**
+ * @brief Records the time from construction to destruction in a Histogram,
+ * in nanoseconds.
+ */
+class LatencyTimer
+{
+ public:
+  explicit LatencyTimer(Histogram& histogramIn)
+    : histogram(histogramIn), start(std::chrono::steady_clock::now()) {}
+
+  ~LatencyTimer()
+  {
+    histogram.record(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count());
+  }
+
+ private:
+  Histogram& histogram;
+  std::chrono::steady_clock::time_point start;
+};
+
+/**
+ * @brief Buffer pool hits and misses of one file.
+ */
+struct FileCounts
+{
+  std::string filename;
+  std::uint64_t hits;
+  std::uint64_t misses;
+};
+
+/**
+ * @brief Hits and misses broken down by file.
+ *
+ * Files get one of a fixed number of slots the first time they are seen,
+ * claimed with a compare-and-swap; files beyond that share an overflow slot.
+ * The counts of a slot are striped like a StatCounter.  When a file is
+ * flushed out of the buffer pool, which has to happen before it is closed, its
+ * counts are folded into totals kept by name and the slot can be reused.
+ */
+class FileStatsTable
+{
+ public:
+  /**
+   * Number of files counted separately
+   */
+  static const std::uint32_t NUM_SLOTS = 32;
+
+  /**
+   * Name the overflow slot is reported under
+   */
+  static const char* const OVERFLOW_NAME;
+
+  FileStatsTable();
+
+  void recordHit(const File* file) { count(file, 0); }
+  void recordMiss(const File* file) { count(file, 1); }
+
+  /**
+   * Folds the counts of 'file' into the totals kept by name.
+   */
+  void retire(const File* file);
+
+  /**
+   * Returns the counts of every file seen since the last clear(), by name.
+   */
+  void collect(std::vector<FileCounts>& counts) const;
+
+  /**
+   * Forgets all files.
+   */
+  void clear();
+
+ private:
+  FileStatsTable(const FileStatsTable&);
+  FileStatsTable& operator=(const FileStatsTable&);
+
+  struct Stripe
+  {
+    std::atomic<std::uint64_t> counts[2];
+    char pad[64 - 2 * sizeof(std::atomic<std::uint64_t>)];
+  };
+
+  struct Slot
+  {
+    std::atomic<const File*> file;
+    std::string filename;
+    Stripe stripes[StatCounter::NUM_STRIPES];
+  };
+
+  /**
+   * Adds one to counts[which] of the slot of 'file'.
+   */
+  void count(const File* file, const int which);
+
+  /**
+   * Returns the slot of 'file', claiming one if it has none.
+   */
+  Slot& slotFor(const File* file);
+
+  /**
+   * Moves the counts of 'slot' into 'retired'.  Called with 'latch' held.
+   */
+  void retireSlot(Slot& slot);
+
+  /**
+   * Slots of the files and, at index NUM_SLOTS, the overflow slot
+   */
+  Slot slots[NUM_SLOTS + 1];
+
+  /**
+   * Protects the names of the slots and 'retired'
+   */
+  mutable std::mutex latch;
+
+  /**
+   * Counts of flushed files by name
+   */
+  std::map<std::string, std::pair<std::uint64_t, std::uint64_t> > retired;
+};
+
+/**
+* @brief Class to maintain statistics of buffer usage
+*
+* Counters are striped per thread and updated with relaxed atomics, so they
+* can stay enabled under load.  The pinned frame gauge is a single atomic but
+* only changes when the pin count of a frame moves between zero and one.
+*/
+struct BufStats
+{
+  /**
+   * Total number of page requests to the buffer pool
+   */
+  StatCounter accesses;
+
+  /**
+   * Number of pages read from disk (including allocs)
+   */
+  StatCounter diskreads;
+
+  /**
+   * Number of pages written back to disk
+   */
+  StatCounter diskwrites;
+
+  /**
+   * Number of pages written back by a foreground thread evicting them
+   */
+  StatCounter evictionWrites;
+
+  /**
+   * Number of readPage() calls that found the page in the buffer pool
+   */
+  StatCounter hits;
+
+  /**
+   * Number of readPage() calls that did not find the page in the buffer pool
+   */
+  StatCounter misses;
+
+  /**
+   * Number of pages read ahead of use by prefetch()
+   */
+  StatCounter prefetches;
+
+  /**
+   * Number of pages read back from the compressed second tier instead of disk
+   */
+  StatCounter compressedHits;
+
+  /**
+   * Number of evicted pages stored in the compressed second tier
+   */
+  StatCounter compressedStores;
+
+  /**
+   * Number of pages evicted that did not have to be written back
+   */
+  StatCounter cleanEvictions;
+
+  /**
+   * Number of pages evicted that had to be written back first
+   */
+  StatCounter dirtyEvictions;
+
+  /**
+   * Number of frames currently pinned
+   */
+  std::atomic<std::int64_t> pinnedFrames;
+
+  /**
+   * Highest value of 'pinnedFrames' since the last clear()
+   */
+  std::atomic<std::int64_t> maxPinnedFrames;
+
+  /**
+   * Time taken by readPage(), in nanoseconds
+   */
+  Histogram readPageLatency;
+
+  /**
+   * Time taken by allocPage(), in nanoseconds
+   */
+  Histogram allocPageLatency;
+
+  /**
+   * Time taken by File::writePage() calls of the buffer manager, in nanoseconds
+   */
+  Histogram writePageLatency;
+
+  /**
+   * Number of frames the CLOCK hand passed over to find each victim
+   */
+  Histogram clockSweepLength;
+
+  /**
+   * Hits and misses by file
+   */
+  FileStatsTable files;
+
+  /**
+   * Fraction of readPage() calls served from the buffer pool
+   */
+  double hitRatio() const
+  {
+    std::uint64_t h = hits, m = misses;
+    return h + m ? (double)h / (h + m) : 0.0;
+  }
+
+  /**
+   * A frame's pin count went from zero to one
+   */
+  void framePinned()
+  {
+    std::int64_t pinned = pinnedFrames.fetch_add(1, std::memory_order_relaxed) + 1;
+    std::int64_t max = maxPinnedFrames.load(std::memory_order_relaxed);
+    while (pinned > max &&
+           !maxPinnedFrames.compare_exchange_weak(max, pinned, std::memory_order_relaxed))
+      ;
+  }
+
+  /**
+   * A frame's pin count went from one to zero
+   */
+  void frameUnpinned()
+  {
+    pinnedFrames.fetch_sub(1, std::memory_order_relaxed);
+  }
+
+  /**
+   * Clear all values; the pinned frame gauge keeps its value
+   */
+  void clear();
+
+  /**
+   * Writes all values to 'out'.  JSON output is a single object.
+   */
+  void dump(std::ostream& out, const StatsFormat format) const;
+
+  /**
+   * Constructor of BufStats class
+   */
+  BufStats()
+  {
+    pinnedFrames = 0;
+    clear();
+  }
+
+ private:
+  BufStats(const BufStats&);
+  BufStats& operator=(const BufStats&);
+};
+
+}
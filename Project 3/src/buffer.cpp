@@ -5,8 +5,13 @@
  * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
  */
 
+#include <algorithm>
+#include <chrono>
+#include <exception>
 #include <memory>
+#include <new>
 #include <iostream>
+#include <thread>
 #include "buffer.h"
 #include "exceptions/buffer_exceeded_exception.h"
 #include "exceptions/page_not_pinned_exception.h"
@@ -16,137 +21,1028 @@
 
 namespace badgerdb { 
 
+const std::uint32_t BufferAccessStrategy::DEFAULT_RING_SIZE;
+const FrameId BufferAccessStrategy::NO_FRAME;
+const std::uint32_t BufMgr::MAX_CHUNKS;
+const std::uint32_t BufMgr::SHRINK_WAIT_MS;
+
+namespace {
+
+/**
+ * Most pages moved by one vectored read or write
+ */
+const std::uint32_t MAX_RUN_PAGES = 64;
+
+/**
+ * Collects the completions of a batch of asynchronous page reads or writes.
+ * Requests are numbered 0 to n-1 by the caller; wait() must be called before
+ * the batch goes away.
+ */
+class IoBatch
+{
+ public:
+  IoBatch(const std::size_t n, Histogram* latencyIn = NULL)
+    : errors(n), started(n), pending(0), latency(latencyIn) {}
+
+  void read(IoEngine& engine, File* file, const PageId pageNo, Page& into, const std::size_t k)
+  {
+    start(k);
+    try
+    {
+      file->submitReadPage(engine, pageNo, into, completion(k));
+    }
+    catch (...)
+    {
+      finish(k, std::current_exception());
+    }
+  }
+
+  void write(IoEngine& engine, File* file, const PageId pageNo, const Page& page, const std::size_t k)
+  {
+    start(k);
+    try
+    {
+      file->submitWritePage(engine, pageNo, page, completion(k));
+    }
+    catch (...)
+    {
+      finish(k, std::current_exception());
+    }
+  }
+
+  /**
+   * Reads a run of consecutive pages with one vectored read on this thread,
+   * or, if that fails, each page on its own so that every request gets its
+   * own error.  Requests are numbered k to k+count-1.
+   */
+  void readRun(IoEngine& engine, File* file, const PageId firstPageNo, const std::uint32_t count,
+               Page* const* into, const std::size_t k)
+  {
+    if (count > 1)
+    {
+      try
+      {
+        file->readPages(firstPageNo, count, into);
+        return;
+      }
+      catch (...)
+      {
+      }
+    }
+    for (std::uint32_t i = 0; i < count; i++)
+      read(engine, file, firstPageNo + i, *into[i], k + i);
+  }
+
+  /**
+   * Writes a run of consecutive pages as readRun() reads them.
+   */
+  void writeRun(IoEngine& engine, File* file, const PageId firstPageNo, const std::uint32_t count,
+                const Page* const* pages, const std::size_t k)
+  {
+    if (count > 1)
+    {
+      try
+      {
+        file->writePages(firstPageNo, count, pages);
+        return;
+      }
+      catch (...)
+      {
+      }
+    }
+    for (std::uint32_t i = 0; i < count; i++)
+      write(engine, file, firstPageNo + i, *pages[i], k + i);
+  }
+
+  void wait()
+  {
+    std::unique_lock<std::mutex> lock(latch);
+    while (pending > 0)
+      cond.wait(lock);
+  }
+
+  std::exception_ptr error(const std::size_t k) const { return errors[k]; }
+
+ private:
+  void start(const std::size_t k)
+  {
+    std::lock_guard<std::mutex> guard(latch);
+    pending++;
+    started[k] = std::chrono::steady_clock::now();
+  }
+
+  void finish(const std::size_t k, std::exception_ptr error)
+  {
+    if (latency != NULL)
+      latency->record(std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now() - started[k]).count());
+    std::lock_guard<std::mutex> guard(latch);
+    errors[k] = error;
+    if (--pending == 0)
+      cond.notify_all();
+  }
+
+  File::PageCallback completion(const std::size_t k)
+  {
+    return [this, k](std::exception_ptr error) { finish(k, error); };
+  }
+
+  std::mutex latch;
+  std::condition_variable cond;
+  std::vector<std::exception_ptr> errors;
+  std::vector<std::chrono::steady_clock::time_point> started;
+  std::size_t pending;
+  Histogram* latency;
+};
+
+}
+
 //----------------------------------------
 // Constructor of the class BufMgr
 //----------------------------------------
 
-BufMgr::BufMgr(std::uint32_t bufs)
-	: numBufs(bufs) {
-	bufDescTable = new BufDesc[bufs];
-
+BufMgr::BufMgr(std::uint32_t bufs, ReplacementPolicyType policyType, PoolPlacement placementIn)
+	: numBufs(bufs), capacity(0), numChunks(0), placement(placementIn) {
+  addChunk(bufs);
   for (FrameId i = 0; i < bufs; i++) 
   {
-  	bufDescTable[i].frameNo = i;
-  	bufDescTable[i].valid = false;
+  	new (&bufPool[i]) Page();
+  	stateTable[i].store(0);
   }
 
-  bufPool = new Page[bufs];
+  // one shard per 64 frames, up to 64 shards
+  numShards = 1;
+  while (numShards < 64 && numShards * 64 < bufs)
+    numShards *= 2;
+
+  hashTable = new PageTableShard[numShards];
+  for (std::uint32_t i = 0; i < numShards; i++)
+    hashTable[i].table = new BufHashTbl (shardSlots(bufs));  // allocate the buffer hash table
 
-  int htsize = ((((int) (bufs * 1.2))*2)/2)+1;
-  hashTable = new BufHashTbl (htsize);  // allocate the buffer hash table
+  policy = ReplacementPolicy::create(policyType, stateTable, bufs, &bufStats);
 
-  clockHand = bufs - 1;
+  ioEngine = &IoEngine::shared();
+  prefetchStop = false;
+
+  writerStop = false;
+  writerInterval = 0;
+  writerMaxPages = 0;
 }
 
 
 BufMgr::~BufMgr() {
-  //Flush out all unwritten pages
+  stopWriter();
+
+  // stop reading ahead before the frames go away
+  {
+    std::lock_guard<std::mutex> guard(prefetchLatch);
+    prefetchStop = true;
+  }
+  prefetchCond.notify_all();
+  if (prefetcher.joinable())
+    prefetcher.join();
+
+  //Flush out all unwritten pages, once no shrink is emptying frames
+  std::lock_guard<std::mutex> resizing(resizeLatch);
   for (std::uint32_t i = 0; i < numBufs; i++) 
   {
   	BufDesc* tmpbuf = &bufDescTable[i];
-  	if (tmpbuf->valid == true && tmpbuf->dirty == true)
+  	if (tmpbuf->valid() == true && tmpbuf->dirty() == true)
 		{
-			tmpbuf->file->writePage(tmpbuf->pageNo, bufPool[i]);
+			LatencyTimer timer(bufStats.writePageLatency);
+			tmpbuf->file.load()->writePage(tmpbuf->pageNo, bufPool[i]);
   	}
   }
 
-  delete [] bufDescTable;
-  delete [] bufPool;
+  for (std::uint32_t i = 0; i < numShards; i++)
+    delete hashTable[i].table;
+  delete [] hashTable;
+  delete policy;
+  for (std::uint32_t i = 0; i < capacity; i++)
+  {
+    if (i < numBufs)
+      bufPool[i].~Page();
+    bufDescTable[i].~BufDesc();
+    stateTable[i].~FrameState();
+  }
+  for (std::uint32_t i = 0; i < numChunks; i++)
+    delete chunks[i].memory;
 }
 
-void BufMgr::allocBuf(FrameId & frame) 
+void BufMgr::addChunk(const std::uint32_t frames)
 {
-  // perform first part of clock algorithm to search for 
-  // open buffer frame
-  // Assumes non-concurrent access to buffer manager
-  std::uint32_t numScanned = 0;
-  bool found = 0;
+  const std::uint32_t extentSize = FrameStateTable::EXTENT_SIZE;
+  std::uint32_t extents = std::max(1u, (frames + extentSize - 1) / extentSize);
+  std::uint32_t firstExtent = capacity / extentSize;
+  if (numChunks == MAX_CHUNKS || extents > FrameStateTable::MAX_EXTENTS - firstExtent)
+    throw BufferExceededException();
+  std::uint32_t count = extents * extentSize;
+
+  // one mapping for the frames, which come first and so start on a huge page
+  // boundary, their descriptors and, on a cache line boundary of its own,
+  // the state words the replacement sweep scans
+  std::size_t poolBytes = (std::size_t)count * sizeof(Page);
+  std::size_t descBytes = (std::size_t)count * sizeof(BufDesc);
+  std::size_t stateOffset = (poolBytes + descBytes + PoolMemory::CACHE_LINE_SIZE - 1) &
+                          ~(PoolMemory::CACHE_LINE_SIZE - 1);
+  PoolMemory* memory = new PoolMemory(stateOffset + (std::size_t)count * sizeof(FrameState), placement);
+  char* base = static_cast<char*>(memory->base());
+  Page* pages = reinterpret_cast<Page*>(base);
+  BufDesc* descs = reinterpret_cast<BufDesc*>(base + poolBytes);
+  FrameState* states = reinterpret_cast<FrameState*>(base + stateOffset);
 
-  while (numScanned < 2*numBufs)	//Need to scn twice
+  // pages are only constructed when their frame comes online, so the memory
+  // of frames that are not needed yet is never touched
+  for (std::uint32_t i = 0; i < count; i++)
   {
-    // advance the clock
-    advanceClock();
-    numScanned++;
+  	new (&states[i]) FrameState(0);
+  	new (&descs[i]) BufDesc(&states[i], &bufStats);
+  	descs[i].frameNo = capacity + i;
+  	states[i].store(BufDesc::OFFLINE);
+  }
+  for (std::uint32_t i = 0; i < extents; i++)
+  {
+    bufPool.setExtent(firstExtent + i, pages + i * extentSize);
+    bufDescTable.setExtent(firstExtent + i, descs + i * extentSize);
+    stateTable.setExtent(firstExtent + i, states + i * extentSize);
+  }
 
-    // if invalid, use frame
-    if (! bufDescTable[clockHand].valid)
+  PoolChunk& chunk = chunks[numChunks];
+  chunk.memory = memory;
+  chunk.pages = pages;
+  chunk.firstFrame = capacity;
+  chunk.numFrames = count;
+  numChunks++;
+  capacity += count;
+}
+
+FrameId BufMgr::frameOf(const Page* page) const
+{
+  for (std::uint32_t i = 0, n = numChunks; i < n; i++)
+  {
+    const PoolChunk& chunk = chunks[i];
+    if (page >= chunk.pages && page < chunk.pages + chunk.numFrames)
+      return chunk.firstFrame + (page - chunk.pages);
+  }
+  // not a page of this pool
+  return BufferAccessStrategy::NO_FRAME;
+}
+
+std::uint32_t BufMgr::shardSlots(const std::uint32_t frames) const
+{
+  // four slots for each frame a shard holds on average: a load factor of a
+  // quarter, and room for pages that hash unevenly across the shards, since
+  // a full shard would have to grow on the pin path
+  return ((frames + numShards - 1) / numShards) * 4;
+}
+
+std::uint32_t BufMgr::resize(const std::uint32_t newFrames)
+{
+  std::lock_guard<std::mutex> guard(resizeLatch);
+  std::uint32_t oldFrames = numBufs;
+  std::uint32_t target = std::max(1u, newFrames);
+
+  if (target >= oldFrames)
+  {
+    // frames given up by an earlier shrink are reused first
+    if (target > capacity)
+      addChunk(target - capacity);
+    for (FrameId i = oldFrames; i < target; i++)
     {
-      break;
+      new (&bufPool[i]) Page();
+      stateTable[i].store(0);
     }
+    // the page table never grows on its own, so make room before the new
+    // frames can be filled
+    for (std::uint32_t i = 0; i < numShards; i++)
+    {
+      std::lock_guard<std::mutex> shardGuard(hashTable[i].latch);
+      hashTable[i].table->reserve(shardSlots(target));
+    }
+    policy->resize(target);
+    numBufs = target;
+    return target;
+  }
 
-    // is valid, check referenced bit
-    if (! bufDescTable[clockHand].refbit)
+  // stop handing out the frames that go, then empty them from the top so
+  // the frames still in the pool always have the lowest numbers
+  numBufs = target;
+  policy->resize(target);
+  FrameId frame = oldFrames;
+  std::exception_ptr error;
+  try
+  {
+    while (frame > target && drainFrame(frame - 1))
     {
-      // check to see if someone has it pinned
-      if (bufDescTable[clockHand].pinCnt == 0)
-      {
-        // hasn't been referenced and is not pinned, use it
-        // remove previous entry from hash table
-        hashTable->remove(bufDescTable[clockHand].file, bufDescTable[clockHand].pageNo);
-        found = true;
-        break;
-      }
+      frame--;
+      bufPool[frame].~Page();
+      bufDescTable[frame].setOffline();
     }
-    else
+  }
+  catch (...)
+  {
+    // a page could not be written back
+    error = std::current_exception();
+  }
+  if (frame > target)
+  {
+    // keep the frame we stopped at and those below it
+    numBufs = frame;
+    policy->resize(frame);
+  }
+
+  // give the memory of the pages back, chunk by chunk
+  for (std::uint32_t i = 0; i < numChunks; i++)
+  {
+    const PoolChunk& chunk = chunks[i];
+    FrameId first = std::max(frame, chunk.firstFrame);
+    FrameId last = std::min(oldFrames, chunk.firstFrame + chunk.numFrames);
+    if (first < last)
+      chunk.memory->discard(&chunk.pages[first - chunk.firstFrame],
+                            (std::size_t)(last - first) * sizeof(Page));
+  }
+  if (error)
+    std::rethrow_exception(error);
+  return frame;
+}
+
+bool BufMgr::drainFrame(const FrameId frame)
+{
+  std::chrono::steady_clock::time_point deadline =
+      std::chrono::steady_clock::now() + std::chrono::milliseconds(SHRINK_WAIT_MS);
+  while (true)
+  {
+    if (bufDescTable[frame].tryClaim() && evictFrame(frame))
+      return true;
+    if (std::chrono::steady_clock::now() >= deadline)
+      return false;
+    std::this_thread::yield();
+  }
+}
+
+void BufMgr::allocBuf(FrameId & frame) 
+{
+  // a victim may be pinned again while we write it out; give the policy a
+  // bounded number of chances to come up with one that stays unpinned
+  for (std::uint32_t attempts = 0; attempts < numBufs; attempts++)
+  {
+    FrameId victim;
+    if (!policy->pickVictim(victim))
+      break;
+
+    if (evictFrame(victim))
     {
-      // has been referenced, clear the bit
-      bufStats.accesses++;
-      bufDescTable[clockHand].refbit = false;
+      // return new frame number
+      frame = victim;
+      return;
     }
   }
   
   // check for full buffer pool
-  if (!found && numScanned >= 2*numBufs)
+  throw BufferExceededException();
+} // end allocBuf
+
+void BufMgr::allocBuf(FrameId & frame, BufferAccessStrategy* strategy)
+{
+  std::lock_guard<std::mutex> guard(strategy->latch);
+  std::uint32_t ringSize = std::min<std::uint32_t>(strategy->ring.size(), std::max(1u, numBufs / 4));
+  if (strategy->current >= ringSize)
+    strategy->current = 0;
+  FrameId& slot = strategy->ring[strategy->current++];
+
+  // recycle the frame we loaded one lap ago, unless it has been used since
+  if (slot != BufferAccessStrategy::NO_FRAME && slot < numBufs)
   {
-    throw BufferExceededException();
+    if (!(stateTable[slot].load() & BufDesc::REFBIT) && bufDescTable[slot].tryClaim() &&
+        evictFrame(slot))
+    {
+      frame = slot;
+      return;
+    }
   }
-  
-  // flush any existing changes to disk if necessary
-  if (bufDescTable[clockHand].dirty)
+
+  allocBuf(frame);
+  slot = frame;
+}
+
+bool BufMgr::evictFrame(const FrameId frame)
+{
+  BufDesc* desc = &bufDescTable[frame];
+
+  // if invalid, use frame
+  if (!(desc->state->load() & BufDesc::VALID))
+    return true;
+
+  File* file = desc->file;
+  PageId pageNo = desc->pageNo;
+
+  // flush any existing changes to disk if necessary.  The page stays in the
+  // page table until it is written, so nobody can read a stale copy.
+  bool wasDirty = (desc->state->fetch_and(~BufDesc::DIRTY) & BufDesc::DIRTY) != 0;
+  if (wasDirty)
   {
     bufStats.diskwrites++;
-    //status = bufDescTable[clockHand].file->writePage(bufDescTable[clockHand].pageNo,
-    bufDescTable[clockHand].file->writePage(bufDescTable[clockHand].pageNo, bufPool[clockHand]);
+    bufStats.evictionWrites++;
+    try
+    {
+      std::lock_guard<std::mutex> io(ioLatch);
+      LatencyTimer timer(bufStats.writePageLatency);
+      file->writePage(pageNo, bufPool[frame]);
+    }
+    catch (...)
+    {
+      desc->unpin(true);
+      throw;
+    }
   }
 
-	//Reset all the BufDesc entry for the frame before returning the frame
-  bufDescTable[clockHand].Clear();
+  // the page now matches the file; keep a compressed copy if it pays
+  std::string compressed;
+  bool keep = pageCache.enabled() && CompressedPageCache::compress(bufPool[frame], compressed);
 
-  // return new frame number
-  frame = clockHand;
-} // end allocBuf
+  // remove previous entry from hash table, unless somebody pinned (and
+  // perhaps dirtied) the page while we were looking at it.  The copy goes
+  // into the second tier first, so whoever misses the page next finds it.
+  PageTableShard& shard = shardFor(file, pageNo);
+  {
+    std::lock_guard<std::mutex> guard(shard.latch);
+    if ((desc->state->load() & (BufDesc::PIN_MASK | BufDesc::DIRTY)) != 1)
+    {
+      desc->unpin(false);
+      return false;
+    }
+    if (keep)
+    {
+      pageCache.insert(file, pageNo, compressed);
+      bufStats.compressedStores++;
+    }
+    shard.table->tryRemove(file, pageNo);
+    desc->file = NULL;
+    desc->pageNo = Page::INVALID_NUMBER;
+    desc->state->store(1);
+  }
+  if (wasDirty)
+    bufStats.dirtyEvictions++;
+  else
+    bufStats.cleanEvictions++;
+  policy->recordEvict(frame, file, pageNo);
+  return true;
+}
+
+void BufMgr::releaseBuf(const FrameId frame)
+{
+	//Reset all the BufDesc entry for the frame before giving it back
+  bufDescTable[frame].Clear();
+  policy->recordFree(frame);
+}
 
 	
 void BufMgr::readPage(File* file, const PageId pageNo, Page*& page)
 {
-  // check to see if it is already in the buffer pool
-  // std::cout << "readPage called on file.page " << file << "." << pageNo << endl;
+  readPage(file, pageNo, page, NULL);
+}
+
+void BufMgr::readPage(File* file, const PageId pageNo, Page*& page, BufferAccessStrategy* strategy)
+{
+  page = &bufPool[pinPage(file, pageNo, strategy)];
+}
+
+PageGuard BufMgr::fetchPage(File* file, const PageId pageNo, BufferAccessStrategy* strategy)
+{
+  FrameId frameNo = pinPage(file, pageNo, strategy);
+  return PageGuard(this, frameNo, pageNo, &bufPool[frameNo]);
+}
+
+FrameId BufMgr::pinPage(File* file, const PageId pageNo, BufferAccessStrategy* strategy)
+{
+  LatencyTimer timer(bufStats.readPageLatency);
   FrameId frameNo = 0;
-	try
-	{
-  	hashTable->lookup(file, pageNo, frameNo);
+  bufStats.accesses++;
+
+  while (true)
+  {
+    // check to see if it is already in the buffer pool.  Scans reading
+    // through a ring do not make the pages they pass over look hot.
+    if (pinResident(file, pageNo, frameNo, strategy == NULL))
+    {
+      bufStats.hits++;
+      bufStats.files.recordHit(file);
+      policy->recordHit(frameNo);
+      return frameNo;
+    }
 
-    // set the referenced bit
-    bufDescTable[frameNo].refbit = true;
-    bufDescTable[frameNo].pinCnt++;
-    page = &bufPool[frameNo];
+    // not in the buffer pool, must read it in
+    if (loadPage(file, pageNo, frameNo, strategy, strategy == NULL))
+    {
+      bufStats.misses++;
+      bufStats.files.recordMiss(file);
+      return frameNo;
+    }
   }
-  catch(HashNotFoundException e) //not in the buffer pool, must allocate a new page
+}
+
+bool BufMgr::pinResident(File* file, const PageId pageNo, FrameId& frameNo, const bool reference)
+{
+  PageTableShard& shard = shardFor(file, pageNo);
+
+  while (true)
   {
-    // alloc a new frame
+    {
+      std::lock_guard<std::mutex> guard(shard.latch);
+      if (!shard.table->tryLookup(file, pageNo, frameNo))
+        return false;
+      // pin it and set the referenced bit
+      bufDescTable[frameNo].pin(reference);
+    }
+
+    // another thread may still be reading the page in; wait for it
+    BufDesc* desc = &bufDescTable[frameNo];
+    while (desc->state->load() & BufDesc::IO_BUSY)
+      std::this_thread::yield();
+
+    if (desc->state->load() & BufDesc::VALID)
+      return true;
+
+    // the read failed and the frame was given up; try again
+    desc->unpin(false);
+  }
+}
+
+bool BufMgr::loadPage(File* file, const PageId pageNo, FrameId& frameNo,
+                      BufferAccessStrategy* strategy, const bool reference)
+{
+  PageTableShard& shard = shardFor(file, pageNo);
+
+  // alloc a new frame
+  if (strategy)
+    allocBuf(frameNo, strategy);
+  else
     allocBuf(frameNo);
+  BufDesc* desc = &bufDescTable[frameNo];
+
+  // somebody may have brought the page in while we looked for a frame
+  {
+    std::lock_guard<std::mutex> guard(shard.latch);
+    FrameId otherFrame;
+    if (shard.table->tryLookup(file, pageNo, otherFrame))
+    {
+      releaseBuf(frameNo);
+      return false;
+    }
+
+    // set up the entry properly and insert in the hash table, marked as
+    // being read so that other readers wait for the contents
+    desc->file = file;
+    desc->pageNo = pageNo;
+    desc->state->store(1 | BufDesc::VALID | BufDesc::IO_BUSY | (reference ? BufDesc::REFBIT : 0));
+    shard.table->insert(file, pageNo, frameNo);
+    policy->recordLoad(frameNo, file, pageNo);
+  }
+
+  // read the page into the new frame, from the second tier if it is there
+  try
+  {
+    if (pageCache.enabled() && pageCache.take(file, pageNo, bufPool[frameNo]))
+      bufStats.compressedHits++;
+    else
+    {
+      bufStats.diskreads++;
+      std::lock_guard<std::mutex> io(ioLatch);
+      //status = file->readPage(pageNo, &bufPool[frameNo]);
+      bufPool[frameNo] = file->readPage(pageNo);
+    }
+  }
+  catch (...)
+  {
+    abortLoad(file, pageNo, frameNo);
+    throw;
+  }
+
+  desc->state->fetch_and(~BufDesc::IO_BUSY);
+  return true;
+}
+
+void BufMgr::abortLoad(File* file, const PageId pageNo, const FrameId frameNo)
+{
+  BufDesc* desc = &bufDescTable[frameNo];
+  {
+    PageTableShard& shard = shardFor(file, pageNo);
+    std::lock_guard<std::mutex> guard(shard.latch);
+    shard.table->tryRemove(file, pageNo);
+    desc->file = NULL;
+    desc->pageNo = Page::INVALID_NUMBER;
+    desc->state->fetch_and(BufDesc::PIN_MASK);
+  }
+  desc->unpin(false);
+}
+
+void BufMgr::sortByShard(const File* file, const PageId* pageNos, const std::uint32_t n,
+                         std::vector<std::pair<std::uint32_t, std::uint32_t> >& byShard)
+{
+  byShard.resize(n);
+  for (std::uint32_t i = 0; i < n; i++)
+    byShard[i] = std::make_pair((std::uint32_t)(&shardFor(file, pageNos[i]) - hashTable), i);
+  std::sort(byShard.begin(), byShard.end());
+}
+
+void BufMgr::readPages(File* file, const PageId* pageNos, const std::uint32_t n, Page** pages)
+{
+  typedef std::pair<std::uint32_t, std::uint32_t> Entry;
+  const FrameId NO_FRAME = BufferAccessStrategy::NO_FRAME;
+
+  // one pass over the page table pins the pages that are there already
+  bufStats.accesses.add(n);
+  std::vector<Entry> byShard;
+  sortByShard(file, pageNos, n, byShard);
+  std::vector<FrameId> frames(n, NO_FRAME);
+  for (std::uint32_t first = 0, last; first < n; first = last)
+  {
+    PageTableShard& shard = hashTable[byShard[first].first];
+    std::lock_guard<std::mutex> guard(shard.latch);
+    for (last = first; last < n && byShard[last].first == byShard[first].first; last++)
+    {
+      std::uint32_t i = byShard[last].second;
+      FrameId frameNo;
+      if (shard.table->tryLookup(file, pageNos[i], frameNo))
+      {
+        bufDescTable[frameNo].pin();
+        frames[i] = frameNo;
+      }
+    }
+  }
+
+  // whatever is missing, or was being read by a thread that failed, is
+  // loaded by us; (pageNo, index) pairs in page order
+  std::vector<Entry> misses;
+  for (std::uint32_t i = 0; i < n; i++)
+  {
+    if (frames[i] != NO_FRAME)
+    {
+      BufDesc* desc = &bufDescTable[frames[i]];
+      while (desc->state->load() & BufDesc::IO_BUSY)
+        std::this_thread::yield();
+      if (desc->state->load() & BufDesc::VALID)
+      {
+        bufStats.hits++;
+        bufStats.files.recordHit(file);
+        policy->recordHit(frames[i]);
+        continue;
+      }
+      desc->unpin(false);
+      frames[i] = NO_FRAME;
+    }
+    misses.push_back(Entry(pageNos[i], i));
+  }
+  std::sort(misses.begin(), misses.end());
+  std::vector<PageId> loads;
+  for (std::uint32_t m = 0; m < misses.size(); m++)
+  {
+    if (loads.empty() || loads.back() != misses[m].first)
+      loads.push_back(misses[m].first);
+  }
+
+  // reserve a frame for every load before reading anything, so running out
+  // of frames leaves nothing behind
+  std::vector<FrameId> loadFrames;
+  try
+  {
+    for (std::uint32_t k = 0; k < loads.size(); k++)
+    {
+      FrameId frameNo;
+      allocBuf(frameNo);
+      loadFrames.push_back(frameNo);
+    }
+  }
+  catch (...)
+  {
+    for (std::uint32_t k = 0; k < loadFrames.size(); k++)
+      releaseBuf(loadFrames[k]);
+    for (std::uint32_t i = 0; i < n; i++)
+    {
+      if (frames[i] != NO_FRAME)
+        bufDescTable[frames[i]].unpin(false);
+    }
+    throw;
+  }
+
+  // publish the loads, marked as being read; a page somebody else brought
+  // in meanwhile is left to readPage() below
+  for (std::uint32_t k = 0; k < loads.size(); k++)
+  {
+    PageTableShard& shard = shardFor(file, loads[k]);
+    std::lock_guard<std::mutex> guard(shard.latch);
+    FrameId otherFrame;
+    if (shard.table->tryLookup(file, loads[k], otherFrame))
+    {
+      releaseBuf(loadFrames[k]);
+      loadFrames[k] = NO_FRAME;
+      continue;
+    }
+    BufDesc* desc = &bufDescTable[loadFrames[k]];
+    desc->file = file;
+    desc->pageNo = loads[k];
+    desc->state->store(1 | BufDesc::VALID | BufDesc::IO_BUSY | BufDesc::REFBIT);
+    shard.table->insert(file, loads[k], loadFrames[k]);
+    policy->recordLoad(loadFrames[k], file, loads[k]);
+  }
+
+  // pages held in the second tier need no I/O at all
+  std::vector<bool> loaded(loads.size(), false);
+  for (std::uint32_t k = 0; k < loads.size() && pageCache.enabled(); k++)
+  {
+    if (loadFrames[k] != NO_FRAME && pageCache.take(file, loads[k], bufPool[loadFrames[k]]))
+    {
+      bufStats.compressedHits++;
+      bufStats.misses++;
+      bufStats.files.recordMiss(file);
+      stateTable[loadFrames[k]].fetch_and(~BufDesc::IO_BUSY);
+      loaded[k] = true;
+    }
+  }
+
+  // read the rest with all the reads in flight at once, in page order; runs
+  // of adjacent pages are read with one call each
+  std::exception_ptr error;
+  {
+    IoEngine& engine = *ioEngine.load();
+    IoBatch batch(loads.size());
+    std::vector<Page*> run;
+    std::lock_guard<std::mutex> io(ioLatch);
+    for (std::uint32_t k = 0, end; k < loads.size(); k = end)
+    {
+      end = k + 1;
+      if (loadFrames[k] == NO_FRAME || loaded[k])
+        continue;
+      run.assign(1, &bufPool[loadFrames[k]]);
+      for (; end < loads.size() && run.size() < MAX_RUN_PAGES && loads[end] == loads[end - 1] + 1 &&
+             loadFrames[end] != NO_FRAME && !loaded[end]; end++)
+        run.push_back(&bufPool[loadFrames[end]]);
+      batch.readRun(engine, file, loads[k], run.size(), &run[0], k);
+    }
+    batch.wait();
+
+    for (std::uint32_t k = 0; k < loads.size(); k++)
+    {
+      if (loadFrames[k] == NO_FRAME || loaded[k])
+        continue;
+      if (batch.error(k))
+      {
+        if (!error)
+          error = batch.error(k);
+        continue;
+      }
+      bufStats.diskreads++;
+      bufStats.misses++;
+      bufStats.files.recordMiss(file);
+      stateTable[loadFrames[k]].fetch_and(~BufDesc::IO_BUSY);
+      loaded[k] = true;
+    }
+  }
+
+  for (std::uint32_t k = 0; k < loads.size() && !error; k++)
+  {
+    if (loadFrames[k] != NO_FRAME)
+      continue;
+    try
+    {
+      loadFrames[k] = pinPage(file, loads[k], NULL);
+      loaded[k] = true;
+    }
+    catch (...)
+    {
+      error = std::current_exception();
+    }
+  }
+
+  // on failure give back everything pinned or published so far
+  if (error)
+  {
+    for (std::uint32_t k = 0; k < loads.size(); k++)
+    {
+      if (loaded[k])
+        bufDescTable[loadFrames[k]].unpin(false);
+      else if (loadFrames[k] != NO_FRAME)
+        abortLoad(file, loads[k], loadFrames[k]);
+    }
+    for (std::uint32_t i = 0; i < n; i++)
+    {
+      if (frames[i] != NO_FRAME)
+        bufDescTable[frames[i]].unpin(false);
+    }
+    std::rethrow_exception(error);
+  }
+
+  // every load carries one pin; pin again for pages listed more than once
+  for (std::uint32_t m = 0, k = 0; m < misses.size(); m++)
+  {
+    if (m > 0 && misses[m].first == misses[m - 1].first)
+      bufDescTable[loadFrames[k]].pin();
+    else if (m > 0)
+      k++;
+    frames[misses[m].second] = loadFrames[k];
+  }
+  for (std::uint32_t i = 0; i < n; i++)
+    pages[i] = &bufPool[frames[i]];
+}
+
+
+bool BufMgr::isResident(const File* file, const PageId pageNo)
+{
+  PageTableShard& shard = shardFor(file, pageNo);
+  std::lock_guard<std::mutex> guard(shard.latch);
+  FrameId frameNo;
+  return shard.table->tryLookup(file, pageNo, frameNo);
+}
+
+void BufMgr::prefetch(File* file, const PageId pageNo, BufferAccessStrategy* strategy)
+{
+  if (isResident(file, pageNo))
+    return;
+
+  std::lock_guard<std::mutex> guard(prefetchLatch);
+  // reading further ahead than a quarter of the pool would evict pages
+  // before anybody gets to use them
+  if (prefetchStop || prefetchQueue.size() >= std::max(1u, numBufs / 4))
+    return;
+  for (std::deque<PrefetchRequest>::iterator it = prefetchQueue.begin(); it != prefetchQueue.end(); ++it)
+  {
+    if (it->file == file && it->pageNo == pageNo)
+      return;
+  }
+
+  PrefetchRequest request = { file, pageNo, strategy };
+  prefetchQueue.push_back(request);
+  if (!prefetcher.joinable())
+    prefetcher = std::thread(&BufMgr::prefetchLoop, this);
+  prefetchCond.notify_all();
+}
+
+void BufMgr::prefetchRange(File* file, const PageId firstPageNo, const std::uint32_t count,
+                           BufferAccessStrategy* strategy)
+{
+  for (std::uint32_t i = 0; i < count; i++)
+    prefetch(file, firstPageNo + i, strategy);
+}
+
+void BufMgr::prefetchPages(const std::vector<PrefetchRequest>& requests)
+{
+  // frames for as many pages as the pool can spare.  Pages read ahead of a
+  // scan go into the scan's ring, or they would flood the pool just the same.
+  std::vector<FrameId> frames;
+  try
+  {
+    while (frames.size() < requests.size())
+    {
+      FrameId frameNo;
+      if (requests[frames.size()].strategy)
+        allocBuf(frameNo, requests[frames.size()].strategy);
+      else
+        allocBuf(frameNo);
+      frames.push_back(frameNo);
+    }
+  }
+  catch (...)
+  {
+    // the pool is full; read what we have frames for
+  }
 
-    // read the page into the new frame
-    bufStats.diskreads++;
-    //status = file->readPage(pageNo, &bufPool[frameNo]);
-    bufPool[frameNo] = file->readPage(pageNo);
+  // unlike readPage(), read first and publish afterwards, both under the I/O
+  // latch: a page that is not allocated yet fails to read, and one allocated
+  // meanwhile by allocPage() is already in the page table when we look
+  std::vector<bool> published(frames.size(), false);
+  {
+    IoEngine& engine = *ioEngine.load();
+    IoBatch batch(frames.size());
+    std::vector<bool> cached(frames.size(), false);
+    std::lock_guard<std::mutex> io(ioLatch);
+    for (std::uint32_t k = 0; k < frames.size(); k++)
+    {
+      if (pageCache.enabled() && pageCache.take(requests[k].file, requests[k].pageNo, bufPool[frames[k]]))
+      {
+        bufStats.compressedHits++;
+        cached[k] = true;
+      }
+    }
+    // requests for adjacent pages of a file, as queued by prefetchRange(),
+    // are read with one call each
+    std::vector<Page*> run;
+    for (std::uint32_t k = 0, end; k < frames.size(); k = end)
+    {
+      end = k + 1;
+      if (cached[k])
+        continue;
+      run.assign(1, &bufPool[frames[k]]);
+      for (; end < frames.size() && run.size() < MAX_RUN_PAGES && !cached[end] &&
+             requests[end].file == requests[k].file &&
+             requests[end].pageNo == requests[end - 1].pageNo + 1; end++)
+        run.push_back(&bufPool[frames[end]]);
+      batch.readRun(engine, requests[k].file, requests[k].pageNo, run.size(), &run[0], k);
+    }
+    batch.wait();
 
-    // set up the entry properly
-    bufDescTable[frameNo].Set(file, pageNo);
-    page = &bufPool[frameNo];
+    for (std::uint32_t k = 0; k < frames.size(); k++)
+    {
+      if (!cached[k])
+      {
+        if (batch.error(k))
+          continue;
+        bufStats.diskreads++;
+      }
 
-    // insert in the hash table
-    hashTable->insert(file, pageNo, frameNo);
+      File* file = requests[k].file;
+      const PageId pageNo = requests[k].pageNo;
+      PageTableShard& shard = shardFor(file, pageNo);
+      std::lock_guard<std::mutex> guard(shard.latch);
+      FrameId otherFrame;
+      if (!shard.table->tryLookup(file, pageNo, otherFrame))
+      {
+        // pages read ahead start out unreferenced so they do not displace hot
+        // pages if they are never used
+        BufDesc* desc = &bufDescTable[frames[k]];
+        desc->file = file;
+        desc->pageNo = pageNo;
+        desc->state->store(1 | BufDesc::VALID);
+        shard.table->insert(file, pageNo, frames[k]);
+        policy->recordLoad(frames[k], file, pageNo);
+        published[k] = true;
+      }
+    }
+  }
+
+  for (std::uint32_t k = 0; k < frames.size(); k++)
+  {
+    if (published[k])
+    {
+      bufStats.prefetches++;
+      bufDescTable[frames[k]].unpin(false);
+    }
+    else
+      releaseBuf(frames[k]);
+  }
+}
+
+void BufMgr::prefetchLoop()
+{
+  std::unique_lock<std::mutex> lock(prefetchLatch);
+  while (true)
+  {
+    while (!prefetchStop && prefetchQueue.empty())
+      prefetchCond.wait(lock);
+    if (prefetchStop)
+      return;
+
+    // take as many requests as the engine keeps in flight
+    const std::uint32_t depth = ioEngine.load()->queueDepth();
+    while (!prefetchQueue.empty() && prefetchActive.size() < depth)
+    {
+      prefetchActive.push_back(prefetchQueue.front());
+      prefetchQueue.pop_front();
+    }
+    lock.unlock();
+
+    // the reader may have caught up with us
+    std::vector<PrefetchRequest> requests;
+    for (std::uint32_t i = 0; i < prefetchActive.size(); i++)
+    {
+      if (!isResident(prefetchActive[i].file, prefetchActive[i].pageNo))
+        requests.push_back(prefetchActive[i]);
+    }
+    try
+    {
+      prefetchPages(requests);
+    }
+    catch (...)
+    {
+      // it was only a hint
+    }
+
+    lock.lock();
+    prefetchActive.clear();
+    prefetchCond.notify_all();
+  }
+}
+
+void BufMgr::cancelPrefetch(const File* file, const PageId pageNo)
+{
+  std::unique_lock<std::mutex> lock(prefetchLatch);
+  std::deque<PrefetchRequest>::iterator it = prefetchQueue.begin();
+  while (it != prefetchQueue.end())
+  {
+    if (it->file == file && (pageNo == Page::INVALID_NUMBER || it->pageNo == pageNo))
+      it = prefetchQueue.erase(it);
+    else
+      ++it;
+  }
+
+  while (true)
+  {
+    bool active = false;
+    for (std::uint32_t i = 0; i < prefetchActive.size() && !active; i++)
+      active = prefetchActive[i].file == file &&
+               (pageNo == Page::INVALID_NUMBER || prefetchActive[i].pageNo == pageNo);
+    if (!active)
+      break;
+    prefetchCond.wait(lock);
   }
 }
 
@@ -155,78 +1051,351 @@ void BufMgr::unPinPage(File* file, const PageId pageNo,
 			     const bool dirty) 
 {
   // lookup in hashtable
+  PageTableShard& shard = shardFor(file, pageNo);
   FrameId frameNo = 0;
-  hashTable->lookup(file, pageNo, frameNo);
-
-  if (dirty == true) bufDescTable[frameNo].dirty = dirty;
+  bool found;
+  {
+    std::lock_guard<std::mutex> guard(shard.latch);
+    found = shard.table->tryLookup(file, pageNo, frameNo);
+  }
+  if (!found)
+    throw HashNotFoundException(file->filename(), pageNo);
 
   // make sure the page is actually pinned
-  if (bufDescTable[frameNo].pinCnt == 0)
+  if (!bufDescTable[frameNo].unpin(dirty))
   {
   	throw PageNotPinnedException(file->filename(), pageNo, frameNo);
   }
-  else bufDescTable[frameNo].pinCnt--;
+}
+
+void BufMgr::unpinFrame(const FrameId frameNo, const bool dirty)
+{
+  // the guard's pin keeps the page in the frame, so no lookup is needed
+  bufDescTable[frameNo].unpin(dirty);
+}
+
+void BufMgr::unPinPages(File* file, const PageId* pageNos, const std::uint32_t n,
+                        const bool dirty)
+{
+  std::vector<std::pair<std::uint32_t, std::uint32_t> > byShard;
+  sortByShard(file, pageNos, n, byShard);
+
+  std::exception_ptr error;
+  for (std::uint32_t first = 0, last; first < n; first = last)
+  {
+    PageTableShard& shard = hashTable[byShard[first].first];
+    std::lock_guard<std::mutex> guard(shard.latch);
+    for (last = first; last < n && byShard[last].first == byShard[first].first; last++)
+    {
+      PageId pageNo = pageNos[byShard[last].second];
+      FrameId frameNo;
+      if (!shard.table->tryLookup(file, pageNo, frameNo))
+      {
+        if (!error)
+          error = std::make_exception_ptr(HashNotFoundException(file->filename(), pageNo));
+      }
+      else if (!bufDescTable[frameNo].unpin(dirty) && !error)
+        error = std::make_exception_ptr(PageNotPinnedException(file->filename(), pageNo, frameNo));
+    }
+  }
+  if (error)
+    std::rethrow_exception(error);
 }
 
 void BufMgr::flushFile(const File* file) 
 {
+  // a shrink takes frames out of the pool before it empties them, so wait
+  // for it; afterwards no frame at or above numBufs holds a page
+  std::lock_guard<std::mutex> resizing(resizeLatch);
+
+  // nothing may be read into the pool for this file behind our back
+  cancelPrefetch(file, Page::INVALID_NUMBER);
+
+  // write the dirty pages back first, runs of adjacent pages with one call
+  // each; a page that is still dirty after that is written on its own below
+  std::vector<FrameId> dirty;
+  for (std::uint32_t i = 0; i < numBufs; i++)
+  {
+    if (bufDescTable[i].file.load() == file && bufDescTable[i].dirty())
+      dirty.push_back(i);
+  }
+  writeFrames(dirty);
+
   for (std::uint32_t i = 0; i < numBufs; i++)
 	{
   	BufDesc* tmpbuf = &(bufDescTable[i]);
-  	if(tmpbuf->valid == true && tmpbuf->file == file)
+  	if (tmpbuf->file.load() != file)
+      continue;
+
+  	if(tmpbuf->valid() == true)
 		{
-	    if (tmpbuf->pinCnt > 0)
+	    tmpbuf->waitForWrite();
+	    if (!tmpbuf->tryClaim())
   			throw PagePinnedException(file->filename(), tmpbuf->pageNo, tmpbuf->frameNo);
 
-	    if (tmpbuf->dirty == true)
+	    if (tmpbuf->state->fetch_and(~BufDesc::DIRTY) & BufDesc::DIRTY)
 			{
 				//if ((status = tmpbuf->file->writePage(tmpbuf->pageNo, &(bufPool[i]))) != OK)
-				tmpbuf->file->writePage(tmpbuf->pageNo, bufPool[i]);
-				tmpbuf->dirty = false;
+				std::lock_guard<std::mutex> io(ioLatch);
+				LatencyTimer timer(bufStats.writePageLatency);
+				tmpbuf->file.load()->writePage(tmpbuf->pageNo, bufPool[i]);
     	}
 
-    	hashTable->remove(file,tmpbuf->pageNo);
+      PageTableShard& shard = shardFor(file, tmpbuf->pageNo);
+      std::lock_guard<std::mutex> guard(shard.latch);
+      if (tmpbuf->pinCnt() != 1)
+      {
+        tmpbuf->unpin(false);
+  			throw PagePinnedException(file->filename(), tmpbuf->pageNo, tmpbuf->frameNo);
+      }
+    	shard.table->tryRemove(file,tmpbuf->pageNo);
     	tmpbuf->Clear();
+    	policy->recordFree(i);
   	}
-		else if (tmpbuf->valid == false && tmpbuf->file == file)
-  		throw BadBufferException(tmpbuf->frameNo, tmpbuf->dirty, tmpbuf->valid, tmpbuf->refbit);
+		else if (tmpbuf->pinCnt() == 0)
+  		throw BadBufferException(tmpbuf->frameNo, tmpbuf->dirty(), tmpbuf->valid(), tmpbuf->refbit());
   }
+
+  // the checksums of the pages written back, in one write for all of them
+  file->flushChecksums();
+
+  // the file object may go away now; keep its counts under its name
+  bufStats.files.retire(file);
+  pageCache.eraseFile(file);
+}
+
+PageGuard BufMgr::newPage(File* file)
+{
+  PageId pageNo;
+  Page* page;
+  allocPage(file, pageNo, page);
+  return PageGuard(this, frameOf(page), pageNo, page);
 }
 
 void BufMgr::disposePage(File* file, const PageId pageNo) 
 {
 	//Deallocate from file altogether
-  //See if it is in the buffer pool
-  FrameId frameNo = 0;
-  hashTable->lookup(file, pageNo, frameNo);
+  cancelPrefetch(file, pageNo);
 
-	// clear the page
-	bufDescTable[frameNo].Clear();
+  //See if it is in the buffer pool
+  PageTableShard& shard = shardFor(file, pageNo);
+  {
+    std::lock_guard<std::mutex> guard(shard.latch);
+    FrameId frameNo = 0;
+    if (shard.table->tryLookup(file, pageNo, frameNo))
+    {
+			// clear the page, once the background writer is done with it
+			bufDescTable[frameNo].waitForWrite();
+			bufDescTable[frameNo].Clear();
+			policy->recordFree(frameNo);
 
-	hashTable->remove(file, pageNo);
+			shard.table->tryRemove(file, pageNo);
+    }
+  }
 
   // deallocate it in the file	
+  pageCache.erase(file, pageNo);
+  std::lock_guard<std::mutex> io(ioLatch);
   file->deletePage(pageNo);
 }
 
 
 void BufMgr::allocPage(File* file, PageId &pageNo, Page*& page) 
 {
+  LatencyTimer timer(bufStats.allocPageLatency);
   FrameId frameNo;
 
   // alloc a new frame
   allocBuf(frameNo);
 
-  // allocate a new page in the file
+  // allocate a new page in the file.  The page is entered in the page table
+  // before the file is released, so a prefetch of a reused page number cannot
+  // slip in between.
 	//std::cerr << "buffer data size:" << bufPool[frameNo].data_.length() << "\n";
-  bufPool[frameNo] = file->allocatePage(pageNo);
+  std::lock_guard<std::mutex> io(ioLatch);
+  try
+  {
+    bufPool[frameNo] = file->allocatePage(pageNo);
+  }
+  catch (...)
+  {
+    releaseBuf(frameNo);
+    throw;
+  }
+
   page = &bufPool[frameNo];
 
-  // set up the entry properly
+  // set up the entry properly and insert in the hash table
+  PageTableShard& shard = shardFor(file, pageNo);
+  std::lock_guard<std::mutex> guard(shard.latch);
   bufDescTable[frameNo].Set(file, pageNo);
+  shard.table->insert(file, pageNo, frameNo);
+  policy->recordLoad(frameNo, file, pageNo);
+}
+
+void BufMgr::startWriter(const std::uint32_t intervalMs, const std::uint32_t maxPages)
+{
+  std::lock_guard<std::mutex> guard(writerLatch);
+  writerInterval = intervalMs;
+  writerMaxPages = maxPages ? maxPages : std::max(1u, numBufs / 8);
+  if (!writer.joinable())
+  {
+    writerStop = false;
+    writer = std::thread(&BufMgr::writerLoop, this);
+  }
+}
+
+void BufMgr::stopWriter()
+{
+  {
+    std::lock_guard<std::mutex> guard(writerLatch);
+    writerStop = true;
+  }
+  writerCond.notify_all();
+  if (writer.joinable())
+    writer.join();
+}
+
+void BufMgr::writerLoop()
+{
+  std::vector<FrameId> candidates, dirty;
+  std::uint64_t lastEvictions = bufStats.cleanEvictions.load() + bufStats.dirtyEvictions.load();
+  std::uint64_t lastEvictionWrites = bufStats.evictionWrites.load();
+  std::unique_lock<std::mutex> lock(writerLatch);
+  while (!writerStop)
+  {
+    std::uint32_t minPages = writerMaxPages;
+    lock.unlock();
+
+    // keep ahead of the evictions of the last round, twice over, so that the
+    // pages the hand reaches before the next round are already clean
+    const std::uint32_t n = numBufs;
+    const std::uint64_t evictions = bufStats.cleanEvictions.load() + bufStats.dirtyEvictions.load();
+    const std::uint64_t evictionWrites = bufStats.evictionWrites.load();
+    const std::uint64_t recent = evictions >= lastEvictions ? evictions - lastEvictions : 0;
+    const bool behind = evictionWrites > lastEvictionWrites;
+    lastEvictions = evictions;
+    lastEvictionWrites = evictionWrites;
+    const std::uint32_t maxPages = static_cast<std::uint32_t>(
+        std::min<std::uint64_t>(std::max<std::uint64_t>(minPages, 2 * recent), n));
+
+    // clean the dirty, unpinned pages among those the policy will evict
+    // next; looking a quarter of the pool ahead leaves the pages time to be
+    // written before a foreground thread gets to them, and the whole pool
+    // once the foreground has caught up with the writer
+    candidates.clear();
+    dirty.clear();
+    policy->nextVictims(candidates, behind ? n : std::max(maxPages, n / 4));
+    for (std::uint32_t i = 0; i < candidates.size() && dirty.size() < maxPages; i++)
+    {
+      std::uint32_t st = stateTable[candidates[i]].load();
+      if ((st & (BufDesc::VALID | BufDesc::DIRTY | BufDesc::IO_BUSY | BufDesc::PIN_MASK)) ==
+          (BufDesc::VALID | BufDesc::DIRTY))
+        dirty.push_back(candidates[i]);
+    }
+    writeFrames(dirty);
+
+    // a foreground thread wrote a victim itself: go round again at once
+    lock.lock();
+    if (!writerStop && !(behind && !dirty.empty()))
+      writerCond.wait_for(lock, std::chrono::milliseconds(writerInterval));
+  }
+}
+
+void BufMgr::setIoEngine(IoEngine* engine)
+{
+  ioEngine = engine != NULL ? engine : &IoEngine::shared();
+}
+
+std::uint32_t BufMgr::checkpoint()
+{
+  std::vector<FrameId> frames;
+  for (std::uint32_t i = 0, n = numBufs; i < n; i++)
+  {
+    const std::uint32_t state = stateTable[i].load();
+    if ((state & BufDesc::DIRTY) && !(state & BufDesc::PIN_MASK))
+      frames.push_back(i);
+  }
+  return writeFrames(frames);
+}
+
+std::uint32_t BufMgr::writeFrames(const std::vector<FrameId>& frames)
+{
+  // take ownership of the writes first, which also freezes which page each
+  // frame holds, then order the pages so runs of a file go out sequentially
+  typedef std::pair<std::pair<File*, PageId>, FrameId> WriteEntry;
+  std::vector<WriteEntry> batch;
+  for (std::uint32_t i = 0; i < frames.size(); i++)
+  {
+    BufDesc* desc = &bufDescTable[frames[i]];
+    if (desc->tryStartWrite())
+      batch.push_back(WriteEntry(std::make_pair(desc->file.load(), desc->pageNo.load()), frames[i]));
+  }
+  std::sort(batch.begin(), batch.end());
 
-  // insert in the hash table
-  hashTable->insert(file, pageNo, frameNo);
+  // write as many runs of adjacent pages at a time as the engine keeps
+  // requests in flight; a run goes out with one call
+  IoEngine& engine = *ioEngine.load();
+  std::uint32_t written = 0;
+  std::vector<std::uint32_t> runEnds;
+  for (std::uint32_t first = 0, last; first < batch.size(); first = last)
+  {
+    runEnds.clear();
+    for (last = first; last < batch.size() && runEnds.size() < engine.queueDepth(); )
+    {
+      std::uint32_t end = last + 1;
+      while (end < batch.size() && end - last < MAX_RUN_PAGES &&
+             batch[end].first.first == batch[last].first.first &&
+             batch[end].first.second == batch[end - 1].first.second + 1)
+        end++;
+      runEnds.push_back(end);
+      last = end;
+    }
+
+    IoBatch writes(last - first, &bufStats.writePageLatency);
+    {
+      std::vector<const Page*> run;
+      std::lock_guard<std::mutex> io(ioLatch);
+      for (std::uint32_t r = 0, k = first; r < runEnds.size(); k = runEnds[r++])
+      {
+        run.clear();
+        for (std::uint32_t i = k; i < runEnds[r]; i++)
+          run.push_back(&bufPool[batch[i].second]);
+        writes.writeRun(engine, batch[k].first.first, batch[k].first.second, run.size(), &run[0], k - first);
+      }
+      writes.wait();
+    }
+
+    for (std::uint32_t k = first; k < last; k++)
+    {
+      bool failed = (bool)writes.error(k - first);
+      bufDescTable[batch[k].second].endWrite(failed);
+      if (!failed)
+      {
+        bufStats.diskwrites++;
+        written++;
+      }
+    }
+  }
+  return written;
+}
+
+void BufMgr::latchPage(const Page* page, const bool exclusive)
+{
+  BufDesc* desc = &bufDescTable[frameOf(page)];
+  if (exclusive)
+    desc->latch.lockExclusive();
+  else
+    desc->latch.lockShared();
+}
+
+void BufMgr::unlatchPage(const Page* page, const bool exclusive)
+{
+  BufDesc* desc = &bufDescTable[frameOf(page)];
+  if (exclusive)
+    desc->latch.unlockExclusive();
+  else
+    desc->latch.unlockShared();
 }
 
 void BufMgr::printSelf(void) 
@@ -240,11 +1409,83 @@ void BufMgr::printSelf(void)
 		std::cout << "FrameNo:" << i << " ";
 		tmpbuf->Print();
 
-  	if (tmpbuf->valid == true)
+  	if (tmpbuf->valid() == true)
     	validFrames++;
   }
 
 	std::cout << "Total Number of Valid Frames:" << validFrames << "\n";
+	std::cout << "Replacement Policy:" << policy->name() << "\n";
+}
+
+void BufMgr::dumpStats(std::ostream& out, const StatsFormat format) const
+{
+  if (format == STATS_PROMETHEUS)
+  {
+    out << "# HELP badgerdb_buffer_frames Frames in the buffer pool.\n"
+        << "# TYPE badgerdb_buffer_frames gauge\n"
+        << "badgerdb_buffer_frames " << numBufs.load() << "\n";
+    bufStats.dump(out, format);
+    return;
+  }
+
+  out << "{\"frames\":" << numBufs.load() << ",\"policy\":\"" << policy->name() << "\",\"stats\":";
+  bufStats.dump(out, format);
+  out << "}\n";
+}
+
+//----------------------------------------
+// PageGuard
+//----------------------------------------
+
+PageGuard::PageGuard()
+  : bufMgr(NULL), frameNo(0), pageNo(Page::INVALID_NUMBER), page(NULL), dirty(false)
+{
+}
+
+PageGuard::PageGuard(BufMgr* bufMgrIn, const FrameId frameNoIn, const PageId pageNoIn, Page* pageIn)
+  : bufMgr(bufMgrIn), frameNo(frameNoIn), pageNo(pageNoIn), page(pageIn), dirty(false)
+{
+}
+
+PageGuard::PageGuard(PageGuard&& other)
+  : bufMgr(other.bufMgr), frameNo(other.frameNo), pageNo(other.pageNo), page(other.page),
+    dirty(other.dirty)
+{
+  other.bufMgr = NULL;
+  other.page = NULL;
+  other.dirty = false;
+}
+
+PageGuard& PageGuard::operator=(PageGuard&& other)
+{
+  if (this != &other)
+  {
+    release();
+    bufMgr = other.bufMgr;
+    frameNo = other.frameNo;
+    pageNo = other.pageNo;
+    page = other.page;
+    dirty = other.dirty;
+    other.bufMgr = NULL;
+    other.page = NULL;
+    other.dirty = false;
+  }
+  return *this;
+}
+
+PageGuard::~PageGuard()
+{
+  release();
+}
+
+void PageGuard::release()
+{
+  if (bufMgr == NULL)
+    return;
+  bufMgr->unpinFrame(frameNo, dirty);
+  bufMgr = NULL;
+  page = NULL;
+  dirty = false;
 }
 
 }
@@ -7,9 +7,20 @@
 
 #pragma once
 
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
 #include "file.h"
 #include "bufHashTbl.h"
-#include <iostream>
+#include "latch.h"
+#include "replacer.h"
+#include "pool_memory.h"
+#include "bufStats.h"
+#include "pageCache.h"
 
 namespace badgerdb {
 
@@ -20,60 +31,222 @@ class BufMgr;
 
 /**
 * @brief Class for maintaining information about buffer pool frames
+*
+* The pin count and the dirty, valid, reference and I/O flags of a frame are
+* packed into a single atomic word so that they can be read and changed
+* without holding any latch.  The words of all frames are kept apart from the
+* descriptors in one dense array, sixteen to a cache line, so that the CLOCK
+* sweep never pulls in a descriptor.  file and pageNo are only written by the
+* thread that has the frame claimed (pinned while it is not mapped in the page
+* table).
 */
 class BufDesc {
 
 	friend class BufMgr;
+	friend class ReplacementPolicy;
+	friend class ClockPolicy;
 
  private:
 	/**
+	 * Bits of 'state' holding the pin count
+	 */
+  static const std::uint32_t PIN_MASK = 0x00FFFFFF;
+
+	/**
+	 * Set if the frame has been referenced since the clock hand last passed it
+	 */
+  static const std::uint32_t REFBIT = 1u << 24;
+
+	/**
+	 * Set if the page in the frame is dirty
+	 */
+  static const std::uint32_t DIRTY = 1u << 25;
+
+	/**
+	 * Set if the frame holds a page
+	 */
+  static const std::uint32_t VALID = 1u << 26;
+
+	/**
+	 * Set while the page is being read into the frame from disk
+	 */
+  static const std::uint32_t IO_BUSY = 1u << 27;
+
+	/**
+	 * Set while the frame is not part of the pool, see BufMgr::resize()
+	 */
+  static const std::uint32_t OFFLINE = 1u << 28;
+
+	/**
    * Pointer to file to which corresponding frame is assigned
 	 */
-  File* file;
+  std::atomic<File*> file;
 
 	/**
    * Page within file to which corresponding frame is assigned
 	 */
-  PageId pageNo;
+  std::atomic<PageId> pageNo;
 
 	/**
    * Frame number of the frame, in the buffer pool, being used
 	 */
   FrameId	frameNo;
 
+	/**
+   * Pin count and flags, see PIN_MASK, REFBIT, DIRTY, VALID and IO_BUSY.
+   * Points into the dense state array of the buffer manager.
+	 */
+  FrameState* state;
+
+	/**
+   * Statistics of the pool, told when the frame becomes pinned or unpinned
+	 */
+  BufStats* stats;
+
+	/**
+   * Latch protecting the contents of the page held in this frame
+	 */
+  RWLatch latch;
+
 	/**
    * Number of times this page has been pinned
 	 */
-  int pinCnt;
+  std::uint32_t pinCnt() const { return state->load() & PIN_MASK; }
 
 	/**
    * True if page is dirty;  false otherwise
 	 */
-  bool dirty;
+  bool dirty() const { return (state->load() & DIRTY) != 0; }
 
 	/**
    * True if page is valid
 	 */
-  bool valid;
+  bool valid() const { return (state->load() & VALID) != 0; }
 
 	/**
    * Has this buffer frame been reference recently
 	 */
-  bool refbit;
+  bool refbit() const { return (state->load() & REFBIT) != 0; }
+
+	/**
+	 * Pins a frame found through the page table and optionally sets its
+	 * reference bit.  Must be called with the page table shard of the page
+	 * latched.
+	 */
+  void pin(const bool reference = true)
+  {
+    std::uint32_t old = state->load();
+    while (!state->compare_exchange_weak(old, (old + 1) | (reference ? REFBIT : 0)))
+      ;
+    if ((old & PIN_MASK) == 0)
+      stats->framePinned();
+  }
+
+	/**
+	 * Claims an unpinned frame for eviction or reuse by pinning it, provided
+	 * nobody holds a pin, no read is in progress and the frame is in the pool.
+	 *
+	 * @return  True if the frame is now claimed by the caller.
+	 */
+  bool tryClaim()
+  {
+    if (!tryClaim(*state))
+      return false;
+    stats->framePinned();
+    return true;
+  }
+
+	/**
+	 * tryClaim() on a state word, for code that sweeps the state array.
+	 */
+  static bool tryClaim(FrameState& word)
+  {
+    std::uint32_t old = word.load();
+    return (old & (PIN_MASK | IO_BUSY | OFFLINE)) == 0 &&
+        word.compare_exchange_strong(old, old + 1);
+  }
+
+	/**
+	 * Marks a dirty, unpinned page as being written back by the background
+	 * writer or a checkpoint.  The page is marked clean and IO_BUSY; new
+	 * readers wait for the write to finish and the frame cannot be claimed
+	 * meanwhile.
+	 *
+	 * @return  True if the caller now owns the write.
+	 */
+  bool tryStartWrite()
+  {
+    std::uint32_t old = state->load();
+    do
+    {
+      if ((old & (VALID | DIRTY | IO_BUSY | PIN_MASK)) != (VALID | DIRTY))
+        return false;
+    } while (!state->compare_exchange_weak(old, (old | IO_BUSY) & ~DIRTY));
+    return true;
+  }
+
+	/**
+	 * Ends a write started with tryStartWrite().
+	 *
+	 * @param failed	True if the page could not be written and is still dirty
+	 */
+  void endWrite(const bool failed)
+  {
+    if (failed)
+      state->fetch_or(DIRTY);
+    state->fetch_and(~IO_BUSY);
+  }
+
+	/**
+	 * Waits for a write by the background writer or a checkpoint to finish.
+	 * Such writes are the only I/O on a frame nobody has pinned.
+	 */
+  void waitForWrite() const
+  {
+    std::uint32_t st;
+    while (((st = state->load()) & IO_BUSY) && (st & PIN_MASK) == 0)
+      std::this_thread::yield();
+  }
+
+	/**
+	 * Drops one pin and optionally marks the page dirty.
+	 *
+	 * @return  False if the frame was not pinned.
+	 */
+  bool unpin(const bool makeDirty)
+  {
+    std::uint32_t old = state->load();
+    do
+    {
+      if ((old & PIN_MASK) == 0)
+        return false;
+    } while (!state->compare_exchange_weak(old, (old - 1) | (makeDirty ? DIRTY : 0)));
+    if ((old & PIN_MASK) == 1)
+      stats->frameUnpinned();
+    return true;
+  }
 
 	/**
    * Initialize buffer frame for a new user
 	 */
   void Clear()
 	{
-    pinCnt = 0;
 		file = NULL;
 		pageNo = Page::INVALID_NUMBER;
-    dirty = false;
-    refbit = false;
-		valid = false;
+    if (state->exchange(0) & PIN_MASK)
+      stats->frameUnpinned();
   };
 
+	/**
+	 * Takes an empty frame claimed by the caller out of the pool.  It cannot
+	 * be claimed again until the state word is reset.
+	 */
+  void setOffline()
+  {
+    if (state->exchange(OFFLINE) & PIN_MASK)
+      stats->frameUnpinned();
+  }
+
 	/**
 	 * Set values of member variables corresponding to assignment of frame to a page in the file. Called when a frame 
 	 * in buffer pool is allocated to any page in the file through readPage() or allocPage()
@@ -85,32 +258,34 @@ class BufDesc {
 	{ 
 		file = filePtr;
     pageNo = pageNum;
-    pinCnt = 1;
-    dirty = false;
-    valid = true;
-    refbit = true;
+    state->store(1 | VALID | REFBIT);
   }
 
   void Print()
 	{
-		if(file != NULL)
+		File* filePtr = file;
+		if(filePtr != NULL)
 		{
-			std::cout << "file:" << file->filename() << " ";
+			std::cout << "file:" << filePtr->filename() << " ";
 			std::cout << "pageNo:" << pageNo << " ";
 		}
 		else
 			std::cout << "file:NULL ";
 
-		std::cout << "valid:" << valid << " ";
-		std::cout << "pinCnt:" << pinCnt << " ";
-		std::cout << "dirty:" << dirty << " ";
-		std::cout << "refbit:" << refbit << "\n";
+		std::cout << "valid:" << valid() << " ";
+		std::cout << "pinCnt:" << pinCnt() << " ";
+		std::cout << "dirty:" << dirty() << " ";
+		std::cout << "refbit:" << refbit() << "\n";
   }
 
 	/**
-   * Constructor of BufDesc class 
+   * Constructor of BufDesc class
+	 *
+	 * @param stateWord	Slot of the frame in the dense state array
+	 * @param statsIn	Statistics of the pool
 	 */
-  BufDesc()
+  BufDesc(FrameState* stateWord, BufStats* statsIn)
+		: state(stateWord), stats(statsIn)
 	{
   	Clear();
   }
@@ -118,68 +293,322 @@ class BufDesc {
 
 
 /**
-* @brief Class to maintain statistics of buffer usage 
+* @brief Hint that a caller reads many pages once, e.g. a sequential scan.
+*
+* Pages read with a strategy are loaded into a small private ring of frames
+* that is recycled as the caller moves on, rather than into frames taken from
+* the whole pool, so a large scan cannot push out everybody else's pages.
+* Frames read through the ring do not get their reference bit set.  A frame
+* that another caller has pinned or referenced since it was loaded is left in
+* the pool and replaced in the ring by a fresh one.  Like PostgreSQL's
+* BufferAccessStrategy.
+*
+* @warning An object must only be used by one thread at a time, apart from the
+* prefetcher reading pages into its ring on behalf of BufMgr::prefetch().
 */
-struct BufStats
+class BufferAccessStrategy
 {
+	friend class BufMgr;
+
+ public:
 	/**
-   * Total number of accesses to buffer pool
+   * Default number of frames in the ring
 	 */
-  int accesses;
+  static const std::uint32_t DEFAULT_RING_SIZE = 32;
 
 	/**
-   * Number of pages read from disk (including allocs)
+   * Constructor of BufferAccessStrategy class
+	 *
+	 * @param ringSize	Number of frames to recycle.  BufMgr uses at most a quarter of its pool.
 	 */
-  int diskreads;
+  explicit BufferAccessStrategy(const std::uint32_t ringSize = DEFAULT_RING_SIZE)
+    : ring(ringSize ? ringSize : 1, NO_FRAME), current(0) {}
 
+ private:
 	/**
-   * Number of pages written back to disk
+   * Marks an empty slot of the ring
 	 */
-  int diskwrites;
+  static const FrameId NO_FRAME = ~(FrameId)0;
 
 	/**
-   * Clear all values 
+   * Frames last loaded through this strategy
 	 */
-  void clear()
-  {
-		accesses = diskreads = diskwrites = 0;
-  }
-      
+  std::vector<FrameId> ring;
+
 	/**
-   * Constructor of BufStats class 
+   * Slot of 'ring' to fill next
 	 */
-  BufStats()
-  {
-		clear();
-  }
+  std::uint32_t current;
+
+	/**
+   * Protects 'ring' and 'current' from the prefetcher
+	 */
+  std::mutex latch;
+};
+
+
+/**
+* @brief A page queued for reading ahead
+*/
+struct PrefetchRequest
+{
+	/**
+   * File the page belongs to
+	 */
+  File* file;
+
+	/**
+   * Page within file
+	 */
+  PageId pageNo;
+
+	/**
+   * Ring to read the page into, or NULL to take a frame from the whole pool
+	 */
+  BufferAccessStrategy* strategy;
+};
+
+
+/**
+* @brief One independently latched partition of the page table
+*/
+struct PageTableShard
+{
+	/**
+   * Protects 'table' and orders pinning against eviction of pages in it
+	 */
+  std::mutex latch;
+
+	/**
+   * Hash table mapping (File, page) to frame for pages hashed to this shard
+	 */
+  BufHashTbl *table;
+};
+
+
+/**
+* @brief A block of frames added to the buffer pool in one piece
+*/
+struct PoolChunk
+{
+	/**
+   * Memory holding the pages, descriptors and state words of the frames
+	 */
+  PoolMemory *memory;
+
+	/**
+   * Page of the first frame; the pages of a chunk are contiguous
+	 */
+  Page *pages;
+
+	/**
+   * Number of the first frame of the chunk
+	 */
+  FrameId firstFrame;
+
+	/**
+   * Number of frames in the chunk, a whole number of extents
+	 */
+  std::uint32_t numFrames;
+};
+
+
+/**
+* @brief A pinned page that is unpinned when the guard goes out of scope
+*
+* Returned by BufMgr::fetchPage() and BufMgr::newPage().  The guard remembers
+* the frame holding the page, so unpinning it does not look the page up in the
+* page table again.  Guards can be moved but not copied; a guard that was
+* moved from or released holds no page.
+*/
+class PageGuard
+{
+  friend class BufMgr;
+
+ public:
+	/**
+   * Constructs a guard holding no page
+	 */
+  PageGuard();
+
+	/**
+   * Takes over the pin held by 'other', which is left empty
+	 */
+  PageGuard(PageGuard&& other);
+
+	/**
+   * Unpins the page held so far and takes over the pin held by 'other'
+	 */
+  PageGuard& operator=(PageGuard&& other);
+
+	/**
+   * Unpins the page, if any
+	 */
+  ~PageGuard();
+
+	/**
+   * Returns the page, or NULL if the guard is empty
+	 */
+  Page* getPage() const { return page; }
+
+	/**
+   * Returns the page viewed as a 'T', e.g. a node of an index
+	 */
+  template<class T>
+  T* as() const { return reinterpret_cast<T*>(page); }
+
+  Page* operator->() const { return page; }
+  Page& operator*() const { return *page; }
+
+	/**
+   * Returns the number of the page within its file
+	 */
+  PageId getPageNo() const { return pageNo; }
+
+	/**
+   * True if the guard holds no page
+	 */
+  bool empty() const { return page == NULL; }
+
+	/**
+   * Marks the page to be written back when it is unpinned
+	 */
+  void markDirty() { dirty = true; }
+
+	/**
+   * Unpins the page now rather than when the guard is destroyed
+	 */
+  void release();
+
+ private:
+  PageGuard(BufMgr* bufMgrIn, const FrameId frameNoIn, const PageId pageNoIn, Page* pageIn);
+  PageGuard(const PageGuard&);
+  PageGuard& operator=(const PageGuard&);
+
+	/**
+   * Buffer manager the page is pinned in, NULL if the guard is empty
+	 */
+  BufMgr* bufMgr;
+
+	/**
+   * Frame holding the page
+	 */
+  FrameId frameNo;
+
+	/**
+   * Page number within its file
+	 */
+  PageId pageNo;
+
+	/**
+   * The pinned page
+	 */
+  Page* page;
+
+	/**
+   * True if the page has to be unpinned dirty
+	 */
+  bool dirty;
 };
 
 
 /**
 * @brief The central class which manages the buffer pool including frame allocation and deallocation to pages in the file 
+*
+* The buffer manager may be used from several threads at once.  The page table
+* is split into shards with their own latch, pin counts and flags of a frame
+* are updated atomically, and the clock sweep claims victims with a single
+* compare-and-swap.  Which page is evicted is decided by a ReplacementPolicy
+* chosen at construction.  Callers who share a page between threads can use
+* latchPage()/unlatchPage() to coordinate access to its contents.  File objects
+* are not threadsafe, so the buffer manager serializes its own calls into the
+* file layer.
+*
+* The pool can be resized while in use.  Its frames live in chunks that are
+* allocated as the pool grows and are reached through directories indexed by
+* frame number, so a frame never moves once it exists.
 */
 class BufMgr 
 {
+	friend class PageGuard;
+
  private:
 	/**
-   * Current position of clockhand in our buffer pool
+   * Maximum number of chunks the pool can be made of
+	 */
+  static const std::uint32_t MAX_CHUNKS = 32;
+
+	/**
+   * Milliseconds resize() waits for a pinned frame it wants to take out of
+   * the pool before it gives up
 	 */
-  FrameId clockHand;
+  static const std::uint32_t SHRINK_WAIT_MS = 100;
 
 	/**
-   * Number of frames in the buffer pool
+   * Number of frames in the buffer pool; frames numBufs and up are offline
 	 */
-  std::uint32_t numBufs;
+  std::atomic<std::uint32_t> numBufs;
+
+	/**
+   * Number of frames allocated, online or not
+	 */
+  std::uint32_t capacity;
 	
 	/**
-   * Hash table mapping (File, page) to frame
+   * Partitions of the page table mapping (File, page) to frame
+	 */
+  PageTableShard *hashTable;
+
+	/**
+   * Number of entries in 'hashTable' (a power of two)
+	 */
+  std::uint32_t numShards;
+
+	/**
+   * Actual buffer pool from which frames are allocated
+	 */
+  FrameDirectory<Page> bufPool;
+
+	/**
+   * BufDesc objects holding information corresponding to every frame allocation from 'bufPool' (the buffer pool)
+	 */
+  FrameDirectory<BufDesc> bufDescTable;
+
+	/**
+   * Pin count and flags of every frame, indexed by frame number
+	 */
+  FrameStateTable stateTable;
+
+	/**
+   * Chunks holding 'bufPool', 'bufDescTable' and 'stateTable'
+	 */
+  PoolChunk chunks[MAX_CHUNKS];
+
+	/**
+   * Number of entries of 'chunks' in use
+	 */
+  std::atomic<std::uint32_t> numChunks;
+
+	/**
+   * NUMA placement of the chunks
+	 */
+  PoolPlacement placement;
+
+	/**
+   * Serializes resize(), and keeps flushFile() and the destructor from
+   * running while a shrink is emptying frames
+	 */
+  std::mutex resizeLatch;
+
+	/**
+   * Serializes calls into the file layer
 	 */
-  BufHashTbl *hashTable;
+  std::mutex ioLatch;
 
 	/**
-   * Array of BufDesc objects to hold information corresponding to every frame allocation from 'bufPool' (the buffer pool)
+   * Engine for batched reads, prefetches and background writes
 	 */
-  BufDesc *bufDescTable;
+  std::atomic<IoEngine*> ioEngine;
 
 	/**
    * Maintains Buffer pool usage statistics 
@@ -187,7 +616,78 @@ class BufMgr
   BufStats bufStats;
 
 	/**
-	 * Allocate a free frame.  
+   * Page replacement algorithm choosing victim frames
+	 */
+  ReplacementPolicy *policy;
+
+	/**
+   * Compressed copies of evicted pages, consulted before disk on a miss
+	 */
+  CompressedPageCache pageCache;
+
+	/**
+   * Background thread reading prefetched pages, started by the first prefetch()
+	 */
+  std::thread prefetcher;
+
+	/**
+   * Protects the prefetch queue and the prefetcher state below
+	 */
+  std::mutex prefetchLatch;
+
+	/**
+   * Signalled when a request is queued, one is finished, or the prefetcher must stop
+	 */
+  std::condition_variable prefetchCond;
+
+	/**
+   * Pages waiting to be read ahead
+	 */
+  std::deque<PrefetchRequest> prefetchQueue;
+
+	/**
+   * Requests the prefetcher is working on; empty while it is idle
+	 */
+  std::vector<PrefetchRequest> prefetchActive;
+
+	/**
+   * Set by the destructor to make the prefetcher exit
+	 */
+  bool prefetchStop;
+
+	/**
+   * Background writer thread, running between startWriter() and stopWriter()
+	 */
+  std::thread writer;
+
+	/**
+   * Protects the writer settings below
+	 */
+  std::mutex writerLatch;
+
+	/**
+   * Wakes the background writer early when it must stop
+	 */
+  std::condition_variable writerCond;
+
+	/**
+   * Set to make the background writer exit
+	 */
+  bool writerStop;
+
+	/**
+   * Milliseconds the background writer sleeps between rounds
+	 */
+  std::uint32_t writerInterval;
+
+	/**
+   * Fewest pages the background writer cleans per round, if there are that many
+	 */
+  std::uint32_t writerMaxPages;
+
+	/**
+	 * Allocate a free frame.  The frame is returned claimed: pinned once, not
+	 * valid and not present in the page table.
 	 *
 	 * @param frame   	Frame reference, frame ID of allocated frame returned via this variable
 	 * @throws BufferExceededException If no such buffer is found which can be allocated
@@ -195,24 +695,175 @@ class BufMgr
   void allocBuf(FrameId & frame);
 
 	/**
-   * Advance clock to next frame in the buffer pool
+	 * Allocate a frame for a read through 'strategy', reusing the next frame
+	 * of its ring if nobody else has touched it since it was loaded.
+	 *
+	 * @param frame   	Frame reference, frame ID of allocated frame returned via this variable
+	 * @param strategy	Access strategy of the caller
+	 * @throws BufferExceededException If no such buffer is found which can be allocated
 	 */
-  void advanceClock()
-  {
-		clockHand = (clockHand + 1) % numBufs;
-  }
+  void allocBuf(FrameId & frame, BufferAccessStrategy* strategy);
 
+	/**
+	 * Pins (file, pageNo) if it is in the buffer pool, waiting for a read in
+	 * progress to finish.
+	 *
+	 * @param file   	File object
+	 * @param pageNo  Page number in the file
+	 * @param frameNo Frame holding the page, returned via this reference
+	 * @param reference	True to set the reference bit of the frame
+	 * @return  False if the page is not in the buffer pool.
+	 */
+  bool pinResident(File* file, const PageId pageNo, FrameId& frameNo, const bool reference);
 
- public:
 	/**
-   * Actual buffer pool from which frames are allocated
+	 * Reads (file, pageNo) into a newly allocated frame and leaves it pinned.
+	 *
+	 * @param file   	File object
+	 * @param pageNo  Page number in the file
+	 * @param frameNo Frame holding the page, returned via this reference
+	 * @param strategy	Access strategy to allocate the frame through, or NULL
+	 * @param reference	True to set the reference bit of the frame
+	 * @return  False if another thread brought the page in first; nothing is pinned then.
+	 */
+  bool loadPage(File* file, const PageId pageNo, FrameId& frameNo,
+                BufferAccessStrategy* strategy, const bool reference);
+
+	/**
+	 * Takes a page whose read failed back out of the page table and drops the
+	 * caller's pin on its frame.  The frame stays known to the policy, which
+	 * will hand it out again.
+	 *
+	 * @param file   	File object
+	 * @param pageNo  Page number in the file
+	 * @param frameNo Frame published for the page by the caller
+	 */
+  void abortLoad(File* file, const PageId pageNo, const FrameId frameNo);
+
+	/**
+	 * Lists the indexes of 'pageNos' grouped by page table shard, as
+	 * (shard, index) pairs, so a batch can latch each shard once.
+	 */
+  void sortByShard(const File* file, const PageId* pageNos, const std::uint32_t n,
+                   std::vector<std::pair<std::uint32_t, std::uint32_t> >& byShard);
+
+	/**
+	 * Pins (file, pageNo), reading it in if necessary; see readPage().
+	 *
+	 * @return  Frame holding the page.
+	 */
+  FrameId pinPage(File* file, const PageId pageNo, BufferAccessStrategy* strategy);
+
+	/**
+	 * Drops a pin taken through a PageGuard.
+	 */
+  void unpinFrame(const FrameId frameNo, const bool dirty);
+
+	/**
+	 * Returns true if (file, pageNo) is in the page table.
+	 */
+  bool isResident(const File* file, const PageId pageNo);
+
+	/**
+	 * Reads the requested pages into newly allocated frames on behalf of
+	 * prefetch(), all at once through the I/O engine.  The pages are left
+	 * unpinned; pages that cannot be read or get no frame are skipped.
+	 *
+	 * @param requests	Pages to read
+	 */
+  void prefetchPages(const std::vector<PrefetchRequest>& requests);
+
+	/**
+	 * Writes back the given frames in (file, page number) order, skipping any
+	 * that are not dirty, are pinned or are busy.  Runs of consecutive pages of
+	 * a file are written under one hold of the I/O latch, each with one
+	 * vectored write.
+	 *
+	 * @param frames	Candidate frames
+	 * @return  Number of pages written.
+	 */
+  std::uint32_t writeFrames(const std::vector<FrameId>& frames);
+
+	/**
+	 * Body of the background writer thread.
+	 */
+  void writerLoop();
+
+	/**
+	 * Body of the prefetcher thread.
+	 */
+  void prefetchLoop();
+
+	/**
+	 * Drops queued prefetches of a page (or of every page of the file if pageNo
+	 * is Page::INVALID_NUMBER) and waits for one in progress to finish.
+	 *
+	 * @param file   	File object
+	 * @param pageNo  Page number in the file, or Page::INVALID_NUMBER
+	 */
+  void cancelPrefetch(const File* file, const PageId pageNo);
+
+	/**
+	 * Writes back and unmaps the page held by a claimed frame.
+	 *
+	 * @param frame   	Frame claimed by the caller
+	 * @return  False if somebody pinned the page meanwhile; the claim is then dropped.
+	 */
+  bool evictFrame(const FrameId frame);
+
+	/**
+	 * Returns a claimed frame that will not be used after all.
+	 *
+	 * @param frame   	Frame returned by allocBuf()
+	 */
+  void releaseBuf(const FrameId frame);
+
+	/**
+	 * Allocates a chunk of at least 'frames' more frames.  The new frames are
+	 * offline.
+	 *
+	 * @throws BufferExceededException If the pool cannot have any more chunks or frames
+	 */
+  void addChunk(const std::uint32_t frames);
+
+	/**
+	 * Claims a frame that resize() takes out of the pool and evicts its page,
+	 * waiting up to SHRINK_WAIT_MS for it to be unpinned.
+	 *
+	 * @return  False if the frame stayed pinned.
+	 */
+  bool drainFrame(const FrameId frame);
+
+	/**
+	 * Returns the frame holding 'page', a pointer into the buffer pool.
+	 */
+  FrameId frameOf(const Page* page) const;
+
+	/**
+   * Returns the number of slots each page table shard needs for a pool of
+   * 'frames' frames.
 	 */
-  Page* bufPool;
+  std::uint32_t shardSlots(const std::uint32_t frames) const;
 
+	/**
+   * Returns the page table shard responsible for (file, pageNo)
+	 */
+  PageTableShard& shardFor(const File* file, const PageId pageNo)
+  {
+    return hashTable[(hashPage(file, pageNo) >> 40) & (numShards - 1)];
+  }
+
+
+ public:
 	/**
    * Constructor of BufMgr class
+	 *
+	 * @param bufs		Number of frames in the buffer pool
+	 * @param policyType	Page replacement algorithm to use
+	 * @param placement	NUMA placement of the frames
 	 */
-  BufMgr(std::uint32_t bufs);
+  BufMgr(std::uint32_t bufs, ReplacementPolicyType policyType = CLOCK_REPLACEMENT,
+         PoolPlacement placement = POOL_LOCAL);
 	
 	/**
    * Destructor of BufMgr class
@@ -230,6 +881,111 @@ class BufMgr
 	 */
   void readPage(File* file, const PageId PageNo, Page*& page);
 
+	/**
+	 * Like readPage(), but a page that has to be read from disk is read into
+	 * the ring of 'strategy' instead of a frame taken from the whole pool.
+	 *
+	 * @param file   	File object
+	 * @param PageNo  Page number in the file to be read
+	 * @param page  	Reference to page pointer
+	 * @param strategy	Access strategy of the caller, or NULL for normal replacement
+	 */
+  void readPage(File* file, const PageId PageNo, Page*& page, BufferAccessStrategy* strategy);
+
+	/**
+	 * Like readPage(), but returns the page in a guard that unpins it when it
+	 * goes out of scope.
+	 *
+	 * @param file   	File object
+	 * @param pageNo  Page number in the file to be read
+	 * @param strategy	Access strategy of the caller, or NULL for normal replacement
+	 * @return  Guard holding the pinned page.
+	 */
+  PageGuard fetchPage(File* file, const PageId pageNo, BufferAccessStrategy* strategy = NULL);
+
+	/**
+	 * Reads several pages of a file and pins all of them, or none if any of
+	 * them cannot be read.  The page table is visited once for the whole batch;
+	 * frames for all missing pages are reserved before the first one is read,
+	 * and the missing pages are read under one hold of the I/O latch, each run
+	 * of consecutive ones with one vectored read.  A page listed twice is
+	 * pinned twice.
+	 *
+	 * @param file   	File object
+	 * @param pageNos	Page numbers in the file to be read
+	 * @param n				Number of entries in 'pageNos' and 'pages'
+	 * @param pages		pages[i] is set to the frame holding pageNos[i]
+	 * @throws  BufferExceededException If there are not enough unpinned frames for the batch
+	 */
+  void readPages(File* file, const PageId* pageNos, const std::uint32_t n, Page** pages);
+
+	/**
+	 * Asks for (file, pageNo) to be read into the buffer pool in the background
+	 * so a later readPage() finds it there.  The page is not pinned.  Prefetching
+	 * is only a hint: requests for pages already in the pool are ignored, and a
+	 * request is dropped if too many are queued, if no frame is free or if the
+	 * page does not exist.  A file, and the strategy if any, must stay alive
+	 * until the file has been flushed.
+	 *
+	 * @param file   	File object
+	 * @param PageNo  Page number in the file to be read
+	 * @param strategy	Access strategy whose ring the page is read into, or NULL
+	 */
+  void prefetch(File* file, const PageId PageNo, BufferAccessStrategy* strategy = NULL);
+
+	/**
+	 * Calls prefetch() for the pages numbered firstPageNo to firstPageNo+count-1.
+	 *
+	 * @param file   	File object
+	 * @param firstPageNo	Number of the first page to read
+	 * @param count		Number of pages to read
+	 * @param strategy	Access strategy whose ring the pages are read into, or NULL
+	 */
+  void prefetchRange(File* file, const PageId firstPageNo, const std::uint32_t count,
+                     BufferAccessStrategy* strategy = NULL);
+
+	/**
+	 * Starts a background thread that writes back dirty, unpinned pages that
+	 * the replacement policy is about to evict, so that readPage() rarely has
+	 * to write a victim itself.  Every file whose pages are in the pool must
+	 * stay open (or be flushed) while the writer runs.
+	 *
+	 * Each round writes at least 'maxPages' pages, and up to twice as many as
+	 * were evicted since the round before, so the writer keeps pace with the
+	 * foreground.  While foreground threads still have to write victims, the
+	 * writer starts its next round without sleeping.
+	 *
+	 * @param intervalMs	Milliseconds between rounds
+	 * @param maxPages	Fewest pages written per round, if that many are dirty; 0 means an eighth of the pool
+	 */
+  void startWriter(const std::uint32_t intervalMs = 20, const std::uint32_t maxPages = 0);
+
+	/**
+	 * Stops the background writer, if running, and waits for it to exit.
+	 */
+  void stopWriter();
+
+	/**
+	 * Sets the engine that readPages(), the prefetcher, the background writer
+	 * and checkpoint() issue their reads and writes on, each batch with all
+	 * its requests in flight at once.  The pool starts out with
+	 * IoEngine::shared().
+	 *
+	 * @param engine	Engine to use, which must outlive the pool; NULL for IoEngine::shared()
+	 */
+  void setIoEngine(IoEngine* engine);
+
+	/**
+	 * Writes back every page that is dirty and unpinned when the call starts.
+	 * Pages dirtied during the checkpoint are left for the next one, so the
+	 * time taken is bounded by the size of the pool.  A pinned page is left
+	 * alone, since its user may be halfway through changing it; it is written
+	 * by a later checkpoint, or by flushFile(), once it is unpinned.
+	 *
+	 * @return  Number of pages written.
+	 */
+  std::uint32_t checkpoint();
+
 	/**
 	 * Unpin a page from memory since it is no longer required for it to remain in memory.
 	 *
@@ -237,9 +993,23 @@ class BufMgr
 	 * @param PageNo  Page number
 	 * @param dirty		True if the page to be unpinned needs to be marked dirty	
    * @throws  PageNotPinnedException If the page is not already pinned
+   * @throws  HashNotFoundException If the page is not in the buffer pool
 	 */
   void unPinPage(File* file, const PageId PageNo, const bool dirty);
 
+	/**
+	 * Unpins several pages of a file, e.g. those pinned by readPages().  Every
+	 * page that can be unpinned is, even if another one of the batch fails.
+	 *
+	 * @param file   	File object
+	 * @param pageNos	Page numbers
+	 * @param n				Number of entries in 'pageNos'
+	 * @param dirty		True if the pages need to be marked dirty
+	 * @throws  PageNotPinnedException If a page is not already pinned
+	 * @throws  HashNotFoundException If a page is not in the buffer pool
+	 */
+  void unPinPages(File* file, const PageId* pageNos, const std::uint32_t n, const bool dirty);
+
 	/**
 	 * Allocates a new, empty page in the file and returns the Page object.
 	 * The newly allocated page is also assigned a frame in the buffer pool.
@@ -251,9 +1021,20 @@ class BufMgr
   void allocPage(File* file, PageId &PageNo, Page*& page); 
 
 	/**
-	 * Writes out all dirty pages of the file to disk.
+	 * Like allocPage(), but returns the new page in a guard that unpins it
+	 * when it goes out of scope.  The page number is available through
+	 * PageGuard::getPageNo().
+	 *
+	 * @param file   	File object
+	 * @return  Guard holding the pinned page.
+	 */
+  PageGuard newPage(File* file);
+
+	/**
+	 * Writes out all dirty pages of the file to disk, runs of consecutive pages
+	 * with one vectored write each.
 	 * All the frames assigned to the file need to be unpinned from buffer pool before this function can be successfully called.
-	 * Otherwise Error returned.
+	 * Otherwise Error returned.  Other threads must not be using the file while it is flushed.
 	 *
 	 * @param file   	File object
    * @throws  PagePinnedException If any page of the file is pinned in the buffer pool 
@@ -264,6 +1045,7 @@ class BufMgr
 	/**
 	 * Delete page from file and also from buffer pool if present.
 	 * Since the page is entirely deleted from file, its unnecessary to see if the page is dirty.
+	 * A page that is not resident is deleted from the file directly.
 	 *
 	 * @param file   	File object
 	 * @param PageNo  Page number
@@ -271,6 +1053,87 @@ class BufMgr
   void disposePage(File* file, const PageId PageNo);
 
 	/**
+	 * Latches the contents of a pinned page.  Shared holders may read the page
+	 * concurrently; an exclusive holder may modify it.
+	 *
+	 * @param page  	Page pointer returned by readPage() or allocPage()
+	 * @param exclusive	True for exclusive (write) access, false for shared (read) access
+	 */
+  void latchPage(const Page* page, const bool exclusive);
+
+	/**
+	 * Releases a latch taken with latchPage().
+	 *
+	 * @param page  	Page pointer passed to latchPage()
+	 * @param exclusive	Mode the latch was taken in
+	 */
+  void unlatchPage(const Page* page, const bool exclusive);
+
+	/**
+	 * Changes the number of frames in the buffer pool while it is in use.
+	 *
+	 * Growing adds frames taken from a new chunk, or frames given up by an
+	 * earlier shrink, and never blocks readers.  Shrinking takes the frames
+	 * with the highest numbers out of the pool: their pages are written back if
+	 * dirty and evicted, and the memory behind them is returned to the
+	 * operating system.  A page that is pinned is waited for, but if it stays
+	 * pinned for SHRINK_WAIT_MS the shrink stops short at that frame.  Pointers
+	 * to pinned pages stay valid either way, since frames never move.  The
+	 * number of page table shards is fixed at construction.  flushFile()
+	 * waits for a resize in progress to finish.
+	 *
+	 * @param newFrames	Requested number of frames, at least one
+	 * @return  Number of frames in the pool afterwards.
+	 * @throws  BufferExceededException If the pool cannot grow that large
+	 */
+  std::uint32_t resize(const std::uint32_t newFrames);
+
+	/**
+	 * Sets the memory budget of the compressed second tier.  Evicted pages
+	 * are compressed and kept there, and a page that misses the pool is looked
+	 * for there before it is read from disk.  Pages that hardly compress are
+	 * not kept.  0, the default, disables the tier and drops its contents.
+	 *
+	 * @param bytes		Budget in bytes, including bookkeeping
+	 */
+  void setCompressedCacheSize(const std::size_t bytes)
+  {
+		pageCache.setCapacity(bytes);
+  }
+
+	/**
+	 * Returns the bytes in use of the compressed second tier.
+	 */
+  std::size_t getCompressedCacheUsage()
+  {
+		return pageCache.bytesUsed();
+  }
+
+	/**
+   * Returns the number of frames in the buffer pool
+	 */
+  std::uint32_t getNumBufs() const
+  {
+		return numBufs;
+  }
+
+	/**
+   * Returns true if the frames are backed by explicit huge pages
+	 */
+  bool usesHugePages() const
+  {
+		return chunks[0].memory->hugePages();
+  }
+
+	/**
+   * Returns the name of the page replacement algorithm in use
+	 */
+  const char* policyName() const
+  {
+		return policy->name();
+  }
+
+	/**
    * Print member variable values. 
 	 */
   void  printSelf();
@@ -290,6 +1153,15 @@ class BufMgr
   {
 		bufStats.clear();
   }
+
+	/**
+	 * Writes the buffer pool statistics, including hits and misses by file and
+	 * latency histograms, as JSON or in the Prometheus text format.
+	 *
+	 * @param out			Stream to write to
+	 * @param format	Output format
+	 */
+  void dumpStats(std::ostream& out, const StatsFormat format = STATS_JSON) const;
 };
 
 }
@@ -0,0 +1,212 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "crc32c.h"
+
+#include <cstring>
+
+#if defined(__x86_64__) && (defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 5))
+#define BADGERDB_CRC32C_SSE42
+#include <nmmintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#define BADGERDB_CRC32C_ARMV8
+#include <arm_acle.h>
+#endif
+
+namespace badgerdb {
+
+namespace {
+
+/**
+ * CRC32C polynomial, bit reversed
+ */
+const std::uint32_t POLYNOMIAL = 0x82F63B78;
+
+/**
+ * Computes the checksum state over 'len' bytes, without the inversions
+ * crc32c() applies before and after.
+ */
+typedef std::uint32_t (*Crc32cFunction)(const unsigned char* p, std::size_t len, std::uint32_t crc);
+
+/**
+ * Tables for eight bytes at a time: entry k of a byte is the checksum of the
+ * byte followed by k zero bytes.
+ */
+struct Crc32cTable
+{
+  Crc32cTable()
+  {
+    for (std::uint32_t i = 0; i < 256; i++)
+    {
+      std::uint32_t crc = i;
+      for (int bit = 0; bit < 8; bit++)
+        crc = (crc >> 1) ^ (POLYNOMIAL & (0u - (crc & 1)));
+      entries[0][i] = crc;
+    }
+    for (std::uint32_t i = 0; i < 256; i++)
+    {
+      for (int k = 1; k < 8; k++)
+        entries[k][i] = (entries[k - 1][i] >> 8) ^ entries[0][entries[k - 1][i] & 0xff];
+    }
+  }
+
+  std::uint32_t entries[8][256];
+};
+
+std::uint32_t load32(const unsigned char* p)
+{
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((std::uint32_t)p[3] << 24);
+}
+
+std::uint32_t crc32cTable(const unsigned char* p, std::size_t len, std::uint32_t crc)
+{
+  static const Crc32cTable table;
+  const std::uint32_t (*t)[256] = table.entries;
+  for (; len >= 8; p += 8, len -= 8)
+  {
+    const std::uint32_t low = crc ^ load32(p);
+    const std::uint32_t high = load32(p + 4);
+    crc = t[7][low & 0xff] ^ t[6][(low >> 8) & 0xff] ^ t[5][(low >> 16) & 0xff] ^ t[4][low >> 24] ^
+          t[3][high & 0xff] ^ t[2][(high >> 8) & 0xff] ^ t[1][(high >> 16) & 0xff] ^ t[0][high >> 24];
+  }
+  for (; len > 0; p++, len--)
+    crc = (crc >> 8) ^ t[0][(crc ^ *p) & 0xff];
+  return crc;
+}
+
+#if defined(BADGERDB_CRC32C_SSE42)
+
+/**
+ * Bytes of each of the three streams crc32cSse42() checksums side by side
+ */
+const std::size_t STREAM_BYTES = 512;
+
+/**
+ * Tables that advance a checksum state past a fixed number of zero bytes.
+ * The state after the zeros is linear in the state before, so it is the xor
+ * of one entry per byte of the state.
+ */
+struct Crc32cShift
+{
+  explicit Crc32cShift(const std::size_t zeros)
+  {
+    static const unsigned char zeroBytes[2 * STREAM_BYTES] = {0};
+    std::uint32_t bits[32];
+    for (int bit = 0; bit < 32; bit++)
+      bits[bit] = crc32cTable(zeroBytes, zeros, 1u << bit);
+    for (int k = 0; k < 4; k++)
+    {
+      for (std::uint32_t i = 0; i < 256; i++)
+      {
+        std::uint32_t shifted = 0;
+        for (int bit = 0; bit < 8; bit++)
+        {
+          if (i & (1u << bit))
+            shifted ^= bits[8 * k + bit];
+        }
+        entries[k][i] = shifted;
+      }
+    }
+  }
+
+  std::uint32_t operator()(const std::uint32_t crc) const
+  {
+    return entries[0][crc & 0xff] ^ entries[1][(crc >> 8) & 0xff] ^
+           entries[2][(crc >> 16) & 0xff] ^ entries[3][crc >> 24];
+  }
+
+  std::uint32_t entries[4][256];
+};
+
+__attribute__((target("sse4.2")))
+std::uint32_t crc32cSse42(const unsigned char* p, std::size_t len, std::uint32_t crc)
+{
+  for (; len > 0 && (reinterpret_cast<std::uintptr_t>(p) & 7) != 0; p++, len--)
+    crc = _mm_crc32_u8(crc, *p);
+
+  // the instruction takes three cycles but can start every cycle, so keep
+  // three independent streams going and join them up afterwards
+  if (len >= 3 * STREAM_BYTES)
+  {
+    static const Crc32cShift shiftOne(STREAM_BYTES);
+    static const Crc32cShift shiftTwo(2 * STREAM_BYTES);
+    for (; len >= 3 * STREAM_BYTES; p += 3 * STREAM_BYTES, len -= 3 * STREAM_BYTES)
+    {
+      std::uint64_t first = crc;
+      std::uint64_t second = 0;
+      std::uint64_t third = 0;
+      for (std::size_t i = 0; i < STREAM_BYTES; i += 8)
+      {
+        std::uint64_t word;
+        std::memcpy(&word, p + i, 8);
+        first = _mm_crc32_u64(first, word);
+        std::memcpy(&word, p + STREAM_BYTES + i, 8);
+        second = _mm_crc32_u64(second, word);
+        std::memcpy(&word, p + 2 * STREAM_BYTES + i, 8);
+        third = _mm_crc32_u64(third, word);
+      }
+      crc = shiftTwo((std::uint32_t)first) ^ shiftOne((std::uint32_t)second) ^ (std::uint32_t)third;
+    }
+  }
+
+  std::uint64_t wide = crc;
+  for (; len >= 8; p += 8, len -= 8)
+  {
+    std::uint64_t word;
+    std::memcpy(&word, p, 8);
+    wide = _mm_crc32_u64(wide, word);
+  }
+  crc = (std::uint32_t)wide;
+  for (; len > 0; p++, len--)
+    crc = _mm_crc32_u8(crc, *p);
+  return crc;
+}
+
+#elif defined(BADGERDB_CRC32C_ARMV8)
+
+std::uint32_t crc32cArmv8(const unsigned char* p, std::size_t len, std::uint32_t crc)
+{
+  for (; len > 0 && (reinterpret_cast<std::uintptr_t>(p) & 7) != 0; p++, len--)
+    crc = __crc32cb(crc, *p);
+  for (; len >= 8; p += 8, len -= 8)
+  {
+    std::uint64_t word;
+    std::memcpy(&word, p, 8);
+    crc = __crc32cd(crc, word);
+  }
+  for (; len > 0; p++, len--)
+    crc = __crc32cb(crc, *p);
+  return crc;
+}
+
+#endif
+
+Crc32cFunction chooseImplementation()
+{
+#if defined(BADGERDB_CRC32C_SSE42)
+  if (__builtin_cpu_supports("sse4.2"))
+    return crc32cSse42;
+#elif defined(BADGERDB_CRC32C_ARMV8)
+  return crc32cArmv8;
+#endif
+  return crc32cTable;
+}
+
+Crc32cFunction implementation()
+{
+  static const Crc32cFunction chosen = chooseImplementation();
+  return chosen;
+}
+
+}
+
+std::uint32_t crc32c(const void* data, const std::size_t len, const std::uint32_t crc)
+{
+  return ~implementation()(static_cast<const unsigned char*>(data), len, ~crc);
+}
+
+}
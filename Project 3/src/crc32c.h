@@ -0,0 +1,30 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace badgerdb {
+
+/**
+ * Returns the CRC32C (Castagnoli) checksum of 'len' bytes at 'data'.  Passing
+ * the checksum of some bytes as 'crc' continues it over the bytes that follow
+ * them, so a buffer may be checksummed in pieces.
+ *
+ * The SSE4.2 crc32 instruction is used when the processor has it, as is the
+ * ARMv8 CRC extension when the compiler targets it; elsewhere a table driven
+ * implementation that handles eight bytes at a time.
+ *
+ * @param data  Bytes to checksum
+ * @param len   Number of bytes
+ * @param crc   Checksum of the bytes before 'data', 0 for none
+ */
+std::uint32_t crc32c(const void* data, const std::size_t len, const std::uint32_t crc = 0);
+
+}
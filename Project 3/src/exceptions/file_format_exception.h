@@ -0,0 +1,53 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "badgerdb_exception.h"
+
+namespace badgerdb {
+
+/**
+ * @brief An exception that is thrown when a file is stored in a format
+ *        version newer than this build understands.
+ */
+class FileFormatException : public BadgerDbException {
+ public:
+  /**
+   * Constructs a file format exception for the given file.
+   *
+   * @param name      Name of the file.
+   * @param version   Format version found in the file.
+   */
+  FileFormatException(const std::string& name, const std::uint32_t version);
+
+  /**
+   * Returns the name of the file that caused this exception.
+   */
+  virtual const std::string& filename() const { return filename_; }
+
+  /**
+   * Returns the format version found in the file.
+   */
+  virtual std::uint32_t version() const { return version_; }
+
+ protected:
+  /**
+   * Name of file that caused this exception.
+   */
+  const std::string filename_;
+
+  /**
+   * Format version found in the file.
+   */
+  const std::uint32_t version_;
+};
+
+}
@@ -0,0 +1,25 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "io_error_exception.h"
+
+#include <cstring>
+#include <sstream>
+#include <string>
+
+namespace badgerdb {
+
+IoErrorException::IoErrorException(const std::string& name,
+                                   const std::string& operation,
+                                   const int error)
+    : BadgerDbException(""), filename_(name), error_(error) {
+  std::stringstream ss;
+  ss << operation << " failed on " << filename_ << ": " << std::strerror(error_);
+  message_.assign(ss.str());
+}
+
+}
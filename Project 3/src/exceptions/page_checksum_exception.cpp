@@ -0,0 +1,28 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "page_checksum_exception.h"
+
+#include <sstream>
+#include <string>
+
+namespace badgerdb {
+
+PageChecksumException::PageChecksumException(
+    const PageId page_number, const std::string& file,
+    const std::uint32_t expected, const std::uint32_t actual)
+    : BadgerDbException(""),
+      page_number_(page_number),
+      filename_(file) {
+  std::stringstream ss;
+  ss << "Checksum mismatch in page " << page_number_
+     << " of file '" << filename_ << "': expected " << std::hex << expected
+     << ", read " << actual;
+  message_.assign(ss.str());
+}
+
+}
@@ -0,0 +1,66 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "badgerdb_exception.h"
+#include "types.h"
+
+namespace badgerdb {
+
+/**
+ * @brief An exception that is thrown when a page read from a file does not
+ *        match the checksum recorded when it was written.
+ *
+ * The page was torn by a crash in the middle of its write or corrupted on the
+ * disk since.
+ */
+class PageChecksumException : public BadgerDbException {
+ public:
+  /**
+   * Constructs a page checksum exception for the given page and file.
+   *
+   * @param page_number   Number of the page that failed the check.
+   * @param file          Name of file the page was read from.
+   * @param expected      Checksum recorded for the page.
+   * @param actual        Checksum of the page as read.
+   */
+  PageChecksumException(const PageId page_number, const std::string& file,
+                        const std::uint32_t expected, const std::uint32_t actual);
+
+  /**
+   * Destroys the exception.  Does nothing special; just included to make the
+   * compiler happy.
+   */
+  virtual ~PageChecksumException() throw() {}
+
+  /**
+   * Returns the number of the page that failed the check.
+   */
+  virtual PageId page_number() const { return page_number_; }
+
+  /**
+   * Returns name of the file that caused this exception.
+   */
+  virtual const std::string& filename() const { return filename_; }
+
+ protected:
+  /**
+   * Number of the page which failed the check.
+   */
+  const PageId page_number_;
+
+  /**
+   * Name of file which caused this exception.
+   */
+  const std::string filename_;
+};
+
+}
@@ -0,0 +1,22 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "pool_not_found_exception.h"
+
+#include <sstream>
+#include <string>
+
+namespace badgerdb {
+
+PoolNotFoundException::PoolNotFoundException(const std::string& name)
+    : BadgerDbException(""), poolName_(name) {
+  std::stringstream ss;
+  ss << "No buffer pool named: " << poolName_;
+  message_.assign(ss.str());
+}
+
+}
@@ -7,24 +7,128 @@
 
 #include "file.h"
 
+#include <algorithm>
 #include <fstream>
 #include <iostream>
 #include <memory>
 #include <string>
+#include <thread>
+#include <cerrno>
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <cassert>
+#include <new>
+#include <vector>
 
+#include "buffer.h"
 #include "exceptions/file_exists_exception.h"
+#include "exceptions/file_format_exception.h"
 #include "exceptions/file_not_found_exception.h"
 #include "exceptions/file_open_exception.h"
+#include "exceptions/insufficient_space_exception.h"
+#include "exceptions/io_error_exception.h"
 #include "exceptions/invalid_page_exception.h"
+#include "exceptions/page_checksum_exception.h"
 #include "file_iterator.h"
+#include "free_space_map.h"
 #include "page.h"
+#include "page_checksums.h"
 
 namespace badgerdb {
 
+static_assert(sizeof(Page) == Page::SIZE,
+              "Pages are read and written whole, header and data together.");
+
+namespace {
+
+/**
+ * Copies a page into heap memory aligned for direct I/O.
+ */
+std::shared_ptr<Page> alignedCopy(const Page& page) {
+  void* memory;
+  if (posix_memalign(&memory, PosixIo::DIRECT_ALIGNMENT, sizeof(Page)) != 0) {
+    throw std::bad_alloc();
+  }
+  return std::shared_ptr<Page>(new (memory) Page(page), std::free);
+}
+
+std::exception_ptr ioError(const std::string& filename, const char* operation,
+                           const int error) {
+  if (error == 0) {
+    return std::exception_ptr();
+  }
+  return std::make_exception_ptr(IoErrorException(filename, operation, error));
+}
+
+/**
+ * Returns the nearest page below the given one that lies in none of the runs
+ * of free pages; Page::INVALID_NUMBER if there is none.
+ */
+PageId pageBefore(const std::map<PageId, PageId>& runs, const PageId page_number) {
+  PageId before = page_number - 1;
+  std::map<PageId, PageId>::const_iterator run = runs.upper_bound(before);
+  if (run != runs.begin() && (--run)->second > before) {
+    // runs are kept apart, so the page before a run is not free
+    before = run->first - 1;
+  }
+  return before;
+}
+
+/**
+ * Adds a page to the runs of free pages, joining it to the runs next to it.
+ */
+void addFreePage(std::map<PageId, PageId>& runs, const PageId page_number) {
+  PageId end = page_number + 1;
+  std::map<PageId, PageId>::iterator after = runs.find(end);
+  if (after != runs.end()) {
+    end = after->second;
+    runs.erase(after);
+  }
+  std::map<PageId, PageId>::iterator run = runs.lower_bound(page_number);
+  if (run != runs.begin() && (--run)->second == page_number) {
+    run->second = end;
+    return;
+  }
+  runs[page_number] = end;
+}
+
+/**
+ * Takes a page out of the runs of free pages, splitting the run it is in.
+ */
+void removeFreePage(std::map<PageId, PageId>& runs, const PageId page_number) {
+  std::map<PageId, PageId>::iterator run = runs.upper_bound(page_number);
+  if (run == runs.begin() || (--run)->second <= page_number) {
+    return;
+  }
+  const PageId end = run->second;
+  if (run->first == page_number) {
+    runs.erase(run);
+  } else {
+    run->second = page_number;
+  }
+  if (page_number + 1 < end) {
+    runs[page_number + 1] = end;
+  }
+}
+
+}
+
+const std::uint32_t File::FORMAT_MAGIC;
+const std::uint32_t File::FORMAT_VERSION;
+const std::uint64_t File::BASE_HEADER_SIZE;
+const std::uint64_t File::TAIL_POSITION;
+
 File::StreamMap File::open_streams_;
+File::HeaderMap File::open_headers_;
+File::ChecksumMap File::open_checksums_;
 File::CountMap File::open_counts_;
+File::HeaderMap File::unwritten_headers_;
+PageFile::FreeSpaceMaps PageFile::open_free_space_maps_;
+IoBackend File::io_backend_ = IO_POSIX;
+PageId File::min_extent_pages_ = 8;
+PageId File::max_extent_pages_ = 1024;
+bool File::checksums_enabled_ = false;
 
 void File::remove(const std::string& filename) {
   if (!exists(filename)) {
@@ -33,7 +137,10 @@ void File::remove(const std::string& filename) {
   if (isOpen(filename)) {
     throw FileOpenException(filename);
   }
+  unwritten_headers_.erase(filename);
   std::remove(filename.c_str());
+  std::remove(FreeSpaceMap::fileName(filename).c_str());
+  std::remove(PageChecksums::fileName(filename).c_str());
 }
 
 bool File::isOpen(const std::string& filename) {
@@ -55,7 +162,229 @@ bool File::exists(const std::string& filename) {
 }
 
 File::~File() {
-  close();
+  try {
+    close();
+  } catch (const IoErrorException&) {
+    // a destructor cannot report it; sync() first to see the error
+  }
+}
+
+void File::sync() {
+  flushHeader();
+  // the checksums first: each was written ahead of its page, and a synced
+  // page must find its checksum on the disk
+  if (checksums_) {
+    checksums_->sync();
+  }
+  io_->sync();
+}
+
+void File::flushChecksums() const {
+  if (checksums_) {
+    checksums_->flush();
+  }
+}
+
+void File::submitReadPage(IoEngine& engine, const PageId page_number,
+                          Page& into, PageCallback done) {
+  const std::string name = filename_;
+  std::shared_ptr<FileIo> io = io_;
+  Page* page = &into;
+  engine.submitRead(*io_, &into, Page::SIZE, pagePosition(page_number),
+                    [this, name, io, page, page_number, done](int error) {
+                      std::exception_ptr result = ioError(name, "read", error);
+                      if (!result) {
+                        try {
+                          verifyChecksum(page_number, *page);
+                        } catch (...) {
+                          result = std::current_exception();
+                        }
+                      }
+                      done(result);
+                    });
+}
+
+void File::submitWritePage(IoEngine& engine, const PageId page_number,
+                           const Page& page, PageCallback done) {
+  const std::string name = filename_;
+  std::shared_ptr<FileIo> io = io_;
+  try {
+    recordChecksum(page_number, page);
+  } catch (...) {
+    done(std::current_exception());
+    return;
+  }
+  engine.submitWrite(*io_, &page, Page::SIZE, pagePosition(page_number),
+                     [name, io, done](int error) {
+                       done(ioError(name, "write", error));
+                     });
+}
+
+void File::readPages(const PageId first_page_number, const std::uint32_t count,
+                     Page* const* pages) const {
+  std::vector<struct iovec> iov(count);
+  for (std::uint32_t i = 0; i < count; ++i) {
+    iov[i].iov_base = pages[i];
+    iov[i].iov_len = Page::SIZE;
+  }
+  io_->readVector(&iov[0], count, pagePosition(first_page_number));
+  for (std::uint32_t i = 0; i < count; ++i) {
+    verifyChecksum(first_page_number + i, *pages[i]);
+  }
+}
+
+void File::writePages(const PageId first_page_number, const std::uint32_t count,
+                      const Page* const* pages) {
+  std::vector<struct iovec> iov(count);
+  for (std::uint32_t i = 0; i < count; ++i) {
+    iov[i].iov_base = const_cast<Page*>(pages[i]);
+    iov[i].iov_len = Page::SIZE;
+  }
+  if (checksums_) {
+    std::vector<std::uint32_t> checksums(count);
+    for (std::uint32_t i = 0; i < count; ++i) {
+      checksums[i] = PageChecksums::compute(pages[i]);
+    }
+    checksums_->record(first_page_number, count, &checksums[0]);
+  }
+  io_->writeVector(&iov[0], count, pagePosition(first_page_number));
+}
+
+std::vector<PageId> File::verify(const std::uint32_t threads) const {
+  return verify(1 /* first_page_number */, readHeader().num_pages, threads);
+}
+
+std::vector<PageId> File::verify(const PageId first_page_number, const PageId count,
+                                 const std::uint32_t threads) const {
+  std::vector<PageId> failed;
+  // page 0 holds the file header
+  const PageId first = std::max<PageId>(first_page_number, 1);
+  const PageId last = (PageId)std::min<std::uint64_t>(
+      (std::uint64_t)first_page_number + count, readHeader().num_pages);
+  if (!checksums_ || first >= last) {
+    return failed;
+  }
+
+  // each thread checks a share of the range, reading 64 pages at a time
+  const PageId RUN_PAGES = 64;
+  const std::uint32_t num_threads = std::max(1u, std::min<std::uint32_t>(threads, last - first));
+  const PageId share = (last - first + num_threads - 1) / num_threads;
+  std::vector<std::vector<PageId> > failed_in(num_threads);
+  std::vector<std::exception_ptr> errors(num_threads);
+  auto check = [&](const std::uint32_t t) {
+    try {
+      void* memory;
+      if (posix_memalign(&memory, PosixIo::DIRECT_ALIGNMENT, RUN_PAGES * Page::SIZE) != 0) {
+        throw std::bad_alloc();
+      }
+      std::unique_ptr<void, void (*)(void*)> holder(memory, std::free);
+      const Page* run = static_cast<const Page*>(memory);
+      const PageId end = std::min<PageId>(last, first + (t + 1) * share);
+      for (PageId start = first + t * share; start < end; start += RUN_PAGES) {
+        const PageId n = std::min(RUN_PAGES, end - start);
+        io_->read(memory, n * Page::SIZE, pagePosition(start));
+        for (PageId i = 0; i < n; ++i) {
+          if (!checksums_->matches(start + i, PageChecksums::compute(&run[i]))) {
+            failed_in[t].push_back(start + i);
+          }
+        }
+      }
+    } catch (...) {
+      errors[t] = std::current_exception();
+    }
+  };
+  std::vector<std::thread> workers;
+  for (std::uint32_t t = 1; t < num_threads; ++t) {
+    workers.push_back(std::thread(check, t));
+  }
+  check(0);
+  for (std::uint32_t t = 1; t < num_threads; ++t) {
+    workers[t - 1].join();
+  }
+
+  for (std::uint32_t t = 0; t < num_threads; ++t) {
+    if (errors[t]) {
+      std::rethrow_exception(errors[t]);
+    }
+    failed.insert(failed.end(), failed_in[t].begin(), failed_in[t].end());
+  }
+  return failed;
+}
+
+void File::recordChecksum(const PageId page_number, const Page& image) {
+  if (checksums_) {
+    checksums_->record(page_number, PageChecksums::compute(&image));
+  }
+}
+
+void File::verifyChecksum(const PageId page_number, const Page& image) const {
+  if (!checksums_) {
+    return;
+  }
+  const std::uint32_t expected = checksums_->recorded(page_number);
+  if (expected == 0) {
+    return;
+  }
+  const std::uint32_t actual = PageChecksums::compute(&image);
+  if (!checksums_->matches(page_number, actual)) {
+    throw PageChecksumException(page_number, filename_, expected, actual);
+  }
+}
+
+std::uint32_t File::readFormatVersion(FileIo& io, const std::string& name) {
+  FileFormat format;
+  io.read(&format, sizeof(FileFormat), BASE_HEADER_SIZE);
+  if (format.magic != FORMAT_MAGIC) {
+    return 1;
+  }
+  if (format.version > FORMAT_VERSION) {
+    throw FileFormatException(name, format.version);
+  }
+  return format.version;
+}
+
+bool File::convert(const std::string& filename) {
+  if (!exists(filename)) {
+    throw FileNotFoundException(filename);
+  }
+  if (isOpen(filename)) {
+    throw FileOpenException(filename);
+  }
+  std::shared_ptr<FileIo> from = FileIo::open(filename, false /* create_new */,
+                                              io_backend_);
+  const std::uint32_t version = readFormatVersion(*from, filename);
+  if (version == FORMAT_VERSION) {
+    return false;
+  }
+
+  FileHeader header = loadHeader(*from, version);
+  const std::string temp_name = filename + ".convert";
+  std::shared_ptr<FileIo> to = FileIo::open(temp_name, true /* create_new */,
+                                            io_backend_);
+  alignas(PosixIo::DIRECT_ALIGNMENT) char page[Page::SIZE];
+  // page 0 is the header; the data pages keep their numbers
+  for (PageId i = 1; i < header.num_pages; ++i) {
+    from->read(page, Page::SIZE, pagePosition(i, version));
+    to->write(page, Page::SIZE, pagePosition(i, FORMAT_VERSION));
+    // the used list runs in page number order, so its tail is the last used page
+    if (reinterpret_cast<const PageHeader*>(page)->current_page_number != Page::INVALID_NUMBER) {
+      header.last_used_page = i;
+    }
+  }
+  std::memset(page, 0, Page::SIZE);
+  std::memcpy(page, &header, BASE_HEADER_SIZE);
+  FileFormat format = {FORMAT_MAGIC, FORMAT_VERSION};
+  std::memcpy(page + BASE_HEADER_SIZE, &format, sizeof(FileFormat));
+  std::memcpy(page + TAIL_POSITION, &header.last_used_page, sizeof(PageId));
+  to->write(page, Page::SIZE, 0 /* pos */);
+  to->sync();
+  to.reset();
+  from.reset();
+
+  if (std::rename(temp_name.c_str(), filename.c_str()) != 0) {
+    throw IoErrorException(filename, "rename", errno);
+  }
+  return true;
 }
 
 
@@ -64,13 +393,21 @@ PageId File::getFirstPageNo() {
   return header.first_used_page;
 }
 
+PageId File::getNumPages() {
+  const FileHeader& header = readHeader();
+  // page 0 holds the file header
+  return header.num_pages - 1 - header.num_free_pages;
+}
+
 File::File(const std::string& name, const bool create_new) : filename_(name) {
   openIfNeeded(create_new);
 
   if (create_new) {
     // File starts with 1 page (the header).
     FileHeader header = {1 /* num_pages */, 0 /* first_used_page */,
-                         0 /* num_free_pages */, 0 /* first_free_page */};
+                         0 /* num_free_pages */, 0 /* first_free_page */,
+                         0 /* last_used_page */};
+    // the stamp goes out with the header
     writeHeader(header);
   }
 }
@@ -78,54 +415,156 @@ File::File(const std::string& name, const bool create_new) : filename_(name) {
 void File::openIfNeeded(const bool create_new) {
   if (open_counts_.find(filename_) != open_counts_.end()) {	//exists an entry already
     ++open_counts_[filename_];
-    stream_ = open_streams_[filename_];
+    io_ = open_streams_[filename_];
+    header_ = open_headers_[filename_];
+    checksums_ = open_checksums_[filename_];
   } else {
-    std::ios_base::openmode mode =
-        std::fstream::in | std::fstream::out | std::fstream::binary;
     const bool already_exists = exists(filename_);
     if (create_new) {
       // Error if we try to overwrite an existing file.
       if (already_exists) {
         throw FileExistsException(filename_);
       }
-      // New files have to be truncated on open.
-      mode = mode | std::fstream::trunc;
     } else {
       // Error if we try to open a file that doesn't exist.
       if (!already_exists) {
         throw FileNotFoundException(filename_);
       }
     }
-    stream_.reset(new std::fstream(filename_, mode));
-    open_streams_[filename_] = stream_;
+    // New files are truncated on open.
+    std::shared_ptr<FileIo> io = FileIo::open(filename_, create_new, io_backend_);
+    std::shared_ptr<SharedHeader> header(new SharedHeader);
+    // a new file gets its header and stamp from the constructor
+    header->format_version = create_new ? FORMAT_VERSION
+                                        : readFormatVersion(*io, filename_);
+    if (!create_new) {
+      header->header = loadHeader(*io, header->format_version);
+    }
+    header->dirty = false;
+    // a new file has no free pages to read
+    header->free_runs_loaded = create_new;
+    // the pages a file already has are on disk
+    header->reserved_pages = create_new ? 0 : header->header.num_pages;
+    // a header the last close could not write is newer than the one on disk
+    HeaderMap::iterator unwritten = unwritten_headers_.find(filename_);
+    if (unwritten != unwritten_headers_.end()) {
+      if (!create_new) {
+        header = unwritten->second;
+      }
+      unwritten_headers_.erase(unwritten);
+    }
+    // a file that has checksums keeps them; a new one starts without any left
+    // behind by an earlier file of its name
+    const std::string checksum_name = PageChecksums::fileName(filename_);
+    std::shared_ptr<PageChecksums> checksums;
+    if (checksums_enabled_ || (!create_new && exists(checksum_name))) {
+      checksums.reset(new PageChecksums(filename_, create_new));
+    } else if (create_new) {
+      std::remove(checksum_name.c_str());
+    }
+    io_ = io;
+    header_ = header;
+    checksums_ = checksums;
+    open_streams_[filename_] = io_;
+    open_headers_[filename_] = header_;
+    open_checksums_[filename_] = checksums_;
     open_counts_[filename_] = 1;
   }
+  format_version_ = header_->format_version;
 }
 
 void File::close() {
+  if (!io_) {
+    return;
+  }
+  // the last File object on the file writes back its header; if that fails
+  // the file is closed all the same, and only the header is kept for the next
+  // open to write
+  std::exception_ptr error;
+  if (open_counts_[filename_] == 1) {
+    try {
+      flushHeader();
+    } catch (...) {
+      error = std::current_exception();
+    }
+  }
+
 	if(open_counts_[filename_] > 0)
   	--open_counts_[filename_];
 
-  stream_.reset();
+  if (open_counts_[filename_] == 0 && header_->dirty) {
+    unwritten_headers_[filename_] = header_;
+  }
+  io_.reset();
+  header_.reset();
+  checksums_.reset();
 	assert(open_counts_[filename_] >= 0);
 
   if (open_counts_[filename_] == 0) {
     open_streams_.erase(filename_);
+    open_headers_.erase(filename_);
+    open_checksums_.erase(filename_);
     open_counts_.erase(filename_);
   }
+  if (error) {
+    std::rethrow_exception(error);
+  }
 }
 
 FileHeader File::readHeader() const {
+  std::lock_guard<std::mutex> guard(header_->latch);
+  return header_->header;
+}
+
+void File::writeHeader(const FileHeader& header) {
+  std::lock_guard<std::mutex> guard(header_->latch);
+  header_->header = header;
+  header_->dirty = true;
+}
+
+void File::flushHeader() {
+  std::lock_guard<std::mutex> guard(header_->latch);
+  if (!header_->dirty) {
+    return;
+  }
+  const FileHeader& header = header_->header;
+  if (format_version_ < 3) {
+    io_->write(&header, BASE_HEADER_SIZE, 0 /* pos */);
+  } else {
+    char area[TAIL_POSITION + sizeof(PageId)];
+    std::memcpy(area, &header, BASE_HEADER_SIZE);
+    FileFormat format = {FORMAT_MAGIC, format_version_};
+    std::memcpy(area + BASE_HEADER_SIZE, &format, sizeof(FileFormat));
+    std::memcpy(area + TAIL_POSITION, &header.last_used_page, sizeof(PageId));
+    io_->write(area, sizeof(area), 0 /* pos */);
+  }
+  header_->dirty = false;
+}
+
+FileHeader File::loadHeader(FileIo& io, const std::uint32_t version) {
   FileHeader header;
-  stream_->seekg(0 /* pos */, std::ios::beg);
-  stream_->read(reinterpret_cast<char*>(&header), sizeof(FileHeader));
+  if (version < 3) {
+    io.read(&header, BASE_HEADER_SIZE, 0 /* pos */);
+    header.last_used_page = Page::INVALID_NUMBER;
+    return header;
+  }
+  char area[TAIL_POSITION + sizeof(PageId)];
+  io.read(area, sizeof(area), 0 /* pos */);
+  std::memcpy(&header, area, BASE_HEADER_SIZE);
+  std::memcpy(&header.last_used_page, area + TAIL_POSITION, sizeof(PageId));
   return header;
 }
 
-void File::writeHeader(const FileHeader& header) {
-  stream_->seekp(0 /* pos */, std::ios::beg);
-  stream_->write(reinterpret_cast<const char*>(&header), sizeof(FileHeader));
-  stream_->flush();
+void File::reservePage(const PageId page_number) {
+  std::lock_guard<std::mutex> guard(header_->latch);
+  if (page_number < header_->reserved_pages || max_extent_pages_ == 0) {
+    return;
+  }
+  const PageId extent = std::min(std::max(page_number, min_extent_pages_),
+                                 max_extent_pages_);
+  const std::uint64_t start = pagePosition(page_number);
+  io_->reserve(start, pagePosition(page_number + extent) - start);
+  header_->reserved_pages = page_number + extent;
 }
 
 
@@ -157,6 +596,7 @@ PageFile& PageFile::operator=(const PageFile& rhs) {
   // This accounts for self-assignment and assignment of a File object for the
   // same file.
   close();	//close my file and associate me with the new one
+  free_space_.reset();
   filename_ = rhs.filename_;
   openIfNeeded(false /* create_new */);
   return *this;
@@ -165,72 +605,45 @@ PageFile& PageFile::operator=(const PageFile& rhs) {
 Page PageFile::allocatePage(PageId &new_page_number) {
   FileHeader header = readHeader();
   Page new_page;
-  Page existing_page;
   if (header.num_free_pages > 0) {
     new_page = readPage(header.first_free_page, true /* allow_free */);
     new_page.set_page_number(header.first_free_page);
-		new_page_number = new_page.page_number();
+    removeFreePage(freeRuns(header), header.first_free_page);
     header.first_free_page = new_page.next_page_number();
     --header.num_free_pages;
 
-    if (header.first_used_page == Page::INVALID_NUMBER ||
-        header.first_used_page > new_page.page_number()) {
-      // Either have no pages used or the head of the used list is a page later
-      // than the one we just allocated, so add the new page to the head.
-      if (header.first_used_page > new_page.page_number()) {
-        new_page.set_next_page_number(header.first_used_page);
-      }
-      header.first_used_page = new_page.page_number();
-    } else {
-      // New page is reused from somewhere after the beginning, so we need to
-      // find where in the used list to insert it.
-      PageId next_page_number = Page::INVALID_NUMBER;
-      for (FileIterator iter = begin(); iter != end(); ++iter) {
-        next_page_number = (*iter).next_page_number();
-        if (next_page_number > new_page.page_number() ||
-            next_page_number == Page::INVALID_NUMBER) {
-          existing_page = *iter;
-          break;
-        }
-      }
-      existing_page.set_next_page_number(new_page.page_number());
-      new_page.set_next_page_number(next_page_number);
-    }
-
     assert((header.num_free_pages == 0) ==
            (header.first_free_page == Page::INVALID_NUMBER));
   }
 	else
 	{
+    reservePage(header.num_pages);
     new_page.set_page_number(header.num_pages);
-		new_page_number = new_page.page_number();
-
-    if (header.first_used_page == Page::INVALID_NUMBER)
-		{
-      header.first_used_page = new_page.page_number();
-    }
-		else
-		{
-      // If we have pages allocated, we need to add the new page to the tail
-      // of the linked list.
-      for (FileIterator iter = begin(); iter != end(); ++iter) {
-        if ((*iter).next_page_number() == Page::INVALID_NUMBER) {
-          existing_page = *iter;
-          break;
-        }
-      }
-      assert(existing_page.isUsed());
-      existing_page.set_next_page_number(new_page.page_number());
-    }
     ++header.num_pages;
   }
-  writePage(new_page_number, new_page.header_, new_page);
-  if (existing_page.page_number() != Page::INVALID_NUMBER) {
-    // If we updated an existing page by inserting the new page into the
-    // used list, we need to write it out.
-    writePage(existing_page.page_number(), existing_page.header_, existing_page);
+	new_page_number = new_page.page_number();
+
+  // Link the new page into the used list after the used page before it; a
+  // page from the end of the file goes after the tail.
+  const PageId previous_page_number = previousUsedPage(new_page_number, header);
+  if (previous_page_number == Page::INVALID_NUMBER) {
+    new_page.set_next_page_number(header.first_used_page);
+    header.first_used_page = new_page_number;
+  } else {
+    PageHeader previous_header = readPageHeader(previous_page_number);
+    new_page.set_next_page_number(previous_header.next_page_number);
+    previous_header.next_page_number = new_page_number;
+    writePageHeader(previous_page_number, previous_header);
+  }
+  if (new_page.next_page_number() == Page::INVALID_NUMBER) {
+    header.last_used_page = new_page_number;
   }
+  writePage(new_page_number, new_page.header_, new_page);
   writeHeader(header);
+  FreeSpaceMap* map = freeSpaceMap(false /* load */);
+  if (map != NULL) {
+    map->update(new_page_number, new_page.getFreeSpace());
+  }
 
   return new_page;
 }
@@ -246,10 +659,10 @@ Page PageFile::readPage(const PageId page_number) const {
 }
 
 Page PageFile::readPage(const PageId page_number, const bool allow_free) const {
-  Page page;
-  stream_->seekg(pagePosition(page_number), std::ios::beg);
-  stream_->read(reinterpret_cast<char*>(&page.header_), sizeof(PageHeader));
-  stream_->read(reinterpret_cast<char*>(&page.data_[0]), Page::DATA_SIZE);
+  alignas(PosixIo::DIRECT_ALIGNMENT) Page page;
+  // header and data lie back to back, in the page as in the file
+  io_->read(&page, Page::SIZE, pagePosition(page_number));
+  verifyChecksum(page_number, page);
   if (!allow_free && !page.isUsed()) {
     throw InvalidPageException(page_number, filename_);
   }
@@ -277,31 +690,105 @@ void PageFile::deletePage(const PageId page_number) {
   FileHeader header = readHeader();
 
   Page existing_page = readPage(page_number);
-  Page previous_page;
-  // If this page is the head of the used list, update the header to point to
-  // the next page in line.
-  if (page_number == header.first_used_page) {
-    header.first_used_page = existing_page.next_page_number();
+  const PageId next_page_number = existing_page.next_page_number();
+  // Unlink the page from the used list, updating the header if it was the
+  // head and the page before it otherwise.
+  const PageId previous_page_number = previousUsedPage(page_number, header);
+  if (previous_page_number == Page::INVALID_NUMBER) {
+    header.first_used_page = next_page_number;
   } else {
-    // Walk the used list so we can update the page that points to this one.
-    for (FileIterator iter = begin(); iter != end(); ++iter) {
-      previous_page = *iter;
-      if (previous_page.next_page_number() == existing_page.page_number()) {
-        previous_page.set_next_page_number(existing_page.next_page_number());
-        break;
-      }
-    }
+    PageHeader previous_header = readPageHeader(previous_page_number);
+    previous_header.next_page_number = next_page_number;
+    writePageHeader(previous_page_number, previous_header);
+  }
+  if (next_page_number == Page::INVALID_NUMBER) {
+    header.last_used_page = previous_page_number;
   }
   // Clear the page and add it to the head of the free list.
+  addFreePage(freeRuns(header), page_number);
   existing_page.initialize();
   existing_page.set_next_page_number(header.first_free_page);
   header.first_free_page = page_number;
   ++header.num_free_pages;
-  if (previous_page.isUsed()) {
-    writePage(previous_page.page_number(), previous_page.header_, previous_page);
-  }
   writePage(page_number, existing_page.header_, existing_page);
   writeHeader(header);
+  FreeSpaceMap* map = freeSpaceMap(false /* load */);
+  if (map != NULL) {
+    map->update(page_number, 0);
+  }
+}
+
+void PageFile::submitReadPage(IoEngine& engine, const PageId page_number,
+                              Page& into, PageCallback done) {
+  const std::string name = filename_;
+  Page* page = &into;
+  File::submitReadPage(engine, page_number, into,
+                       [name, page, page_number, done](std::exception_ptr error) {
+                         if (!error && !page->isUsed()) {
+                           error = std::make_exception_ptr(
+                               InvalidPageException(page_number, name));
+                         }
+                         done(error);
+                       });
+}
+
+void PageFile::submitWritePage(IoEngine& engine, const PageId page_number,
+                               const Page& page, PageCallback done) {
+  PageHeader header = readPageHeader(page_number);
+  if (header.current_page_number == Page::INVALID_NUMBER) {
+    // Page has been deleted since it was read.
+    done(std::make_exception_ptr(InvalidPageException(page_number, filename_)));
+    return;
+  }
+  // As writePage(): keep the next page pointer on disk, and with it the page
+  // image, alive until the write is done.
+  std::shared_ptr<Page> image = alignedCopy(page);
+  image->header_.next_page_number = header.next_page_number;
+  File::submitWritePage(engine, page_number, *image,
+                        [image, done](std::exception_ptr error) {
+                          done(error);
+                        });
+}
+
+void PageFile::readPages(const PageId first_page_number, const std::uint32_t count,
+                         Page* const* pages) const {
+  File::readPages(first_page_number, count, pages);
+  for (std::uint32_t i = 0; i < count; ++i) {
+    if (!pages[i]->isUsed()) {
+      throw InvalidPageException(first_page_number + i, filename_);
+    }
+  }
+}
+
+void PageFile::writePages(const PageId first_page_number, const std::uint32_t count,
+                          const Page* const* pages) {
+  // As writePage(), for every page before any is written: keep the next page
+  // pointer on disk.  Each page goes out as a patched copy of its header and
+  // its data, which lie back to back in the file.
+  std::vector<PageHeader> headers(count);
+  std::vector<struct iovec> iov(2 * count);
+  for (std::uint32_t i = 0; i < count; ++i) {
+    const PageId page_number = first_page_number + i;
+    const PageHeader header = readPageHeader(page_number);
+    if (header.current_page_number == Page::INVALID_NUMBER) {
+      // Page has been deleted since it was read.
+      throw InvalidPageException(page_number, filename_);
+    }
+    headers[i] = pages[i]->header_;
+    headers[i].next_page_number = header.next_page_number;
+    iov[2 * i].iov_base = &headers[i];
+    iov[2 * i].iov_len = sizeof(PageHeader);
+    iov[2 * i + 1].iov_base = const_cast<char*>(pages[i]->data_);
+    iov[2 * i + 1].iov_len = Page::DATA_SIZE;
+  }
+  if (checksums_) {
+    std::vector<std::uint32_t> checksums(count);
+    for (std::uint32_t i = 0; i < count; ++i) {
+      checksums[i] = PageChecksums::compute(headers[i], pages[i]->data_);
+    }
+    checksums_->record(first_page_number, count, &checksums[0]);
+  }
+  io_->writeVector(&iov[0], iov.size(), pagePosition(first_page_number));
 }
 
 FileIterator PageFile::begin() {
@@ -313,22 +800,156 @@ FileIterator PageFile::end() {
   return FileIterator(this, Page::INVALID_NUMBER);
 }
 
+RecordId PageFile::insertRecord(BufMgr* buf_mgr, const std::string& record_data) {
+  // room for the record and, to be safe, a new slot
+  const std::size_t space = record_data.length() + sizeof(PageSlot);
+  if (space > Page::DATA_SIZE) {
+    throw InsufficientSpaceException(Page::INVALID_NUMBER, record_data.length(),
+                                     Page::DATA_SIZE - sizeof(PageSlot));
+  }
+
+  FreeSpaceMap* map = freeSpaceMap(true /* load */);
+  for (PageId page_number = map->find(space);
+       page_number != Page::INVALID_NUMBER; page_number = map->find(space)) {
+    PageGuard guard;
+    try {
+      guard = buf_mgr->fetchPage(this, page_number);
+    } catch (const InvalidPageException&) {
+      // deleted since the map was last written
+      map->update(page_number, 0);
+      continue;
+    }
+    Page* page = guard.getPage();
+    if (page->hasSpaceForRecord(record_data)) {
+      const RecordId record_id = page->insertRecord(record_data);
+      guard.markDirty();
+      map->update(page_number, page->getFreeSpace());
+      return record_id;
+    }
+    // The page was changed behind the map's back; its category drops below
+    // the one asked for, so it is not tried again.
+    map->update(page_number, page->getFreeSpace());
+  }
+
+  PageGuard guard = buf_mgr->newPage(this);
+  Page* page = guard.getPage();
+  const RecordId record_id = page->insertRecord(record_data);
+  guard.markDirty();
+  map->update(guard.getPageNo(), page->getFreeSpace());
+  return record_id;
+}
+
+void PageFile::deleteRecord(BufMgr* buf_mgr, const RecordId& record_id) {
+  PageGuard guard = buf_mgr->fetchPage(this, record_id.page_number);
+  Page* page = guard.getPage();
+  page->deleteRecord(record_id);
+  guard.markDirty();
+  freeSpaceMap(true /* load */)->update(record_id.page_number, page->getFreeSpace());
+}
+
+FreeSpaceMap* PageFile::freeSpaceMap(const bool load) {
+  if (free_space_) {
+    return free_space_.get();
+  }
+  FreeSpaceMaps::iterator it = open_free_space_maps_.find(filename_);
+  if (it != open_free_space_maps_.end()) {
+    free_space_ = it->second.lock();
+  }
+  if (free_space_ || !load) {
+    return free_space_.get();
+  }
+
+  free_space_.reset(new FreeSpaceMap(filename_));
+  open_free_space_maps_[filename_] = free_space_;
+  if (free_space_->isNew()) {
+    FileHeader header = readHeader();
+    for (PageId page_number = header.first_used_page;
+         page_number != Page::INVALID_NUMBER;) {
+      const PageHeader page_header = readPageHeader(page_number);
+      free_space_->update(page_number, page_header.free_space_upper_bound -
+                                       page_header.free_space_lower_bound);
+      page_number = page_header.next_page_number;
+    }
+  }
+  return free_space_.get();
+}
+
 void PageFile::writePage(const PageId page_number, const PageHeader& header,
                      const Page& new_page) {
-  stream_->seekp(pagePosition(page_number), std::ios::beg);
-  stream_->write(reinterpret_cast<const char*>(&header), sizeof(PageHeader));
-  stream_->write(reinterpret_cast<const char*>(&new_page.data_[0]),
-                 Page::DATA_SIZE);
-  stream_->flush();
+  if (&header == &new_page.header_) {
+    recordChecksum(page_number, new_page);
+    io_->write(&new_page, Page::SIZE, pagePosition(page_number));
+    return;
+  }
+  // one write of header and data together
+  alignas(PosixIo::DIRECT_ALIGNMENT) Page image(new_page);
+  image.header_ = header;
+  recordChecksum(page_number, image);
+  io_->write(&image, Page::SIZE, pagePosition(page_number));
 }
 
 PageHeader PageFile::readPageHeader(PageId page_number) const {
   PageHeader header;
-  stream_->seekg(pagePosition(page_number), std::ios::beg);
-  stream_->read(reinterpret_cast<char*>(&header), sizeof(PageHeader));
+  io_->read(&header, sizeof(PageHeader), pagePosition(page_number));
   return header;
 }
 
+void PageFile::writePageHeader(const PageId page_number, const PageHeader& header) {
+  if (checksums_) {
+    // the checksum covers the whole page, so the whole page is rewritten
+    writePage(page_number, header, readPage(page_number, true /* allow_free */));
+    return;
+  }
+  // the header lies at the start of the page, in the file as in memory
+  io_->write(&header, sizeof(PageHeader), pagePosition(page_number));
+}
+
+PageId PageFile::lastUsedPage(const FileHeader& header) const {
+  if (format_version_ >= 3) {
+    return header.last_used_page;
+  }
+  if (header.first_used_page == Page::INVALID_NUMBER) {
+    return Page::INVALID_NUMBER;
+  }
+  return pageBefore(freeRuns(header), header.num_pages);
+}
+
+PageId PageFile::previousUsedPage(const PageId page_number,
+                                  const FileHeader& header) const {
+  if (header.first_used_page == Page::INVALID_NUMBER ||
+      header.first_used_page >= page_number) {
+    return Page::INVALID_NUMBER;
+  }
+  const PageId last_used_page = lastUsedPage(header);
+  if (last_used_page < page_number) {
+    return last_used_page;
+  }
+  // The head of the used list lies below the page, so there is one.
+  return pageBefore(freeRuns(header), page_number);
+}
+
+std::map<PageId, PageId>& PageFile::freeRuns(const FileHeader& header) const {
+  std::map<PageId, PageId>& runs = header_->free_runs;
+  if (header_->free_runs_loaded) {
+    return runs;
+  }
+  std::vector<PageId> free_pages;
+  free_pages.reserve(header.num_free_pages);
+  for (PageId page_number = header.first_free_page;
+       page_number != Page::INVALID_NUMBER &&
+       free_pages.size() < header.num_free_pages;
+       page_number = readPageHeader(page_number).next_page_number) {
+    free_pages.push_back(page_number);
+  }
+  std::sort(free_pages.begin(), free_pages.end());
+  runs.clear();
+  for (std::size_t i = 0; i < free_pages.size(); ++i) {
+    addFreePage(runs, free_pages[i]);
+  }
+  header_->free_runs_loaded = true;
+  return runs;
+}
+
 
 
 
@@ -366,10 +987,12 @@ Page BlobFile::allocatePage(PageId &new_page_number) {
 	Page new_page;
 
 	new_page_number = header.num_pages;
+	reservePage(new_page_number);
 
 	if (header.first_used_page == Page::INVALID_NUMBER) {
 		header.first_used_page = header.num_pages;
 	}
+	header.last_used_page = header.num_pages;
 
 	++header.num_pages;
   //NEW PORTION
@@ -383,16 +1006,15 @@ Page BlobFile::allocatePage(PageId &new_page_number) {
 }
 
 Page BlobFile::readPage(const PageId page_number) const {
-	Page page;
-	stream_->seekg(pagePosition(page_number), std::ios::beg);
-	stream_->read(reinterpret_cast<char*>(&page), Page::SIZE);
+	alignas(PosixIo::DIRECT_ALIGNMENT) Page page;
+	io_->read(&page, Page::SIZE, pagePosition(page_number));
+	verifyChecksum(page_number, page);
 	return page;
 }
 
 void BlobFile::writePage(const PageId new_page_number, const Page& new_page) {
-	stream_->seekp(pagePosition(new_page_number), std::ios::beg);
-	stream_->write(reinterpret_cast<const char*>(&new_page), Page::SIZE);
-	stream_->flush();
+	recordChecksum(new_page_number, new_page);
+	io_->write(&new_page, Page::SIZE, pagePosition(new_page_number));
 }
 
 //delePage should not be called for a blob_file, not supported
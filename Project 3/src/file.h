@@ -7,19 +7,32 @@
 
 #pragma once
 
-#include <fstream>
+#include <cstdint>
+#include <exception>
+#include <functional>
 #include <string>
 #include <map>
 #include <memory>
+#include <mutex>
+#include <vector>
 
+#include "file_io.h"
+#include "io_engine.h"
 #include "page.h"
 
 namespace badgerdb {
 
+class BufMgr;
 class FileIterator;
+class FreeSpaceMap;
+class PageChecksums;
 
 /**
  * @brief Header metadata for files on disk which contain pages.
+ *
+ * The fields up to first_free_page lie at the start of every file.
+ * last_used_page is only stored from format version 3, after the FileFormat
+ * stamp.
  */
 struct FileHeader {
   /**
@@ -42,6 +55,12 @@ struct FileHeader {
    */
   PageId first_free_page;
 
+  /**
+   * Page number of the last used page in the file, the tail of the used list.
+   * Page::INVALID_NUMBER when read from a file older than format version 3.
+   */
+  PageId last_used_page;
+
   /**
    * Returns true if this file header is equal to the other.
    *
@@ -52,21 +71,66 @@ struct FileHeader {
     return num_pages == rhs.num_pages &&
         num_free_pages == rhs.num_free_pages &&
         first_used_page == rhs.first_used_page &&
-        first_free_page == rhs.first_free_page;
+        first_free_page == rhs.first_free_page &&
+        last_used_page == rhs.last_used_page;
   }
 };
 
+/**
+ * @brief Format stamp stored right after the FileHeader.
+ *
+ * Files written before the format was versioned have no stamp, and their
+ * pages follow the FileHeader directly, 16 bytes into the file (version 1).
+ * From version 2 the header area takes a whole page and page n starts at
+ * n * Page::SIZE, so every page lies on an offset aligned for direct I/O.
+ * From version 3 the stamp is followed by FileHeader::last_used_page, so that
+ * pages can be added to the used list without walking it.
+ */
+struct FileFormat {
+  /**
+   * File::FORMAT_MAGIC in a versioned file.
+   */
+  std::uint32_t magic;
+
+  /**
+   * Format version of the file.
+   */
+  std::uint32_t version;
+};
+
 /**
  * @brief Class which represents a file in the filesystem containing database
  *        pages.
  *
- * The File class wraps a stream to an underlying file on disk.  Files contain
+ * The File class wraps a FileIo for an underlying file on disk.  Files contain
  * fixed-sized pages, and they never deallocate space (though they do reuse
  * deleted pages if possible).  If multiple File objects refer to the same
- * underlying file, they will share the stream in memory.
+ * underlying file, they will share the FileIo in memory.
  * If a file that has already been opened (possibly by another query), then the File class
  * detects this (by looking in the open_streams_ map) and just returns a file object with
- * the already created stream for the file without actually opening the UNIX file again. 
+ * the already created FileIo for the file without actually opening the UNIX file again. 
+ * They also share the file's header, which is read once when the file is opened
+ * and kept in memory; changes to it are written back by sync() and when the
+ * last File object on the file closes it.
+ *
+ * Files opened while setChecksums() is on, and files that already have
+ * checksums, record a CRC32C checksum of every page they write (see
+ * PageChecksums) and check pages against it as they read them, throwing
+ * PageChecksumException on a mismatch; verify() checks a whole file.  Pages
+ * read through a FileMap and page headers read on their own are not checked.
+ *
+ * Files grow by extents: disk space for several pages is reserved at once
+ * (see setExtentPages()), so appending a page does not allocate blocks on
+ * its own.  Reserved space past the last page stays part of the file.
+ *
+ * Pages are written to the operating system as they are written to the file
+ * but reach the disk only when sync() is called.  Files are opened with the
+ * backend set by setIoBackend(), pread/pwrite unless changed.  With IO_DIRECT
+ * pages bypass the kernel's page cache; this needs files in format version 2 or
+ * later, which all new files are and which older files can be converted to with
+ * convert() (or the badgerdb_convert tool), and pages in 4 KiB aligned memory
+ * such as the frames of a BufMgr.  Other accesses still work, but are staged
+ * through a bounce buffer.
  *
  * @warning This class is not threadsafe.
  */
@@ -74,6 +138,21 @@ struct FileHeader {
 
 class File {
  public:
+  /**
+   * Called when an asynchronous page access completes, with NULL or the
+   * exception the synchronous call would have thrown.
+   */
+  typedef std::function<void(std::exception_ptr)> PageCallback;
+
+  /**
+   * Value of FileFormat::magic in a versioned file.
+   */
+  static const std::uint32_t FORMAT_MAGIC = 0xBADBF11E;
+
+  /**
+   * Format version new files are written in.
+   */
+  static const std::uint32_t FORMAT_VERSION = 3;
 
   /**
    * Constructs a file object representing a file on the filesystem.
@@ -111,6 +190,57 @@ class File {
    */
   static bool exists(const std::string& filename);
 
+  /**
+   * Sets the backend that files opened from now on are accessed with.  Files
+   * already open keep theirs.
+   *
+   * @param backend   Backend for newly opened files.
+   */
+  static void setIoBackend(const IoBackend backend) { io_backend_ = backend; }
+
+  /**
+   * Returns the backend that newly opened files are accessed with.
+   */
+  static IoBackend ioBackend() { return io_backend_; }
+
+  /**
+   * Sets how far files grow ahead of the pages they allocate.  A file that
+   * runs out of reserved space reserves room for as many pages again as it
+   * already has, at least min_pages and at most max_pages, so that it doubles
+   * until it grows by max_pages at a time.  Pages are handed out of the
+   * reserved extent one at a time as they are allocated.  A max_pages of 0
+   * turns reservation off.
+   *
+   * @param min_pages   Fewest pages to reserve at once.
+   * @param max_pages   Most pages to reserve at once.
+   */
+  static void setExtentPages(const PageId min_pages, const PageId max_pages) {
+    min_extent_pages_ = min_pages;
+    max_extent_pages_ = max_pages;
+  }
+
+  /**
+   * Sets whether files opened from now on keep checksums of their pages.  A
+   * file that already has checksums keeps them up to date either way; one
+   * that gets them when it is opened has its pages checked once they are
+   * rewritten.
+   *
+   * @param enabled   True to checksum the pages of newly opened files.
+   */
+  static void setChecksums(const bool enabled) { checksums_enabled_ = enabled; }
+
+  /**
+   * Rewrites a file in an older format in the current format.  The file is
+   * copied to "<filename>.convert", synced, and renamed over the original.
+   *
+   * @param filename  Name of the file.
+   * @return  True if the file was converted; false if it already was current.
+   * @throws  FileNotFoundException   If the file doesn't exist.
+   * @throws  FileOpenException       If the file is currently open.
+   * @throws  FileFormatException     If the file's format is newer than this build.
+   */
+  static bool convert(const std::string& filename);
+
   /**
    * Destructor that automatically closes the underlying file if no other
    * File objects are using it.
@@ -150,6 +280,57 @@ class File {
    */
   virtual void deletePage(const PageId page_number) = 0;
 
+  /**
+   * Reads a page through an IoEngine.  The page is checked as readPage()
+   * checks it, except that a page past the end of the file is reported as
+   * not in use.  The File and 'into' must stay valid until 'done' has run,
+   * on a thread of the engine.  By default the page is read as it is on disk.
+   *
+   * @param engine        Engine to issue the read on.
+   * @param page_number   Number of page to read.
+   * @param into          Page the contents are read into.
+   * @param done          Called when the read has completed.
+   */
+  virtual void submitReadPage(IoEngine& engine, const PageId page_number,
+                              Page& into, PageCallback done);
+
+  /**
+   * Writes a page through an IoEngine, as writePage() would.  The File and
+   * 'page' must stay valid and unchanged until 'done' has run, on a thread of
+   * the engine.  By default the page is written as it is.
+   *
+   * @param engine        Engine to issue the write on.
+   * @param page_number   Number of page whose contents to replace.
+   * @param page          Page to write.
+   * @param done          Called when the write has completed.
+   */
+  virtual void submitWritePage(IoEngine& engine, const PageId page_number,
+                               const Page& page, PageCallback done);
+
+  /**
+   * Reads a run of consecutive pages with one vectored read.  Every page is
+   * read, then they are checked as readPage() checks them.  By default the
+   * pages are read as they are on disk.
+   *
+   * @param first_page_number   Number of first page to read.
+   * @param count               Number of pages to read.
+   * @param pages               Pages the contents are read into, one per page.
+   * @throws  InvalidPageException  If one of the pages is not in use.
+   */
+  virtual void readPages(const PageId first_page_number, const std::uint32_t count,
+                         Page* const* pages) const;
+
+  /**
+   * Writes a run of consecutive pages with one vectored write, as writePage()
+   * would write each of them.  By default the pages are written as they are.
+   *
+   * @param first_page_number   Number of first page to write.
+   * @param count               Number of pages to write.
+   * @param pages               Pages to write, one per page.
+   */
+  virtual void writePages(const PageId first_page_number, const std::uint32_t count,
+                          const Page* const* pages);
+
   /**
    * Returns the name of the file this object represents.
    *
@@ -157,6 +338,56 @@ class File {
    */
   const std::string& filename() const { return filename_; }
 
+  /**
+   * Returns the format version of the file.
+   */
+  std::uint32_t formatVersion() const { return format_version_; }
+
+  /**
+   * Forces all pages and headers written to this file so far to the disk,
+   * writing back the header first if it changed.
+   *
+   * @throws  IoErrorException  If the operating system cannot sync the file.
+   */
+  void sync();
+
+  /**
+   * Writes the checksums recorded for pages written so far to the checksum
+   * file, without forcing them to the disk.  Does nothing for a file that
+   * keeps no checksums.
+   *
+   * @throws  IoErrorException  If the checksums cannot be written.
+   */
+  void flushChecksums() const;
+
+  /**
+   * Returns true if the file keeps checksums of its pages.
+   */
+  bool hasChecksums() const { return (bool)checksums_; }
+
+  /**
+   * Checks the pages numbered first_page_number to first_page_number+count-1
+   * that lie in the file against their checksums, as they are on disk.  The
+   * range is split into one share per thread, and each thread reads its
+   * share a run of pages at a time.  Pages written meanwhile may be reported.
+   *
+   * @param first_page_number   Number of first page to check.
+   * @param count               Number of pages to check.
+   * @param threads             Number of threads to check with.
+   * @return  Numbers of the pages that fail their check, in order; none if
+   *          the file keeps no checksums.
+   * @throws  IoErrorException  If the pages cannot be read.
+   */
+  std::vector<PageId> verify(const PageId first_page_number, const PageId count,
+                             const std::uint32_t threads = 1) const;
+
+  /**
+   * Checks every page of the file against its checksum.
+   *
+   * @see verify(const PageId, const PageId, const std::uint32_t)
+   */
+  std::vector<PageId> verify(const std::uint32_t threads = 1) const;
+
  	/**
    * Returns pageid of first page in the file.
    *
@@ -164,7 +395,25 @@ class File {
    */
 	PageId getFirstPageNo();
 
+ 	/**
+   * Returns the number of pages currently in use in the file.
+   *
+   * @return  Number of allocated, not deleted pages.
+   */
+	PageId getNumPages();
+
  protected:
+  /**
+   * Bytes of FileHeader stored at the start of every file, the fields before
+   * last_used_page.  The FileFormat stamp follows them.
+   */
+  static const std::uint64_t BASE_HEADER_SIZE = 4 * sizeof(PageId);
+
+  /**
+   * Position of FileHeader::last_used_page from format version 3.
+   */
+  static const std::uint64_t TAIL_POSITION = BASE_HEADER_SIZE + sizeof(FileFormat);
+
   /**
    * Returns the position of the page with the given number in the file (as an
    * offset from the beginning of the file).
@@ -172,14 +421,37 @@ class File {
    * @param page_number   Number of page.
    * @return  Position of page in file.
    */
-  static std::streampos pagePosition(const PageId page_number) {
-    return sizeof(FileHeader) + ((page_number - 1) * Page::SIZE);
+  std::uint64_t pagePosition(const PageId page_number) const {
+    return pagePosition(page_number, format_version_);
   }
 
+  /**
+   * Returns the position of the page with the given number in a file of the
+   * given format version.
+   */
+  static std::uint64_t pagePosition(const PageId page_number,
+                                    const std::uint32_t version) {
+    if (version < 2) {
+      return BASE_HEADER_SIZE + ((page_number - 1) * (std::uint64_t)Page::SIZE);
+    }
+    return page_number * (std::uint64_t)Page::SIZE;
+  }
+
+  /**
+   * Reads the format version of a file from its format stamp.
+   *
+   * @param io    Access to the file.
+   * @param name  Name of the file, for errors.
+   * @return  The version; 1 if the file has no stamp.
+   * @throws  FileFormatException If the version is newer than FORMAT_VERSION.
+   */
+  static std::uint32_t readFormatVersion(FileIo& io, const std::string& name);
+
   /**
    * Opens the underlying file named in filename_.
    * This method only opens the file if no other File objects exist that access
-   * the same filesystem file; otherwise, it reuses the existing stream.
+   * the same filesystem file; otherwise, it reuses the existing FileIo.
+   * Sets <format_version_> from the file.
    *
    * @param create_new  Whether to create a new file.
    * @throws  FileExistsException     If the underlying file exists and
@@ -190,50 +462,191 @@ class File {
   void openIfNeeded(const bool create_new);
 
   /**
-   * Closes the underlying file stream in <stream_>.
+   * Releases the underlying FileIo in <io_>.
    * This method only closes the file if no other File objects exist that access
-   * the same file.
+   * the same file, after writing back its header if it changed.  The File is
+   * closed even if that fails; the next open of the file tries again.
+   *
+   * @throws  IoErrorException  If the header cannot be written back.
    */
   void close();
 
   /**
-   * Reads the header for this file from disk.
+   * Returns the header for this file, as kept in memory.
    *
    * @return  The file header.
    */
   FileHeader readHeader() const;
 
   /**
-   * Writes the given header to the disk as the header for this file.
+   * Replaces the header for this file.  The header on disk is updated by
+   * flushHeader().
    *
    * @param header  File header to write.
    */
   void writeHeader(const FileHeader& header);
 
-  typedef std::map<std::string, std::shared_ptr<std::fstream> > StreamMap;
+  /**
+   * Writes the header for this file to disk if it changed since it was last
+   * written.  From format version 3 the stamp and last_used_page go out in
+   * the same write.
+   *
+   * @throws  IoErrorException  If the header cannot be written.
+   */
+  void flushHeader();
+
+  /**
+   * Reads the header of a file from disk.
+   *
+   * @param io        Access to the file.
+   * @param version   Format version of the file.
+   * @return  The file header.
+   */
+  static FileHeader loadHeader(FileIo& io, const std::uint32_t version);
+
+  /**
+   * Makes sure disk space is reserved for the page with the given number,
+   * reserving the next extent of the file if it is not.  Called before a page
+   * is appended to the file.
+   *
+   * @param page_number   Number of page about to be written.
+   * @throws  IoErrorException  If the space cannot be reserved.
+   */
+  void reservePage(const PageId page_number);
+
+  /**
+   * Records the checksum of a page image about to be written, if the file
+   * keeps checksums.  It reaches the checksum file with the next flush of
+   * the checksums, see PageChecksums.
+   *
+   * @param page_number   Number of page to be written.
+   * @param image         Page as it will be written.
+   * @throws  IoErrorException  If a batch of checksums cannot be written.
+   */
+  void recordChecksum(const PageId page_number, const Page& image);
+
+  /**
+   * Checks a page image just read against its checksum, if the file keeps
+   * checksums.
+   *
+   * @param page_number   Number of page read.
+   * @param image         Page as read.
+   * @throws  PageChecksumException  If the page does not match its checksum.
+   */
+  void verifyChecksum(const PageId page_number, const Page& image) const;
+
+  /**
+   * Header of an open file, shared by all File objects open on it.
+   */
+  struct SharedHeader {
+    /**
+     * Protects the members below.
+     */
+    std::mutex latch;
+
+    FileHeader header;
+
+    /**
+     * Format version of the file.
+     */
+    std::uint32_t format_version;
+
+    /**
+     * True if <header> changed since it was written to disk.
+     */
+    bool dirty;
+
+    /**
+     * Pages with lower numbers have disk space reserved for them.
+     */
+    PageId reserved_pages;
+
+    /**
+     * Runs of consecutive free pages, from the first page of each run to the
+     * page after its last, read from the free list when first needed and then
+     * kept up to date by allocatePage() and deletePage().
+     */
+    std::map<PageId, PageId> free_runs;
+
+    /**
+     * True once <free_runs> has been read.
+     */
+    bool free_runs_loaded;
+  };
+
+  typedef std::map<std::string, std::shared_ptr<FileIo> > StreamMap;
   typedef std::map<std::string, int> CountMap;
+  typedef std::map<std::string, std::shared_ptr<SharedHeader> > HeaderMap;
+  typedef std::map<std::string, std::shared_ptr<PageChecksums> > ChecksumMap;
 
   /**
-   * Streams for opened files.
+   * FileIo objects for opened files.
    */
   static StreamMap open_streams_;
 
+  /**
+   * Headers of opened files.
+   */
+  static HeaderMap open_headers_;
+
+  /**
+   * Checksums of opened files, NULL for files without.
+   */
+  static ChecksumMap open_checksums_;
+
   /**
    * Counts for opened files.
    */
   static CountMap open_counts_;
 
+  /**
+   * Changed headers of closed files that could not be written back.
+   */
+  static HeaderMap unwritten_headers_;
+
+  /**
+   * Backend for newly opened files.
+   */
+  static IoBackend io_backend_;
+
+  /**
+   * Bounds on the pages reserved at once, set by setExtentPages().
+   */
+  static PageId min_extent_pages_;
+  static PageId max_extent_pages_;
+
+  /**
+   * Whether newly opened files keep checksums, set by setChecksums().
+   */
+  static bool checksums_enabled_;
+
   /**
    * Name of the file this object represents.
    */
   std::string filename_;
 
   /**
-   * Stream for underlying filesystem object.
+   * Access to underlying filesystem object.
+   */
+  std::shared_ptr<FileIo> io_;
+
+  /**
+   * Header of the underlying file.
+   */
+  std::shared_ptr<SharedHeader> header_;
+
+  /**
+   * Checksums of the pages of the underlying file, NULL if it keeps none.
+   */
+  std::shared_ptr<PageChecksums> checksums_;
+
+  /**
+   * Format version of the underlying file.
    */
-  std::shared_ptr<std::fstream> stream_;
+  std::uint32_t format_version_;
 
   friend class FileIterator;
+  friend class FileMap;
 };
 
 class PageFile : public File {
@@ -326,6 +739,45 @@ class PageFile : public File {
    */
   void deletePage(const PageId page_number);
 
+  /**
+   * Reads a page through an IoEngine; a page that is not in use is reported
+   * with InvalidPageException.
+   *
+   * @see File::submitReadPage()
+   */
+  void submitReadPage(IoEngine& engine, const PageId page_number, Page& into,
+                      PageCallback done);
+
+  /**
+   * Writes a page through an IoEngine, keeping the next page pointer on disk
+   * as writePage() does.  The page header on disk is read synchronously and
+   * the page is written from a copy, so 'page' may change as soon as this
+   * returns.
+   *
+   * @see File::submitWritePage()
+   */
+  void submitWritePage(IoEngine& engine, const PageId page_number,
+                       const Page& page, PageCallback done);
+
+  /**
+   * Reads a run of pages; a page that is not in use is reported with
+   * InvalidPageException once all of them are read.
+   *
+   * @see File::readPages()
+   */
+  void readPages(const PageId first_page_number, const std::uint32_t count,
+                 Page* const* pages) const;
+
+  /**
+   * Writes a run of pages, keeping their next page pointers on disk as
+   * writePage() does.  Nothing is written if one of the pages was deleted.
+   *
+   * @see File::writePages()
+   * @throws  InvalidPageException  If one of the pages is not in use.
+   */
+  void writePages(const PageId first_page_number, const std::uint32_t count,
+                  const Page* const* pages);
+
   /**
    * Returns an iterator at the first page in the file.
    *
@@ -341,14 +793,58 @@ class PageFile : public File {
    */
   FileIterator end();
 
+  /**
+   * Inserts a record into a page of the file that has room for it, found
+   * through the file's FreeSpaceMap, or else into a new page.  The page is
+   * read, changed and left dirty in the given buffer pool.  The map is
+   * created on first use, from the headers of the pages in use.
+   *
+   * @param buf_mgr       Buffer pool to change the page in.
+   * @param record_data   Bytes that compose the record.
+   * @return  ID of the newly inserted record.
+   * @throws  InsufficientSpaceException  If the record does not fit in an
+   *                                      empty page.
+   */
+  RecordId insertRecord(BufMgr* buf_mgr, const std::string& record_data);
+
+  /**
+   * Deletes a record, through the given buffer pool, and records the space it
+   * frees in the file's FreeSpaceMap for insertRecord() to reuse.
+   *
+   * @param buf_mgr     Buffer pool to change the page in.
+   * @param record_id   ID of the record to delete.
+   * @throws  InvalidPageException    If the page is not in use.
+   * @throws  InvalidRecordException  If the record does not exist.
+   */
+  void deleteRecord(BufMgr* buf_mgr, const RecordId& record_id);
+
  private:
+  typedef std::map<std::string, std::weak_ptr<FreeSpaceMap> > FreeSpaceMaps;
+
+  /**
+   * Free-space maps of opened files, while some PageFile uses them.
+   */
+  static FreeSpaceMaps open_free_space_maps_;
+
+  /**
+   * Returns the FreeSpaceMap of the file, which all PageFile objects on the
+   * file share.  If none is in use, it is opened (and, if the file has none,
+   * built from the page headers) when 'load' is set, and NULL is returned
+   * otherwise.
+   */
+  FreeSpaceMap* freeSpaceMap(const bool load);
+
+  /**
+   * FreeSpaceMap of the file, once this object has used it.
+   */
+  std::shared_ptr<FreeSpaceMap> free_space_;
 
   /**
    * Reads a page from the file.  If <allow_free> is not set, an exception
    * will be thrown if the page read from disk is not currently in use.
    *
-   * No bounds checking is performed; the underlying file stream will throw
-   * an exception if the page is past the end of the file.
+   * No bounds checking is performed; a page past the end of the file reads
+   * as zeros, i.e. as a free page.
    *
    * @param page_number   Number of page to read.
    * @param allow_free    Whether to allow reading a free (unused) page.
@@ -379,6 +875,45 @@ class PageFile : public File {
    */
   PageHeader readPageHeader(const PageId page_number) const;
 
+  /**
+   * Writes only the header of the given page to disk, leaving the record data
+   * and slot table as they are.  No bounds checking is performed.
+   *
+   * @param page_number   Number of page whose header is to be written.
+   * @param header        Header to write.
+   */
+  void writePageHeader(const PageId page_number, const PageHeader& header);
+
+  /**
+   * Returns the tail of the used list, from the header in format version 3
+   * and as the last page of the file that is not free in older files.
+   *
+   * @param header  Header of the file.
+   * @return  Number of the last used page; Page::INVALID_NUMBER if none.
+   */
+  PageId lastUsedPage(const FileHeader& header) const;
+
+  /**
+   * Returns the used page that precedes the given page in the used list,
+   * which is kept in page number order: the tail if the page lies beyond it,
+   * and otherwise the nearest page below it that is not free, found in the
+   * runs of free pages without reading any page.
+   *
+   * @param page_number   Number of page, used or not.
+   * @param header        Header of the file.
+   * @return  Number of the previous used page; Page::INVALID_NUMBER if the
+   *          page would head the used list.
+   */
+  PageId previousUsedPage(const PageId page_number, const FileHeader& header) const;
+
+  /**
+   * Returns the runs of free pages of the file, reading the free list the
+   * first time it is called on the open file.
+   *
+   * @param header  Header of the file.
+   */
+  std::map<PageId, PageId>& freeRuns(const FileHeader& header) const;
+
   friend class FileIterator;
 };
 
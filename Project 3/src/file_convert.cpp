@@ -0,0 +1,43 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include <iostream>
+#include "file.h"
+#include "exceptions/badgerdb_exception.h"
+
+/**
+ * Converts database files to the current format version in place.
+ *
+ * usage: badgerdb_convert FILE...
+ */
+int main(int argc, char* argv[])
+{
+  if (argc < 2)
+  {
+    std::cerr << "usage: " << argv[0] << " FILE...\n";
+    return 2;
+  }
+
+  int status = 0;
+  for (int i = 1; i < argc; i++)
+  {
+    try
+    {
+      if (badgerdb::File::convert(argv[i]))
+        std::cout << argv[i] << ": converted to format version "
+                  << badgerdb::File::FORMAT_VERSION << "\n";
+      else
+        std::cout << argv[i] << ": already current\n";
+    }
+    catch (const badgerdb::BadgerDbException& e)
+    {
+      std::cerr << argv[i] << ": " << e.message() << "\n";
+      status = 1;
+    }
+  }
+  return status;
+}
@@ -0,0 +1,393 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "file_io.h"
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <climits>
+#include <new>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "exceptions/io_error_exception.h"
+
+namespace badgerdb {
+
+const std::size_t PosixIo::DIRECT_ALIGNMENT;
+
+namespace {
+
+/**
+ * Heap buffer aligned for O_DIRECT
+ */
+class AlignedBuffer
+{
+ public:
+  explicit AlignedBuffer(const std::size_t len)
+    : data(NULL)
+  {
+    if (posix_memalign(&data, PosixIo::DIRECT_ALIGNMENT, len) != 0)
+      throw std::bad_alloc();
+  }
+
+  ~AlignedBuffer() { std::free(data); }
+
+  char* get() { return static_cast<char*>(data); }
+
+ private:
+  AlignedBuffer(const AlignedBuffer&);
+  AlignedBuffer& operator=(const AlignedBuffer&);
+
+  void* data;
+};
+
+bool isAligned(const void* buf, const std::size_t len, const std::uint64_t offset)
+{
+  return ((reinterpret_cast<std::uintptr_t>(buf) | len | offset)
+          & (PosixIo::DIRECT_ALIGNMENT - 1)) == 0;
+}
+
+bool isAligned(const struct iovec* iov, const int count, const std::uint64_t offset)
+{
+  std::uint64_t bits = offset;
+  for (int i = 0; i < count; i++)
+    bits |= reinterpret_cast<std::uintptr_t>(iov[i].iov_base) | iov[i].iov_len;
+  return (bits & (PosixIo::DIRECT_ALIGNMENT - 1)) == 0;
+}
+
+/**
+ * Moves 'iov' past the first 'n' bytes of the buffers from 'first' on,
+ * returning the first buffer not yet done.
+ */
+std::size_t advance(std::vector<struct iovec>& iov, std::size_t first, std::size_t n)
+{
+  while (first < iov.size() && n >= iov[first].iov_len)
+    n -= iov[first++].iov_len;
+  if (n > 0)
+  {
+    iov[first].iov_base = static_cast<char*>(iov[first].iov_base) + n;
+    iov[first].iov_len -= n;
+  }
+  return first;
+}
+
+}
+
+std::shared_ptr<FileIo> FileIo::open(const std::string& name, const bool create_new,
+                                     const IoBackend backend)
+{
+  if (backend == IO_STREAM)
+    return std::shared_ptr<FileIo>(new StreamIo(name, create_new));
+  return std::shared_ptr<FileIo>(new PosixIo(name, create_new, backend == IO_DIRECT));
+}
+
+void FileIo::readVector(const struct iovec* iov, const int count, const std::uint64_t offset)
+{
+  std::uint64_t position = offset;
+  for (int i = 0; i < count; i++)
+  {
+    read(iov[i].iov_base, iov[i].iov_len, position);
+    position += iov[i].iov_len;
+  }
+}
+
+void FileIo::writeVector(const struct iovec* iov, const int count, const std::uint64_t offset)
+{
+  std::uint64_t position = offset;
+  for (int i = 0; i < count; i++)
+  {
+    write(iov[i].iov_base, iov[i].iov_len, position);
+    position += iov[i].iov_len;
+  }
+}
+
+//----------------------------------------
+// StreamIo
+//----------------------------------------
+
+StreamIo::StreamIo(const std::string& name, const bool create_new)
+  : FileIo(name)
+{
+  std::ios_base::openmode mode =
+      std::fstream::in | std::fstream::out | std::fstream::binary;
+  if (create_new)
+    mode = mode | std::fstream::trunc;
+  stream_.open(filename_, mode);
+  if (!stream_)
+    throw IoErrorException(filename_, "open", errno);
+}
+
+void StreamIo::read(void* buf, const std::size_t len, const std::uint64_t offset)
+{
+  std::lock_guard<std::mutex> guard(latch_);
+  stream_.seekg(offset, std::ios::beg);
+  stream_.read(static_cast<char*>(buf), len);
+  const std::size_t got = stream_ ? len : (std::size_t)stream_.gcount();
+  if (got < len)
+  {
+    // past the end of the file; a failed stream refuses all later accesses
+    stream_.clear();
+    std::memset(static_cast<char*>(buf) + got, 0, len - got);
+  }
+}
+
+void StreamIo::write(const void* buf, const std::size_t len, const std::uint64_t offset)
+{
+  std::lock_guard<std::mutex> guard(latch_);
+  stream_.seekp(offset, std::ios::beg);
+  stream_.write(static_cast<const char*>(buf), len);
+  if (!stream_)
+  {
+    stream_.clear();
+    throw IoErrorException(filename_, "write", errno);
+  }
+}
+
+void StreamIo::readVector(const struct iovec* iov, const int count, const std::uint64_t offset)
+{
+  std::lock_guard<std::mutex> guard(latch_);
+  stream_.seekg(offset, std::ios::beg);
+  for (int i = 0; i < count; i++)
+  {
+    char* buf = static_cast<char*>(iov[i].iov_base);
+    stream_.read(buf, iov[i].iov_len);
+    const std::size_t got = stream_ ? iov[i].iov_len : (std::size_t)stream_.gcount();
+    if (got < iov[i].iov_len)
+    {
+      // past the end of the file, as in read(); so are the buffers after it
+      std::memset(buf + got, 0, iov[i].iov_len - got);
+      for (i++; i < count; i++)
+        std::memset(iov[i].iov_base, 0, iov[i].iov_len);
+      stream_.clear();
+    }
+  }
+}
+
+void StreamIo::writeVector(const struct iovec* iov, const int count, const std::uint64_t offset)
+{
+  std::lock_guard<std::mutex> guard(latch_);
+  stream_.seekp(offset, std::ios::beg);
+  for (int i = 0; i < count && stream_; i++)
+    stream_.write(static_cast<const char*>(iov[i].iov_base), iov[i].iov_len);
+  if (!stream_)
+  {
+    stream_.clear();
+    throw IoErrorException(filename_, "write", errno);
+  }
+}
+
+void StreamIo::sync()
+{
+  std::lock_guard<std::mutex> guard(latch_);
+  stream_.flush();
+  if (!stream_)
+  {
+    stream_.clear();
+    throw IoErrorException(filename_, "flush", errno);
+  }
+}
+
+//----------------------------------------
+// PosixIo
+//----------------------------------------
+
+PosixIo::PosixIo(const std::string& name, const bool create_new, const bool direct)
+  : FileIo(name), fd_(-1), direct_(false)
+{
+  int flags = O_RDWR;
+  if (create_new)
+    flags |= O_CREAT | O_TRUNC;
+#ifdef O_DIRECT
+  if (direct)
+  {
+    fd_ = ::open(filename_.c_str(), flags | O_DIRECT, 0666);
+    // tmpfs and some other filesystems refuse O_DIRECT with EINVAL
+    direct_ = fd_ >= 0;
+    if (fd_ < 0 && errno != EINVAL)
+      throw IoErrorException(filename_, "open", errno);
+  }
+#endif
+  if (fd_ < 0)
+    fd_ = ::open(filename_.c_str(), flags, 0666);
+  if (fd_ < 0)
+    throw IoErrorException(filename_, "open", errno);
+}
+
+PosixIo::~PosixIo()
+{
+  ::close(fd_);
+}
+
+void PosixIo::read(void* buf, const std::size_t len, const std::uint64_t offset)
+{
+  if (!direct_ || isAligned(buf, len, offset))
+  {
+    readAll(static_cast<char*>(buf), len, offset);
+    return;
+  }
+
+  const std::uint64_t first = offset & ~(std::uint64_t)(DIRECT_ALIGNMENT - 1);
+  const std::uint64_t last = (offset + len + DIRECT_ALIGNMENT - 1) & ~(std::uint64_t)(DIRECT_ALIGNMENT - 1);
+  AlignedBuffer staging(last - first);
+  readAll(staging.get(), last - first, first);
+  std::memcpy(buf, staging.get() + (offset - first), len);
+}
+
+void PosixIo::write(const void* buf, const std::size_t len, const std::uint64_t offset)
+{
+  if (!direct_ || isAligned(buf, len, offset))
+  {
+    writeAll(static_cast<const char*>(buf), len, offset);
+    return;
+  }
+
+  const std::uint64_t first = offset & ~(std::uint64_t)(DIRECT_ALIGNMENT - 1);
+  const std::uint64_t last = (offset + len + DIRECT_ALIGNMENT - 1) & ~(std::uint64_t)(DIRECT_ALIGNMENT - 1);
+  AlignedBuffer staging(last - first);
+  readAll(staging.get(), last - first, first);
+  std::memcpy(staging.get() + (offset - first), buf, len);
+  writeAll(staging.get(), last - first, first);
+}
+
+void PosixIo::readVector(const struct iovec* iov, const int count, const std::uint64_t offset)
+{
+  // buffers direct I/O cannot use are staged together, through read()
+  if (direct_ && !isAligned(iov, count, offset))
+  {
+    std::size_t len = 0;
+    for (int i = 0; i < count; i++)
+      len += iov[i].iov_len;
+    AlignedBuffer staging(len);
+    read(staging.get(), len, offset);
+    std::size_t done = 0;
+    for (int i = 0; i < count; done += iov[i++].iov_len)
+      std::memcpy(iov[i].iov_base, staging.get() + done, iov[i].iov_len);
+    return;
+  }
+
+  std::vector<struct iovec> rest(iov, iov + count);
+  std::uint64_t position = offset;
+  for (std::size_t first = 0; first < rest.size(); )
+  {
+    const int n_iov = std::min<std::size_t>(rest.size() - first, IOV_MAX);
+    std::size_t wanted = 0;
+    for (int i = 0; i < n_iov; i++)
+      wanted += rest[first + i].iov_len;
+    ssize_t n = ::preadv(fd_, &rest[first], n_iov, position);
+    if (n < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      throw IoErrorException(filename_, "preadv", errno);
+    }
+    position += n;
+    first = advance(rest, first, n);
+    // the end of the file, as in readAll()
+    if (n == 0 || (direct_ && (std::size_t)n < wanted))
+    {
+      for (; first < rest.size(); first++)
+        std::memset(rest[first].iov_base, 0, rest[first].iov_len);
+    }
+  }
+}
+
+void PosixIo::writeVector(const struct iovec* iov, const int count, const std::uint64_t offset)
+{
+  if (direct_ && !isAligned(iov, count, offset))
+  {
+    std::size_t len = 0;
+    for (int i = 0; i < count; i++)
+      len += iov[i].iov_len;
+    AlignedBuffer staging(len);
+    std::size_t done = 0;
+    for (int i = 0; i < count; done += iov[i++].iov_len)
+      std::memcpy(staging.get() + done, iov[i].iov_base, iov[i].iov_len);
+    write(staging.get(), len, offset);
+    return;
+  }
+
+  std::vector<struct iovec> rest(iov, iov + count);
+  std::uint64_t position = offset;
+  for (std::size_t first = 0; first < rest.size(); )
+  {
+    const int n_iov = std::min<std::size_t>(rest.size() - first, IOV_MAX);
+    ssize_t n = ::pwritev(fd_, &rest[first], n_iov, position);
+    if (n < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      throw IoErrorException(filename_, "pwritev", errno);
+    }
+    position += n;
+    first = advance(rest, first, n);
+  }
+}
+
+int PosixIo::nativeHandle(const void* buf, const std::size_t len,
+                          const std::uint64_t offset) const
+{
+  return !direct_ || isAligned(buf, len, offset) ? fd_ : -1;
+}
+
+void PosixIo::readAll(char* p, const std::size_t len, const std::uint64_t offset)
+{
+  std::size_t done = 0;
+  while (done < len)
+  {
+    ssize_t n = ::pread(fd_, p + done, len - done, offset + done);
+    if (n < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      throw IoErrorException(filename_, "pread", errno);
+    }
+    done += n;
+    // the end of the file; with O_DIRECT it may end inside a block
+    if (n == 0 || (direct_ && done < len))
+    {
+      std::memset(p + done, 0, len - done);
+      break;
+    }
+  }
+}
+
+void PosixIo::writeAll(const char* p, const std::size_t len, const std::uint64_t offset)
+{
+  std::size_t done = 0;
+  while (done < len)
+  {
+    ssize_t n = ::pwrite(fd_, p + done, len - done, offset + done);
+    if (n < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      throw IoErrorException(filename_, "pwrite", errno);
+    }
+    done += n;
+  }
+}
+
+void PosixIo::sync()
+{
+  if (::fdatasync(fd_) != 0)
+    throw IoErrorException(filename_, "fdatasync", errno);
+}
+
+void PosixIo::reserve(const std::uint64_t offset, const std::uint64_t len)
+{
+  // returns the error rather than setting errno
+  const int error = ::posix_fallocate(fd_, offset, len);
+  // a filesystem that cannot reserve space just allocates blocks as written
+  if (error != 0 && error != EINVAL && error != EOPNOTSUPP)
+    throw IoErrorException(filename_, "posix_fallocate", error);
+}
+
+}
@@ -0,0 +1,203 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <sys/uio.h>
+
+namespace badgerdb {
+
+/**
+ * @brief How a File reads and writes the underlying file on disk.
+ */
+enum IoBackend
+{
+	IO_STREAM = 0,	/* A std::fstream; every access seeks the one stream position */
+	IO_POSIX = 1,		/* A file descriptor accessed with pread/pwrite */
+	IO_DIRECT = 2		/* As IO_POSIX, opened with O_DIRECT to bypass the kernel page cache */
+};
+
+/**
+ * @brief Positioned access to an open file on disk.
+ *
+ * One FileIo is shared by all File objects open on the same file.  Reads and
+ * writes name their offset, so callers never depend on a file position, and
+ * may be made from several threads at once; a read past the end of the file
+ * returns zeros for the missing bytes.  Writes are not flushed to the disk
+ * until sync() is called.
+ */
+class FileIo
+{
+ public:
+	/**
+	 * Opens a file with the given backend.
+	 *
+	 * @param name		Name of the file
+	 * @param create_new	Whether to create the file, truncating it
+	 * @param backend		Backend to access the file with
+	 * @throws  IoErrorException	If the file cannot be opened
+	 */
+  static std::shared_ptr<FileIo> open(const std::string& name, const bool create_new,
+                                      const IoBackend backend);
+
+  virtual ~FileIo() {}
+
+	/**
+	 * Reads 'len' bytes at 'offset' into 'buf'.
+	 *
+	 * @throws  IoErrorException	If the read fails
+	 */
+  virtual void read(void* buf, const std::size_t len, const std::uint64_t offset) = 0;
+
+	/**
+	 * Writes 'len' bytes from 'buf' at 'offset'.
+	 *
+	 * @throws  IoErrorException	If the write fails
+	 */
+  virtual void write(const void* buf, const std::size_t len, const std::uint64_t offset) = 0;
+
+	/**
+	 * Reads consecutive bytes at 'offset' into the 'count' buffers of 'iov', in
+	 * order.  By default each buffer is read with read().
+	 *
+	 * @throws  IoErrorException	If the read fails
+	 */
+  virtual void readVector(const struct iovec* iov, const int count, const std::uint64_t offset);
+
+	/**
+	 * Writes the 'count' buffers of 'iov' one after another at 'offset'.  By
+	 * default each buffer is written with write().
+	 *
+	 * @throws  IoErrorException	If the write fails
+	 */
+  virtual void writeVector(const struct iovec* iov, const int count, const std::uint64_t offset);
+
+	/**
+	 * Forces all writes made so far to the disk.
+	 *
+	 * @throws  IoErrorException	If the file cannot be synced
+	 */
+  virtual void sync() = 0;
+
+	/**
+	 * Reserves disk space for 'len' bytes at 'offset', extending the file over
+	 * them if it is shorter, so that later writes there need not allocate
+	 * blocks.  Reserved bytes read as zeros.  By default nothing is reserved.
+	 *
+	 * @throws  IoErrorException	If the space cannot be reserved
+	 */
+  virtual void reserve(const std::uint64_t offset, const std::uint64_t len) {}
+
+	/**
+	 * Returns the file descriptor through which an IoEngine may make the given
+	 * access itself, or -1 if it must call read() or write().
+	 */
+  virtual int nativeHandle(const void* buf, const std::size_t len,
+                           const std::uint64_t offset) const
+  {
+    return -1;
+  }
+
+ protected:
+  explicit FileIo(const std::string& name) : filename_(name) {}
+
+	/**
+	 * Name of the file, for error messages
+	 */
+  const std::string filename_;
+
+ private:
+  FileIo(const FileIo&);
+  FileIo& operator=(const FileIo&);
+};
+
+/**
+ * @brief FileIo over a std::fstream.
+ *
+ * Each access seeks the stream and then reads or writes it under a latch;
+ * the buffers of a vectored access follow one seek.
+ * sync() flushes the stream's buffer to the operating system; the standard
+ * library cannot force it further.
+ */
+class StreamIo : public FileIo
+{
+ public:
+  StreamIo(const std::string& name, const bool create_new);
+
+  void read(void* buf, const std::size_t len, const std::uint64_t offset);
+  void write(const void* buf, const std::size_t len, const std::uint64_t offset);
+  void readVector(const struct iovec* iov, const int count, const std::uint64_t offset);
+  void writeVector(const struct iovec* iov, const int count, const std::uint64_t offset);
+  void sync();
+
+ private:
+	/**
+	 * Serializes accesses, which all move the one stream position
+	 */
+  std::mutex latch_;
+
+  std::fstream stream_;
+};
+
+/**
+ * @brief FileIo over a file descriptor.
+ *
+ * A page is moved with one pread or pwrite, and a run of pages with one
+ * preadv or pwritev; none of them keep a file position, so accesses from
+ * different threads may overlap.  sync() calls fdatasync and reserve()
+ * posix_fallocate.
+ *
+ * In direct mode the file is opened with O_DIRECT, which only transfers whole
+ * blocks between aligned memory and aligned offsets.  Accesses that are
+ * aligned on DIRECT_ALIGNMENT, such as whole pages of a version 2 or later file read
+ * into buffer pool frames, go straight to the disk; any other access is
+ * staged through an aligned buffer, writes by read-modify-write of the blocks
+ * they touch.  A filesystem that refuses O_DIRECT gets buffered I/O.
+ */
+class PosixIo : public FileIo
+{
+ public:
+	/**
+	 * Alignment of memory, offsets and lengths in direct mode
+	 */
+  static const std::size_t DIRECT_ALIGNMENT = 4096;
+
+  PosixIo(const std::string& name, const bool create_new, const bool direct);
+  ~PosixIo();
+
+	/**
+	 * Returns true if the file was opened with O_DIRECT.
+	 */
+  bool direct() const { return direct_; }
+
+  void read(void* buf, const std::size_t len, const std::uint64_t offset);
+  void write(const void* buf, const std::size_t len, const std::uint64_t offset);
+  void readVector(const struct iovec* iov, const int count, const std::uint64_t offset);
+  void writeVector(const struct iovec* iov, const int count, const std::uint64_t offset);
+  void sync();
+  void reserve(const std::uint64_t offset, const std::uint64_t len);
+  int nativeHandle(const void* buf, const std::size_t len, const std::uint64_t offset) const;
+
+ private:
+	/**
+	 * pread/pwrite loops retrying interrupted and partial transfers
+	 */
+  void readAll(char* buf, const std::size_t len, const std::uint64_t offset);
+  void writeAll(const char* buf, const std::size_t len, const std::uint64_t offset);
+
+  int fd_;
+
+  bool direct_;
+};
+
+}
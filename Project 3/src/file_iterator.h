@@ -103,6 +103,14 @@ class FileIterator {
 	inline Page operator*() const
   { return file_->readPage(current_page_number_); }
 
+  /**
+   * Returns the number of the page the iterator points to, without reading
+   * the page from the file.
+   *
+   * @return  Page number, Page::INVALID_NUMBER at the end of the file.
+   */
+  PageId page_number() const { return current_page_number_; }
+
  private:
   /**
    * File we're iterating over.
@@ -0,0 +1,88 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "file_map.h"
+
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "file.h"
+#include "exceptions/invalid_page_exception.h"
+#include "exceptions/io_error_exception.h"
+
+namespace badgerdb {
+
+FileMap::FileMap(const File& file)
+  : filename_(file.filename()), version_(file.formatVersion()),
+    base_(NULL), length_(0)
+{
+  // a descriptor of our own, since the file's FileIo may not have one
+  int fd = ::open(filename_.c_str(), O_RDONLY);
+  if (fd < 0)
+    throw IoErrorException(filename_, "open", errno);
+
+  struct stat st;
+  if (::fstat(fd, &st) != 0)
+  {
+    int error = errno;
+    ::close(fd);
+    throw IoErrorException(filename_, "fstat", error);
+  }
+
+  length_ = st.st_size;
+  if (length_ > 0)
+  {
+    void* base = ::mmap(NULL, length_, PROT_READ, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED)
+    {
+      int error = errno;
+      ::close(fd);
+      throw IoErrorException(filename_, "mmap", error);
+    }
+    base_ = static_cast<char*>(base);
+    // index lookups jump between pages; scans ask for their pages by prefetch()
+    ::madvise(base_, length_, MADV_RANDOM);
+  }
+  // the mapping keeps the file open
+  ::close(fd);
+}
+
+FileMap::~FileMap()
+{
+  if (base_ != NULL)
+    ::munmap(base_, length_);
+}
+
+bool FileMap::covers(const PageId page_number) const
+{
+  return page_number != Page::INVALID_NUMBER
+      && File::pagePosition(page_number, version_) + Page::SIZE <= length_;
+}
+
+const Page* FileMap::page(const PageId page_number) const
+{
+  if (!covers(page_number))
+    throw InvalidPageException(page_number, filename_);
+  return reinterpret_cast<const Page*>(base_ + File::pagePosition(page_number, version_));
+}
+
+void FileMap::prefetch(const PageId page_number) const
+{
+  if (!covers(page_number))
+    return;
+
+  // madvise wants an address on a boundary of the system page size
+  const std::uintptr_t mask = ::sysconf(_SC_PAGESIZE) - 1;
+  char* first = base_ + File::pagePosition(page_number, version_);
+  char* start = reinterpret_cast<char*>(reinterpret_cast<std::uintptr_t>(first) & ~mask);
+  ::madvise(start, first + Page::SIZE - start, MADV_WILLNEED);
+}
+
+}
@@ -0,0 +1,92 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "page.h"
+#include "types.h"
+
+namespace badgerdb {
+
+class File;
+
+/**
+ * @brief Read-only memory mapping of the pages of a file.
+ *
+ * Maps the whole file as it is on disk when the mapping is made, so that
+ * pages can be read in place without copying them into the buffer pool.  The
+ * mapping is shared with the kernel page cache: a page written through a
+ * PosixIo file later shows through the mapping, but pages allocated after the
+ * mapping was made are not covered by it.  Pages written to a StreamIo file
+ * only show once the file is synced.
+ *
+ * The pages may not be modified through the mapping; doing so faults.
+ */
+class FileMap
+{
+ public:
+	/**
+	 * Maps the pages of an open file.
+	 *
+	 * @param file	File to map
+	 * @throws  IoErrorException	If the file cannot be opened or mapped
+	 */
+  explicit FileMap(const File& file);
+
+	/**
+	 * Unmaps the file.  Pointers returned by page() become invalid.
+	 */
+  ~FileMap();
+
+	/**
+	 * Returns the page with the given number in the mapping.
+	 *
+	 * @param page_number	Number of page
+	 * @throws  InvalidPageException	If the page lies outside the mapping
+	 */
+  const Page* page(const PageId page_number) const;
+
+	/**
+	 * Asks the kernel to read the given page in ahead of its use.  Does nothing
+	 * for a page outside the mapping.
+	 */
+  void prefetch(const PageId page_number) const;
+
+	/**
+	 * Returns the number of bytes mapped.
+	 */
+  std::size_t length() const { return length_; }
+
+ private:
+  FileMap(const FileMap&);
+  FileMap& operator=(const FileMap&);
+
+	/**
+	 * Returns true if the page with the given number lies in the mapping.
+	 */
+  bool covers(const PageId page_number) const;
+
+	/**
+	 * Name of the mapped file, for errors
+	 */
+  const std::string filename_;
+
+	/**
+	 * Format version of the file, which decides where its pages lie
+	 */
+  const std::uint32_t version_;
+
+  char* base_;
+
+  std::size_t length_;
+};
+
+}
@@ -5,32 +5,49 @@
  * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
  */
 
+#include <algorithm>
 #include "filescan.h"
 #include "exceptions/end_of_file_exception.h"
 
 namespace badgerdb { 
 
-FileScan::FileScan(const std::string &name, BufMgr *bufferMgr)
+const double FileScan::DEFAULT_RING_THRESHOLD = 0.25;
+const std::uint32_t FileScan::DEFAULT_PREFETCH_DISTANCE;
+
+FileScan::FileScan(const std::string &name, BufMgr *bufferMgr, const double ringThreshold,
+                   const std::uint32_t prefetchDist)
 {
   file = new PageFile(name, false);	//dont create new file
 	bufMgr = bufferMgr;
-	curDirtyFlag = false;
-  curPage = NULL;
+  strategy = NULL;
+  prefetchDistance = prefetchDist;
+  if (file->getNumPages() > ringThreshold * bufMgr->getNumBufs())
+  {
+    // room for the pages read ahead and as many again, or the ring recycles
+    // them before the scan gets to them; BufMgr uses at most a quarter of
+    // the pool for a ring, so a small pool shortens the distance instead
+    std::uint32_t ringSize = std::max(BufferAccessStrategy::DEFAULT_RING_SIZE, 2 * prefetchDist);
+    strategy = new BufferAccessStrategy(ringSize);
+    ringSize = std::min(ringSize, std::max(1u, bufMgr->getNumBufs() / 4));
+    prefetchDistance = std::min(prefetchDist, ringSize / 2);
+  }
+  prefetchedUpTo = 0;
 	filePageIter = file->begin();
 }
 
+FileScan::FileScan(const std::string &name, BufferPoolSet *pools, const double ringThreshold,
+                   const std::uint32_t prefetchDist)
+  : FileScan(name, pools->poolFor(name), ringThreshold, prefetchDist)
+{
+}
+
 FileScan::~FileScan()
 {
   // generally must unpin last page of the scan
-  if (curPage != NULL)
-  {
-    bufMgr->unPinPage(file, (*filePageIter).page_number(), curDirtyFlag);
-    curPage = NULL;
-		curDirtyFlag = false;
-    filePageIter = file->begin();
-  }
+  curPage.release();
   bufMgr->flushFile(file);
   delete file;
+  delete strategy;
 }
 
 void FileScan::scanNext(RecordId& outRid)
@@ -43,7 +60,7 @@ void FileScan::scanNext(RecordId& outRid)
 	}
 
   // special case of the first record of the first page of the file
-  if (curPage == NULL)
+  if (curPage.empty())
   {
     // need to get the first page of the file
 		filePageIter = file->begin();
@@ -53,8 +70,8 @@ void FileScan::scanNext(RecordId& outRid)
 		}
 	 
 		// read the first page of the file
-    bufMgr->readPage(file, (*filePageIter).page_number(), curPage); 
-		curDirtyFlag = false;
+    curPage = bufMgr->fetchPage(file, filePageIter.page_number(), strategy);
+		readAhead();
 
 		// get the first record off the page
     pageRecordIter = curPage->begin(); 
@@ -75,20 +92,20 @@ void FileScan::scanNext(RecordId& outRid)
 
   while (pageRecordIter == curPage->end())
   {
-    // unpin the current page
-    bufMgr->unPinPage(file, (*filePageIter).page_number(), curDirtyFlag);
-    curPage = NULL;
-    curDirtyFlag = false;
+    // unpin the current page.  The next page number comes from the header
+    // on disk: allocating or deleting a page relinks its neighbours there
+    // only, so the copy in the buffer pool may point at the wrong page.
+    curPage.release();
 
     filePageIter++;
     if (filePageIter == file->end())
     {
-      curPage = NULL;
 			throw EndOfFileException();
     }
 
     // read the next page of the file
-    bufMgr->readPage(file, (*filePageIter).page_number(), curPage);
+    curPage = bufMgr->fetchPage(file, filePageIter.page_number(), strategy);
+    readAhead();
 
     // get the first record off the page
     pageRecordIter = curPage->begin(); 
@@ -104,6 +121,23 @@ void FileScan::scanNext(RecordId& outRid)
 	return;
 }
 
+void FileScan::readAhead()
+{
+  // used pages are chained in page number order and mostly contiguous, so
+  // guess the pages that follow; a page that does not exist is not read
+  PageId nextPageNo = filePageIter.page_number() + 1;
+  if (prefetchDistance == 0)
+    return;
+
+  PageId lastPageNo = nextPageNo + prefetchDistance - 1;
+  if (lastPageNo <= prefetchedUpTo)
+    return;
+  PageId firstPageNo = std::max(nextPageNo, prefetchedUpTo + 1);
+  // through the scan's ring, if it has one, like the pages it reads itself
+  bufMgr->prefetchRange(file, firstPageNo, lastPageNo - firstPageNo + 1, strategy);
+  prefetchedUpTo = lastPageNo;
+}
+
 // returns pointer to the current record.  page is left pinned
 // and the scan logic is required to unpin the page 
 std::string FileScan::getRecord()
@@ -114,7 +148,7 @@ std::string FileScan::getRecord()
 // mark current page of scan dirty
 void FileScan::markDirty()
 {
-  curDirtyFlag = true;
+  curPage.markDirty();
 }
 
 }
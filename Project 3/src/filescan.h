@@ -12,6 +12,7 @@
 #include "types.h"
 #include "page.h"
 #include "buffer.h"
+#include "bufPoolSet.h"
 #include "file_iterator.h"
 #include "page_iterator.h"
 
@@ -24,7 +25,43 @@ class FileScan
 {
  public:
 
-  FileScan(const std::string &name, BufMgr *bufMgr);
+  /**
+   * Default for the ringThreshold argument of the constructor
+   */
+  static const double DEFAULT_RING_THRESHOLD;
+
+  /**
+   * Default for the prefetchDistance argument of the constructor
+   */
+  static const std::uint32_t DEFAULT_PREFETCH_DISTANCE = 8;
+
+  /**
+   * Opens a scan of the relation.  Relations with more pages than
+   * ringThreshold times the size of the buffer pool are read through a
+   * BufferAccessStrategy ring so the scan does not flush the pool.
+   *
+   * @param name            Name of the relation
+   * @param bufMgr          Buffer manager to read pages through
+   * @param ringThreshold   Fraction of the pool above which the ring is used;
+   *                        0 always uses it, a very large value never does
+   * @param prefetchDistance  Number of pages to read ahead of the scan; 0 disables read-ahead.
+   *                        Through a ring, at most half the frames it gets.
+   */
+  FileScan(const std::string &name, BufMgr *bufMgr,
+           const double ringThreshold = DEFAULT_RING_THRESHOLD,
+           const std::uint32_t prefetchDistance = DEFAULT_PREFETCH_DISTANCE);
+
+  /**
+   * Opens a scan of the relation through the pool 'pools' assigns to it.
+   *
+   * @param name            Name of the relation
+   * @param pools           Buffer pools to pick the buffer manager from
+   * @param ringThreshold   See above
+   * @param prefetchDistance  See above
+   */
+  FileScan(const std::string &name, BufferPoolSet *pools,
+           const double ringThreshold = DEFAULT_RING_THRESHOLD,
+           const std::uint32_t prefetchDistance = DEFAULT_PREFETCH_DISTANCE);
 
   ~FileScan();
 
@@ -49,17 +86,32 @@ class FileScan
 	BufMgr				*bufMgr;
 
   /**
-   * Current page being scanned.
+   * Ring of frames the scan reads pages into, NULL for a small relation.
    */
-  Page*         curPage;
+  BufferAccessStrategy *strategy;
 
-  FileIterator  filePageIter;
-  PageIterator  pageRecordIter;
+  /**
+   * Current page being scanned, kept pinned until the scan moves on.
+   */
+  PageGuard     curPage;
+
+  /**
+   * Asks the buffer manager to read the pages following the current one.
+   */
+  void readAhead();
 
   /**
-   * True if page has been updated
+   * Number of pages to keep reading ahead of the scan
    */
-  bool  	      curDirtyFlag;
+  std::uint32_t prefetchDistance;
+
+  /**
+   * Highest page number read ahead so far
+   */
+  PageId        prefetchedUpTo;
+
+  FileIterator  filePageIter;
+  PageIterator  pageRecordIter;
 };
 
 }
@@ -0,0 +1,82 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "free_space_map.h"
+
+#include <algorithm>
+#include <sys/stat.h>
+
+#include "file_io.h"
+#include "page.h"
+
+namespace badgerdb {
+
+const std::uint16_t FreeSpaceMap::CATEGORY_SIZE;
+const std::size_t FreeSpaceMap::NUM_CATEGORIES;
+
+static_assert(Page::DATA_SIZE / FreeSpaceMap::CATEGORY_SIZE < FreeSpaceMap::NUM_CATEGORIES,
+              "Every amount of free space must have a one-byte category.");
+
+FreeSpaceMap::FreeSpaceMap(const std::string& filename)
+  : buckets_(NUM_CATEGORIES)
+{
+  const std::string name = fileName(filename);
+  struct stat st;
+  is_new_ = ::stat(name.c_str(), &st) != 0;
+  // the map is small and written a byte at a time, so never with O_DIRECT
+  io_ = FileIo::open(name, is_new_, IO_POSIX);
+  if (is_new_)
+    return;
+
+  categories_.resize(st.st_size);
+  if (!categories_.empty())
+    io_->read(&categories_[0], categories_.size(), 0);
+  for (PageId i = 0; i < categories_.size(); ++i)
+  {
+    if (categories_[i] != 0)
+      buckets_[categories_[i]].insert(i);
+  }
+}
+
+FreeSpaceMap::~FreeSpaceMap()
+{
+}
+
+void FreeSpaceMap::update(const PageId page_number, const std::size_t free_space)
+{
+  const std::uint8_t category = std::min(free_space / CATEGORY_SIZE, NUM_CATEGORIES - 1);
+  if (page_number >= categories_.size())
+  {
+    if (category == 0)
+      return;
+    categories_.resize(page_number + 1, 0);
+  }
+  const std::uint8_t old_category = categories_[page_number];
+  if (old_category == category)
+    return;
+
+  if (old_category != 0)
+    buckets_[old_category].erase(page_number);
+  if (category != 0)
+    buckets_[category].insert(page_number);
+  categories_[page_number] = category;
+  io_->write(&category, 1, page_number);
+}
+
+PageId FreeSpaceMap::find(const std::size_t space) const
+{
+  // the lowest category whose every page is certain to have the space
+  for (std::size_t category = std::max<std::size_t>((space + CATEGORY_SIZE - 1) / CATEGORY_SIZE, 1);
+       category < NUM_CATEGORIES; ++category)
+  {
+    if (!buckets_[category].empty())
+      return *buckets_[category].begin();
+  }
+  return Page::INVALID_NUMBER;
+}
+
+}
@@ -0,0 +1,105 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "types.h"
+
+namespace badgerdb {
+
+class FileIo;
+
+/**
+ * @brief Free space of the pages of a PageFile, bucketed so that a page with
+ *        room for a record is found without reading any page.
+ *
+ * Each page gets a category, its free space divided by CATEGORY_SIZE, and
+ * pages of each category are kept in a bucket.  A page of category c has at
+ * least c * CATEGORY_SIZE bytes free.  The categories are kept on disk, one
+ * byte per page, in a file next to the PageFile (see fileName()), written as
+ * they change but never synced.  The map is only a hint: a page's category
+ * may be stale after a crash or after the page was changed other than
+ * through PageFile::insertRecord() and PageFile::deleteRecord(), so callers
+ * check the page they are given.
+ *
+ * @warning This class is not threadsafe.
+ */
+class FreeSpaceMap
+{
+ public:
+	/**
+	 * Bytes of free space per category
+	 */
+  static const std::uint16_t CATEGORY_SIZE = 32;
+
+	/**
+	 * Number of categories, enough to cover an empty page
+	 */
+  static const std::size_t NUM_CATEGORIES = 256;
+
+	/**
+	 * Returns the name of the file the map of the given PageFile is kept in.
+	 */
+  static std::string fileName(const std::string& filename) { return filename + ".fsm"; }
+
+	/**
+	 * Opens the map of the given PageFile, creating an empty one if the file
+	 * has none yet.
+	 *
+	 * @param filename	Name of the PageFile
+	 * @throws  IoErrorException	If the map cannot be read or created
+	 */
+  explicit FreeSpaceMap(const std::string& filename);
+
+  ~FreeSpaceMap();
+
+	/**
+	 * Returns true if the map was created rather than read from disk.
+	 */
+  bool isNew() const { return is_new_; }
+
+	/**
+	 * Records the free space of a page; 0 for a page that is full or deleted.
+	 *
+	 * @throws  IoErrorException	If the map cannot be written
+	 */
+  void update(const PageId page_number, const std::size_t free_space);
+
+	/**
+	 * Returns a page that has at least the given number of bytes free, the one
+	 * with the lowest number among those in the lowest category that is
+	 * certain to fit, or Page::INVALID_NUMBER if there is none.
+	 */
+  PageId find(const std::size_t space) const;
+
+ private:
+  FreeSpaceMap(const FreeSpaceMap&);
+  FreeSpaceMap& operator=(const FreeSpaceMap&);
+
+  std::shared_ptr<FileIo> io_;
+
+	/**
+	 * Category of every page, indexed by page number
+	 */
+  std::vector<std::uint8_t> categories_;
+
+	/**
+	 * Pages of each category; category 0 is not kept
+	 */
+  std::vector<std::set<PageId> > buckets_;
+
+  bool is_new_;
+};
+
+}
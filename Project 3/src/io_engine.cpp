@@ -0,0 +1,504 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "io_engine.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+
+#ifdef __linux__
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "file_io.h"
+#include "exceptions/io_error_exception.h"
+
+namespace badgerdb {
+
+const std::uint32_t IoEngine::DEFAULT_QUEUE_DEPTH;
+const std::uint32_t ThreadPoolIoEngine::MAX_THREADS;
+
+namespace {
+
+/**
+ * Runs a request synchronously.  Returns 0 or the errno of the failure.
+ */
+int runRequest(FileIo& io, const bool write, char* buf, const std::size_t len,
+               const std::uint64_t offset)
+{
+  try
+  {
+    if (write)
+      io.write(buf, len, offset);
+    else
+      io.read(buf, len, offset);
+  }
+  catch (const IoErrorException& e)
+  {
+    return e.error() ? e.error() : EIO;
+  }
+  catch (...)
+  {
+    return EIO;
+  }
+  return 0;
+}
+
+}
+
+//----------------------------------------
+// IoEngine
+//----------------------------------------
+
+std::future<int> IoEngine::submitRead(FileIo& io, void* buf, const std::size_t len,
+                                      const std::uint64_t offset)
+{
+  std::shared_ptr<std::promise<int> > promise(new std::promise<int>());
+  std::future<int> result = promise->get_future();
+  submitRead(io, buf, len, offset, [promise](int error) { promise->set_value(error); });
+  return result;
+}
+
+std::future<int> IoEngine::submitWrite(FileIo& io, const void* buf, const std::size_t len,
+                                       const std::uint64_t offset)
+{
+  std::shared_ptr<std::promise<int> > promise(new std::promise<int>());
+  std::future<int> result = promise->get_future();
+  submitWrite(io, buf, len, offset, [promise](int error) { promise->set_value(error); });
+  return result;
+}
+
+IoEngine& IoEngine::shared()
+{
+  static std::unique_ptr<IoEngine> engine(create());
+  return *engine;
+}
+
+//----------------------------------------
+// ThreadPoolIoEngine
+//----------------------------------------
+
+ThreadPoolIoEngine::ThreadPoolIoEngine(const std::uint32_t queueDepth)
+  : IoEngine(std::max(1u, std::min(queueDepth, MAX_THREADS))), stop(false)
+{
+  for (std::uint32_t i = 0; i < queueDepth_; i++)
+    workers.push_back(std::thread(&ThreadPoolIoEngine::run, this));
+}
+
+ThreadPoolIoEngine::~ThreadPoolIoEngine()
+{
+  {
+    std::lock_guard<std::mutex> guard(latch);
+    stop = true;
+  }
+  cond.notify_all();
+  for (std::size_t i = 0; i < workers.size(); i++)
+    workers[i].join();
+}
+
+void ThreadPoolIoEngine::submitRead(FileIo& io, void* buf, const std::size_t len,
+                                    const std::uint64_t offset, Callback done)
+{
+  Request request = { false, &io, static_cast<char*>(buf), len, offset, done };
+  submit(request);
+}
+
+void ThreadPoolIoEngine::submitWrite(FileIo& io, const void* buf, const std::size_t len,
+                                     const std::uint64_t offset, Callback done)
+{
+  Request request = { true, &io, const_cast<char*>(static_cast<const char*>(buf)),
+                      len, offset, done };
+  submit(request);
+}
+
+void ThreadPoolIoEngine::submit(Request& request)
+{
+  {
+    std::lock_guard<std::mutex> guard(latch);
+    queue.push_back(Request());
+    std::swap(queue.back(), request);
+  }
+  cond.notify_one();
+}
+
+void ThreadPoolIoEngine::run()
+{
+  std::unique_lock<std::mutex> lock(latch);
+  while (true)
+  {
+    // the queue is drained before the workers exit
+    while (!stop && queue.empty())
+      cond.wait(lock);
+    if (queue.empty())
+      return;
+
+    Request request;
+    std::swap(request, queue.front());
+    queue.pop_front();
+    lock.unlock();
+
+    request.done(runRequest(*request.io, request.write, request.buf, request.len, request.offset));
+
+    lock.lock();
+  }
+}
+
+#ifdef __linux__
+
+//----------------------------------------
+// UringIoEngine
+//----------------------------------------
+
+namespace {
+
+/**
+ * IoEngine on an io_uring, driven with the raw system calls.
+ *
+ * Submitters fill one submission queue entry each and enter the kernel right
+ * away; a completion thread waits for completion queue entries and runs the
+ * callbacks.  Requests the kernel cannot take as they are (see
+ * FileIo::nativeHandle()) and reads or writes the kernel cut short are
+ * finished with FileIo's own calls: the former on a small thread pool, the
+ * latter on the completion thread.
+ */
+class UringIoEngine : public IoEngine
+{
+ public:
+	/**
+	 * Sets up the ring.  Returns NULL if the kernel has no usable io_uring.
+	 */
+  static UringIoEngine* create(const std::uint32_t queueDepth);
+
+  ~UringIoEngine();
+
+  void submitRead(FileIo& io, void* buf, const std::size_t len,
+                  const std::uint64_t offset, Callback done)
+  {
+    submit(io, false, static_cast<char*>(buf), len, offset, done);
+  }
+
+  void submitWrite(FileIo& io, const void* buf, const std::size_t len,
+                   const std::uint64_t offset, Callback done)
+  {
+    submit(io, true, const_cast<char*>(static_cast<const char*>(buf)), len, offset, done);
+  }
+
+  const char* name() const { return "io_uring"; }
+
+ private:
+  struct Request
+  {
+    bool write;
+    FileIo* io;
+    char* buf;
+    std::size_t len;
+    std::uint64_t offset;
+    Callback done;
+
+	/**
+	 * Set once the fields above are filled in.  The request reaches the
+	 * completion thread through the kernel, which the language's memory model
+	 * does not see, so this provides the ordering it can see.
+	 */
+    std::atomic<bool> ready;
+  };
+
+  explicit UringIoEngine(const std::uint32_t queueDepth);
+
+  bool setup();
+
+  void submit(FileIo& io, const bool write, char* buf, const std::size_t len,
+              const std::uint64_t offset, Callback done);
+
+	/**
+	 * Queues one entry and enters the kernel.  Called with 'latch' held.  If
+	 * the kernel refuses the entry, it is taken back out of the queue and
+	 * IoErrorException is thrown, and the caller still owns 'request'.  Once
+	 * the kernel has the entry, 'request' belongs to the completion thread.
+	 */
+  void push(const std::uint8_t opcode, const int fd, char* buf, const std::size_t len,
+            const std::uint64_t offset, Request* request);
+
+	/**
+	 * Body of the completion thread
+	 */
+  void reap();
+
+  int ringFd;
+
+  void* sqRing;
+  std::size_t sqRingSize;
+  void* cqRing;
+  std::size_t cqRingSize;
+  io_uring_sqe* sqes;
+  std::size_t sqesSize;
+
+  unsigned* sqHead;
+  unsigned* sqTail;
+  unsigned sqMask;
+  unsigned* sqArray;
+  unsigned* cqHead;
+  unsigned* cqTail;
+  unsigned cqMask;
+  io_uring_cqe* cqes;
+
+	/**
+	 * Serializes submissions and protects the members below
+	 */
+  std::mutex latch;
+
+	/**
+	 * Signalled when a request completes
+	 */
+  std::condition_variable cond;
+
+	/**
+	 * Requests submitted and not completed
+	 */
+  std::uint32_t inFlight;
+
+	/**
+	 * Set by the destructor to make the completion thread exit
+	 */
+  std::atomic<bool> stop;
+
+  std::thread reaper;
+
+	/**
+	 * Runs requests that cannot go to the kernel as they are
+	 */
+  std::unique_ptr<ThreadPoolIoEngine> fallback;
+};
+
+UringIoEngine* UringIoEngine::create(const std::uint32_t queueDepth)
+{
+  std::unique_ptr<UringIoEngine> engine(new UringIoEngine(queueDepth));
+  if (!engine->setup())
+    return NULL;
+  engine->reaper = std::thread(&UringIoEngine::reap, engine.get());
+  return engine.release();
+}
+
+UringIoEngine::UringIoEngine(const std::uint32_t queueDepth)
+  : IoEngine(std::max(1u, queueDepth)), ringFd(-1),
+    sqRing(MAP_FAILED), sqRingSize(0), cqRing(MAP_FAILED), cqRingSize(0),
+    sqes(static_cast<io_uring_sqe*>(MAP_FAILED)), sqesSize(0),
+    inFlight(0), stop(false), fallback(new ThreadPoolIoEngine(2))
+{
+}
+
+bool UringIoEngine::setup()
+{
+  io_uring_params params;
+  std::memset(&params, 0, sizeof(params));
+  ringFd = (int)syscall(__NR_io_uring_setup, queueDepth_, &params);
+  if (ringFd < 0)
+    return false;
+  // IORING_OP_READ and IORING_OP_WRITE came with the kernel (5.6) that added
+  // this feature
+  if (!(params.features & IORING_FEAT_RW_CUR_POS) || !(params.features & IORING_FEAT_NODROP))
+    return false;
+
+  sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+  const bool single = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+  if (single)
+    sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+  sqRing = mmap(NULL, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                ringFd, IORING_OFF_SQ_RING);
+  if (sqRing == MAP_FAILED)
+    return false;
+  if (single)
+    cqRing = sqRing;
+  else
+  {
+    cqRing = mmap(NULL, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                  ringFd, IORING_OFF_CQ_RING);
+    if (cqRing == MAP_FAILED)
+      return false;
+  }
+  sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+  sqes = static_cast<io_uring_sqe*>(mmap(NULL, sqesSize, PROT_READ | PROT_WRITE,
+                                         MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES));
+  if (sqes == MAP_FAILED)
+    return false;
+
+  char* sq = static_cast<char*>(sqRing);
+  char* cq = static_cast<char*>(cqRing);
+  sqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+  sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+  sqMask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+  sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+  cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+  cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+  cqMask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+  cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+  return true;
+}
+
+UringIoEngine::~UringIoEngine()
+{
+  if (reaper.joinable())
+  {
+    // wake the completion thread with an empty request once all are done
+    std::unique_lock<std::mutex> lock(latch);
+    while (inFlight > 0)
+      cond.wait(lock);
+    stop = true;
+    push(IORING_OP_NOP, -1, NULL, 0, 0, NULL);
+    lock.unlock();
+    reaper.join();
+  }
+  fallback.reset();
+
+  if (sqes != MAP_FAILED)
+    munmap(sqes, sqesSize);
+  if (cqRing != MAP_FAILED && cqRing != sqRing)
+    munmap(cqRing, cqRingSize);
+  if (sqRing != MAP_FAILED)
+    munmap(sqRing, sqRingSize);
+  if (ringFd >= 0)
+    close(ringFd);
+}
+
+void UringIoEngine::submit(FileIo& io, const bool write, char* buf, const std::size_t len,
+                           const std::uint64_t offset, Callback done)
+{
+  const int fd = io.nativeHandle(buf, len, offset);
+  if (fd < 0)
+  {
+    if (write)
+      fallback->submitWrite(io, buf, len, offset, done);
+    else
+      fallback->submitRead(io, buf, len, offset, done);
+    return;
+  }
+
+  Request* request = new Request;
+  request->write = write;
+  request->io = &io;
+  request->buf = buf;
+  request->len = len;
+  request->offset = offset;
+  request->done.swap(done);
+  request->ready.store(true, std::memory_order_release);
+
+  std::unique_lock<std::mutex> lock(latch);
+  // the completion queue is twice as long, so it cannot overflow
+  while (inFlight >= queueDepth_)
+    cond.wait(lock);
+  inFlight++;
+  try
+  {
+    push(write ? IORING_OP_WRITE : IORING_OP_READ, fd, buf, len, offset, request);
+  }
+  catch (...)
+  {
+    inFlight--;
+    delete request;
+    throw;
+  }
+}
+
+void UringIoEngine::push(const std::uint8_t opcode, const int fd, char* buf, const std::size_t len,
+                         const std::uint64_t offset, Request* request)
+{
+  const unsigned tail = *sqTail;
+  const unsigned index = tail & sqMask;
+  io_uring_sqe* sqe = &sqes[index];
+  std::memset(sqe, 0, sizeof(*sqe));
+  sqe->opcode = opcode;
+  sqe->fd = fd;
+  sqe->addr = reinterpret_cast<std::uint64_t>(buf);
+  sqe->len = (std::uint32_t)len;
+  sqe->off = offset;
+  sqe->user_data = reinterpret_cast<std::uint64_t>(request);
+  sqArray[index] = index;
+  __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+
+  // without SQPOLL the kernel consumes the entry before returning
+  while (syscall(__NR_io_uring_enter, ringFd, 1, 0, 0, NULL, 0) < 0)
+  {
+    if (errno == EINTR || errno == EAGAIN || errno == EBUSY)
+      continue;
+    const int error = errno;
+    // nothing else takes entries off the queue, so one the kernel did not
+    // take can be withdrawn; one it did take completes like any other
+    if (__atomic_load_n(sqHead, __ATOMIC_ACQUIRE) != tail)
+      return;
+    __atomic_store_n(sqTail, tail, __ATOMIC_RELEASE);
+    throw IoErrorException("io_uring", "io_uring_enter", error);
+  }
+}
+
+void UringIoEngine::reap()
+{
+  while (true)
+  {
+    const unsigned head = *cqHead;
+    if (head == __atomic_load_n(cqTail, __ATOMIC_ACQUIRE))
+    {
+      if (stop)
+        return;
+      syscall(__NR_io_uring_enter, ringFd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+      continue;
+    }
+
+    const io_uring_cqe cqe = cqes[head & cqMask];
+    __atomic_store_n(cqHead, head + 1, __ATOMIC_RELEASE);
+    Request* request = reinterpret_cast<Request*>(cqe.user_data);
+    if (request == NULL)
+      continue;
+    request->ready.load(std::memory_order_acquire);
+
+    int error = 0;
+    if (cqe.res < 0)
+    {
+      // transient refusals are retried synchronously
+      if (cqe.res == -EAGAIN || cqe.res == -EINTR)
+        error = runRequest(*request->io, request->write, request->buf, request->len, request->offset);
+      else
+        error = -cqe.res;
+    }
+    else if ((std::size_t)cqe.res < request->len)
+    {
+      // the end of the file, or a transfer cut short; FileIo finishes both
+      error = runRequest(*request->io, request->write, request->buf + cqe.res,
+                         request->len - cqe.res, request->offset + cqe.res);
+    }
+    request->done(error);
+    delete request;
+
+    std::lock_guard<std::mutex> guard(latch);
+    inFlight--;
+    cond.notify_all();
+  }
+}
+
+}
+
+#endif
+
+std::unique_ptr<IoEngine> IoEngine::create(const std::uint32_t queueDepth, const bool useUring)
+{
+#ifdef __linux__
+  if (useUring)
+  {
+    IoEngine* engine = UringIoEngine::create(queueDepth);
+    if (engine != NULL)
+      return std::unique_ptr<IoEngine>(engine);
+  }
+#endif
+  return std::unique_ptr<IoEngine>(new ThreadPoolIoEngine(queueDepth));
+}
+
+}
@@ -0,0 +1,167 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace badgerdb {
+
+class FileIo;
+
+/**
+ * @brief Issues reads and writes of a FileIo asynchronously.
+ *
+ * A request names its buffer, length and offset like FileIo::read() and
+ * FileIo::write(), and completes by calling its callback with 0 or the errno
+ * of the failure; reads past the end of the file return zeros as FileIo's do.
+ * Up to queueDepth() requests are serviced at a time; further ones wait in
+ * the submit call or in a queue.  The FileIo and the buffer must stay valid
+ * until the callback runs.  Callbacks run on a thread of the engine, must
+ * not submit to or wait for the same engine, and must not throw.
+ *
+ * create() returns an io_uring engine when the kernel provides io_uring and
+ * a ThreadPoolIoEngine otherwise.
+ */
+class IoEngine
+{
+ public:
+  typedef std::function<void(int error)> Callback;
+
+	/**
+	 * Queue depth of the engine returned by shared()
+	 */
+  static const std::uint32_t DEFAULT_QUEUE_DEPTH = 32;
+
+	/**
+	 * Creates the best engine available.
+	 *
+	 * @param queueDepth	Maximum number of requests in flight
+	 * @param useUring	False to skip io_uring even if the kernel has it
+	 */
+  static std::unique_ptr<IoEngine> create(const std::uint32_t queueDepth = DEFAULT_QUEUE_DEPTH,
+                                          const bool useUring = true);
+
+	/**
+	 * Returns an engine for the whole process, created on first use.
+	 */
+  static IoEngine& shared();
+
+	/**
+	 * Waits for all requests in flight to complete.
+	 */
+  virtual ~IoEngine() {}
+
+  virtual void submitRead(FileIo& io, void* buf, const std::size_t len,
+                          const std::uint64_t offset, Callback done) = 0;
+
+  virtual void submitWrite(FileIo& io, const void* buf, const std::size_t len,
+                           const std::uint64_t offset, Callback done) = 0;
+
+	/**
+	 * As submitRead(), but completes a future with the error instead.
+	 */
+  std::future<int> submitRead(FileIo& io, void* buf, const std::size_t len,
+                              const std::uint64_t offset);
+
+	/**
+	 * As submitWrite(), but completes a future with the error instead.
+	 */
+  std::future<int> submitWrite(FileIo& io, const void* buf, const std::size_t len,
+                               const std::uint64_t offset);
+
+	/**
+	 * Returns the maximum number of requests in flight.
+	 */
+  std::uint32_t queueDepth() const { return queueDepth_; }
+
+	/**
+	 * Returns "io_uring" or "threads".
+	 */
+  virtual const char* name() const = 0;
+
+ protected:
+  explicit IoEngine(const std::uint32_t queueDepth) : queueDepth_(queueDepth) {}
+
+  const std::uint32_t queueDepth_;
+
+ private:
+  IoEngine(const IoEngine&);
+  IoEngine& operator=(const IoEngine&);
+};
+
+/**
+ * @brief IoEngine running each request synchronously on one of a pool of
+ *        threads, one thread per request in flight.
+ *
+ * Works with every FileIo and every kernel.
+ */
+class ThreadPoolIoEngine : public IoEngine
+{
+ public:
+	/**
+	 * Largest number of threads the pool starts
+	 */
+  static const std::uint32_t MAX_THREADS = 64;
+
+  explicit ThreadPoolIoEngine(const std::uint32_t queueDepth);
+  ~ThreadPoolIoEngine();
+
+  void submitRead(FileIo& io, void* buf, const std::size_t len,
+                  const std::uint64_t offset, Callback done);
+  void submitWrite(FileIo& io, const void* buf, const std::size_t len,
+                   const std::uint64_t offset, Callback done);
+  const char* name() const { return "threads"; }
+
+  using IoEngine::submitRead;
+  using IoEngine::submitWrite;
+
+ private:
+  struct Request
+  {
+    bool write;
+    FileIo* io;
+    char* buf;
+    std::size_t len;
+    std::uint64_t offset;
+    Callback done;
+  };
+
+  void submit(Request& request);
+
+	/**
+	 * Body of the worker threads
+	 */
+  void run();
+
+	/**
+	 * Protects the members below
+	 */
+  std::mutex latch;
+
+	/**
+	 * Signalled when a request is queued or the workers must stop
+	 */
+  std::condition_variable cond;
+
+  std::deque<Request> queue;
+
+  bool stop;
+
+  std::vector<std::thread> workers;
+};
+
+}
@@ -0,0 +1,111 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+
+namespace badgerdb {
+
+/**
+ * @brief Small reader-writer spin latch used to protect the contents of a
+ * buffer frame.
+ *
+ * Any number of threads may hold the latch in shared mode at the same time;
+ * exclusive mode excludes everybody else.  A waiting writer blocks new readers
+ * so that a steady stream of readers cannot starve it.  Latches are held for
+ * the duration of a page access only, so waiters spin and then yield instead
+ * of sleeping on a kernel object.
+ */
+class RWLatch {
+ public:
+  /**
+   * Constructs an unlatched latch.
+   */
+  RWLatch() : word(0) {}
+
+  /**
+   * Acquires the latch in shared mode.
+   */
+  void lockShared()
+  {
+    for (std::uint32_t spins = 0; ; spins++)
+    {
+      std::uint32_t old = word.load(std::memory_order_relaxed);
+      if ((old & (WRITER | WRITER_WAITING)) == 0 &&
+          word.compare_exchange_weak(old, old + 1, std::memory_order_acquire))
+        return;
+      backoff(spins);
+    }
+  }
+
+  /**
+   * Releases a shared hold on the latch.
+   */
+  void unlockShared()
+  {
+    word.fetch_sub(1, std::memory_order_release);
+  }
+
+  /**
+   * Acquires the latch in exclusive mode.
+   */
+  void lockExclusive()
+  {
+    for (std::uint32_t spins = 0; ; spins++)
+    {
+      std::uint32_t old = word.load(std::memory_order_relaxed);
+      if ((old & ~WRITER_WAITING) == 0)
+      {
+        if (word.compare_exchange_weak(old, WRITER, std::memory_order_acquire))
+          return;
+      }
+      else if ((old & WRITER_WAITING) == 0)
+      {
+        word.fetch_or(WRITER_WAITING, std::memory_order_relaxed);
+      }
+      backoff(spins);
+    }
+  }
+
+  /**
+   * Releases an exclusive hold on the latch.
+   */
+  void unlockExclusive()
+  {
+    word.fetch_and(~WRITER, std::memory_order_release);
+  }
+
+ private:
+  /**
+   * Set while a thread holds the latch exclusively.
+   */
+  static const std::uint32_t WRITER = 1u << 31;
+
+  /**
+   * Set while a thread is waiting for exclusive mode; keeps new readers out.
+   */
+  static const std::uint32_t WRITER_WAITING = 1u << 30;
+
+  /**
+   * Spins briefly, then starts giving the processor away.
+   */
+  static void backoff(const std::uint32_t spins)
+  {
+    if (spins >= 64)
+      std::this_thread::yield();
+  }
+
+  /**
+   * Reader count in the low bits plus the WRITER / WRITER_WAITING flags.
+   */
+  std::atomic<std::uint32_t> word;
+};
+
+}
@@ -6,6 +6,9 @@
  */
 
 #include <vector>
+#include <thread>
+#include <fstream>
+#include <cstdlib>
 #include "btree.h"
 #include "page.h"
 #include "filescan.h"
@@ -19,6 +22,8 @@
 #include "exceptions/bad_opcodes_exception.h"
 #include "exceptions/scan_not_initialized_exception.h"
 #include "exceptions/end_of_file_exception.h"
+#include "exceptions/page_not_pinned_exception.h"
+#include "exceptions/page_checksum_exception.h"
 
 #include "exceptions/tree_empty_exception.h"
 
@@ -98,6 +103,11 @@ void test7();
 
 void errorTests();
 void deleteRelation();
+void concurrentPinTests();
+void ringTests();
+void pageGuardTests();
+void freeSpaceTests();
+void checksumTests();
 
 int main(int argc, char **argv)
 {
@@ -180,6 +190,12 @@ int main(int argc, char **argv)
 
 	File::remove(relationName);
 
+	concurrentPinTests();
+	ringTests();
+	pageGuardTests();
+	freeSpaceTests();
+	checksumTests();
+
 	test1();
 	test2();
 	test3();
@@ -1300,6 +1316,332 @@ void deleteRelation()
 	}
 }
 
+// -----------------------------------------------------------------------------
+// concurrentPinTests
+// -----------------------------------------------------------------------------
+
+void concurrentPinTests()
+{
+	std::cout << "Concurrent pin tests" << std::endl;
+	std::cout << "--------------------" << std::endl;
+	const std::string pinFileName = relationName + ".pins";
+	const int numPages = 64;
+	const int numThreads = 4;
+	const int rounds = 1000;
+
+	try {
+		File::remove(pinFileName);
+	} catch(FileNotFoundException e) {
+	}
+
+	{
+		PageFile pinFile = PageFile::create(pinFileName);
+		for (int i = 0; i < numPages; i++)
+		{
+			PageId pageNo;
+			Page page = pinFile.allocatePage(pageNo);
+			page.insertRecord("0");
+			pinFile.writePage(pageNo, page);
+		}
+
+		// fewer frames than pages, so that threads evict each other's pages
+		BufMgr pool(16);
+		int wrongPages[numThreads] = {0};
+		std::vector<std::thread> threads;
+		for (int t = 0; t < numThreads; t++)
+		{
+			threads.push_back(std::thread([&pool, &pinFile, &wrongPages, t]() {
+				unsigned int seed = t;
+				for (int i = 0; i < rounds; i++)
+				{
+					// any page, read only
+					Page* page;
+					PageId pageNo = 1 + rand_r(&seed) % numPages;
+					pool.readPage(&pinFile, pageNo, page);
+					if (page->page_number() != pageNo)
+						wrongPages[t]++;
+					pool.unPinPage(&pinFile, pageNo, false);
+
+					// a page of this thread's own, counted up
+					pageNo = 1 + (rand_r(&seed) % (numPages / numThreads)) * numThreads + t;
+					pool.readPage(&pinFile, pageNo, page);
+					const RecordId rid = {pageNo, 1};
+					page->updateRecord(rid, std::to_string(std::stoi(page->getRecord(rid)) + 1));
+					pool.unPinPage(&pinFile, pageNo, true);
+				}
+			}));
+		}
+		for (int t = 0; t < numThreads; t++)
+			threads[t].join();
+
+		// throws if any page was left pinned
+		pool.flushFile(&pinFile);
+
+		int wrong = 0;
+		int count = 0;
+		for (int t = 0; t < numThreads; t++)
+			wrong += wrongPages[t];
+		for (FileIterator iter = pinFile.begin(); iter != pinFile.end(); ++iter)
+		{
+			Page page = *iter;
+			const RecordId rid = {page.page_number(), 1};
+			count += std::stoi(page.getRecord(rid));
+		}
+		checkPassFail(wrong, 0)
+		checkPassFail(count, numThreads * rounds)
+	}
+
+	File::remove(pinFileName);
+}
+
+// -----------------------------------------------------------------------------
+// ringTests
+// -----------------------------------------------------------------------------
+
+void ringTests()
+{
+	std::cout << "Ring buffer tests" << std::endl;
+	std::cout << "-----------------" << std::endl;
+	const std::string ringFileName = relationName + ".ring";
+	const PageId hotPages = 16;
+	const PageId numPages = 400;
+	const std::uint32_t ringSize = 8;
+
+	try {
+		File::remove(ringFileName);
+	} catch(FileNotFoundException e) {
+	}
+
+	{
+		PageFile ringFile = PageFile::create(ringFileName);
+		for (PageId i = 0; i < numPages; i++)
+		{
+			PageId pageNo;
+			ringFile.allocatePage(pageNo);
+		}
+
+		BufMgr pool(64);
+		Page* page;
+		for (PageId pageNo = 1; pageNo <= hotPages; pageNo++)
+		{
+			pool.readPage(&ringFile, pageNo, page);
+			pool.unPinPage(&ringFile, pageNo, false);
+		}
+
+		// a scan of six times the pool, through a ring of eight frames
+		BufferAccessStrategy ring(ringSize);
+		for (PageId pageNo = hotPages + 1; pageNo <= numPages; pageNo++)
+		{
+			pool.readPage(&ringFile, pageNo, page, &ring);
+			pool.unPinPage(&ringFile, pageNo, false);
+		}
+
+		// the hot pages were left alone
+		pool.clearBufStats();
+		for (PageId pageNo = 1; pageNo <= hotPages; pageNo++)
+		{
+			pool.readPage(&ringFile, pageNo, page);
+			pool.unPinPage(&ringFile, pageNo, false);
+		}
+		checkPassFail(pool.getBufStats().hits.load(), hotPages)
+
+		// and the scan kept to the frames of its ring: going back over its last
+		// pages, newest first, finds only as many as the ring holds
+		pool.clearBufStats();
+		for (PageId pageNo = numPages; pageNo > numPages - 2 * ringSize; pageNo--)
+		{
+			pool.readPage(&ringFile, pageNo, page, &ring);
+			pool.unPinPage(&ringFile, pageNo, false);
+		}
+		checkPassFail(pool.getBufStats().hits.load(), ringSize)
+		pool.flushFile(&ringFile);
+	}
+
+	File::remove(ringFileName);
+}
+
+// -----------------------------------------------------------------------------
+// pageGuardTests
+// -----------------------------------------------------------------------------
+
+void pageGuardTests()
+{
+	std::cout << "Page guard tests" << std::endl;
+	std::cout << "----------------" << std::endl;
+	const std::string guardFileName = relationName + ".guard";
+
+	try {
+		File::remove(guardFileName);
+	} catch(FileNotFoundException e) {
+	}
+
+	{
+		PageFile guardFile = PageFile::create(guardFileName);
+		for (int i = 0; i < 2; i++)
+		{
+			PageId pageNo;
+			Page page = guardFile.allocatePage(pageNo);
+			page.insertRecord("old");
+			guardFile.writePage(pageNo, page);
+		}
+
+		BufMgr pool(8);
+		const RecordId rid = {1, 1};
+		PageId newPageNo;
+		{
+			PageGuard guard = pool.fetchPage(&guardFile, 1);
+			checkPassFail(guard.getPageNo(), 1)
+
+			// moving hands the pin over and leaves the source empty
+			PageGuard moved(std::move(guard));
+			checkPassFail(guard.empty(), true)
+			checkPassFail(moved->page_number(), 1)
+			moved->updateRecord(rid, "new");
+			moved.markDirty();
+
+			// assigning over a guard unpins the page it held
+			PageGuard other = pool.fetchPage(&guardFile, 2);
+			other = std::move(moved);
+			checkPassFail(other.getPageNo(), 1)
+			bool unpinned = false;
+			try
+			{
+				pool.unPinPage(&guardFile, 2, false);
+			}
+			catch(PageNotPinnedException e)
+			{
+				unpinned = true;
+			}
+			checkPassFail(unpinned, true)
+
+			other.release();
+			checkPassFail(other.empty(), true)
+
+			PageGuard fresh = pool.newPage(&guardFile);
+			newPageNo = fresh.getPageNo();
+			fresh->insertRecord("fresh");
+			fresh.markDirty();
+		}
+
+		// throws if a guard left its page pinned
+		pool.flushFile(&guardFile);
+		checkPassFail(guardFile.readPage(1).getRecord(rid), std::string("new"))
+		const RecordId freshRid = {newPageNo, 1};
+		checkPassFail(guardFile.readPage(newPageNo).getRecord(freshRid), std::string("fresh"))
+	}
+
+	File::remove(guardFileName);
+}
+
+// -----------------------------------------------------------------------------
+// freeSpaceTests
+// -----------------------------------------------------------------------------
+
+void freeSpaceTests()
+{
+	std::cout << "Free space tests" << std::endl;
+	std::cout << "----------------" << std::endl;
+	const std::string spaceFileName = relationName + ".space";
+	const int numRecords = 400;
+	const std::string data(500, 'x');
+
+	try {
+		File::remove(spaceFileName);
+	} catch(FileNotFoundException e) {
+	}
+
+	{
+		PageFile spaceFile = PageFile::create(spaceFileName);
+		BufMgr pool(32);
+		std::vector<RecordId> rids;
+		for (int i = 0; i < numRecords; i++)
+			rids.push_back(spaceFile.insertRecord(&pool, data));
+		const PageId numPages = spaceFile.getNumPages();
+
+		// empty the first half of the pages
+		int deleted = 0;
+		for (int i = 0; i < numRecords; i++)
+		{
+			if (rids[i].page_number <= numPages / 2)
+			{
+				spaceFile.deleteRecord(&pool, rids[i]);
+				deleted++;
+			}
+		}
+
+		// as many records again fit in the space freed, without a new page
+		int reused = 0;
+		for (int i = 0; i < deleted; i++)
+		{
+			if (spaceFile.insertRecord(&pool, data).page_number <= numPages / 2)
+				reused++;
+		}
+		checkPassFail(reused, deleted)
+		checkPassFail(spaceFile.getNumPages(), numPages)
+		pool.flushFile(&spaceFile);
+	}
+
+	File::remove(spaceFileName);
+}
+
+// -----------------------------------------------------------------------------
+// checksumTests
+// -----------------------------------------------------------------------------
+
+void checksumTests()
+{
+	std::cout << "Checksum tests" << std::endl;
+	std::cout << "--------------" << std::endl;
+	const std::string sumFileName = relationName + ".sums";
+	const PageId badPageNo = 4;
+
+	try {
+		File::remove(sumFileName);
+	} catch(FileNotFoundException e) {
+	}
+
+	File::setChecksums(true);
+	{
+		PageFile sumFile = PageFile::create(sumFileName);
+		for (int i = 0; i < 10; i++)
+		{
+			PageId pageNo;
+			Page page = sumFile.allocatePage(pageNo);
+			page.insertRecord("checked");
+			sumFile.writePage(pageNo, page);
+		}
+		checkPassFail(sumFile.verify().size(), 0)
+	}
+	File::setChecksums(false);
+
+	// flip a byte of one page behind the file's back
+	{
+		std::fstream raw(sumFileName.c_str(), std::ios::in | std::ios::out | std::ios::binary);
+		raw.seekp(badPageNo * Page::SIZE + Page::SIZE / 2);
+		raw.put('!');
+	}
+
+	{
+		PageFile sumFile = PageFile::open(sumFileName);
+		const std::vector<PageId> failed = sumFile.verify(2);
+		checkPassFail(failed.size(), 1)
+		checkPassFail(failed[0], badPageNo)
+
+		bool caught = false;
+		try
+		{
+			sumFile.readPage(badPageNo);
+		}
+		catch(PageChecksumException e)
+		{
+			caught = true;
+		}
+		checkPassFail(caught, true)
+	}
+
+	File::remove(sumFileName);
+}
+
 
 
 
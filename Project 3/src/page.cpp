@@ -185,6 +185,12 @@ SlotId Page::getAvailableSlot() {
     ++header_.num_slots;
     ++header_.num_free_slots;
     header_.free_space_lower_bound = sizeof(PageSlot) * header_.num_slots;
+    // The slot lies in what was free space, which may still hold bytes of
+    // records moved by deleteRecord().
+    PageSlot* slot = getSlot(slot_number);
+    slot->used = false;
+    slot->item_offset = 0;
+    slot->item_length = 0;
   }
   assert(slot_number != INVALID_SLOT);
   return static_cast<SlotId>(slot_number);
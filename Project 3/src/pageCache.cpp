@@ -0,0 +1,340 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include <algorithm>
+#include <cstring>
+#include "pageCache.h"
+#include "bufHashTbl.h"
+#include "page.h"
+
+namespace badgerdb {
+
+const std::size_t CompressedPageCache::ENTRY_OVERHEAD;
+
+namespace {
+
+/**
+ * Shortest match the codec encodes
+ */
+const std::size_t MIN_MATCH = 4;
+
+/**
+ * log2 of the number of entries of the match finder's hash table
+ */
+const std::uint32_t HASH_BITS = 12;
+
+/**
+ * First byte of a compressed page: how the page was filtered before the LZ
+ * stage
+ */
+const char FILTER_NONE = 0;
+const char FILTER_DELTA32 = 1;
+
+inline std::uint32_t read32(const std::uint8_t* p)
+{
+  std::uint32_t v;
+  std::memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+inline std::uint64_t read64(const std::uint8_t* p)
+{
+  std::uint64_t v;
+  std::memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+/**
+ * Writes the part of a length beyond the 15 its token nibble holds.
+ */
+void putLength(std::string& out, std::size_t len)
+{
+  while (len >= 255)
+  {
+    out.push_back((char)255);
+    len -= 255;
+  }
+  out.push_back((char)len);
+}
+
+/**
+ * Reads a length written by putLength() and adds it to 'len'.
+ */
+bool getLength(const std::uint8_t*& in, const std::uint8_t* end, std::size_t& len)
+{
+  std::uint8_t b;
+  do
+  {
+    if (in == end)
+      return false;
+    b = *in++;
+    len += b;
+  } while (b == 255);
+  return true;
+}
+
+/**
+ * Appends one sequence: a token holding both lengths, the literals, and
+ * unless this is the last sequence the match offset.
+ */
+void emit(std::string& out, const std::uint8_t* literals, const std::size_t litLen,
+          const std::size_t offset, const std::size_t matchLen)
+{
+  std::size_t ml = matchLen ? matchLen - MIN_MATCH : 0;
+  out.push_back((char)((std::min<std::size_t>(litLen, 15) << 4) | std::min<std::size_t>(ml, 15)));
+  if (litLen >= 15)
+    putLength(out, litLen - 15);
+  out.append(reinterpret_cast<const char*>(literals), litLen);
+  if (matchLen == 0)
+    return;
+  out.push_back((char)(offset & 0xFF));
+  out.push_back((char)(offset >> 8));
+  if (ml >= 15)
+    putLength(out, ml - 15);
+}
+
+/**
+ * Greedy LZ77 with a single entry hash table per 4 byte sequence.
+ */
+void lzEncode(const std::uint8_t* src, const std::size_t n, std::string& out)
+{
+  std::int32_t table[1 << HASH_BITS];
+  std::fill(table, table + (1 << HASH_BITS), -1);
+
+  std::size_t pos = 0, anchor = 0;
+  while (pos + MIN_MATCH <= n)
+  {
+    std::uint32_t seq = read32(src + pos);
+    std::uint32_t h = (seq * 2654435761u) >> (32 - HASH_BITS);
+    std::int32_t candidate = table[h];
+    table[h] = (std::int32_t)pos;
+    if (candidate < 0 || pos - candidate > 0xFFFF || read32(src + candidate) != seq)
+    {
+      pos++;
+      continue;
+    }
+
+    // a word at a time: pages are mostly runs of zeros, so matches are long
+    std::size_t len = MIN_MATCH;
+    while (pos + len + sizeof(std::uint64_t) <= n &&
+           read64(src + candidate + len) == read64(src + pos + len))
+      len += sizeof(std::uint64_t);
+    while (pos + len < n && src[candidate + len] == src[pos + len])
+      len++;
+    emit(out, src + anchor, pos - anchor, pos - candidate, len);
+    pos += len;
+    anchor = pos;
+  }
+  emit(out, src + anchor, n - anchor, 0, 0);
+}
+
+bool lzDecode(const std::uint8_t* in, const std::uint8_t* end, std::uint8_t* dst, const std::size_t n)
+{
+  std::size_t op = 0;
+  while (in < end)
+  {
+    std::uint8_t token = *in++;
+    std::size_t litLen = token >> 4;
+    if (litLen == 15 && !getLength(in, end, litLen))
+      return false;
+    if (litLen > (std::size_t)(end - in) || litLen > n - op)
+      return false;
+    std::memcpy(dst + op, in, litLen);
+    in += litLen;
+    op += litLen;
+    if (in == end)
+      break;
+
+    if (end - in < 2)
+      return false;
+    std::size_t offset = in[0] | ((std::size_t)in[1] << 8);
+    in += 2;
+    std::size_t matchLen = token & 15;
+    if (matchLen == 15 && !getLength(in, end, matchLen))
+      return false;
+    matchLen += MIN_MATCH;
+    if (offset == 0 || offset > op || matchLen > n - op)
+      return false;
+    // the match may overlap what it produces, so copy whole periods of
+    // 'offset' bytes from its start, each copy doubling what is available
+    const std::size_t from = op - offset;
+    std::size_t copied = 0;
+    while (copied < matchLen)
+    {
+      const std::size_t chunk = std::min(matchLen - copied, offset + copied);
+      std::memcpy(dst + op + copied, dst + from, chunk);
+      copied += chunk;
+    }
+    op += matchLen;
+  }
+  return op == n;
+}
+
+}
+
+//----------------------------------------
+// Codec
+//----------------------------------------
+
+bool CompressedPageCache::compress(const Page& page, std::string& out)
+{
+  const std::uint8_t* src = reinterpret_cast<const std::uint8_t*>(&page);
+  const std::size_t n = sizeof(Page);
+  const std::size_t words = n / sizeof(std::uint32_t);
+
+  out.clear();
+  out.push_back(FILTER_NONE);
+  lzEncode(src, n, out);
+
+  // sorted keys and record ids differ little from one word to the next
+  std::uint8_t delta[sizeof(Page)];
+  std::uint32_t prev = 0;
+  for (std::size_t i = 0; i < words; i++)
+  {
+    std::uint32_t w = read32(src + i * sizeof(w));
+    std::uint32_t d = w - prev;
+    std::memcpy(delta + i * sizeof(d), &d, sizeof(d));
+    prev = w;
+  }
+  std::memcpy(delta + words * sizeof(std::uint32_t), src + words * sizeof(std::uint32_t),
+              n - words * sizeof(std::uint32_t));
+
+  std::string filtered;
+  filtered.push_back(FILTER_DELTA32);
+  lzEncode(delta, n, filtered);
+  if (filtered.size() < out.size())
+    out.swap(filtered);
+
+  return out.size() <= n - n / 8;
+}
+
+bool CompressedPageCache::decompress(const std::string& in, Page& page)
+{
+  if (in.empty())
+    return false;
+
+  std::uint8_t* dst = reinterpret_cast<std::uint8_t*>(&page);
+  const std::size_t n = sizeof(Page);
+  const std::uint8_t* begin = reinterpret_cast<const std::uint8_t*>(in.data());
+  if (!lzDecode(begin + 1, begin + in.size(), dst, n))
+    return false;
+
+  if (in[0] == FILTER_DELTA32)
+  {
+    std::uint32_t prev = 0;
+    for (std::size_t i = 0; i < n / sizeof(std::uint32_t); i++)
+    {
+      prev += read32(dst + i * sizeof(prev));
+      std::memcpy(dst + i * sizeof(prev), &prev, sizeof(prev));
+    }
+  }
+  else if (in[0] != FILTER_NONE)
+    return false;
+  return true;
+}
+
+//----------------------------------------
+// CompressedPageCache
+//----------------------------------------
+
+std::size_t CompressedPageCache::KeyHash::operator()(const Key& key) const
+{
+  return (std::size_t)hashPage(key.first, key.second);
+}
+
+CompressedPageCache::CompressedPageCache()
+  : capacity_(0), used(0)
+{
+}
+
+void CompressedPageCache::setCapacity(const std::size_t bytes)
+{
+  std::lock_guard<std::mutex> guard(latch);
+  capacity_ = bytes;
+  trim();
+}
+
+std::size_t CompressedPageCache::bytesUsed()
+{
+  std::lock_guard<std::mutex> guard(latch);
+  return used;
+}
+
+std::size_t CompressedPageCache::pagesHeld()
+{
+  std::lock_guard<std::mutex> guard(latch);
+  return entries.size();
+}
+
+void CompressedPageCache::drop(EntryMap::iterator it)
+{
+  used -= it->second.data.size() + ENTRY_OVERHEAD;
+  order.erase(it->second.position);
+  entries.erase(it);
+}
+
+void CompressedPageCache::trim()
+{
+  while (used > capacity_ && !order.empty())
+    drop(entries.find(order.front()));
+}
+
+void CompressedPageCache::insert(const File* file, const PageId pageNo, std::string& data)
+{
+  std::lock_guard<std::mutex> guard(latch);
+  Key key(file, pageNo);
+  EntryMap::iterator it = entries.find(key);
+  if (it != entries.end())
+    drop(it);
+  if (data.size() + ENTRY_OVERHEAD > capacity_)
+    return;
+
+  Entry& entry = entries[key];
+  entry.data.swap(data);
+  entry.position = order.insert(order.end(), key);
+  used += entry.data.size() + ENTRY_OVERHEAD;
+  trim();
+}
+
+bool CompressedPageCache::take(const File* file, const PageId pageNo, Page& page)
+{
+  std::string data;
+  {
+    std::lock_guard<std::mutex> guard(latch);
+    EntryMap::iterator it = entries.find(Key(file, pageNo));
+    if (it == entries.end())
+      return false;
+    data.swap(it->second.data);
+    used -= data.size() + ENTRY_OVERHEAD;
+    order.erase(it->second.position);
+    entries.erase(it);
+  }
+  return decompress(data, page);
+}
+
+void CompressedPageCache::erase(const File* file, const PageId pageNo)
+{
+  std::lock_guard<std::mutex> guard(latch);
+  EntryMap::iterator it = entries.find(Key(file, pageNo));
+  if (it != entries.end())
+    drop(it);
+}
+
+void CompressedPageCache::eraseFile(const File* file)
+{
+  std::lock_guard<std::mutex> guard(latch);
+  for (EntryMap::iterator it = entries.begin(); it != entries.end(); )
+  {
+    EntryMap::iterator next = it;
+    ++next;
+    if (it->first.first == file)
+      drop(it);
+    it = next;
+  }
+}
+
+}
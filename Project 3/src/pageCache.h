@@ -0,0 +1,173 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include "types.h"
+
+namespace badgerdb {
+
+class File;
+class Page;
+
+/**
+ * @brief A second tier of the buffer pool holding evicted pages compressed.
+ *
+ * Pages the buffer manager evicts are compressed and kept here, up to a
+ * budget of bytes, and a page that misses the pool is looked for here before
+ * it is read from disk.  Only pages whose on-disk copy is current are stored,
+ * and a page is taken out when it is read back into the pool, so an entry is
+ * never older than the file.  The least recently stored entries are dropped
+ * when the budget is exceeded.
+ *
+ * Pages are compressed with a small LZ77 codec in the style of LZ4.  The page
+ * is also tried as differences of consecutive 32 bit words, which turns the
+ * sorted key and record id arrays of B+tree nodes into runs of small numbers;
+ * whichever comes out smaller is kept.  Pages that do not shrink by at least
+ * an eighth are not stored.
+ *
+ * Threadsafe; compression and decompression run outside the latch.
+ */
+class CompressedPageCache
+{
+ public:
+	/**
+	 * Bytes charged per entry on top of the compressed page, for the index
+	 */
+  static const std::size_t ENTRY_OVERHEAD = 64;
+
+  CompressedPageCache();
+
+	/**
+	 * Sets the budget in bytes, dropping entries if it shrinks; 0 disables
+	 * the cache.
+	 */
+  void setCapacity(const std::size_t bytes);
+
+	/**
+	 * Returns the budget in bytes.
+	 */
+  std::size_t capacity() const { return capacity_; }
+
+	/**
+	 * Returns true if the cache stores pages at all.
+	 */
+  bool enabled() const { return capacity_ != 0; }
+
+	/**
+	 * Returns the bytes charged for the entries held now.
+	 */
+  std::size_t bytesUsed();
+
+	/**
+	 * Returns the number of pages held now.
+	 */
+  std::size_t pagesHeld();
+
+	/**
+	 * Compresses a page.
+	 *
+	 * @param page		Page to compress
+	 * @param out		Replaced by the compressed page
+	 * @return  False if the page does not compress well enough to be worth keeping.
+	 */
+  static bool compress(const Page& page, std::string& out);
+
+	/**
+	 * Restores a page compressed with compress().
+	 *
+	 * @return  False if 'in' is not a well formed compressed page.
+	 */
+  static bool decompress(const std::string& in, Page& page);
+
+	/**
+	 * Stores the compressed copy of (file, pageNo), replacing any older one.
+	 * The caller's string is emptied.
+	 */
+  void insert(const File* file, const PageId pageNo, std::string& data);
+
+	/**
+	 * Removes (file, pageNo) from the cache and restores it into 'page'.
+	 *
+	 * @return  False if the page is not in the cache.
+	 */
+  bool take(const File* file, const PageId pageNo, Page& page);
+
+	/**
+	 * Drops (file, pageNo) if it is in the cache.
+	 */
+  void erase(const File* file, const PageId pageNo);
+
+	/**
+	 * Drops every page of 'file'.
+	 */
+  void eraseFile(const File* file);
+
+ private:
+  CompressedPageCache(const CompressedPageCache&);
+  CompressedPageCache& operator=(const CompressedPageCache&);
+
+  typedef std::pair<const File*, PageId> Key;
+
+  struct KeyHash
+  {
+    std::size_t operator()(const Key& key) const;
+  };
+
+  struct Entry
+  {
+    std::string data;
+    std::list<Key>::iterator position;
+  };
+
+  typedef std::unordered_map<Key, Entry, KeyHash> EntryMap;
+
+	/**
+	 * Drops 'it'.  Called with 'latch' held.
+	 */
+  void drop(EntryMap::iterator it);
+
+	/**
+	 * Drops the oldest entries until the budget is kept.  Called with 'latch'
+	 * held.
+	 */
+  void trim();
+
+	/**
+	 * Protects all members below except 'capacity_'
+	 */
+  std::mutex latch;
+
+	/**
+	 * Budget in bytes
+	 */
+  std::atomic<std::size_t> capacity_;
+
+	/**
+	 * Bytes charged for the entries
+	 */
+  std::size_t used;
+
+	/**
+	 * Entries by page
+	 */
+  EntryMap entries;
+
+	/**
+	 * Keys of 'entries', oldest first
+	 */
+  std::list<Key> order;
+};
+
+}
@@ -0,0 +1,178 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "page_checksums.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <sys/stat.h>
+
+#include "crc32c.h"
+#include "exceptions/io_error_exception.h"
+#include "file_io.h"
+#include "page.h"
+
+namespace badgerdb {
+
+static_assert(sizeof(PageHeader) + Page::DATA_SIZE == Page::SIZE,
+              "A page image is its header followed by its data.");
+
+std::uint32_t PageChecksums::compute(const void* image)
+{
+  const std::uint32_t crc = crc32c(image, Page::SIZE);
+  // 0 marks a page with no checksum
+  return crc != 0 ? crc : 1;
+}
+
+std::uint32_t PageChecksums::compute(const PageHeader& header, const void* data)
+{
+  const std::uint32_t crc = crc32c(data, Page::DATA_SIZE, crc32c(&header, sizeof(PageHeader)));
+  return crc != 0 ? crc : 1;
+}
+
+PageChecksums::PageChecksums(const std::string& filename, const bool create_new)
+  : unflushed_(0)
+{
+  const std::string name = fileName(filename);
+  struct stat st;
+  const bool is_new = create_new || ::stat(name.c_str(), &st) != 0;
+  // written a slot at a time, so never with O_DIRECT
+  io_ = FileIo::open(name, is_new, IO_POSIX);
+  if (is_new)
+  {
+    const Slot layout = {LAYOUT_MAGIC, LAYOUT_VERSION};
+    slots_.push_back(layout);
+    io_->write(&slots_[0], sizeof(Slot), 0);
+    return;
+  }
+
+  Slot layout = {0, 0};
+  if ((std::uint64_t)st.st_size >= sizeof(Slot))
+    io_->read(&layout, sizeof(Slot), 0);
+  if (layout.current != LAYOUT_MAGIC)
+  {
+    convert(name, st.st_size);
+    return;
+  }
+  slots_.resize(st.st_size / sizeof(Slot));
+  io_->read(&slots_[0], slots_.size() * sizeof(Slot), 0);
+}
+
+PageChecksums::~PageChecksums()
+{
+  try
+  {
+    flush();
+  }
+  catch (const IoErrorException&)
+  {
+    // a destructor cannot report it; File::sync() first to see the error
+  }
+}
+
+void PageChecksums::convert(const std::string& name, const std::uint64_t size)
+{
+  std::vector<std::uint32_t> checksums(size / sizeof(std::uint32_t));
+  if (!checksums.empty())
+    io_->read(&checksums[0], checksums.size() * sizeof(std::uint32_t), 0);
+  slots_.assign(std::max<std::size_t>(checksums.size(), 1), Slot());
+  for (std::size_t i = 1; i < checksums.size(); i++)
+    slots_[i].current = checksums[i];
+  slots_[0].current = LAYOUT_MAGIC;
+  slots_[0].previous = LAYOUT_VERSION;
+
+  // written in full beside the old file and renamed over it, so that a crash
+  // leaves one or the other
+  const std::string converted = name + ".new";
+  std::shared_ptr<FileIo> io = FileIo::open(converted, true, IO_POSIX);
+  io->write(&slots_[0], slots_.size() * sizeof(Slot), 0);
+  io->sync();
+  if (std::rename(converted.c_str(), name.c_str()) != 0)
+    throw IoErrorException(name, "rename", errno);
+  io_ = io;
+}
+
+void PageChecksums::record(const PageId page_number, const std::uint32_t checksum)
+{
+  record(page_number, 1, &checksum);
+}
+
+void PageChecksums::record(const PageId first_page_number, const std::uint32_t count,
+                           const std::uint32_t* checksums)
+{
+  if (count == 0)
+    return;
+  std::lock_guard<std::mutex> guard(latch_);
+  if (first_page_number + count > slots_.size())
+    slots_.resize(first_page_number + count, Slot());
+  dirty_blocks_.resize((slots_.size() + SLOTS_PER_BLOCK - 1) / SLOTS_PER_BLOCK, false);
+  for (std::uint32_t i = 0; i < count; i++)
+  {
+    Slot& slot = slots_[first_page_number + i];
+    // the checksum it replaces stays, as the page on disk is still the old one
+    if (slot.current != checksums[i])
+    {
+      slot.previous = slot.current;
+      slot.current = checksums[i];
+      dirty_blocks_[(first_page_number + i) / SLOTS_PER_BLOCK] = true;
+    }
+  }
+  unflushed_ += count;
+  if (unflushed_ >= FLUSH_PAGES)
+    flushLocked();
+}
+
+void PageChecksums::flush()
+{
+  std::lock_guard<std::mutex> guard(latch_);
+  flushLocked();
+}
+
+void PageChecksums::flushLocked()
+{
+  // runs of dirty blocks go out with one write each
+  unflushed_ = 0;
+  for (std::size_t first = 0, last; first < dirty_blocks_.size(); first = last)
+  {
+    last = first + 1;
+    if (!dirty_blocks_[first])
+      continue;
+    while (last < dirty_blocks_.size() && dirty_blocks_[last])
+      last++;
+    const std::size_t begin = first * SLOTS_PER_BLOCK;
+    const std::size_t end = std::min<std::size_t>(last * SLOTS_PER_BLOCK, slots_.size());
+    io_->write(&slots_[begin], (end - begin) * sizeof(Slot), (std::uint64_t)begin * sizeof(Slot));
+    std::fill(dirty_blocks_.begin() + first, dirty_blocks_.begin() + last, false);
+  }
+}
+
+std::uint32_t PageChecksums::recorded(const PageId page_number) const
+{
+  std::lock_guard<std::mutex> guard(latch_);
+  // slot 0 holds the layout
+  if (page_number == 0 || page_number >= slots_.size())
+    return 0;
+  return slots_[page_number].current;
+}
+
+bool PageChecksums::matches(const PageId page_number, const std::uint32_t checksum) const
+{
+  std::lock_guard<std::mutex> guard(latch_);
+  if (page_number == 0 || page_number >= slots_.size())
+    return true;
+  const Slot& slot = slots_[page_number];
+  return slot.current == 0 || checksum == slot.current || checksum == slot.previous;
+}
+
+void PageChecksums::sync()
+{
+  flush();
+  io_->sync();
+}
+
+}
@@ -0,0 +1,191 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "types.h"
+
+namespace badgerdb {
+
+class FileIo;
+struct PageHeader;
+
+/**
+ * @brief CRC32C checksums of the pages of a File, recorded as pages are
+ *        written and checked as they are read.
+ *
+ * The checksums are kept in a file next to the File (see fileName()) rather
+ * than in the pages themselves, which leaves the page format alone and covers
+ * the raw pages of a BlobFile, whose every byte belongs to its user.  Each
+ * page has a slot there with two checksums, the one recorded last and the one
+ * before it, so a page that a crash cut short while it was being rewritten
+ * matches one of the two, and a page that matches either passes its check.
+ *
+ * record() only changes the slots in memory.  They are written to the
+ * checksum file in blocks of SLOTS_PER_BLOCK slots by flush(), which
+ * record() itself calls once FLUSH_PAGES pages have been recorded since the
+ * last flush, and which sync() and the destructor call as well; a writer of
+ * many pages thus pays for one write of the checksum file, not one per page.
+ * File::sync() syncs the checksums before the pages.  After a crash, of the
+ * process or of the system, the pages written since the checksums were last
+ * flushed or synced may fail their check, as they may also be torn.
+ *
+ * The slot of page 0, the file header, holds the layout of the checksum file
+ * instead.  Checksum files of the earlier layout, one checksum of four bytes
+ * per page, are rewritten in this one when opened.  A page with no checksum
+ * recorded, 0, is not checked.
+ *
+ * All members may be called from several threads at once, but not for the
+ * same page.
+ */
+class PageChecksums
+{
+ public:
+	/**
+	 * Returns the name of the file the checksums of the given file are kept in.
+	 */
+  static std::string fileName(const std::string& filename) { return filename + ".crc"; }
+
+	/**
+	 * Returns the checksum of a page image of Page::SIZE bytes, never 0.
+	 */
+  static std::uint32_t compute(const void* image);
+
+	/**
+	 * Returns the checksum of a page image given as its header and its data,
+	 * the same as compute() of the two back to back.
+	 */
+  static std::uint32_t compute(const PageHeader& header, const void* data);
+
+	/**
+	 * Opens the checksums of the given file.
+	 *
+	 * @param filename		Name of the file whose pages are checksummed
+	 * @param create_new	Whether to start with no checksums, truncating any kept so far
+	 * @throws  IoErrorException	If the checksums cannot be read or created
+	 */
+  PageChecksums(const std::string& filename, const bool create_new);
+
+  ~PageChecksums();
+
+	/**
+	 * Records the checksum of a page about to be written.
+	 *
+	 * @throws  IoErrorException	If this record fills a batch, and the batch cannot be written
+	 */
+  void record(const PageId page_number, const std::uint32_t checksum);
+
+	/**
+	 * Records the checksums of pages about to be written, as record() does.
+	 *
+	 * @param first_page_number	Number of the first page
+	 * @param count				Number of pages
+	 * @param checksums			Checksum of each page, in order
+	 * @throws  IoErrorException	If these records fill a batch, and the batch cannot be written
+	 */
+  void record(const PageId first_page_number, const std::uint32_t count,
+              const std::uint32_t* checksums);
+
+	/**
+	 * Returns the checksum recorded last for a page, or 0 if there is none.
+	 */
+  std::uint32_t recorded(const PageId page_number) const;
+
+	/**
+	 * Returns true if a page image with the given checksum passes its check:
+	 * it matches one of the last two checksums recorded for the page, or the
+	 * page has none.
+	 */
+  bool matches(const PageId page_number, const std::uint32_t checksum) const;
+
+	/**
+	 * Writes the slots changed since the last flush to the checksum file.
+	 *
+	 * @throws  IoErrorException	If the checksums cannot be written
+	 */
+  void flush();
+
+	/**
+	 * Flushes the checksums and forces them to the disk.
+	 *
+	 * @throws  IoErrorException	If the checksums cannot be written
+	 */
+  void sync();
+
+ private:
+  PageChecksums(const PageChecksums&);
+  PageChecksums& operator=(const PageChecksums&);
+
+	/**
+	 * Checksums of a page in the checksum file
+	 */
+  struct Slot
+  {
+    std::uint32_t current;
+    std::uint32_t previous;
+  };
+
+	/**
+	 * Contents of slot 0 in a checksum file of this layout
+	 */
+  static const std::uint32_t LAYOUT_MAGIC = 0x43524342;
+  static const std::uint32_t LAYOUT_VERSION = 2;
+
+	/**
+	 * Number of slots in a block of the checksum file, the unit flush() writes
+	 */
+  static const std::uint32_t SLOTS_PER_BLOCK = 4096 / sizeof(Slot);
+
+	/**
+	 * Number of pages recorded after which record() flushes the checksums
+	 */
+  static const std::uint32_t FLUSH_PAGES = 64;
+
+	/**
+	 * Writes the dirty blocks; the caller holds 'latch_'.
+	 */
+  void flushLocked();
+
+	/**
+	 * Rewrites a checksum file of the earlier layout in this one.
+	 *
+	 * @param name	Name of the checksum file
+	 * @param size	Its size in bytes
+	 */
+  void convert(const std::string& name, const std::uint64_t size);
+
+  std::shared_ptr<FileIo> io_;
+
+	/**
+	 * Protects the members below, and orders the writes of a slot
+	 */
+  mutable std::mutex latch_;
+
+	/**
+	 * Slot of every page, indexed by page number, as in the checksum file
+	 * once flushed
+	 */
+  std::vector<Slot> slots_;
+
+	/**
+	 * Whether each block of 'slots_' has changed since the last flush
+	 */
+  std::vector<bool> dirty_blocks_;
+
+	/**
+	 * Number of pages recorded since the last flush
+	 */
+  std::uint32_t unflushed_;
+};
+
+}
@@ -0,0 +1,172 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "pool_memory.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <new>
+#include <string>
+#include <vector>
+#include <sys/mman.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+namespace badgerdb {
+
+const std::size_t PoolMemory::HUGE_PAGE_SIZE;
+const std::size_t PoolMemory::SMALL_PAGE_SIZE;
+
+namespace {
+
+/**
+ * Returns the online NUMA nodes, as listed in sysfs (e.g. "0-1,4").  Empty if
+ * the machine is not NUMA or the list cannot be read.
+ */
+std::vector<int> onlineNodes()
+{
+  std::vector<int> nodes;
+  std::ifstream in("/sys/devices/system/node/online");
+  std::string list;
+  if (!(in >> list))
+    return nodes;
+
+  std::size_t pos = 0;
+  while (pos < list.size())
+  {
+    std::size_t end = list.find(',', pos);
+    if (end == std::string::npos)
+      end = list.size();
+    std::string range = list.substr(pos, end - pos);
+    std::size_t dash = range.find('-');
+    int first = std::atoi(range.c_str());
+    int last = dash == std::string::npos ? first : std::atoi(range.c_str() + dash + 1);
+    for (int n = first; n <= last && n < 64; n++)
+      nodes.push_back(n);
+    pos = end + 1;
+  }
+  return nodes;
+}
+
+/**
+ * Sets the memory policy of [addr, addr+len).  Failure only means the kernel
+ * keeps its default placement, so it is ignored.
+ */
+void bindRange(void* addr, const std::size_t len, const int mode, const unsigned long mask)
+{
+#if defined(__linux__) && defined(SYS_mbind)
+  syscall(SYS_mbind, addr, len, mode, &mask, sizeof(mask) * 8, 0);
+#endif
+}
+
+// from <numaif.h>, which is not installed everywhere
+const int MPOL_PREFERRED_MODE = 1;
+const int MPOL_INTERLEAVE_MODE = 3;
+
+}
+
+PoolMemory::PoolMemory(const std::size_t bytes, const PoolPlacement placement)
+  : base_(NULL), size_(0), mapStart_(NULL), mapSize_(0), hugePages_(false)
+{
+  size_ = (bytes + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+  if (size_ == 0)
+    size_ = HUGE_PAGE_SIZE;
+
+#ifdef MAP_HUGETLB
+  // explicit huge pages, if the administrator reserved enough of them
+  void* p = mmap(NULL, size_, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+  if (p != MAP_FAILED)
+  {
+    base_ = mapStart_ = p;
+    mapSize_ = size_;
+    hugePages_ = true;
+  }
+#endif
+
+  if (!base_)
+  {
+    // over-allocate by one huge page so the block can start on a 2 MiB
+    // boundary, which transparent huge pages need
+    void* p = mmap(NULL, size_ + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p != MAP_FAILED)
+    {
+      mapStart_ = p;
+      mapSize_ = size_ + HUGE_PAGE_SIZE;
+      std::uintptr_t aligned = ((std::uintptr_t)p + HUGE_PAGE_SIZE - 1) & ~(std::uintptr_t)(HUGE_PAGE_SIZE - 1);
+      base_ = (void*)aligned;
+#ifdef MADV_HUGEPAGE
+      madvise(base_, size_, MADV_HUGEPAGE);
+#endif
+    }
+  }
+
+  if (!base_)
+  {
+    // no mmap: take page aligned heap memory
+    if (posix_memalign(&base_, SMALL_PAGE_SIZE, size_) != 0)
+      throw std::bad_alloc();
+    return;
+  }
+
+  place(placement);
+}
+
+PoolMemory::~PoolMemory()
+{
+  if (mapStart_)
+    munmap(mapStart_, mapSize_);
+  else
+    free(base_);
+}
+
+void PoolMemory::discard(void* addr, const std::size_t len)
+{
+  if (!mapStart_)
+    return;
+
+  // explicit huge pages can only be released whole
+  std::uintptr_t pageSize = hugePages_ ? HUGE_PAGE_SIZE : SMALL_PAGE_SIZE;
+  std::uintptr_t start = ((std::uintptr_t)addr + pageSize - 1) & ~(pageSize - 1);
+  std::uintptr_t end = ((std::uintptr_t)addr + len) & ~(pageSize - 1);
+  if (start < end)
+    madvise((void*)start, end - start, MADV_DONTNEED);
+}
+
+void PoolMemory::place(const PoolPlacement placement)
+{
+  if (placement == POOL_LOCAL)
+    return;
+
+  std::vector<int> nodes = onlineNodes();
+  if (nodes.size() < 2)
+    return;
+
+  if (placement == POOL_INTERLEAVE)
+  {
+    unsigned long mask = 0;
+    for (std::size_t i = 0; i < nodes.size(); i++)
+      mask |= 1UL << nodes[i];
+    bindRange(base_, size_, MPOL_INTERLEAVE_MODE, mask);
+    return;
+  }
+
+  // POOL_PARTITION: equal slices, rounded to huge pages, one per node.  The
+  // slices are preferred rather than bound so a full node spills over.
+  std::size_t slice = (size_ / nodes.size() + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+  for (std::size_t i = 0; i < nodes.size() && i * slice < size_; i++)
+  {
+    std::size_t len = std::min(slice, size_ - i * slice);
+    bindRange((char*)base_ + i * slice, len, MPOL_PREFERRED_MODE, 1UL << nodes[i]);
+  }
+}
+
+}
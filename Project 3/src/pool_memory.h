@@ -0,0 +1,118 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace badgerdb {
+
+/**
+ * @brief Where the memory of a buffer pool is placed on a NUMA machine.
+ */
+enum PoolPlacement
+{
+	POOL_LOCAL = 0,				/* Kernel default: first touch, normally the constructing thread's node */
+	POOL_INTERLEAVE = 1,	/* Pages spread round robin over all nodes */
+	POOL_PARTITION = 2		/* One contiguous slice of the pool per node */
+};
+
+/**
+ * @brief A large, aligned block of memory for the frames of a buffer pool.
+ *
+ * The block is mapped anonymously and aligned to 2 MiB.  Explicit huge pages
+ * (MAP_HUGETLB) are tried first, then transparent huge pages are requested
+ * with madvise, and if mmap is not available at all the block comes from the
+ * heap aligned to 4 KiB.  On Linux the block is optionally interleaved or
+ * partitioned over the NUMA nodes with mbind; a kernel without NUMA support
+ * silently gets the default placement.
+ */
+class PoolMemory
+{
+ public:
+	/**
+	 * Alignment of every block, the size of an x86-64 huge page
+	 */
+  static const std::size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+	/**
+	 * Alignment of a block that had to come from the heap
+	 */
+  static const std::size_t SMALL_PAGE_SIZE = 4096;
+
+	/**
+	 * Size of a cache line, the alignment of data sharing the block that is
+	 * scanned densely
+	 */
+  static const std::size_t CACHE_LINE_SIZE = 64;
+
+	/**
+	 * Allocates a block.
+	 *
+	 * @param bytes		Minimum size of the block
+	 * @param placement	NUMA placement of the block
+	 * @throws std::bad_alloc if no memory is available
+	 */
+  PoolMemory(const std::size_t bytes, const PoolPlacement placement);
+
+	/**
+	 * Releases the block.
+	 */
+  ~PoolMemory();
+
+	/**
+	 * Returns the start of the block.
+	 */
+  void* base() const { return base_; }
+
+	/**
+	 * Returns true if the block is backed by explicit huge pages.
+	 */
+  bool hugePages() const { return hugePages_; }
+
+	/**
+	 * Returns the physical memory behind [addr, addr+len), a range of the
+	 * block, to the operating system.  Only the whole pages of the block that
+	 * lie within the range are released, and nothing is released if the block
+	 * is on the heap.  The contents of the range are undefined afterwards.
+	 */
+  void discard(void* addr, const std::size_t len);
+
+ private:
+  PoolMemory(const PoolMemory&);
+  PoolMemory& operator=(const PoolMemory&);
+
+	/**
+	 * Applies the NUMA placement to the block before it is first touched.
+	 */
+  void place(const PoolPlacement placement);
+
+	/**
+	 * Start of the block
+	 */
+  void* base_;
+
+	/**
+	 * Size of the block as mapped
+	 */
+  std::size_t size_;
+
+	/**
+	 * Start and size of the whole mapping, which may extend beyond the block
+	 * to achieve the alignment; mapStart_ is NULL if the block is on the heap
+	 */
+  void* mapStart_;
+  std::size_t mapSize_;
+
+	/**
+	 * True if the block is backed by explicit huge pages
+	 */
+  bool hugePages_;
+};
+
+}
@@ -0,0 +1,527 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include <algorithm>
+#include "buffer.h"
+#include "replacer.h"
+
+namespace badgerdb {
+
+//----------------------------------------
+// ReplacementPolicy
+//----------------------------------------
+
+ReplacementPolicy* ReplacementPolicy::create(const ReplacementPolicyType type,
+                                             const FrameStateTable& stateTable,
+                                             const std::uint32_t numBufs,
+                                             BufStats* stats)
+{
+  switch (type)
+  {
+    case LRUK_REPLACEMENT:
+      return new LRUKPolicy(stateTable, numBufs, stats);
+    case TWOQ_REPLACEMENT:
+      return new TwoQPolicy(stateTable, numBufs, stats);
+    case ARC_REPLACEMENT:
+      return new ARCPolicy(stateTable, numBufs, stats);
+    case CLOCK_REPLACEMENT:
+    default:
+      return new ClockPolicy(stateTable, numBufs, stats);
+  }
+}
+
+bool ReplacementPolicy::tryClaim(const FrameId frame)
+{
+  // lists and a hand that lagged behind a shrink may still name frames
+  // that are leaving the pool
+  if (frame >= numBufs || !BufDesc::tryClaim(stateTable[frame]))
+    return false;
+  stats->framePinned();
+  return true;
+}
+
+//----------------------------------------
+// ClockPolicy
+//----------------------------------------
+
+ClockPolicy::ClockPolicy(const FrameStateTable& stateTable, const std::uint32_t numBufs, BufStats* stats)
+  : ReplacementPolicy(stateTable, numBufs, stats)
+{
+  clockHand = numBufs - 1;
+}
+
+void ClockPolicy::nextVictims(std::vector<FrameId>& frames, const std::uint32_t max)
+{
+  // the frames the hand will reach first, referenced or not: the hand only
+  // clears a reference bit before the frame comes round again, and under
+  // load most frames have it set, so skipping them leaves the writer little
+  // but the frames the foreground evicts right away
+  FrameId hand = clockHand.load();
+  std::uint32_t n = numBufs;
+  for (std::uint32_t i = 1; i <= n && i <= max; i++)
+    frames.push_back((hand + i) % n);
+}
+
+bool ClockPolicy::pickVictim(FrameId& frame)
+{
+  std::uint32_t n = numBufs;
+  for (std::uint32_t numScanned = 0; numScanned < 2*n; numScanned++)	//Need to scn twice
+  {
+    // advance the clock
+    FrameId hand = (clockHand.fetch_add(1) + 1) % n;
+    FrameState& state = stateTable[hand];
+
+    // has been referenced, clear the bit
+    if (state.load() & BufDesc::REFBIT)
+    {
+      state.fetch_and(~BufDesc::REFBIT);
+      continue;
+    }
+
+    // check to see if someone has it pinned; if not, claim it
+    if (tryClaim(hand))
+    {
+      stats->clockSweepLength.record(numScanned + 1);
+      frame = hand;
+      return true;
+    }
+  }
+  stats->clockSweepLength.record(2*n);
+  return false;
+}
+
+//----------------------------------------
+// ListPolicy
+//----------------------------------------
+
+ListPolicy::ListPolicy(const FrameStateTable& stateTable, const std::uint32_t numBufs, BufStats* stats)
+  : ReplacementPolicy(stateTable, numBufs, stats)
+{
+  // hand out low frame numbers first
+  freeFrames.reserve(numBufs);
+  for (std::uint32_t i = numBufs; i > 0; i--)
+    freeFrames.push_back(i - 1);
+}
+
+void ListPolicy::recordFree(const FrameId frame)
+{
+  std::lock_guard<std::mutex> guard(latch);
+  unlink(frame);
+  freeFrames.push_back(frame);
+}
+
+void ListPolicy::resize(const std::uint32_t newNumBufs)
+{
+  std::lock_guard<std::mutex> guard(latch);
+  std::uint32_t oldNumBufs = numBufs;
+  resizeFrames(newNumBufs);
+  if (newNumBufs > oldNumBufs)
+  {
+    for (std::uint32_t i = newNumBufs; i > oldNumBufs; i--)
+      freeFrames.push_back(i - 1);
+  }
+  else
+  {
+    std::vector<FrameId> kept;
+    for (std::uint32_t i = 0; i < freeFrames.size(); i++)
+    {
+      if (freeFrames[i] < newNumBufs)
+        kept.push_back(freeFrames[i]);
+    }
+    freeFrames.swap(kept);
+  }
+  numBufs = newNumBufs;
+}
+
+bool ListPolicy::claimFree(FrameId& frame)
+{
+  while (!freeFrames.empty())
+  {
+    FrameId candidate = freeFrames.back();
+    freeFrames.pop_back();
+    // entries can be stale if a frame was reused before it was reported
+    // free; allocBuf() checks the state of whatever frame it is given
+    if (tryClaim(candidate))
+    {
+      frame = candidate;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool ListPolicy::claimFrom(const std::list<FrameId>& frames, FrameId& frame)
+{
+  for (std::list<FrameId>::const_iterator it = frames.begin(); it != frames.end(); ++it)
+  {
+    if (tryClaim(*it))
+    {
+      frame = *it;
+      return true;
+    }
+  }
+  return false;
+}
+
+void ListPolicy::appendFrom(const std::list<FrameId>& list, std::vector<FrameId>& frames,
+                            const std::uint32_t max)
+{
+  for (std::list<FrameId>::const_iterator it = list.begin();
+       it != list.end() && frames.size() < max; ++it)
+    frames.push_back(*it);
+}
+
+std::uint64_t ListPolicy::ghostKey(const File* file, const PageId pageNo)
+{
+  // the odd collision only costs a misjudged page, never correctness
+  return hashPage(file, pageNo);
+}
+
+//----------------------------------------
+// LRUKPolicy
+//----------------------------------------
+
+LRUKPolicy::LRUKPolicy(const FrameStateTable& stateTable, const std::uint32_t numBufs, BufStats* stats)
+  : ListPolicy(stateTable, numBufs, stats), now(0), history(numBufs), tracked(numBufs, false)
+{
+}
+
+void LRUKPolicy::unlink(const FrameId frame)
+{
+  if (tracked[frame])
+  {
+    order.erase(orderKey(frame));
+    tracked[frame] = false;
+  }
+}
+
+void LRUKPolicy::resizeFrames(const std::uint32_t newNumBufs)
+{
+  if (history.size() < newNumBufs)
+  {
+    history.resize(newNumBufs);
+    tracked.resize(newNumBufs, false);
+  }
+}
+
+void LRUKPolicy::recordHit(const FrameId frame)
+{
+  std::lock_guard<std::mutex> guard(latch);
+  if (!tracked[frame])
+    return;
+  order.erase(orderKey(frame));
+  history[frame].prev = history[frame].last;
+  history[frame].last = ++now;
+  order.insert(orderKey(frame));
+}
+
+void LRUKPolicy::recordLoad(const FrameId frame, const File* file, const PageId pageNo)
+{
+  std::lock_guard<std::mutex> guard(latch);
+  unlink(frame);
+
+  History& h = history[frame];
+  h.prev = 0;
+  h.last = ++now;
+  RetainedMap::iterator it = retained.find(ghostKey(file, pageNo));
+  if (it != retained.end())
+  {
+    // seen before: its last reference becomes the second most recent one
+    h.prev = it->second.first.last;
+    retainedOrder.erase(it->second.second);
+    retained.erase(it);
+  }
+
+  order.insert(orderKey(frame));
+  tracked[frame] = true;
+}
+
+void LRUKPolicy::recordEvict(const FrameId frame, const File* file, const PageId pageNo)
+{
+  std::lock_guard<std::mutex> guard(latch);
+  if (!tracked[frame])
+    return;
+  unlink(frame);
+
+  std::uint64_t key = ghostKey(file, pageNo);
+  RetainedMap::iterator it = retained.find(key);
+  if (it != retained.end())
+    retainedOrder.erase(it->second.second);
+  retained[key] = std::make_pair(history[frame], retainedOrder.insert(retainedOrder.end(), key));
+
+  // keep history for at most as many pages as fit in the pool
+  if (retained.size() > numBufs)
+  {
+    retained.erase(retainedOrder.front());
+    retainedOrder.pop_front();
+  }
+}
+
+void LRUKPolicy::nextVictims(std::vector<FrameId>& frames, const std::uint32_t max)
+{
+  std::lock_guard<std::mutex> guard(latch);
+  std::uint32_t end = frames.size() + max;
+  for (std::set<OrderKey>::iterator it = order.begin(); it != order.end() && frames.size() < end; ++it)
+    frames.push_back(it->second);
+}
+
+bool LRUKPolicy::pickVictim(FrameId& frame)
+{
+  std::lock_guard<std::mutex> guard(latch);
+  if (claimFree(frame))
+    return true;
+
+  for (std::set<OrderKey>::iterator it = order.begin(); it != order.end(); ++it)
+  {
+    if (tryClaim(it->second))
+    {
+      frame = it->second;
+      return true;
+    }
+  }
+  return false;
+}
+
+//----------------------------------------
+// TwoQPolicy
+//----------------------------------------
+
+TwoQPolicy::TwoQPolicy(const FrameStateTable& stateTable, const std::uint32_t numBufs, BufStats* stats)
+  : ListPolicy(stateTable, numBufs, stats),
+    kin(std::max(1u, numBufs / 4)), kout(std::max(1u, numBufs / 2)),
+    where(numBufs, NONE), position(numBufs)
+{
+}
+
+void TwoQPolicy::unlink(const FrameId frame)
+{
+  if (where[frame] == A1IN)
+    a1in.erase(position[frame]);
+  else if (where[frame] == AM)
+    am.erase(position[frame]);
+  where[frame] = NONE;
+}
+
+void TwoQPolicy::resizeFrames(const std::uint32_t newNumBufs)
+{
+  if (where.size() < newNumBufs)
+  {
+    where.resize(newNumBufs, NONE);
+    position.resize(newNumBufs);
+  }
+  kin = std::max(1u, newNumBufs / 4);
+  kout = std::max(1u, newNumBufs / 2);
+  while (a1out.size() > kout)
+  {
+    a1outIndex.erase(a1out.front());
+    a1out.pop_front();
+  }
+}
+
+void TwoQPolicy::recordHit(const FrameId frame)
+{
+  std::lock_guard<std::mutex> guard(latch);
+  // hits in A1in are deliberately ignored: they are likely correlated
+  if (where[frame] == AM)
+    am.splice(am.end(), am, position[frame]);
+}
+
+void TwoQPolicy::recordLoad(const FrameId frame, const File* file, const PageId pageNo)
+{
+  std::lock_guard<std::mutex> guard(latch);
+  unlink(frame);
+
+  std::uint64_t key = ghostKey(file, pageNo);
+  std::unordered_map<std::uint64_t, std::list<std::uint64_t>::iterator>::iterator it = a1outIndex.find(key);
+  if (it != a1outIndex.end())
+  {
+    a1out.erase(it->second);
+    a1outIndex.erase(it);
+    where[frame] = AM;
+    position[frame] = am.insert(am.end(), frame);
+  }
+  else
+  {
+    where[frame] = A1IN;
+    position[frame] = a1in.insert(a1in.end(), frame);
+  }
+}
+
+void TwoQPolicy::recordEvict(const FrameId frame, const File* file, const PageId pageNo)
+{
+  std::lock_guard<std::mutex> guard(latch);
+  bool fromA1in = where[frame] == A1IN;
+  unlink(frame);
+  if (!fromA1in)
+    return;
+
+  std::uint64_t key = ghostKey(file, pageNo);
+  if (a1outIndex.count(key))
+    return;
+  a1outIndex[key] = a1out.insert(a1out.end(), key);
+  if (a1out.size() > kout)
+  {
+    a1outIndex.erase(a1out.front());
+    a1out.pop_front();
+  }
+}
+
+void TwoQPolicy::nextVictims(std::vector<FrameId>& frames, const std::uint32_t max)
+{
+  std::lock_guard<std::mutex> guard(latch);
+  std::uint32_t end = frames.size() + max;
+  bool a1inFirst = a1in.size() > kin || am.empty();
+  appendFrom(a1inFirst ? a1in : am, frames, end);
+  appendFrom(a1inFirst ? am : a1in, frames, end);
+}
+
+bool TwoQPolicy::pickVictim(FrameId& frame)
+{
+  std::lock_guard<std::mutex> guard(latch);
+  if (claimFree(frame))
+    return true;
+
+  if (a1in.size() > kin || am.empty())
+    return claimFrom(a1in, frame) || claimFrom(am, frame);
+  return claimFrom(am, frame) || claimFrom(a1in, frame);
+}
+
+//----------------------------------------
+// ARCPolicy
+//----------------------------------------
+
+ARCPolicy::ARCPolicy(const FrameStateTable& stateTable, const std::uint32_t numBufs, BufStats* stats)
+  : ListPolicy(stateTable, numBufs, stats), p(0), where(numBufs, NONE), position(numBufs)
+{
+}
+
+void ARCPolicy::unlink(const FrameId frame)
+{
+  if (where[frame] == T1)
+    t1.erase(position[frame]);
+  else if (where[frame] == T2)
+    t2.erase(position[frame]);
+  where[frame] = NONE;
+}
+
+void ARCPolicy::dropOldest(GhostList& list, GhostIndex& index)
+{
+  if (list.empty())
+    return;
+  index.erase(list.front());
+  list.pop_front();
+}
+
+void ARCPolicy::resizeFrames(const std::uint32_t newNumBufs)
+{
+  if (where.size() < newNumBufs)
+  {
+    where.resize(newNumBufs, NONE);
+    position.resize(newNumBufs);
+  }
+  p = std::min(p, newNumBufs);
+  while (b1.size() > newNumBufs)
+    dropOldest(b1, b1Index);
+  while (b2.size() > newNumBufs)
+    dropOldest(b2, b2Index);
+}
+
+void ARCPolicy::recordHit(const FrameId frame)
+{
+  std::lock_guard<std::mutex> guard(latch);
+  if (where[frame] == NONE)
+    return;
+  unlink(frame);
+  where[frame] = T2;
+  position[frame] = t2.insert(t2.end(), frame);
+}
+
+void ARCPolicy::recordLoad(const FrameId frame, const File* file, const PageId pageNo)
+{
+  std::lock_guard<std::mutex> guard(latch);
+  unlink(frame);
+
+  std::uint64_t key = ghostKey(file, pageNo);
+  GhostIndex::iterator it;
+  if ((it = b1Index.find(key)) != b1Index.end())
+  {
+    // B1 hit: T1 was too small
+    std::uint32_t delta = std::max<std::uint32_t>(1, b2.size() / b1.size());
+    p = std::min<std::uint32_t>(numBufs, p + delta);
+    b1.erase(it->second);
+    b1Index.erase(it);
+    where[frame] = T2;
+    position[frame] = t2.insert(t2.end(), frame);
+    return;
+  }
+  if ((it = b2Index.find(key)) != b2Index.end())
+  {
+    // B2 hit: T2 was too small
+    std::uint32_t delta = std::max<std::uint32_t>(1, b1.size() / b2.size());
+    p = p > delta ? p - delta : 0;
+    b2.erase(it->second);
+    b2Index.erase(it);
+    where[frame] = T2;
+    position[frame] = t2.insert(t2.end(), frame);
+    return;
+  }
+
+  // a page not seen recently: keep the directory within 2c entries
+  if (t1.size() + b1.size() >= numBufs)
+    dropOldest(b1, b1Index);
+  else if (t1.size() + t2.size() + b1.size() + b2.size() >= 2 * numBufs)
+    dropOldest(b2, b2Index);
+  where[frame] = T1;
+  position[frame] = t1.insert(t1.end(), frame);
+}
+
+void ARCPolicy::recordEvict(const FrameId frame, const File* file, const PageId pageNo)
+{
+  std::lock_guard<std::mutex> guard(latch);
+  Queue from = where[frame];
+  unlink(frame);
+  if (from == NONE)
+    return;
+
+  std::uint64_t key = ghostKey(file, pageNo);
+  if (b1Index.count(key) || b2Index.count(key))
+    return;
+  if (from == T1)
+  {
+    b1Index[key] = b1.insert(b1.end(), key);
+    if (b1.size() > numBufs)
+      dropOldest(b1, b1Index);
+  }
+  else
+  {
+    b2Index[key] = b2.insert(b2.end(), key);
+    if (b2.size() > numBufs)
+      dropOldest(b2, b2Index);
+  }
+}
+
+void ARCPolicy::nextVictims(std::vector<FrameId>& frames, const std::uint32_t max)
+{
+  std::lock_guard<std::mutex> guard(latch);
+  std::uint32_t end = frames.size() + max;
+  bool t1First = !t1.empty() && (t1.size() > p || t2.empty());
+  appendFrom(t1First ? t1 : t2, frames, end);
+  appendFrom(t1First ? t2 : t1, frames, end);
+}
+
+bool ARCPolicy::pickVictim(FrameId& frame)
+{
+  std::lock_guard<std::mutex> guard(latch);
+  if (claimFree(frame))
+    return true;
+
+  if (!t1.empty() && (t1.size() > p || t2.empty()))
+    return claimFrom(t1, frame) || claimFrom(t2, frame);
+  return claimFrom(t2, frame) || claimFrom(t1, frame);
+}
+
+}
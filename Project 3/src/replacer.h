@@ -0,0 +1,471 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <set>
+#include <unordered_map>
+#include <vector>
+
+#include "types.h"
+
+namespace badgerdb {
+
+class File;
+struct BufStats;
+
+/**
+ * @brief Pin count and flag bits of one frame, see BufDesc.
+ */
+typedef std::atomic<std::uint32_t> FrameState;
+
+/**
+ * @brief Maps frame numbers to per frame objects allocated in extents.
+ *
+ * The buffer pool grows in chunks that need not be adjacent in memory, so
+ * arrays indexed by frame number are reached through a directory holding the
+ * start of every extent of EXTENT_SIZE frames.  The directory is allocated at
+ * its full size up front and never moves; an entry is filled in before any
+ * frame of its extent is handed out and does not change afterwards, so
+ * lookups need no latch.
+ */
+template <class T>
+class FrameDirectory
+{
+ public:
+	/**
+	 * log2 of the number of frames per extent
+	 */
+  static const std::uint32_t EXTENT_SHIFT = 6;
+
+	/**
+	 * Number of frames per extent
+	 */
+  static const std::uint32_t EXTENT_SIZE = 1u << EXTENT_SHIFT;
+
+	/**
+	 * Number of entries of the directory
+	 */
+  static const std::uint32_t MAX_EXTENTS = 1u << 16;
+
+  FrameDirectory() : extents(new T*[MAX_EXTENTS]) {}
+  ~FrameDirectory() { delete [] extents; }
+
+  T& operator[](const FrameId frame) const
+  {
+    return extents[frame >> EXTENT_SHIFT][frame & (EXTENT_SIZE - 1)];
+  }
+
+	/**
+	 * Sets the start of extent 'extent', which covers frames
+	 * extent * EXTENT_SIZE to (extent + 1) * EXTENT_SIZE - 1.
+	 */
+  void setExtent(const std::uint32_t extent, T* first) { extents[extent] = first; }
+
+ private:
+  FrameDirectory(const FrameDirectory&);
+  FrameDirectory& operator=(const FrameDirectory&);
+
+  T** extents;
+};
+
+template <class T> const std::uint32_t FrameDirectory<T>::EXTENT_SHIFT;
+template <class T> const std::uint32_t FrameDirectory<T>::EXTENT_SIZE;
+template <class T> const std::uint32_t FrameDirectory<T>::MAX_EXTENTS;
+
+/**
+ * @brief State words of all frames, indexed by frame number.
+ */
+typedef FrameDirectory<FrameState> FrameStateTable;
+
+/**
+ * @brief Page replacement algorithms a BufMgr can be constructed with.
+ */
+enum ReplacementPolicyType
+{
+	CLOCK_REPLACEMENT = 0,	/* Two pass CLOCK sweep over reference bits */
+	LRUK_REPLACEMENT = 1,		/* LRU-K with K = 2 */
+	TWOQ_REPLACEMENT = 2,		/* Full 2Q (A1in / A1out / Am) */
+	ARC_REPLACEMENT = 3			/* Adaptive Replacement Cache */
+};
+
+/**
+ * @brief Interface between the buffer manager and a page replacement algorithm.
+ *
+ * The buffer manager reports every hit, every page brought into a frame,
+ * every eviction and every frame that becomes free.  When it needs a frame it
+ * asks the policy for a victim; the policy returns the frame already claimed
+ * (pinned once by the caller) so it cannot be pinned by anybody else while the
+ * buffer manager writes it back and unmaps it.  If that fails the frame is
+ * unpinned again and the policy is asked for another victim.
+ *
+ * Policies must be threadsafe.  They are called with no buffer manager latch
+ * held, except recordLoad() and recordFree() which may be called with a page
+ * table shard latched; a policy must therefore never call back into BufMgr.
+ */
+class ReplacementPolicy
+{
+ public:
+	/**
+	 * Creates a policy of the given type for a pool of numBufs frames.
+	 *
+	 * @param type		Replacement algorithm
+	 * @param stateTable	State words of the frames of the pool
+	 * @param numBufs	Number of frames in the pool
+	 * @param stats		Statistics of the pool
+	 * @return  Newly allocated policy, owned by the caller.
+	 */
+  static ReplacementPolicy* create(const ReplacementPolicyType type,
+                                   const FrameStateTable& stateTable,
+                                   const std::uint32_t numBufs,
+                                   BufStats* stats);
+
+  virtual ~ReplacementPolicy() {}
+
+	/**
+	 * Returns a short name of the algorithm, e.g. "CLOCK".
+	 */
+  virtual const char* name() const = 0;
+
+	/**
+	 * A page already in 'frame' was requested again.
+	 */
+  virtual void recordHit(const FrameId frame) = 0;
+
+	/**
+	 * (file, pageNo) was brought into 'frame'.
+	 */
+  virtual void recordLoad(const FrameId frame, const File* file, const PageId pageNo) = 0;
+
+	/**
+	 * The victim 'frame' holding (file, pageNo) was evicted.
+	 */
+  virtual void recordEvict(const FrameId frame, const File* file, const PageId pageNo) = 0;
+
+	/**
+	 * 'frame' became empty without being chosen as a victim, e.g. because its
+	 * page was flushed or disposed.
+	 */
+  virtual void recordFree(const FrameId frame) = 0;
+
+	/**
+	 * Lists up to 'max' frames the policy expects to choose as victims next,
+	 * most imminent first, without claiming them or changing any state.
+	 * Used by the background writer to clean pages before they are evicted.
+	 *
+	 * @param frames	Frames are appended to this vector
+	 * @param max		Maximum number of frames to append
+	 */
+  virtual void nextVictims(std::vector<FrameId>& frames, const std::uint32_t max) = 0;
+
+	/**
+	 * Chooses and claims a victim frame.
+	 *
+	 * @param frame		Claimed frame returned via this reference
+	 * @return  False if every frame is pinned.
+	 */
+  virtual bool pickVictim(FrameId& frame) = 0;
+
+	/**
+	 * The pool now has 'newNumBufs' frames, numbered from zero.  Frames beyond
+	 * the new size are no longer claimed; when the pool shrinks the buffer
+	 * manager evicts their pages itself, which reports them through
+	 * recordEvict() as usual.  Frames that join the pool are treated as free;
+	 * one that still holds a page is evicted normally when it is claimed.
+	 */
+  virtual void resize(const std::uint32_t newNumBufs) { numBufs = newNumBufs; }
+
+ protected:
+	/**
+	 * Constructor for subclasses.
+	 */
+  ReplacementPolicy(const FrameStateTable& stateTableIn, const std::uint32_t numBufsIn, BufStats* statsIn)
+    : stateTable(stateTableIn), numBufs(numBufsIn), stats(statsIn) {}
+
+	/**
+	 * Claims 'frame' if it is in the pool and neither pinned nor being read.
+	 */
+  bool tryClaim(const FrameId frame);
+
+	/**
+	 * State words of the frames of the pool, indexed by frame number; the
+	 * descriptors themselves are never touched by a policy
+	 */
+  const FrameStateTable& stateTable;
+
+	/**
+	 * Number of frames in the pool
+	 */
+  std::atomic<std::uint32_t> numBufs;
+
+	/**
+	 * Statistics of the pool
+	 */
+  BufStats* stats;
+};
+
+/**
+ * @brief The classic two pass CLOCK algorithm over the frame reference bits.
+ *
+ * The buffer manager sets the reference bit whenever it pins a frame, so hits
+ * cost nothing here and the sweep needs no latch.  The sweep reads only the
+ * dense state array, sixteen frames per cache line.
+ */
+class ClockPolicy : public ReplacementPolicy
+{
+ public:
+  ClockPolicy(const FrameStateTable& stateTable, const std::uint32_t numBufs, BufStats* stats);
+
+  const char* name() const { return "CLOCK"; }
+  void recordHit(const FrameId frame) {}
+  void recordLoad(const FrameId frame, const File* file, const PageId pageNo) {}
+  void recordEvict(const FrameId frame, const File* file, const PageId pageNo) {}
+  void recordFree(const FrameId frame) {}
+  void nextVictims(std::vector<FrameId>& frames, const std::uint32_t max);
+  bool pickVictim(FrameId& frame);
+
+ private:
+	/**
+   * Current position of clockhand in our buffer pool
+	 */
+  std::atomic<FrameId> clockHand;
+};
+
+/**
+ * @brief Common part of the list based policies: a latch and a list of frames
+ * that hold no page.
+ */
+class ListPolicy : public ReplacementPolicy
+{
+ public:
+  void recordFree(const FrameId frame);
+  void resize(const std::uint32_t newNumBufs);
+
+ protected:
+  ListPolicy(const FrameStateTable& stateTable, const std::uint32_t numBufs, BufStats* stats);
+
+	/**
+	 * Adapts the per frame state and the targets of the algorithm to a pool
+	 * of 'newNumBufs' frames.  Per frame state is never shrunk, since frames
+	 * beyond the new size stay listed until their pages are evicted.  Called
+	 * with 'latch' held.
+	 */
+  virtual void resizeFrames(const std::uint32_t newNumBufs) = 0;
+
+	/**
+	 * Removes 'frame' from whatever list of the algorithm holds it.
+	 * Called with 'latch' held.
+	 */
+  virtual void unlink(const FrameId frame) = 0;
+
+	/**
+	 * Claims a frame off the free list.  Called with 'latch' held.
+	 */
+  bool claimFree(FrameId& frame);
+
+	/**
+	 * Claims the least recently used claimable frame of 'frames'.  Called with
+	 * 'latch' held.
+	 */
+  bool claimFrom(const std::list<FrameId>& frames, FrameId& frame);
+
+	/**
+	 * Appends frames of 'list' to 'frames' until it holds 'max' entries.
+	 * Called with 'latch' held.
+	 */
+  static void appendFrom(const std::list<FrameId>& list, std::vector<FrameId>& frames,
+                         const std::uint32_t max);
+
+	/**
+	 * Returns the key ghost entries of (file, pageNo) are stored under.
+	 */
+  static std::uint64_t ghostKey(const File* file, const PageId pageNo);
+
+	/**
+	 * Protects all state of the policy
+	 */
+  std::mutex latch;
+
+	/**
+	 * Frames holding no page
+	 */
+  std::vector<FrameId> freeFrames;
+};
+
+/**
+ * @brief LRU-K with K = 2 (O'Neil, O'Neil and Weikum).
+ *
+ * The victim is the frame whose second most recent reference lies furthest in
+ * the past; frames referenced only once are preferred, oldest first.  Access
+ * history of recently evicted pages is retained so that a page coming back
+ * quickly is recognized as hot.
+ */
+class LRUKPolicy : public ListPolicy
+{
+ public:
+  LRUKPolicy(const FrameStateTable& stateTable, const std::uint32_t numBufs, BufStats* stats);
+
+  const char* name() const { return "LRU-2"; }
+  void recordHit(const FrameId frame);
+  void recordLoad(const FrameId frame, const File* file, const PageId pageNo);
+  void recordEvict(const FrameId frame, const File* file, const PageId pageNo);
+  void nextVictims(std::vector<FrameId>& frames, const std::uint32_t max);
+  bool pickVictim(FrameId& frame);
+
+ private:
+	/**
+	 * Last two reference times of a frame or of an evicted page
+	 */
+  struct History
+  {
+    std::uint64_t prev;
+    std::uint64_t last;
+  };
+
+	/**
+	 * Eviction order key: (prev, last, frame); prev == 0 means "referenced once"
+	 */
+  typedef std::pair<std::pair<std::uint64_t, std::uint64_t>, FrameId> OrderKey;
+
+  void unlink(const FrameId frame);
+  void resizeFrames(const std::uint32_t newNumBufs);
+
+  OrderKey orderKey(const FrameId frame) const
+  {
+    return OrderKey(std::make_pair(history[frame].prev, history[frame].last), frame);
+  }
+
+	/**
+	 * Logical clock, advanced on every reference
+	 */
+  std::uint64_t now;
+
+	/**
+	 * Reference history of each frame
+	 */
+  std::vector<History> history;
+
+	/**
+	 * True if the frame is in 'order'
+	 */
+  std::vector<bool> tracked;
+
+	/**
+	 * Resident frames in eviction order
+	 */
+  std::set<OrderKey> order;
+
+	/**
+	 * Retained history of evicted pages and their position in 'retainedOrder'
+	 */
+  typedef std::unordered_map<std::uint64_t,
+          std::pair<History, std::list<std::uint64_t>::iterator> > RetainedMap;
+  RetainedMap retained;
+
+	/**
+	 * Keys of 'retained', oldest first; bounded to numBufs entries
+	 */
+  std::list<std::uint64_t> retainedOrder;
+};
+
+/**
+ * @brief Full 2Q (Johnson and Shasha).
+ *
+ * New pages enter the FIFO A1in.  Pages evicted from A1in are remembered in
+ * the ghost queue A1out; a page that is requested again while in A1out is
+ * promoted to the LRU queue Am.  One-time accesses such as a sequential scan
+ * therefore only ever displace A1in.
+ */
+class TwoQPolicy : public ListPolicy
+{
+ public:
+  TwoQPolicy(const FrameStateTable& stateTable, const std::uint32_t numBufs, BufStats* stats);
+
+  const char* name() const { return "2Q"; }
+  void recordHit(const FrameId frame);
+  void recordLoad(const FrameId frame, const File* file, const PageId pageNo);
+  void recordEvict(const FrameId frame, const File* file, const PageId pageNo);
+  void nextVictims(std::vector<FrameId>& frames, const std::uint32_t max);
+  bool pickVictim(FrameId& frame);
+
+ private:
+  enum Queue { NONE, A1IN, AM };
+
+  void unlink(const FrameId frame);
+  void resizeFrames(const std::uint32_t newNumBufs);
+
+	/**
+	 * Target size of A1in (25% of the pool) and A1out (50% of the pool)
+	 */
+  std::uint32_t kin, kout;
+
+  std::list<FrameId> a1in, am;
+  std::list<std::uint64_t> a1out;
+  std::unordered_map<std::uint64_t, std::list<std::uint64_t>::iterator> a1outIndex;
+
+	/**
+	 * Queue holding each frame and its position in it
+	 */
+  std::vector<Queue> where;
+  std::vector<std::list<FrameId>::iterator> position;
+};
+
+/**
+ * @brief Adaptive Replacement Cache (Megiddo and Modha).
+ *
+ * T1 holds pages seen once recently and T2 pages seen at least twice; the
+ * ghost lists B1 and B2 remember pages recently evicted from each.  Hits in
+ * the ghost lists move the target size p of T1 towards whichever list would
+ * have kept the page.
+ */
+class ARCPolicy : public ListPolicy
+{
+ public:
+  ARCPolicy(const FrameStateTable& stateTable, const std::uint32_t numBufs, BufStats* stats);
+
+  const char* name() const { return "ARC"; }
+  void recordHit(const FrameId frame);
+  void recordLoad(const FrameId frame, const File* file, const PageId pageNo);
+  void recordEvict(const FrameId frame, const File* file, const PageId pageNo);
+  void nextVictims(std::vector<FrameId>& frames, const std::uint32_t max);
+  bool pickVictim(FrameId& frame);
+
+ private:
+  enum Queue { NONE, T1, T2 };
+
+  typedef std::list<std::uint64_t> GhostList;
+  typedef std::unordered_map<std::uint64_t, GhostList::iterator> GhostIndex;
+
+  void unlink(const FrameId frame);
+  void resizeFrames(const std::uint32_t newNumBufs);
+
+	/**
+	 * Drops the least recent entry of a ghost list.
+	 */
+  static void dropOldest(GhostList& list, GhostIndex& index);
+
+	/**
+	 * Target size of T1
+	 */
+  std::uint32_t p;
+
+  std::list<FrameId> t1, t2;
+  GhostList b1, b2;
+  GhostIndex b1Index, b2Index;
+
+	/**
+	 * List holding each frame and its position in it
+	 */
+  std::vector<Queue> where;
+  std::vector<std::list<FrameId>::iterator> position;
+};
+
+}